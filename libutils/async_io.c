@@ -0,0 +1,873 @@
+/*
+  Copyright 2023 Northern.tech AS
+
+  This file is part of CFEngine 3 - written and maintained by Northern.tech AS.
+
+  This program is free software; you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by the
+  Free Software Foundation; version 3.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA
+
+  To the extent this program is licensed as part of the Enterprise
+  versions of CFEngine, the applicable Commercial Open Source License
+  (COSL) may apply to this file if you as a licensee so wish it. See
+  included file COSL.txt.
+*/
+
+#include <async_io.h>
+
+#include <alloc.h>
+#include <file_lib.h>
+#include <logging.h>
+#include <misc_lib.h>
+
+#if defined(HAVE_IO_URING) && defined(HAVE_STATX)
+# define ASYNC_IO_URING 1
+# include <linux/io_uring.h>
+# include <linux/openat2.h>
+# include <sys/mman.h>
+# include <sys/syscall.h>
+#endif
+
+/* Threads of the fallback, which mostly wait for the disk */
+#define ASYNC_IO_THREADS 8
+
+/* Requests in flight in io_uring */
+#define ASYNC_IO_URING_ENTRIES 64
+
+/* Files are first read into this much, then in doubling sizes */
+#define ASYNC_IO_READ_SIZE 4096
+
+typedef enum
+{
+    ASYNC_IO_READ,
+    ASYNC_IO_STAT,
+} AsyncIOOp;
+
+typedef struct AsyncIORequest_ AsyncIORequest;
+
+struct AsyncIORequest_
+{
+    AsyncIORequest *next;
+    AsyncIOOp op;
+    char *path;
+    size_t max_size;
+    AsyncIOCallback *callback;
+    void *data;
+    AsyncIOResult result;
+#ifdef ASYNC_IO_URING
+    int fd;
+    bool closing;
+    struct open_how how;
+    struct statx stx;
+#endif
+};
+
+typedef struct
+{
+    AsyncIORequest *head;
+    AsyncIORequest *tail;
+} AsyncIOList;
+
+#ifdef ASYNC_IO_URING
+typedef struct
+{
+    int fd;
+    unsigned entries;
+    void *sq_ring;
+    size_t sq_ring_size;
+    void *cq_ring;
+    size_t cq_ring_size;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+
+    unsigned *sq_tail;
+    unsigned sq_mask;
+    unsigned *sq_array;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned cq_mask;
+    struct io_uring_cqe *cqes;
+
+    unsigned in_flight;
+    unsigned to_submit;
+} AsyncIOUring;
+#endif
+
+struct AsyncIO_
+{
+    AsyncIOBackend backend;
+    AsyncIOList queued;          /* not started yet */
+    size_t outstanding;          /* queued, running or not called back */
+
+    /* ASYNC_IO_BACKEND_THREADS */
+    pthread_mutex_t lock;
+    pthread_cond_t work;
+    pthread_cond_t done;
+    AsyncIOList todo;
+    AsyncIOList completed;
+    pthread_t workers[ASYNC_IO_THREADS];
+    size_t started;
+    bool shutdown;
+
+#ifdef ASYNC_IO_URING
+    AsyncIOUring ring;
+#endif
+};
+
+static void ListAppend_(AsyncIOList *list, AsyncIORequest *request)
+{
+    request->next = NULL;
+    if (list->tail != NULL)
+    {
+        list->tail->next = request;
+    }
+    else
+    {
+        list->head = request;
+    }
+    list->tail = request;
+}
+
+static AsyncIORequest *ListPop_(AsyncIOList *list)
+{
+    AsyncIORequest *request = list->head;
+    if (request != NULL)
+    {
+        list->head = request->next;
+        if (list->head == NULL)
+        {
+            list->tail = NULL;
+        }
+    }
+    return request;
+}
+
+/* Reading, shared by the backends */
+
+/**
+ * Make room for the next read and return its size, which goes up to one
+ * byte beyond max_size to detect truncation.
+ */
+static size_t ReadSize_(AsyncIORequest *request)
+{
+    AsyncIOResult *result = &request->result;
+    const size_t limit = (request->max_size < SIZE_MAX - 1) ? request->max_size + 1 : SIZE_MAX - 1;
+
+    if (result->data == NULL || result->length + 1 == result->allocated)
+    {
+        size_t size = (result->data == NULL) ? ASYNC_IO_READ_SIZE : 2 * (result->allocated - 1);
+        size = MIN(size, limit);
+        result->allocated = size + 1;
+        result->data = xrealloc(result->data, result->allocated);
+    }
+    return MIN(result->allocated - 1, limit) - result->length;
+}
+
+/* @return true once the whole file, or max_size of it, is read */
+static bool ReadDone_(AsyncIORequest *request, size_t count)
+{
+    AsyncIOResult *result = &request->result;
+    result->length += count;
+    if (result->length > request->max_size)
+    {
+        result->length = request->max_size;
+        result->truncated = true;
+    }
+    else if (count != 0)
+    {
+        return false;
+    }
+
+    result->data[result->length] = '\0';
+    return true;
+}
+
+static void ReadFailed_(AsyncIORequest *request, int error)
+{
+    free(request->result.data);
+    request->result.data = NULL;
+    request->result.length = 0;
+    request->result.allocated = 0;
+    request->result.error = error;
+}
+
+/* Tell which file was read, for reading the rest of it later */
+static void StatTruncated_(AsyncIORequest *request, int fd)
+{
+    if (request->result.truncated && fstat(fd, &request->result.sb) == -1)
+    {
+        ReadFailed_(request, errno);
+    }
+}
+
+static void ReadFromFd_(AsyncIORequest *request, int fd)
+{
+    while (true)
+    {
+        const size_t size = ReadSize_(request);
+        const ssize_t count = read(fd, request->result.data + request->result.length, size);
+        if (count < 0)
+        {
+            if (errno != EINTR)
+            {
+                ReadFailed_(request, errno);
+                return;
+            }
+        }
+        else if (ReadDone_(request, count))
+        {
+            StatTruncated_(request, fd);
+            return;
+        }
+    }
+}
+
+static void RunBlocking_(AsyncIORequest *request)
+{
+    if (request->op == ASYNC_IO_STAT)
+    {
+        if (lstat(request->path, &request->result.sb) == -1)
+        {
+            request->result.error = errno;
+        }
+        return;
+    }
+
+    const int fd = safe_open(request->path, O_RDONLY | O_BINARY);
+    if (fd < 0)
+    {
+        request->result.error = errno;
+        return;
+    }
+    ReadFromFd_(request, fd);
+    close(fd);
+}
+
+static void Complete_(AsyncIO *aio, AsyncIORequest *request)
+{
+    request->callback(&request->result, request->data);
+    free(request->result.data);
+    free(request->path);
+    free(request);
+    aio->outstanding--;
+}
+
+/* Thread pool backend */
+
+static void ThreadsInit_(AsyncIO *aio)
+{
+    aio->backend = ASYNC_IO_BACKEND_THREADS;
+    pthread_mutex_init(&aio->lock, NULL);
+    pthread_cond_init(&aio->work, NULL);
+    pthread_cond_init(&aio->done, NULL);
+}
+
+static void *Worker_(void *arg)
+{
+    AsyncIO *aio = arg;
+
+    pthread_mutex_lock(&aio->lock);
+    while (true)
+    {
+        while (aio->todo.head == NULL && !aio->shutdown)
+        {
+            pthread_cond_wait(&aio->work, &aio->lock);
+        }
+        if (aio->shutdown)
+        {
+            break;
+        }
+
+        AsyncIORequest *request = ListPop_(&aio->todo);
+        pthread_mutex_unlock(&aio->lock);
+
+        RunBlocking_(request);
+
+        pthread_mutex_lock(&aio->lock);
+        ListAppend_(&aio->completed, request);
+        pthread_cond_signal(&aio->done);
+    }
+    pthread_mutex_unlock(&aio->lock);
+
+    return NULL;
+}
+
+static void WaitThreads_(AsyncIO *aio)
+{
+    while (aio->outstanding > 0)
+    {
+        pthread_mutex_lock(&aio->lock);
+        size_t queued = 0;
+        AsyncIORequest *request;
+        while ((request = ListPop_(&aio->queued)) != NULL)
+        {
+            ListAppend_(&aio->todo, request);
+            queued++;
+        }
+        if (queued > 0)
+        {
+            pthread_cond_broadcast(&aio->work);
+        }
+        /* Threads are started as there is work for them */
+        while (aio->started < MIN(queued, ASYNC_IO_THREADS))
+        {
+            if (pthread_create(&aio->workers[aio->started], NULL, Worker_, aio) != 0)
+            {
+                break;
+            }
+            aio->started++;
+        }
+        if (aio->started == 0)
+        {
+            /* Not a single thread could be started, do it here */
+            while ((request = ListPop_(&aio->todo)) != NULL)
+            {
+                RunBlocking_(request);
+                ListAppend_(&aio->completed, request);
+            }
+        }
+
+        while (aio->completed.head == NULL)
+        {
+            pthread_cond_wait(&aio->done, &aio->lock);
+        }
+        AsyncIOList completed = aio->completed;
+        aio->completed = (AsyncIOList) { NULL, NULL };
+        pthread_mutex_unlock(&aio->lock);
+
+        while ((request = ListPop_(&completed)) != NULL)
+        {
+            Complete_(aio, request);
+        }
+    }
+}
+
+/* io_uring backend, through the system calls as liburing is not needed for
+ * the few operations used here */
+
+#ifdef ASYNC_IO_URING
+
+static int RingSetup_(unsigned entries, struct io_uring_params *params)
+{
+    return syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int RingEnter_(int fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+    return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int RingRegister_(int fd, unsigned opcode, void *arg, unsigned nr_args)
+{
+    return syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+static void RingClose_(AsyncIOUring *ring)
+{
+    if (ring->sqes != NULL && ring->sqes != MAP_FAILED)
+    {
+        munmap(ring->sqes, ring->sqes_size);
+    }
+    if (ring->cq_ring != NULL && ring->cq_ring != MAP_FAILED && ring->cq_ring != ring->sq_ring)
+    {
+        munmap(ring->cq_ring, ring->cq_ring_size);
+    }
+    if (ring->sq_ring != NULL && ring->sq_ring != MAP_FAILED)
+    {
+        munmap(ring->sq_ring, ring->sq_ring_size);
+    }
+    close(ring->fd);
+}
+
+/* Whether the kernel knows all operations used */
+static bool RingProbe_(int fd)
+{
+    const size_t n_ops = 256;
+    struct io_uring_probe *probe =
+        xcalloc(1, sizeof(struct io_uring_probe) + n_ops * sizeof(struct io_uring_probe_op));
+
+    bool supported = false;
+    if (RingRegister_(fd, IORING_REGISTER_PROBE, probe, n_ops) == 0)
+    {
+        const int ops[] = { IORING_OP_OPENAT2, IORING_OP_READ, IORING_OP_CLOSE, IORING_OP_STATX };
+        supported = true;
+        for (size_t i = 0; i < sizeof(ops) / sizeof(ops[0]); i++)
+        {
+            supported = supported && (ops[i] <= probe->last_op) &&
+                (probe->ops[ops[i]].flags & IO_URING_OP_SUPPORTED);
+        }
+    }
+
+    free(probe);
+    return supported;
+}
+
+static bool RingOpen_(AsyncIOUring *ring)
+{
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    memset(ring, 0, sizeof(AsyncIOUring));
+
+    ring->fd = RingSetup_(ASYNC_IO_URING_ENTRIES, &params);
+    if (ring->fd < 0)
+    {
+        Log(LOG_LEVEL_DEBUG, "Not using io_uring (io_uring_setup: %s)", GetErrorStr());
+        return false;
+    }
+    if (!(params.features & IORING_FEAT_RW_CUR_POS) || !RingProbe_(ring->fd))
+    {
+        Log(LOG_LEVEL_DEBUG, "Not using io_uring, the kernel lacks needed operations");
+        close(ring->fd);
+        return false;
+    }
+
+    ring->entries = params.sq_entries;
+    ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        ring->sq_ring_size = MAX(ring->sq_ring_size, ring->cq_ring_size);
+    }
+
+    ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ring == MAP_FAILED)
+    {
+        goto failed;
+    }
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        ring->cq_ring = ring->sq_ring;
+    }
+    else
+    {
+        ring->cq_ring = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE,
+                             MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+        if (ring->cq_ring == MAP_FAILED)
+        {
+            goto failed;
+        }
+    }
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED)
+    {
+        goto failed;
+    }
+
+    char *sq = ring->sq_ring;
+    char *cq = ring->cq_ring;
+    ring->sq_tail = (unsigned *) (sq + params.sq_off.tail);
+    ring->sq_mask = *(unsigned *) (sq + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned *) (sq + params.sq_off.array);
+    ring->cq_head = (unsigned *) (cq + params.cq_off.head);
+    ring->cq_tail = (unsigned *) (cq + params.cq_off.tail);
+    ring->cq_mask = *(unsigned *) (cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *) (cq + params.cq_off.cqes);
+    return true;
+
+failed:
+    Log(LOG_LEVEL_DEBUG, "Not using io_uring (mmap: %s)", GetErrorStr());
+    RingClose_(ring);
+    return false;
+}
+
+/* The next submission entry, there is one for every request in flight */
+static struct io_uring_sqe *RingGetSqe_(AsyncIOUring *ring, AsyncIORequest *request)
+{
+    assert(ring->in_flight < ring->entries);
+
+    const unsigned tail = *ring->sq_tail;
+    const unsigned index = tail & ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    sqe->user_data = (uint64_t) (uintptr_t) request;
+    ring->sq_array[index] = index;
+
+    ring->in_flight++;
+    ring->to_submit++;
+    return sqe;
+}
+
+static void RingCommitSqe_(AsyncIOUring *ring)
+{
+    __atomic_store_n(ring->sq_tail, *ring->sq_tail + 1, __ATOMIC_RELEASE);
+}
+
+static void PrepareRead_(AsyncIOUring *ring, AsyncIORequest *request)
+{
+    const size_t size = ReadSize_(request);
+    struct io_uring_sqe *sqe = RingGetSqe_(ring, request);
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = request->fd;
+    sqe->addr = (uint64_t) (uintptr_t) (request->result.data + request->result.length);
+    sqe->len = MIN(size, (size_t) INT_MAX);
+    sqe->off = (uint64_t) -1;    /* from the current position, like read() */
+    RingCommitSqe_(ring);
+}
+
+static void PrepareClose_(AsyncIOUring *ring, AsyncIORequest *request)
+{
+    request->closing = true;
+    struct io_uring_sqe *sqe = RingGetSqe_(ring, request);
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->fd = request->fd;
+    RingCommitSqe_(ring);
+}
+
+static void PrepareFirst_(AsyncIOUring *ring, AsyncIORequest *request)
+{
+    struct io_uring_sqe *sqe = RingGetSqe_(ring, request);
+    sqe->fd = AT_FDCWD;
+    sqe->addr = (uint64_t) (uintptr_t) request->path;
+
+    if (request->op == ASYNC_IO_STAT)
+    {
+        sqe->opcode = IORING_OP_STATX;
+        sqe->len = STATX_BASIC_STATS;
+        sqe->off = (uint64_t) (uintptr_t) &request->stx;
+        sqe->statx_flags = AT_SYMLINK_NOFOLLOW;
+    }
+    else
+    {
+        /* Without symlinks safe_open() is plain open(), with them it has to
+         * check their owners itself. */
+        request->how.flags = O_RDONLY | O_CLOEXEC;
+        request->how.resolve = RESOLVE_NO_SYMLINKS;
+        sqe->opcode = IORING_OP_OPENAT2;
+        sqe->len = sizeof(struct open_how);
+        sqe->off = (uint64_t) (uintptr_t) &request->how;
+    }
+    RingCommitSqe_(ring);
+}
+
+static void StatFromStatx_(struct stat *sb, const struct statx *stx)
+{
+    memset(sb, 0, sizeof(struct stat));
+    sb->st_dev = makedev(stx->stx_dev_major, stx->stx_dev_minor);
+    sb->st_ino = stx->stx_ino;
+    sb->st_mode = stx->stx_mode;
+    sb->st_nlink = stx->stx_nlink;
+    sb->st_uid = stx->stx_uid;
+    sb->st_gid = stx->stx_gid;
+    sb->st_rdev = makedev(stx->stx_rdev_major, stx->stx_rdev_minor);
+    sb->st_size = stx->stx_size;
+    sb->st_blksize = stx->stx_blksize;
+    sb->st_blocks = stx->stx_blocks;
+    sb->st_atim.tv_sec = stx->stx_atime.tv_sec;
+    sb->st_atim.tv_nsec = stx->stx_atime.tv_nsec;
+    sb->st_mtim.tv_sec = stx->stx_mtime.tv_sec;
+    sb->st_mtim.tv_nsec = stx->stx_mtime.tv_nsec;
+    sb->st_ctim.tv_sec = stx->stx_ctime.tv_sec;
+    sb->st_ctim.tv_nsec = stx->stx_ctime.tv_nsec;
+}
+
+/**
+ * Take the next step of #request after one of its operations completed.
+ * @return true if the request is complete
+ */
+static bool Advance_(AsyncIOUring *ring, AsyncIORequest *request, int res)
+{
+    if (request->op == ASYNC_IO_STAT)
+    {
+        if (res < 0)
+        {
+            request->result.error = -res;
+        }
+        else
+        {
+            StatFromStatx_(&request->result.sb, &request->stx);
+        }
+        return true;
+    }
+
+    if (request->closing)
+    {
+        return true;
+    }
+
+    if (request->fd < 0)
+    {
+        /* opened */
+        if (res == -ELOOP || res == -EAGAIN)
+        {
+            res = safe_open(request->path, O_RDONLY);
+            if (res < 0)
+            {
+                res = -errno;
+            }
+        }
+        if (res < 0)
+        {
+            request->result.error = -res;
+            return true;
+        }
+        request->fd = res;
+        PrepareRead_(ring, request);
+        return false;
+    }
+
+    if (res == -EINTR || res == -EAGAIN)
+    {
+        PrepareRead_(ring, request);
+        return false;
+    }
+    if (res < 0)
+    {
+        ReadFailed_(request, -res);
+        PrepareClose_(ring, request);
+        return false;
+    }
+    if (ReadDone_(request, res))
+    {
+        StatTruncated_(request, request->fd);
+        PrepareClose_(ring, request);
+    }
+    else
+    {
+        PrepareRead_(ring, request);
+    }
+    return false;
+}
+
+/* Handle the completed operations */
+static void RingReap_(AsyncIO *aio)
+{
+    AsyncIOUring *ring = &aio->ring;
+
+    unsigned head = *ring->cq_head;
+    const unsigned tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+    while (head != tail)
+    {
+        const struct io_uring_cqe *cqe = &ring->cqes[head & ring->cq_mask];
+        AsyncIORequest *request = (AsyncIORequest *) (uintptr_t) cqe->user_data;
+        const int res = cqe->res;
+        head++;
+        __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+
+        ring->in_flight--;
+        if (Advance_(ring, request, res))
+        {
+            Complete_(aio, request);
+        }
+    }
+}
+
+/**
+ * Take back the operations the kernel has not consumed yet and queue their
+ * requests again to be run from scratch, or complete them if all that was
+ * left was closing the file.
+ */
+static void RingRequeueUnsubmitted_(AsyncIO *aio)
+{
+    AsyncIOUring *ring = &aio->ring;
+
+    unsigned tail = *ring->sq_tail;
+    while (ring->to_submit > 0)
+    {
+        tail--;
+        const struct io_uring_sqe *sqe = &ring->sqes[tail & ring->sq_mask];
+        AsyncIORequest *request = (AsyncIORequest *) (uintptr_t) sqe->user_data;
+        ring->to_submit--;
+        ring->in_flight--;
+
+        if (request->fd >= 0)
+        {
+            close(request->fd);
+            request->fd = -1;
+            if (request->closing)
+            {
+                Complete_(aio, request);
+                continue;
+            }
+            ReadFailed_(request, 0);
+            request->result.truncated = false;
+        }
+        ListAppend_(&aio->queued, request);
+    }
+    __atomic_store_n(ring->sq_tail, tail, __ATOMIC_RELEASE);
+}
+
+/**
+ * Stop using a ring which the kernel refuses to take submissions for: wait
+ * for the operations it already has and hand everything else over to the
+ * thread pool backend.
+ */
+static void RingFallBack_(AsyncIO *aio)
+{
+    AsyncIOUring *ring = &aio->ring;
+
+    RingRequeueUnsubmitted_(aio);
+    while (ring->in_flight > 0)
+    {
+        /* Only waits, there is nothing to submit which could fail */
+        if (RingEnter_(ring->fd, 0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR)
+        {
+            ProgrammingError("Waiting for io_uring failed (io_uring_enter: %s)", GetErrorStr());
+        }
+        RingReap_(aio);
+        RingRequeueUnsubmitted_(aio);
+    }
+
+    RingClose_(ring);
+    ThreadsInit_(aio);
+}
+
+/* @return false if the ring failed and the remaining requests were left to
+ *         the thread pool backend */
+static bool WaitRing_(AsyncIO *aio)
+{
+    AsyncIOUring *ring = &aio->ring;
+
+    while (aio->outstanding > 0)
+    {
+        AsyncIORequest *request;
+        while (ring->in_flight < ring->entries && (request = ListPop_(&aio->queued)) != NULL)
+        {
+            PrepareFirst_(ring, request);
+        }
+
+        int ret = RingEnter_(ring->fd, ring->to_submit, 1, IORING_ENTER_GETEVENTS);
+        if (ret < 0)
+        {
+            if (errno != EINTR && errno != EAGAIN && errno != EBUSY)
+            {
+                Log(LOG_LEVEL_VERBOSE,
+                    "Submitting to io_uring failed, falling back to threads (io_uring_enter: %s)",
+                    GetErrorStr());
+                RingFallBack_(aio);
+                return false;
+            }
+            /* Nothing was submitted, make room by reaping and try again */
+            ret = 0;
+        }
+        ring->to_submit -= ret;
+
+        RingReap_(aio);
+    }
+    return true;
+}
+
+#endif /* ASYNC_IO_URING */
+
+AsyncIO *AsyncIONew(AsyncIOBackend backend)
+{
+    AsyncIO *aio = xcalloc(1, sizeof(AsyncIO));
+    aio->backend = ASYNC_IO_BACKEND_THREADS;
+
+    if (backend != ASYNC_IO_BACKEND_THREADS)
+    {
+#ifdef ASYNC_IO_URING
+        if (RingOpen_(&aio->ring))
+        {
+            aio->backend = ASYNC_IO_BACKEND_IO_URING;
+        }
+#endif
+        if (backend == ASYNC_IO_BACKEND_IO_URING && aio->backend != ASYNC_IO_BACKEND_IO_URING)
+        {
+            free(aio);
+            return NULL;
+        }
+    }
+
+    if (aio->backend == ASYNC_IO_BACKEND_THREADS)
+    {
+        ThreadsInit_(aio);
+    }
+    return aio;
+}
+
+void AsyncIODestroy(AsyncIO *aio)
+{
+    if (aio == NULL)
+    {
+        return;
+    }
+
+    /* Complete whatever was left queued */
+    AsyncIOWait(aio);
+
+    if (aio->backend == ASYNC_IO_BACKEND_THREADS)
+    {
+        pthread_mutex_lock(&aio->lock);
+        aio->shutdown = true;
+        pthread_cond_broadcast(&aio->work);
+        pthread_mutex_unlock(&aio->lock);
+        for (size_t i = 0; i < aio->started; i++)
+        {
+            pthread_join(aio->workers[i], NULL);
+        }
+        pthread_cond_destroy(&aio->done);
+        pthread_cond_destroy(&aio->work);
+        pthread_mutex_destroy(&aio->lock);
+    }
+#ifdef ASYNC_IO_URING
+    else
+    {
+        RingClose_(&aio->ring);
+    }
+#endif
+    free(aio);
+}
+
+AsyncIOBackend AsyncIOGetBackend(const AsyncIO *aio)
+{
+    return aio->backend;
+}
+
+static void Queue_(AsyncIO *aio, AsyncIOOp op, const char *path, size_t max_size,
+                   AsyncIOCallback *callback, void *data)
+{
+    assert(aio != NULL);
+    assert(path != NULL);
+    assert(callback != NULL);
+
+    AsyncIORequest *request = xcalloc(1, sizeof(AsyncIORequest));
+    request->op = op;
+    request->path = xstrdup(path);
+    request->max_size = max_size;
+    request->callback = callback;
+    request->data = data;
+    request->result.path = request->path;
+#ifdef ASYNC_IO_URING
+    request->fd = -1;
+#endif
+
+    ListAppend_(&aio->queued, request);
+    aio->outstanding++;
+}
+
+void AsyncIOReadFile(AsyncIO *aio, const char *path, size_t max_size,
+                     AsyncIOCallback *callback, void *data)
+{
+    Queue_(aio, ASYNC_IO_READ, path, max_size, callback, data);
+}
+
+void AsyncIOStat(AsyncIO *aio, const char *path,
+                 AsyncIOCallback *callback, void *data)
+{
+    Queue_(aio, ASYNC_IO_STAT, path, 0, callback, data);
+}
+
+void AsyncIOWait(AsyncIO *aio)
+{
+    assert(aio != NULL);
+
+#ifdef ASYNC_IO_URING
+    if (aio->backend == ASYNC_IO_BACKEND_IO_URING && WaitRing_(aio))
+    {
+        return;
+    }
+#endif
+    WaitThreads_(aio);
+}
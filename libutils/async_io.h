@@ -0,0 +1,99 @@
+/*
+  Copyright 2023 Northern.tech AS
+
+  This file is part of CFEngine 3 - written and maintained by Northern.tech AS.
+
+  This program is free software; you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by the
+  Free Software Foundation; version 3.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA
+
+  To the extent this program is licensed as part of the Enterprise
+  versions of CFEngine, the applicable Commercial Open Source License
+  (COSL) may apply to this file if you as a licensee so wish it. See
+  included file COSL.txt.
+*/
+
+#ifndef CFENGINE_ASYNC_IO_H
+#define CFENGINE_ASYNC_IO_H
+
+#include <platform.h>
+
+/**
+ * Batches of file operations, run concurrently.
+ *
+ * Requests are queued with AsyncIOReadFile() and AsyncIOStat() and run by
+ * AsyncIOWait(), which calls their callbacks as they complete. On Linux the
+ * requests are submitted through io_uring when the kernel supports it,
+ * elsewhere a pool of threads makes the blocking calls. Should io_uring fail
+ * at run time, the requests left are handed over to the threads (and
+ * AsyncIOGetBackend() changes accordingly). Either way the callbacks are only
+ * called from AsyncIOWait(), in the calling thread, and may queue more
+ * requests.
+ *
+ * An AsyncIO must only be used by one thread at a time.
+ */
+
+typedef struct AsyncIO_ AsyncIO;
+
+typedef enum
+{
+    ASYNC_IO_BACKEND_DEFAULT,    /* io_uring where possible, threads otherwise */
+    ASYNC_IO_BACKEND_THREADS,
+    ASYNC_IO_BACKEND_IO_URING,
+} AsyncIOBackend;
+
+typedef struct
+{
+    const char *path;
+    int error;                   /* errno of the failed call, 0 on success */
+
+    /* AsyncIOReadFile() */
+    char *data;                  /* '\0'-terminated, NULL on error, may be
+                                  * taken over by setting it to NULL */
+    size_t length;
+    size_t allocated;            /* size of the data allocation */
+    bool truncated;
+
+    /* AsyncIOStat(), and AsyncIOReadFile() if truncated: fstat() of the
+     * file read */
+    struct stat sb;
+} AsyncIOResult;
+
+typedef void AsyncIOCallback(AsyncIOResult *result, void *data);
+
+/**
+ * @return NULL if #backend is ASYNC_IO_BACKEND_IO_URING and io_uring can not
+ *         be used, at build or run time
+ */
+AsyncIO *AsyncIONew(AsyncIOBackend backend);
+void AsyncIODestroy(AsyncIO *aio);
+AsyncIOBackend AsyncIOGetBackend(const AsyncIO *aio);
+
+/**
+ * @brief Open #path like safe_open(), read up to #max_size bytes and close it.
+ */
+void AsyncIOReadFile(AsyncIO *aio, const char *path, size_t max_size,
+                     AsyncIOCallback *callback, void *data);
+
+/**
+ * @brief lstat() #path.
+ */
+void AsyncIOStat(AsyncIO *aio, const char *path,
+                 AsyncIOCallback *callback, void *data);
+
+/**
+ * @brief Run the queued requests, and those queued by their callbacks, until
+ *        all are complete.
+ */
+void AsyncIOWait(AsyncIO *aio);
+
+#endif
@@ -0,0 +1,744 @@
+/*
+  Copyright 2023 Northern.tech AS
+
+  This file is part of CFEngine 3 - written and maintained by Northern.tech AS.
+
+  This program is free software; you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by the
+  Free Software Foundation; version 3.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA
+
+  To the extent this program is licensed as part of the Enterprise
+  versions of CFEngine, the applicable Commercial Open Source License
+  (COSL) may apply to this file if you as a licensee so wish it. See
+  included file COSL.txt.
+*/
+
+#include <btree.h>
+
+#include <alloc.h>
+
+/* Entries per leaf and children per branch, several cache lines of
+ * pointers each, so that a lookup in a tree of a million entries only
+ * visits four or five nodes. */
+#define BTREE_LEAF_SIZE 32
+#define BTREE_BRANCH_SIZE 32
+
+/* All nodes but the root are kept at least half full */
+#define BTREE_LEAF_MIN (BTREE_LEAF_SIZE / 2)
+#define BTREE_BRANCH_MIN (BTREE_BRANCH_SIZE / 2)
+
+typedef struct BTreeNode_ BTreeNode;
+typedef struct BTreeLeaf_ BTreeLeaf;
+typedef struct BTreeBranch_ BTreeBranch;
+
+struct BTreeNode_
+{
+    bool leaf;
+    size_t count;                /* entries in a leaf, children in a branch */
+};
+
+struct BTreeLeaf_
+{
+    BTreeNode node;
+    BTreeLeaf *next;
+    void *keys[BTREE_LEAF_SIZE];
+    void *values[BTREE_LEAF_SIZE];
+};
+
+/* keys[i] separates children[i] and children[i + 1]: all keys under
+ * children[i + 1] compare greater or equal. It points to one of the keys in
+ * the leaves, which are not destroyed while they are used here. */
+struct BTreeBranch_
+{
+    BTreeNode node;
+    void *keys[BTREE_BRANCH_SIZE - 1];
+    BTreeNode *children[BTREE_BRANCH_SIZE];
+};
+
+struct BTree_
+{
+    BTreeKeyCopyFn *KeyCopy;
+    BTreeKeyCompareFn *KeyCompare;
+    BTreeKeyDestroyFn *KeyDestroy;
+
+    BTreeValueCopyFn *ValueCopy;
+    BTreeValueCompareFn *ValueCompare;
+    BTreeValueDestroyFn *ValueDestroy;
+
+    BTreeNode *root;             /* an empty leaf in an empty tree */
+    BTreeLeaf *first;
+    size_t size;
+};
+
+static int PointerCompare_(const void *a, const void *b)
+{
+    return (a > b) - (a < b);
+}
+
+static void NoopDestroy_(ARG_UNUSED void *a)
+{
+    return;
+}
+
+static void *NoopCopy_(const void *a)
+{
+    return (void *) a;
+}
+
+static BTreeLeaf *LeafNew_(void)
+{
+    BTreeLeaf *leaf = xmalloc(sizeof(BTreeLeaf));
+    leaf->node.leaf = true;
+    leaf->node.count = 0;
+    leaf->next = NULL;
+    return leaf;
+}
+
+static BTreeBranch *BranchNew_(void)
+{
+    BTreeBranch *branch = xmalloc(sizeof(BTreeBranch));
+    branch->node.leaf = false;
+    branch->node.count = 0;
+    return branch;
+}
+
+BTree *BTreeNew(BTreeKeyCopyFn *key_copy,
+                BTreeKeyCompareFn *key_compare,
+                BTreeKeyDestroyFn *key_destroy,
+                BTreeValueCopyFn *value_copy,
+                BTreeValueCompareFn *value_compare,
+                BTreeValueDestroyFn *value_destroy)
+{
+    assert(!(key_copy && key_destroy) || (key_copy && key_destroy));
+    assert(!(value_copy && value_destroy) || (value_copy && value_destroy));
+
+    BTree *tree = xmalloc(sizeof(BTree));
+
+    tree->KeyCopy = key_copy ? key_copy : NoopCopy_;
+    tree->KeyCompare = key_compare ? key_compare : PointerCompare_;
+    tree->KeyDestroy = key_destroy ? key_destroy : NoopDestroy_;
+
+    tree->ValueCopy = value_copy ? value_copy : NoopCopy_;
+    tree->ValueCompare = value_compare ? value_compare : PointerCompare_;
+    tree->ValueDestroy = value_destroy ? value_destroy : NoopDestroy_;
+
+    BTreeLeaf *leaf = LeafNew_();
+    tree->root = &leaf->node;
+    tree->first = leaf;
+    tree->size = 0;
+
+    return tree;
+}
+
+static void NodeDestroy_(BTree *tree, BTreeNode *node)
+{
+    if (node->leaf)
+    {
+        BTreeLeaf *leaf = (BTreeLeaf *) node;
+        for (size_t i = 0; i < node->count; i++)
+        {
+            tree->KeyDestroy(leaf->keys[i]);
+            tree->ValueDestroy(leaf->values[i]);
+        }
+    }
+    else
+    {
+        BTreeBranch *branch = (BTreeBranch *) node;
+        for (size_t i = 0; i < node->count; i++)
+        {
+            NodeDestroy_(tree, branch->children[i]);
+        }
+    }
+    free(node);
+}
+
+void BTreeClear(BTree *tree)
+{
+    assert(tree != NULL);
+
+    NodeDestroy_(tree, tree->root);
+
+    BTreeLeaf *leaf = LeafNew_();
+    tree->root = &leaf->node;
+    tree->first = leaf;
+    tree->size = 0;
+}
+
+void BTreeDestroy(void *btree)
+{
+    BTree *tree = btree;
+    if (tree != NULL)
+    {
+        NodeDestroy_(tree, tree->root);
+        free(tree);
+    }
+}
+
+size_t BTreeSize(const BTree *tree)
+{
+    return tree->size;
+}
+
+/* Index of the first key in #leaf not less than #key */
+static size_t LeafLowerBound_(const BTree *tree, const BTreeLeaf *leaf, const void *key, bool *found)
+{
+    size_t low = 0;
+    size_t high = leaf->node.count;
+    *found = false;
+    while (low < high)
+    {
+        const size_t mid = low + (high - low) / 2;
+        const int cmp = tree->KeyCompare(leaf->keys[mid], key);
+        if (cmp < 0)
+        {
+            low = mid + 1;
+        }
+        else
+        {
+            *found = (cmp == 0);
+            high = mid;
+        }
+    }
+    *found = *found && (low < leaf->node.count) &&
+        (tree->KeyCompare(leaf->keys[low], key) == 0);
+    return low;
+}
+
+/* Index of the child of #branch that #key belongs to */
+static size_t BranchChild_(const BTree *tree, const BTreeBranch *branch, const void *key)
+{
+    size_t low = 0;
+    size_t high = branch->node.count - 1;
+    while (low < high)
+    {
+        const size_t mid = low + (high - low) / 2;
+        if (tree->KeyCompare(branch->keys[mid], key) <= 0)
+        {
+            low = mid + 1;
+        }
+        else
+        {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+static BTreeLeaf *FindLeaf_(const BTree *tree, const void *key)
+{
+    const BTreeNode *node = tree->root;
+    while (!node->leaf)
+    {
+        const BTreeBranch *branch = (const BTreeBranch *) node;
+        node = branch->children[BranchChild_(tree, branch, key)];
+    }
+    return (BTreeLeaf *) node;
+}
+
+void *BTreeGet(const BTree *tree, const void *key)
+{
+    assert(tree != NULL);
+
+    const BTreeLeaf *leaf = FindLeaf_(tree, key);
+    bool found;
+    const size_t i = LeafLowerBound_(tree, leaf, key, &found);
+    return found ? leaf->values[i] : NULL;
+}
+
+static void LeafInsertAt_(BTreeLeaf *leaf, size_t i, void *key, void *value)
+{
+    const size_t count = leaf->node.count;
+    memmove(&leaf->keys[i + 1], &leaf->keys[i], (count - i) * sizeof(void *));
+    memmove(&leaf->values[i + 1], &leaf->values[i], (count - i) * sizeof(void *));
+    leaf->keys[i] = key;
+    leaf->values[i] = value;
+    leaf->node.count++;
+}
+
+/**
+ * Puts the entry under #node. If #node had to be split, returns the new
+ * node to its right, with its smallest key in #split_key.
+ */
+static BTreeNode *Put_(BTree *tree, BTreeNode *node, const void *key, const void *value,
+                       bool *replaced, void **split_key)
+{
+    if (node->leaf)
+    {
+        BTreeLeaf *leaf = (BTreeLeaf *) node;
+        bool found;
+        const size_t i = LeafLowerBound_(tree, leaf, key, &found);
+        if (found)
+        {
+            /* The key in the tree may be in use as a separator, only the
+             * value is replaced. */
+            tree->ValueDestroy(leaf->values[i]);
+            leaf->values[i] = tree->ValueCopy(value);
+            *replaced = true;
+            return NULL;
+        }
+
+        void *const new_key = tree->KeyCopy(key);
+        void *const new_value = tree->ValueCopy(value);
+        if (node->count < BTREE_LEAF_SIZE)
+        {
+            LeafInsertAt_(leaf, i, new_key, new_value);
+            return NULL;
+        }
+
+        BTreeLeaf *right = LeafNew_();
+        const size_t half = BTREE_LEAF_SIZE / 2;
+        memcpy(right->keys, &leaf->keys[half], (BTREE_LEAF_SIZE - half) * sizeof(void *));
+        memcpy(right->values, &leaf->values[half], (BTREE_LEAF_SIZE - half) * sizeof(void *));
+        right->node.count = BTREE_LEAF_SIZE - half;
+        leaf->node.count = half;
+        right->next = leaf->next;
+        leaf->next = right;
+
+        if (i <= half)
+        {
+            LeafInsertAt_(leaf, i, new_key, new_value);
+        }
+        else
+        {
+            LeafInsertAt_(right, i - half, new_key, new_value);
+        }
+
+        *split_key = right->keys[0];
+        return &right->node;
+    }
+
+    BTreeBranch *branch = (BTreeBranch *) node;
+    const size_t i = BranchChild_(tree, branch, key);
+    void *child_split_key = NULL;
+    BTreeNode *new_child = Put_(tree, branch->children[i], key, value, replaced, &child_split_key);
+    if (new_child == NULL)
+    {
+        return NULL;
+    }
+
+    const size_t count = node->count;
+    if (count < BTREE_BRANCH_SIZE)
+    {
+        memmove(&branch->keys[i + 1], &branch->keys[i], (count - 1 - i) * sizeof(void *));
+        memmove(&branch->children[i + 2], &branch->children[i + 1], (count - 1 - i) * sizeof(void *));
+        branch->keys[i] = child_split_key;
+        branch->children[i + 1] = new_child;
+        node->count++;
+        return NULL;
+    }
+
+    /* Split the full branch, with the new child, in two halves and move the
+     * key separating them up. */
+    void *keys[BTREE_BRANCH_SIZE];
+    BTreeNode *children[BTREE_BRANCH_SIZE + 1];
+    memcpy(keys, branch->keys, i * sizeof(void *));
+    keys[i] = child_split_key;
+    memcpy(&keys[i + 1], &branch->keys[i], (BTREE_BRANCH_SIZE - 1 - i) * sizeof(void *));
+    memcpy(children, branch->children, (i + 1) * sizeof(void *));
+    children[i + 1] = new_child;
+    memcpy(&children[i + 2], &branch->children[i + 1], (BTREE_BRANCH_SIZE - 1 - i) * sizeof(void *));
+
+    const size_t left_count = (BTREE_BRANCH_SIZE + 1) / 2;
+    const size_t right_count = BTREE_BRANCH_SIZE + 1 - left_count;
+    BTreeBranch *right = BranchNew_();
+
+    memcpy(branch->keys, keys, (left_count - 1) * sizeof(void *));
+    memcpy(branch->children, children, left_count * sizeof(void *));
+    node->count = left_count;
+
+    memcpy(right->keys, &keys[left_count], (right_count - 1) * sizeof(void *));
+    memcpy(right->children, &children[left_count], right_count * sizeof(void *));
+    right->node.count = right_count;
+
+    *split_key = keys[left_count - 1];
+    return &right->node;
+}
+
+bool BTreePut(BTree *tree, const void *key, const void *value)
+{
+    assert(tree != NULL);
+
+    bool replaced = false;
+    void *split_key = NULL;
+    BTreeNode *right = Put_(tree, tree->root, key, value, &replaced, &split_key);
+    if (right != NULL)
+    {
+        BTreeBranch *root = BranchNew_();
+        root->children[0] = tree->root;
+        root->children[1] = right;
+        root->keys[0] = split_key;
+        root->node.count = 2;
+        tree->root = &root->node;
+    }
+
+    if (!replaced)
+    {
+        tree->size++;
+    }
+    return replaced;
+}
+
+static void BranchRemoveAt_(BTreeBranch *branch, size_t key_index)
+{
+    const size_t count = branch->node.count;
+    memmove(&branch->keys[key_index], &branch->keys[key_index + 1],
+            (count - 2 - key_index) * sizeof(void *));
+    memmove(&branch->children[key_index + 1], &branch->children[key_index + 2],
+            (count - 2 - key_index) * sizeof(void *));
+    branch->node.count--;
+}
+
+/* Refill children[i] of #parent, which has fallen below the minimum, from a
+ * sibling or merge the two. */
+static void Rebalance_(BTreeBranch *parent, size_t i)
+{
+    BTreeNode *child = parent->children[i];
+    BTreeNode *left = (i > 0) ? parent->children[i - 1] : NULL;
+    BTreeNode *right = (i + 1 < parent->node.count) ? parent->children[i + 1] : NULL;
+    const size_t min = child->leaf ? BTREE_LEAF_MIN : BTREE_BRANCH_MIN;
+
+    if (child->leaf)
+    {
+        BTreeLeaf *c = (BTreeLeaf *) child;
+        if (left != NULL && left->count > min)
+        {
+            BTreeLeaf *l = (BTreeLeaf *) left;
+            l->node.count--;
+            LeafInsertAt_(c, 0, l->keys[l->node.count], l->values[l->node.count]);
+            parent->keys[i - 1] = c->keys[0];
+        }
+        else if (right != NULL && right->count > min)
+        {
+            BTreeLeaf *r = (BTreeLeaf *) right;
+            c->keys[c->node.count] = r->keys[0];
+            c->values[c->node.count] = r->values[0];
+            c->node.count++;
+            r->node.count--;
+            memmove(r->keys, &r->keys[1], r->node.count * sizeof(void *));
+            memmove(r->values, &r->values[1], r->node.count * sizeof(void *));
+            parent->keys[i] = r->keys[0];
+        }
+        else
+        {
+            /* merge the right one of the two into the left one */
+            const size_t s = (left != NULL) ? i - 1 : i;
+            BTreeLeaf *l = (BTreeLeaf *) parent->children[s];
+            BTreeLeaf *r = (BTreeLeaf *) parent->children[s + 1];
+            memcpy(&l->keys[l->node.count], r->keys, r->node.count * sizeof(void *));
+            memcpy(&l->values[l->node.count], r->values, r->node.count * sizeof(void *));
+            l->node.count += r->node.count;
+            l->next = r->next;
+            free(r);
+            BranchRemoveAt_(parent, s);
+        }
+        return;
+    }
+
+    BTreeBranch *c = (BTreeBranch *) child;
+    if (left != NULL && left->count > min)
+    {
+        /* rotate the last child of the left sibling through the parent */
+        BTreeBranch *l = (BTreeBranch *) left;
+        memmove(&c->keys[1], c->keys, (c->node.count - 1) * sizeof(void *));
+        memmove(&c->children[1], c->children, c->node.count * sizeof(void *));
+        c->keys[0] = parent->keys[i - 1];
+        c->children[0] = l->children[l->node.count - 1];
+        c->node.count++;
+        parent->keys[i - 1] = l->keys[l->node.count - 2];
+        l->node.count--;
+    }
+    else if (right != NULL && right->count > min)
+    {
+        BTreeBranch *r = (BTreeBranch *) right;
+        c->keys[c->node.count - 1] = parent->keys[i];
+        c->children[c->node.count] = r->children[0];
+        c->node.count++;
+        parent->keys[i] = r->keys[0];
+        memmove(r->keys, &r->keys[1], (r->node.count - 2) * sizeof(void *));
+        memmove(r->children, &r->children[1], (r->node.count - 1) * sizeof(void *));
+        r->node.count--;
+    }
+    else
+    {
+        /* merge, the separator comes down between the two */
+        const size_t s = (left != NULL) ? i - 1 : i;
+        BTreeBranch *l = (BTreeBranch *) parent->children[s];
+        BTreeBranch *r = (BTreeBranch *) parent->children[s + 1];
+        l->keys[l->node.count - 1] = parent->keys[s];
+        memcpy(&l->keys[l->node.count], r->keys, (r->node.count - 1) * sizeof(void *));
+        memcpy(&l->children[l->node.count], r->children, r->node.count * sizeof(void *));
+        l->node.count += r->node.count;
+        free(r);
+        BranchRemoveAt_(parent, s);
+    }
+}
+
+static bool Remove_(BTree *tree, BTreeNode *node, const void *key,
+                    void **removed_key, void **removed_value)
+{
+    if (node->leaf)
+    {
+        BTreeLeaf *leaf = (BTreeLeaf *) node;
+        bool found;
+        const size_t i = LeafLowerBound_(tree, leaf, key, &found);
+        if (!found)
+        {
+            return false;
+        }
+
+        *removed_key = leaf->keys[i];
+        *removed_value = leaf->values[i];
+        node->count--;
+        memmove(&leaf->keys[i], &leaf->keys[i + 1], (node->count - i) * sizeof(void *));
+        memmove(&leaf->values[i], &leaf->values[i + 1], (node->count - i) * sizeof(void *));
+        return true;
+    }
+
+    BTreeBranch *branch = (BTreeBranch *) node;
+    const size_t i = BranchChild_(tree, branch, key);
+    if (!Remove_(tree, branch->children[i], key, removed_key, removed_value))
+    {
+        return false;
+    }
+
+    BTreeNode *child = branch->children[i];
+    if (child->count < (child->leaf ? BTREE_LEAF_MIN : BTREE_BRANCH_MIN))
+    {
+        Rebalance_(branch, i);
+    }
+    return true;
+}
+
+bool BTreeRemove(BTree *tree, const void *key)
+{
+    assert(tree != NULL);
+
+    void *removed_key = NULL;
+    void *removed_value = NULL;
+    if (!Remove_(tree, tree->root, key, &removed_key, &removed_value))
+    {
+        return false;
+    }
+
+    if (!tree->root->leaf && tree->root->count == 1)
+    {
+        BTreeBranch *root = (BTreeBranch *) tree->root;
+        tree->root = root->children[0];
+        free(root);
+    }
+
+    /* The removed key may still separate two subtrees, on the way to where
+     * it was. The smallest key of the subtree to its right takes its place. */
+    BTreeNode *node = tree->root;
+    while (!node->leaf)
+    {
+        BTreeBranch *branch = (BTreeBranch *) node;
+        const size_t i = BranchChild_(tree, branch, key);
+        if (i > 0 && branch->keys[i - 1] == removed_key)
+        {
+            const BTreeNode *successor = branch->children[i];
+            while (!successor->leaf)
+            {
+                successor = ((const BTreeBranch *) successor)->children[0];
+            }
+            branch->keys[i - 1] = ((const BTreeLeaf *) successor)->keys[0];
+            break;
+        }
+        node = branch->children[i];
+    }
+
+    tree->KeyDestroy(removed_key);
+    tree->ValueDestroy(removed_value);
+    tree->size--;
+    return true;
+}
+
+bool BTreeBulkLoad(BTree *tree, const void *const *keys, const void *const *values,
+                   size_t count)
+{
+    assert(tree != NULL);
+    assert(keys != NULL || count == 0);
+
+    if (tree->size != 0)
+    {
+        return false;
+    }
+    for (size_t i = 1; i < count; i++)
+    {
+        if (tree->KeyCompare(keys[i - 1], keys[i]) >= 0)
+        {
+            return false;
+        }
+    }
+    if (count == 0)
+    {
+        return true;
+    }
+
+    /* Spread the entries evenly, so that every node is at least half full */
+    size_t nodes = (count + BTREE_LEAF_SIZE - 1) / BTREE_LEAF_SIZE;
+    BTreeNode **level = xmalloc(nodes * sizeof(BTreeNode *));
+    void **level_keys = xmalloc(nodes * sizeof(void *));   /* smallest under each node */
+
+    size_t next = 0;
+    BTreeLeaf *previous = NULL;
+    for (size_t n = 0; n < nodes; n++)
+    {
+        BTreeLeaf *leaf = (n == 0) ? tree->first : LeafNew_();
+        const size_t entries = count / nodes + ((n < count % nodes) ? 1 : 0);
+        for (size_t i = 0; i < entries; i++, next++)
+        {
+            leaf->keys[i] = tree->KeyCopy(keys[next]);
+            leaf->values[i] = tree->ValueCopy((values != NULL) ? values[next] : NULL);
+        }
+        leaf->node.count = entries;
+        if (previous != NULL)
+        {
+            previous->next = leaf;
+        }
+        previous = leaf;
+        level[n] = &leaf->node;
+        level_keys[n] = leaf->keys[0];
+    }
+
+    while (nodes > 1)
+    {
+        const size_t parents = (nodes + BTREE_BRANCH_SIZE - 1) / BTREE_BRANCH_SIZE;
+        size_t child = 0;
+        for (size_t n = 0; n < parents; n++)
+        {
+            BTreeBranch *branch = BranchNew_();
+            const size_t children = nodes / parents + ((n < nodes % parents) ? 1 : 0);
+            void *smallest = level_keys[child];
+            for (size_t i = 0; i < children; i++, child++)
+            {
+                branch->children[i] = level[child];
+                if (i > 0)
+                {
+                    branch->keys[i - 1] = level_keys[child];
+                }
+            }
+            branch->node.count = children;
+            level[n] = &branch->node;
+            level_keys[n] = smallest;
+        }
+        nodes = parents;
+    }
+
+    tree->root = level[0];
+    tree->size = count;
+    free(level);
+    free(level_keys);
+    return true;
+}
+
+bool BTreeEqual(const void *_a, const void *_b)
+{
+    const BTree *a = _a, *b = _b;
+
+    if (a == b)
+    {
+        return true;
+    }
+    if (a == NULL || b == NULL)
+    {
+        return false;
+    }
+    if (a->KeyCompare != b->KeyCompare || a->ValueCompare != b->ValueCompare)
+    {
+        return false;
+    }
+    if (BTreeSize(a) != BTreeSize(b))
+    {
+        return false;
+    }
+
+    BTreeIterator it_a, it_b;
+    BTreeIteratorInit(&it_a, a);
+    BTreeIteratorInit(&it_b, b);
+
+    void *a_key, *a_val, *b_key, *b_val;
+    while (BTreeIteratorNext(&it_a, &a_key, &a_val)
+           && BTreeIteratorNext(&it_b, &b_key, &b_val))
+    {
+        if (a->KeyCompare(a_key, b_key) != 0
+            || a->ValueCompare(a_val, b_val) != 0)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void BTreeIteratorInit(BTreeIterator *iter, const BTree *tree)
+{
+    assert(iter != NULL);
+    assert(tree != NULL);
+
+    iter->leaf = tree->first;
+    iter->index = 0;
+}
+
+void BTreeIteratorLowerBound(BTreeIterator *iter, const BTree *tree, const void *key)
+{
+    assert(iter != NULL);
+    assert(tree != NULL);
+
+    const BTreeLeaf *leaf = FindLeaf_(tree, key);
+    bool found;
+    iter->leaf = leaf;
+    iter->index = LeafLowerBound_(tree, leaf, key, &found);
+}
+
+void BTreeIteratorUpperBound(BTreeIterator *iter, const BTree *tree, const void *key)
+{
+    assert(iter != NULL);
+    assert(tree != NULL);
+
+    const BTreeLeaf *leaf = FindLeaf_(tree, key);
+    bool found;
+    size_t i = LeafLowerBound_(tree, leaf, key, &found);
+    if (found)
+    {
+        i++;
+    }
+    iter->leaf = leaf;
+    iter->index = i;
+}
+
+bool BTreeIteratorNext(BTreeIterator *iter, void **key, void **value)
+{
+    assert(iter != NULL);
+
+    const BTreeLeaf *leaf = iter->leaf;
+    while (leaf != NULL && iter->index >= leaf->node.count)
+    {
+        leaf = leaf->next;
+        iter->index = 0;
+    }
+    iter->leaf = leaf;
+    if (leaf == NULL)
+    {
+        return false;
+    }
+
+    if (key != NULL)
+    {
+        *key = leaf->keys[iter->index];
+    }
+    if (value != NULL)
+    {
+        *value = leaf->values[iter->index];
+    }
+    iter->index++;
+    return true;
+}
@@ -0,0 +1,116 @@
+/*
+  Copyright 2023 Northern.tech AS
+
+  This file is part of CFEngine 3 - written and maintained by Northern.tech AS.
+
+  This program is free software; you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by the
+  Free Software Foundation; version 3.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA
+
+  To the extent this program is licensed as part of the Enterprise
+  versions of CFEngine, the applicable Commercial Open Source License
+  (COSL) may apply to this file if you as a licensee so wish it. See
+  included file COSL.txt.
+*/
+
+#ifndef CFENGINE_BTREE_H
+#define CFENGINE_BTREE_H
+
+#include <platform.h>
+
+/*
+ * In-memory B+tree, an ordered map like RBTree (with the same callbacks),
+ * but with many entries per node, so that lookups touch few cache lines
+ * and ordered iteration walks arrays in linked leaves.
+ */
+
+typedef struct BTree_ BTree;
+
+typedef void *BTreeKeyCopyFn(const void *key);
+typedef int BTreeKeyCompareFn(const void *a, const void *b);
+typedef void BTreeKeyDestroyFn(void *key);
+typedef void *BTreeValueCopyFn(const void *value);
+typedef int BTreeValueCompareFn(const void *a, const void *b);
+typedef void BTreeValueDestroyFn(void *value);
+
+/**
+ * @brief Iterator over a BTree, meant to be on the stack. Any change to the
+ *        tree invalidates it. The fields are private.
+ */
+typedef struct
+{
+    const void *leaf;
+    size_t index;
+} BTreeIterator;
+
+/**
+ * @note As with RBTreeNew(), NULL callbacks mean the keys and values are
+ *       used as they are and compared as pointers.
+ */
+BTree *BTreeNew(BTreeKeyCopyFn *key_copy,
+                BTreeKeyCompareFn *key_compare,
+                BTreeKeyDestroyFn *key_destroy,
+                BTreeValueCopyFn *value_copy,
+                BTreeValueCompareFn *value_compare,
+                BTreeValueDestroyFn *value_destroy);
+
+bool BTreeEqual(const void *a, const void *b);
+void BTreeDestroy(void *btree);
+
+/**
+ * @return true if the key was already there and its value was replaced.
+ */
+bool BTreePut(BTree *tree, const void *key, const void *value);
+void *BTreeGet(const BTree *tree, const void *key);
+bool BTreeRemove(BTree *tree, const void *key);
+void BTreeClear(BTree *tree);
+size_t BTreeSize(const BTree *tree);
+
+/**
+ * @brief Fills an empty tree from keys in strictly ascending order, much
+ *        faster than putting them one by one.
+ * @param values Values for the keys, or NULL for all NULL values.
+ * @return false if the tree is not empty or the keys are not sorted, in
+ *         which case the tree is left unchanged.
+ */
+bool BTreeBulkLoad(BTree *tree, const void *const *keys, const void *const *values,
+                   size_t count);
+
+/**
+ * @brief Start at the first entry.
+ */
+void BTreeIteratorInit(BTreeIterator *iter, const BTree *tree);
+
+/**
+ * @brief Start at the first entry with a key not less than #key.
+ *
+ * Entries in [from, to) are iterated with:
+ *
+ *   BTreeIterator iter;
+ *   BTreeIteratorLowerBound(&iter, tree, from);
+ *   while (BTreeIteratorNext(&iter, &key, &value) && compare(key, to) < 0)
+ */
+void BTreeIteratorLowerBound(BTreeIterator *iter, const BTree *tree, const void *key);
+
+/**
+ * @brief Start at the first entry with a key greater than #key.
+ */
+void BTreeIteratorUpperBound(BTreeIterator *iter, const BTree *tree, const void *key);
+
+/**
+ * @brief Gets the current entry and moves to the next one.
+ * @param key, value Where to store the entry, may be NULL.
+ * @return false at the end.
+ */
+bool BTreeIteratorNext(BTreeIterator *iter, void **key, void **value);
+
+#endif
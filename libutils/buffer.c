@@ -32,15 +32,36 @@
 #endif
 #include <string_lib.h>
 
+static inline bool IsInline(const Buffer *buffer)
+{
+    return buffer->has_inline && buffer->buffer == buffer->inline_data;
+}
+
 Buffer *BufferNewWithCapacity(size_t initial_capacity)
 {
-    Buffer *buffer = xmalloc(sizeof(Buffer));
+    Buffer *buffer;
 
-    buffer->capacity = initial_capacity;
-    buffer->buffer = xmalloc(buffer->capacity);
+    /* Only small buffers get the inline storage, the others keep the size
+     * of a Buffer without it. */
+    if (initial_capacity <= BUFFER_INLINE_CAPACITY)
+    {
+        buffer = xmalloc(sizeof(Buffer) + BUFFER_INLINE_CAPACITY);
+        buffer->has_inline = true;
+        buffer->capacity = BUFFER_INLINE_CAPACITY;
+        buffer->buffer = buffer->inline_data;
+    }
+    else
+    {
+        buffer = xmalloc(sizeof(Buffer));
+        buffer->has_inline = false;
+        buffer->capacity = initial_capacity;
+        buffer->buffer = xmalloc(buffer->capacity);
+    }
     buffer->buffer[0] = '\0';
     buffer->mode = BUFFER_BEHAVIOR_CSTRING;
     buffer->used = 0;
+    buffer->unsafe = false;
+    buffer->growth = BUFFER_GROWTH_POWER_OF_TWO;
 
     return buffer;
 }
@@ -50,17 +71,66 @@ Buffer *BufferNew(void)
     return BufferNewWithCapacity(DEFAULT_BUFFER_CAPACITY);
 }
 
+Buffer *BufferNewSmall(void)
+{
+    return BufferNewWithCapacity(BUFFER_INLINE_CAPACITY);
+}
+
+static void Resize(Buffer *buffer, size_t new_capacity)
+{
+    assert(new_capacity > buffer->capacity);
+
+    if (IsInline(buffer))
+    {
+        char *data = xmalloc(new_capacity);
+        memcpy(data, buffer->inline_data, buffer->capacity);
+        buffer->buffer = data;
+    }
+    else
+    {
+        buffer->buffer = xrealloc(buffer->buffer, new_capacity);
+    }
+    buffer->capacity = new_capacity;
+}
+
 static void ExpandIfNeeded(Buffer *buffer, size_t needed)
 {
     assert(buffer != NULL);
     if (needed >= buffer->capacity)
     {
-        size_t new_capacity = UpperPowerOfTwo(needed + 1);
-        buffer->buffer = xrealloc(buffer->buffer, new_capacity);
-        buffer->capacity = new_capacity;
+        size_t new_capacity;
+        switch (buffer->growth)
+        {
+        case BUFFER_GROWTH_ONE_AND_HALF:
+            new_capacity = MAX(needed + 1, buffer->capacity + buffer->capacity / 2);
+            break;
+        case BUFFER_GROWTH_EXACT:
+            new_capacity = needed + 1;
+            break;
+        case BUFFER_GROWTH_POWER_OF_TWO:
+        default:
+            new_capacity = UpperPowerOfTwo(needed + 1);
+            break;
+        }
+        Resize(buffer, new_capacity);
     }
 }
 
+void BufferReserve(Buffer *buffer, size_t size)
+{
+    assert(buffer != NULL);
+    if (size >= buffer->capacity)
+    {
+        Resize(buffer, size + 1);
+    }
+}
+
+void BufferSetGrowthPolicy(Buffer *buffer, BufferGrowthPolicy growth)
+{
+    assert(buffer != NULL);
+    buffer->growth = growth;
+}
+
 Buffer* BufferNewFrom(const char *data, size_t length)
 {
     Buffer *buffer = BufferNewWithCapacity(length + 1);
@@ -73,7 +143,10 @@ void BufferDestroy(Buffer *buffer)
 {
     if (buffer != NULL)
     {
-        free(buffer->buffer);
+        if (!IsInline(buffer))
+        {
+            free(buffer->buffer);
+        }
         free(buffer);
     }
 }
@@ -81,12 +154,28 @@ void BufferDestroy(Buffer *buffer)
 char *BufferClose(Buffer *buffer)
 {
     assert(buffer != NULL);
-    char *detached = buffer->buffer;
+    char *detached = IsInline(buffer) ?
+        xmemdup(buffer->inline_data, buffer->capacity) : buffer->buffer;
     free(buffer);
 
     return detached;
 }
 
+Writer *BufferCloseToStringWriter(Buffer *buffer)
+{
+    assert(buffer != NULL);
+
+    /* ByteArray mode does not keep the data terminated */
+    ExpandIfNeeded(buffer, buffer->used + 1);
+    buffer->buffer[buffer->used] = '\0';
+
+    const size_t length = (buffer->mode == BUFFER_BEHAVIOR_CSTRING) ?
+        buffer->used : strnlen(buffer->buffer, buffer->used);
+    const size_t capacity = buffer->capacity;
+
+    return StringWriterFromData(BufferClose(buffer), length, capacity);
+}
+
 Buffer *BufferCopy(const Buffer *source)
 {
     assert(source != NULL);
@@ -458,6 +547,7 @@ const char* BufferSearchAndReplace(Buffer *buffer, const char *pattern, const ch
     char *result;
     if (0 > (err = pcre_wrap_execute(job, (char*)BufferData(buffer), length, &result, &length)))
     {
+        pcre_wrap_free_job(job);
         return pcre_wrap_strerror(err);
     }
 
@@ -531,7 +621,7 @@ Buffer* BufferFilter(Buffer *buffer, BufferFilterFn filter, const bool invert)
 {
     assert(buffer != NULL);
 
-    Buffer *filtered = BufferNew();
+    Buffer *filtered = BufferNewWithCapacity(buffer->used + 1);
     for (size_t i = 0; i < buffer->used; ++i)
     {
         bool test = (*filter)(buffer->buffer[i]);
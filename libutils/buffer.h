@@ -27,6 +27,7 @@
 
 #include <compiler.h>
 #include <stdarg.h> // va_list
+#include <writer.h>
 
 /**
   @brief Buffer implementation
@@ -46,6 +47,17 @@ typedef enum
 
 #define DEFAULT_BUFFER_CAPACITY     4096
 
+/* Buffers with at most this capacity keep their data inside the Buffer
+ * structure itself, see BufferNewSmall(). */
+#define BUFFER_INLINE_CAPACITY      64
+
+typedef enum
+{
+    BUFFER_GROWTH_POWER_OF_TWO //<! Grow to the next power of two above the needed size (default).
+    , BUFFER_GROWTH_ONE_AND_HALF //<! Grow by at least half of the capacity, wastes less memory on big buffers.
+    , BUFFER_GROWTH_EXACT //<! Grow to exactly the needed size, for buffers filled once (see also BufferReserve()).
+} BufferGrowthPolicy;
+
 typedef struct
 {
     char *buffer;
@@ -53,6 +65,9 @@ typedef struct
     size_t capacity;
     size_t used;
     bool unsafe;
+    bool has_inline; //<! Whether inline_data was allocated, only for small buffers.
+    BufferGrowthPolicy growth;
+    char inline_data[]; //<! Storage used while the data fits, never access directly.
 } Buffer;
 
 
@@ -76,6 +91,16 @@ Buffer* BufferNew(void);
   */
 Buffer *BufferNewWithCapacity(size_t initial_capacity);
 
+/**
+  @brief Allocates a buffer meant for short contents, like a number or an address.
+
+  The data is kept inside the Buffer structure as long as it fits into BUFFER_INLINE_CAPACITY bytes (including the
+  terminating '\0'), so a short-lived buffer costs a single small allocation. It grows like any other buffer.
+  @return Pointer to initialized Buffer if the initialization was successful,
+          otherwise terminate with message to stderr.
+  */
+Buffer *BufferNewSmall(void);
+
 /**
   @brief Initializes a buffer based on a const char pointer.
   @param data Data
@@ -97,9 +122,20 @@ void BufferDestroy(Buffer *buffer);
   @brief Destroys a buffer structure returning the its contents.
   @param buffer Structure to operate on.
   @return Contents of the buffer.
+  @remarks The storage is handed over without copying, unless the data is kept inline (see BufferNewSmall()).
   */
 char *BufferClose(Buffer *buffer);
 
+/**
+  @brief Destroys a buffer structure turning its contents into a StringWriter.
+
+  Like BufferClose(), the storage is handed over to the writer without copying the data.
+  @param buffer Structure to operate on.
+  @return StringWriter containing the data of the buffer.
+  @remarks In ByteArray mode, the data is cut at the first '\0' by the StringWriter functions.
+  */
+Writer *BufferCloseToStringWriter(Buffer *buffer);
+
 /**
   @brief Creates a shallow copy of the source buffer.
   @param source Source buffer.
@@ -215,6 +251,22 @@ size_t BufferSize(const Buffer *buffer);
   */
 size_t BufferCapacity(const Buffer *buffer);
 
+/**
+  @brief Makes room for the given number of bytes, so that appending up to that size does not need any reallocation.
+
+  Useful before appending big amounts of data of known size, which would otherwise go through several reallocations.
+  @param buffer Structure to operate on.
+  @param size Number of bytes of content (not including the terminating '\0') the buffer should be able to hold.
+  */
+void BufferReserve(Buffer *buffer, size_t size);
+
+/**
+  @brief Sets how the buffer grows when it runs out of space.
+  @param buffer Structure to operate on.
+  @param growth The new growth policy, the default is BUFFER_GROWTH_POWER_OF_TWO.
+  */
+void BufferSetGrowthPolicy(Buffer *buffer, BufferGrowthPolicy growth);
+
 /**
   @brief Returns the current mode of operation of the buffer.
   @param buffer The buffer to operate on.
@@ -0,0 +1,396 @@
+/*
+  Copyright 2023 Northern.tech AS
+
+  This file is part of CFEngine 3 - written and maintained by Northern.tech AS.
+
+  This program is free software; you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by the
+  Free Software Foundation; version 3.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA
+
+  To the extent this program is licensed as part of the Enterprise
+  versions of CFEngine, the applicable Commercial Open Source License
+  (COSL) may apply to this file if you as a licensee so wish it. See
+  included file COSL.txt.
+*/
+
+#include <platform.h>
+#include <cidr_trie.h>
+
+#include <alloc.h>
+#include <logging.h>
+#include <string_lib.h> /* SAFENULL */
+
+typedef struct CidrTrieNode_ CidrTrieNode;
+
+struct CidrTrieNode_
+{
+    uint8_t key[16];             /* bits beyond len are always 0 */
+    uint8_t len;                 /* prefix length in bits */
+    bool has_value;              /* false for nodes only joining two others */
+    void *value;
+    CidrTrieNode *child[2];      /* by the bit after the prefix */
+};
+
+/* Nodes are never freed one by one, so they come from chunks that grow
+ * with the trie, which also keeps them close together in memory. */
+#define CIDR_TRIE_CHUNK_MIN 16
+#define CIDR_TRIE_CHUNK_MAX 4096
+
+typedef struct CidrTrieChunk_ CidrTrieChunk;
+
+struct CidrTrieChunk_
+{
+    CidrTrieChunk *next;
+    size_t used;
+    size_t capacity;
+    CidrTrieNode nodes[];
+};
+
+struct CidrTrie
+{
+    CidrTrieNode *roots[2];      /* IPv4 and IPv6 */
+    CidrTrieValueDestroyFn *value_destroy;
+    size_t size;
+    CidrTrieChunk *chunks;
+};
+
+static inline unsigned int KeyBit(const uint8_t *key, unsigned int i)
+{
+    return (key[i / 8] >> (7 - (i % 8))) & 1;
+}
+
+/* Clear the bits beyond #len */
+static void KeyMask(uint8_t *key, unsigned int len)
+{
+    if (len % 8 != 0)
+    {
+        key[len / 8] &= 0xFF << (8 - (len % 8));
+        len += 8 - (len % 8);
+    }
+    memset(key + len / 8, 0, 16 - len / 8);
+}
+
+/**
+ * Number of leading bits #a and #b have in common, up to #max. The first
+ * #known bits are already known to be the same.
+ */
+static unsigned int CommonPrefixLength(const uint8_t *a, const uint8_t *b,
+                                       unsigned int known, unsigned int max)
+{
+    for (unsigned int byte = known / 8; byte * 8 < max; byte++)
+    {
+        uint8_t diff = a[byte] ^ b[byte];
+        if (diff != 0)
+        {
+            unsigned int i = byte * 8;
+            while ((diff & 0x80) == 0)
+            {
+                diff <<= 1;
+                i++;
+            }
+            return MIN(i, max);
+        }
+    }
+    return max;
+}
+
+static inline int RootIndex(const IPAddr *addr)
+{
+    return (addr->type == IP_ADDRESS_TYPE_IPV4) ? 0 : 1;
+}
+
+CidrTrie *CidrTrieNew(CidrTrieValueDestroyFn *value_destroy)
+{
+    CidrTrie *trie = xcalloc(1, sizeof(CidrTrie));
+    trie->value_destroy = value_destroy;
+    return trie;
+}
+
+void CidrTrieDestroy(CidrTrie *trie)
+{
+    if (trie == NULL)
+    {
+        return;
+    }
+
+    CidrTrieChunk *chunk = trie->chunks;
+    while (chunk != NULL)
+    {
+        if (trie->value_destroy != NULL)
+        {
+            for (size_t i = 0; i < chunk->used; i++)
+            {
+                if (chunk->nodes[i].has_value)
+                {
+                    trie->value_destroy(chunk->nodes[i].value);
+                }
+            }
+        }
+
+        CidrTrieChunk *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    free(trie);
+}
+
+static CidrTrieNode *NodeNew(CidrTrie *trie, const uint8_t *key, unsigned int len)
+{
+    CidrTrieChunk *chunk = trie->chunks;
+    if (chunk == NULL || chunk->used == chunk->capacity)
+    {
+        const size_t capacity = (chunk == NULL) ?
+            CIDR_TRIE_CHUNK_MIN : MIN(chunk->capacity * 2, CIDR_TRIE_CHUNK_MAX);
+        chunk = xmalloc(sizeof(CidrTrieChunk) + capacity * sizeof(CidrTrieNode));
+        chunk->next = trie->chunks;
+        chunk->used = 0;
+        chunk->capacity = capacity;
+        trie->chunks = chunk;
+    }
+
+    CidrTrieNode *node = &chunk->nodes[chunk->used++];
+    memcpy(node->key, key, sizeof(node->key));
+    KeyMask(node->key, len);
+    node->len = len;
+    node->has_value = false;
+    node->value = NULL;
+    node->child[0] = NULL;
+    node->child[1] = NULL;
+    return node;
+}
+
+static void NodeSetValue(CidrTrie *trie, CidrTrieNode *node, void *value)
+{
+    if (node->has_value)
+    {
+        if (trie->value_destroy != NULL && node->value != value)
+        {
+            trie->value_destroy(node->value);
+        }
+    }
+    else
+    {
+        node->has_value = true;
+        trie->size++;
+    }
+    node->value = value;
+}
+
+bool CidrTrieInsert(CidrTrie *trie, const IPAddr *prefix, unsigned int prefix_len, void *value)
+{
+    assert(trie != NULL);
+    assert(prefix != NULL);
+
+    if (prefix_len > IP_ADDR_BITS(prefix->type))
+    {
+        return false;
+    }
+
+    uint8_t key[16];
+    memcpy(key, prefix->bytes, sizeof(key));
+    KeyMask(key, prefix_len);
+
+    CidrTrieNode **link = &trie->roots[RootIndex(prefix)];
+    unsigned int known = 0;
+    while (*link != NULL)
+    {
+        CidrTrieNode *node = *link;
+        const unsigned int common =
+            CommonPrefixLength(node->key, key, known, MIN(node->len, prefix_len));
+
+        if (common == node->len)
+        {
+            if (node->len == prefix_len)
+            {
+                NodeSetValue(trie, node, value);
+                return true;
+            }
+
+            /* the new network is inside this one */
+            known = node->len;
+            link = &node->child[KeyBit(key, node->len)];
+            continue;
+        }
+
+        /* The new network and this node's part ways (or the node is inside
+         * the new network), a new node takes the place of this one. */
+        CidrTrieNode *parent;
+        if (common == prefix_len)
+        {
+            parent = NodeNew(trie, key, prefix_len);
+            NodeSetValue(trie, parent, value);
+        }
+        else
+        {
+            parent = NodeNew(trie, key, common);
+            CidrTrieNode *leaf = NodeNew(trie, key, prefix_len);
+            NodeSetValue(trie, leaf, value);
+            parent->child[KeyBit(key, common)] = leaf;
+        }
+        parent->child[KeyBit(node->key, common)] = node;
+        *link = parent;
+        return true;
+    }
+
+    *link = NodeNew(trie, key, prefix_len);
+    NodeSetValue(trie, *link, value);
+    return true;
+}
+
+bool CidrTrieInsertString(CidrTrie *trie, const char *cidr, void *value)
+{
+    assert(cidr != NULL);
+
+    IPAddr prefix;
+    unsigned int prefix_len;
+    if (!IPAddrParseCidr(cidr, strlen(cidr), &prefix, &prefix_len))
+    {
+        return false;
+    }
+    return CidrTrieInsert(trie, &prefix, prefix_len, value);
+}
+
+typedef struct
+{
+    IPAddr prefix;
+    unsigned int prefix_len;
+} CidrTrieEntry;
+
+static int CidrTrieEntryCompare(const void *a, const void *b)
+{
+    const CidrTrieEntry *x = a;
+    const CidrTrieEntry *y = b;
+
+    const int result = IPAddrCompare(&x->prefix, &y->prefix);
+    if (result != 0)
+    {
+        return result;
+    }
+    return (x->prefix_len > y->prefix_len) - (x->prefix_len < y->prefix_len);
+}
+
+CidrTrie *CidrTrieNewFromStrings(const Seq *cidrs, void *value, size_t *invalid)
+{
+    assert(cidrs != NULL);
+
+    const size_t length = SeqLength(cidrs);
+    CidrTrieEntry *entries = xmalloc(MAX(length, 1) * sizeof(CidrTrieEntry));
+    size_t count = 0;
+    size_t skipped = 0;
+
+    for (size_t i = 0; i < length; i++)
+    {
+        const char *cidr = SeqAt(cidrs, i);
+        CidrTrieEntry *entry = &entries[count];
+        if (cidr == NULL ||
+            !IPAddrParseCidr(cidr, strlen(cidr), &entry->prefix, &entry->prefix_len))
+        {
+            Log(LOG_LEVEL_WARNING, "Invalid network '%s', skipping it", SAFENULL(cidr));
+            skipped++;
+            continue;
+        }
+        count++;
+    }
+
+    /* Inserting in order puts every network after the ones containing it,
+     * so nothing has to be split, and lays the nodes out in address order. */
+    qsort(entries, count, sizeof(CidrTrieEntry), CidrTrieEntryCompare);
+
+    CidrTrie *trie = CidrTrieNew(NULL);
+    for (size_t i = 0; i < count; i++)
+    {
+        CidrTrieInsert(trie, &entries[i].prefix, entries[i].prefix_len, value);
+    }
+    free(entries);
+
+    if (invalid != NULL)
+    {
+        *invalid = skipped;
+    }
+    return trie;
+}
+
+bool CidrTrieMatch(const CidrTrie *trie, const IPAddr *addr,
+                   void **value, unsigned int *prefix_len)
+{
+    assert(trie != NULL);
+    assert(addr != NULL);
+
+    const unsigned int bits = IP_ADDR_BITS(addr->type);
+    const CidrTrieNode *best = NULL;
+    const CidrTrieNode *node = trie->roots[RootIndex(addr)];
+    unsigned int known = 0;
+
+    while (node != NULL &&
+           CommonPrefixLength(node->key, addr->bytes, known, node->len) == node->len)
+    {
+        if (node->has_value)
+        {
+            best = node;
+        }
+        if (node->len == bits)
+        {
+            break;
+        }
+        known = node->len;
+        node = node->child[KeyBit(addr->bytes, node->len)];
+    }
+
+    if (best == NULL)
+    {
+        return false;
+    }
+    if (value != NULL)
+    {
+        *value = best->value;
+    }
+    if (prefix_len != NULL)
+    {
+        *prefix_len = best->len;
+    }
+    return true;
+}
+
+void *CidrTrieGet(const CidrTrie *trie, const IPAddr *prefix, unsigned int prefix_len)
+{
+    assert(trie != NULL);
+    assert(prefix != NULL);
+
+    if (prefix_len > IP_ADDR_BITS(prefix->type))
+    {
+        return NULL;
+    }
+
+    uint8_t key[16];
+    memcpy(key, prefix->bytes, sizeof(key));
+    KeyMask(key, prefix_len);
+
+    const CidrTrieNode *node = trie->roots[RootIndex(prefix)];
+    unsigned int known = 0;
+    while (node != NULL && node->len <= prefix_len &&
+           CommonPrefixLength(node->key, key, known, node->len) == node->len)
+    {
+        if (node->len == prefix_len)
+        {
+            return node->has_value ? node->value : NULL;
+        }
+        known = node->len;
+        node = node->child[KeyBit(key, node->len)];
+    }
+    return NULL;
+}
+
+size_t CidrTrieSize(const CidrTrie *trie)
+{
+    assert(trie != NULL);
+    return trie->size;
+}
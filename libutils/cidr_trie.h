@@ -0,0 +1,89 @@
+/*
+  Copyright 2023 Northern.tech AS
+
+  This file is part of CFEngine 3 - written and maintained by Northern.tech AS.
+
+  This program is free software; you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by the
+  Free Software Foundation; version 3.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA
+
+  To the extent this program is licensed as part of the Enterprise
+  versions of CFEngine, the applicable Commercial Open Source License
+  (COSL) may apply to this file if you as a licensee so wish it. See
+  included file COSL.txt.
+*/
+
+#ifndef CFENGINE_CIDR_TRIE_H
+#define CFENGINE_CIDR_TRIE_H
+
+#include <ip_address.h>
+#include <sequence.h>
+
+/*
+ * Path-compressed binary (Patricia) trie of IPv4 and IPv6 networks, for
+ * finding the most specific network an address belongs to in time
+ * proportional to the address length, independent of the number of
+ * networks.
+ */
+
+typedef struct CidrTrie CidrTrie;
+
+typedef void CidrTrieValueDestroyFn(void *value);
+
+/**
+ * @param value_destroy Called on the values when the trie is destroyed or
+ *                      when they are replaced, may be NULL.
+ */
+CidrTrie *CidrTrieNew(CidrTrieValueDestroyFn *value_destroy);
+void CidrTrieDestroy(CidrTrie *trie);
+
+/**
+ * @brief Builds a trie from a list of networks in CIDR notation (see
+ *        IPAddrParseCidr()), all mapped to #value.
+ * @param cidrs Seq of strings, entries that fail to parse are logged and
+ *              skipped.
+ * @param invalid Where to store the number of skipped entries, may be NULL.
+ */
+CidrTrie *CidrTrieNewFromStrings(const Seq *cidrs, void *value, size_t *invalid);
+
+/**
+ * @brief Maps the network #prefix/#prefix_len to #value, replacing the value
+ *        of the network if it was already there.
+ * @note The bits of #prefix beyond #prefix_len are ignored.
+ * @return false if #prefix_len is too long for the address family.
+ */
+bool CidrTrieInsert(CidrTrie *trie, const IPAddr *prefix, unsigned int prefix_len, void *value);
+
+/**
+ * @brief Same as CidrTrieInsert() for a network in CIDR notation.
+ * @return false if #cidr is not a valid network.
+ */
+bool CidrTrieInsertString(CidrTrie *trie, const char *cidr, void *value);
+
+/**
+ * @brief Longest prefix match, finds the most specific network containing #addr.
+ * @param value Where to store the value of the network, may be NULL.
+ * @param prefix_len Where to store the length of its prefix, may be NULL.
+ * @return false if no network contains #addr.
+ */
+bool CidrTrieMatch(const CidrTrie *trie, const IPAddr *addr,
+                   void **value, unsigned int *prefix_len);
+
+/**
+ * @brief The value of exactly the network #prefix/#prefix_len, or NULL.
+ */
+void *CidrTrieGet(const CidrTrie *trie, const IPAddr *prefix, unsigned int prefix_len);
+
+/* Number of networks in the trie */
+size_t CidrTrieSize(const CidrTrie *trie);
+
+#endif
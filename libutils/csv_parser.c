@@ -365,3 +365,371 @@ char *GetCsvLineNext(FILE *fp)
 
     return StringWriterClose(buffer);
 }
+
+/**
+ * Find the end of the record at the start of #data, line breaks inside quoted
+ * fields do not end it.
+ *
+ * @param content_length [out] Length of the record without its line ending
+ * @return Length of the record including its line ending, 0 if there is no
+ *         line ending in #data (#content_length is #length then)
+ */
+static size_t CsvRecordEnd(const char *const data, const size_t length,
+                           const CsvLineEnding line_ending,
+                           size_t *const content_length)
+{
+    assert(data != NULL || length == 0);
+
+    bool in_quotes = false;
+    const char *p = data;
+    const char *const end = data + length;
+    while (p < end)
+    {
+        /* Only the quotes on the line can change the state at its LF, look
+         * for them there instead of in all of the remaining data. */
+        const char *const lf = memchr(p, '\n', end - p);
+        const char *const line_end = (lf != NULL) ? lf : end;
+        for (const char *quote = memchr(p, '"', line_end - p);
+             quote != NULL;
+             quote = memchr(quote + 1, '"', line_end - (quote + 1)))
+        {
+            in_quotes = !in_quotes;
+        }
+
+        if (lf == NULL)
+        {
+            break;
+        }
+        if (!in_quotes)
+        {
+            const bool cr = (lf > data && lf[-1] == '\r');
+            if (cr || line_ending == CSV_LINE_ENDING_LF)
+            {
+                *content_length = (lf - data) - (cr ? 1 : 0);
+                return (lf - data) + 1;
+            }
+        }
+        p = lf + 1;
+    }
+
+    *content_length = length;
+    return 0;
+}
+
+size_t GetCsvLineLength(const char *const data, const size_t length)
+{
+    size_t content_length;
+    const size_t record_length =
+        CsvRecordEnd(data, length, CSV_LINE_ENDING_CRLF, &content_length);
+    return (record_length != 0) ? record_length : length;
+}
+
+/* Size of the buffer CsvReaderNewFromFd() reads into, grown for records that
+ * do not fit. */
+#define CSV_READER_BUFSIZE (256 * 1024)
+
+#define CSV_BLANK(x) (((x) == ' ') || ((x) == '\t') || ((x) == '\n') || ((x) == '\r'))
+
+struct CsvReader_
+{
+    const char *data;
+    size_t length;
+    size_t pos;                 /* start of the next record in data */
+    size_t offset;              /* bytes consumed before data */
+    char separator;
+    CsvLineEnding line_ending;
+
+    int fd;                     /* -1 when reading from memory */
+    char *buffer;               /* == data when reading from fd */
+    size_t buffer_size;
+    bool eof;
+
+    CsvField *fields;
+    size_t n_fields;
+    size_t fields_size;
+    char *scratch;              /* unescaped quoted fields */
+    size_t scratch_size;
+    size_t record_number;
+};
+
+static CsvReader *CsvReaderCreate(const char separator,
+                                  const CsvLineEnding line_ending)
+{
+    assert(separator != '"' && separator != '\n' && separator != '\r');
+
+    CsvReader *reader = xcalloc(1, sizeof(CsvReader));
+    reader->separator = separator;
+    reader->line_ending = line_ending;
+    reader->fd = -1;
+    reader->fields_size = 16;
+    reader->fields = xmalloc(reader->fields_size * sizeof(CsvField));
+    return reader;
+}
+
+CsvReader *CsvReaderNew(const char *const data, const size_t length,
+                        const char separator, const CsvLineEnding line_ending)
+{
+    assert(data != NULL || length == 0);
+
+    CsvReader *reader = CsvReaderCreate(separator, line_ending);
+    reader->data = data;
+    reader->length = length;
+    reader->eof = true;
+    return reader;
+}
+
+CsvReader *CsvReaderNewFromFd(const int fd, const char separator,
+                              const CsvLineEnding line_ending)
+{
+    assert(fd >= 0);
+
+    CsvReader *reader = CsvReaderCreate(separator, line_ending);
+    reader->fd = fd;
+    reader->buffer_size = CSV_READER_BUFSIZE;
+    reader->buffer = xmalloc(reader->buffer_size);
+    reader->data = reader->buffer;
+    return reader;
+}
+
+void CsvReaderDestroy(CsvReader *const reader)
+{
+    if (reader != NULL)
+    {
+        free(reader->buffer);
+        free(reader->fields);
+        free(reader->scratch);
+        free(reader);
+    }
+}
+
+/**
+ * Move the unconsumed data to the start of the buffer and read more after
+ * it, growing the buffer if it is full.
+ */
+static bool CsvReaderFill(CsvReader *const reader)
+{
+    assert(reader->fd >= 0);
+
+    const size_t remaining = reader->length - reader->pos;
+    if (reader->pos > 0)
+    {
+        memmove(reader->buffer, reader->buffer + reader->pos, remaining);
+        reader->offset += reader->pos;
+        reader->pos = 0;
+        reader->length = remaining;
+    }
+    if (reader->length == reader->buffer_size)
+    {
+        reader->buffer_size *= 2;
+        reader->buffer = xrealloc(reader->buffer, reader->buffer_size);
+    }
+    reader->data = reader->buffer;
+
+    for (;;)
+    {
+        const ssize_t n = read(reader->fd, reader->buffer + reader->length,
+                               reader->buffer_size - reader->length);
+        if (n > 0)
+        {
+            reader->length += n;
+            return true;
+        }
+        else if (n == 0)
+        {
+            reader->eof = true;
+            return true;
+        }
+        else if (errno != EINTR)
+        {
+            return false;
+        }
+    }
+}
+
+static void CsvReaderAddField(CsvReader *const reader,
+                              const char *const data, const size_t length)
+{
+    if (reader->n_fields == reader->fields_size)
+    {
+        reader->fields_size *= 2;
+        reader->fields = xrealloc(reader->fields,
+                                  reader->fields_size * sizeof(CsvField));
+    }
+    reader->fields[reader->n_fields].data = data;
+    reader->fields[reader->n_fields].length = length;
+    reader->n_fields++;
+}
+
+/**
+ * Split the record [p, end) into fields. Unquoted fields and quoted fields
+ * without escaped quotes point into the record, others are unescaped into
+ * the scratch buffer (which is big enough for the whole record).
+ */
+static bool CsvReaderSplitRecord(CsvReader *const reader,
+                                 const char *p, const char *const end)
+{
+    const char separator = reader->separator;
+    char *scratch = reader->scratch;
+
+    reader->n_fields = 0;
+    for (;;)
+    {
+        const char *q = p;
+        while (q < end && (*q == ' ' || *q == '\t'))
+        {
+            q++;
+        }
+
+        if (q < end && *q == '"')
+        {
+            /* Quoted field, "" stands for a literal quote */
+            const char *const start = q + 1;
+            const char *field = start;
+            size_t field_length = 0;
+            bool unescaped = false;
+            q = start;
+            for (;;)
+            {
+                const char *const quote = memchr(q, '"', end - q);
+                if (quote == NULL)
+                {
+                    return false;
+                }
+                if (quote + 1 < end && quote[1] == '"')
+                {
+                    if (!unescaped)
+                    {
+                        field = scratch;
+                        unescaped = true;
+                    }
+                    const size_t n = quote + 1 - q;
+                    memcpy(scratch, q, n);
+                    scratch += n;
+                    q = quote + 2;
+                }
+                else
+                {
+                    if (unescaped)
+                    {
+                        const size_t n = quote - q;
+                        memcpy(scratch, q, n);
+                        scratch += n;
+                        field_length = scratch - field;
+                    }
+                    else
+                    {
+                        field_length = quote - start;
+                    }
+                    q = quote + 1;
+                    break;
+                }
+            }
+            CsvReaderAddField(reader, field, field_length);
+
+            while (q < end && CSV_BLANK(*q))
+            {
+                q++;
+            }
+            if (q == end)
+            {
+                return true;
+            }
+            if (*q != separator)
+            {
+                return false;
+            }
+            p = q + 1;
+        }
+        else
+        {
+            const char *const sep = memchr(p, separator, end - p);
+            const char *const field_end = (sep != NULL) ? sep : end;
+            if (memchr(p, '"', field_end - p) != NULL)
+            {
+                return false;
+            }
+            CsvReaderAddField(reader, p, field_end - p);
+            if (sep == NULL)
+            {
+                return true;
+            }
+            p = sep + 1;
+        }
+    }
+}
+
+CsvReaderStatus CsvReaderNextRecord(CsvReader *const reader)
+{
+    assert(reader != NULL);
+
+    size_t record_length, content_length;
+    for (;;)
+    {
+        const size_t available = reader->length - reader->pos;
+        if (available == 0 && reader->eof)
+        {
+            reader->n_fields = 0;
+            return CSV_READER_EOF;
+        }
+
+        record_length = CsvRecordEnd(reader->data + reader->pos, available,
+                                     reader->line_ending, &content_length);
+        if (record_length != 0)
+        {
+            break;
+        }
+        if (reader->eof)
+        {
+            /* Last record, without a line ending */
+            record_length = available;
+            break;
+        }
+        if (!CsvReaderFill(reader))
+        {
+            reader->n_fields = 0;
+            return CSV_READER_IO_ERROR;
+        }
+    }
+
+    if (content_length > reader->scratch_size)
+    {
+        reader->scratch_size = MAX(content_length, 2 * reader->scratch_size);
+        free(reader->scratch);
+        reader->scratch = xmalloc(reader->scratch_size);
+    }
+
+    const char *const record = reader->data + reader->pos;
+    reader->pos += record_length;
+    reader->record_number++;
+
+    if (!CsvReaderSplitRecord(reader, record, record + content_length))
+    {
+        reader->n_fields = 0;
+        return CSV_READER_MALFORMED;
+    }
+    return CSV_READER_OK;
+}
+
+size_t CsvReaderFieldCount(const CsvReader *const reader)
+{
+    assert(reader != NULL);
+    return reader->n_fields;
+}
+
+const CsvField *CsvReaderFields(const CsvReader *const reader)
+{
+    assert(reader != NULL);
+    return reader->fields;
+}
+
+size_t CsvReaderRecordNumber(const CsvReader *const reader)
+{
+    assert(reader != NULL);
+    return reader->record_number;
+}
+
+size_t CsvReaderOffset(const CsvReader *const reader)
+{
+    assert(reader != NULL);
+    return reader->offset + reader->pos;
+}
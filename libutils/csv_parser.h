@@ -29,4 +29,71 @@
 
 Seq *SeqParseCsvString(const char *string);
 char *GetCsvLineNext(FILE *fp);
+
+/**
+ * Length of the CSV record at the start of #data, including its CRLF
+ * terminator. Line breaks inside quoted fields do not end the record, same
+ * as in GetCsvLineNext(). Returns 0 only if #length is 0.
+ */
+size_t GetCsvLineLength(const char *data, size_t length);
+
+/**
+ * Streaming CSV reader.
+ *
+ * Parses records straight out of a memory buffer (e.g. a FileMap()) or out of
+ * a large read buffer filled from a file descriptor. Fields are returned as
+ * slices of that buffer, only quoted fields containing escaped quotes ("")
+ * are unescaped into a scratch buffer owned by the reader.
+ *
+ * Quoting follows SeqParseCsvString(): blanks around a quoted field are
+ * dropped, blanks in unquoted fields are kept, a quote inside an unquoted
+ * field makes the record malformed.
+ */
+typedef struct CsvReader_ CsvReader;
+
+typedef struct
+{
+    const char *data;                    /* NOT '\0'-terminated */
+    size_t length;
+} CsvField;
+
+typedef enum
+{
+    CSV_LINE_ENDING_CRLF,   /* Only CRLF ends a record, like GetCsvLineNext() */
+    CSV_LINE_ENDING_LF,     /* LF ends a record, a preceding CR is dropped */
+} CsvLineEnding;
+
+typedef enum
+{
+    CSV_READER_OK,
+    CSV_READER_EOF,
+    CSV_READER_MALFORMED,   /* The record was skipped, reading can go on */
+    CSV_READER_IO_ERROR,
+} CsvReaderStatus;
+
+/**
+ * @param data Buffer to parse, needs to stay valid while the reader is used
+ */
+CsvReader *CsvReaderNew(const char *data, size_t length,
+                        char separator, CsvLineEnding line_ending);
+CsvReader *CsvReaderNewFromFd(int fd, char separator, CsvLineEnding line_ending);
+void CsvReaderDestroy(CsvReader *reader);
+
+/**
+ * Parse the next record. Its fields are available with CsvReaderFields()
+ * until the next call.
+ */
+CsvReaderStatus CsvReaderNextRecord(CsvReader *reader);
+size_t CsvReaderFieldCount(const CsvReader *reader);
+const CsvField *CsvReaderFields(const CsvReader *reader);
+
+/**
+ * @return Number of records read so far, including malformed ones
+ */
+size_t CsvReaderRecordNumber(const CsvReader *reader);
+
+/**
+ * @return Number of bytes consumed so far
+ */
+size_t CsvReaderOffset(const CsvReader *reader);
 #endif
@@ -0,0 +1,421 @@
+/*
+  Copyright 2023 Northern.tech AS
+
+  This file is part of CFEngine 3 - written and maintained by Northern.tech AS.
+
+  This program is free software; you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by the
+  Free Software Foundation; version 3.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA
+
+  To the extent this program is licensed as part of the Enterprise
+  versions of CFEngine, the applicable Commercial Open Source License
+  (COSL) may apply to this file if you as a licensee so wish it. See
+  included file COSL.txt.
+*/
+
+#include <dir_list.h>
+
+#include <alloc.h>
+#include <dir.h>
+#include <file_lib.h>
+
+#ifdef __linux__
+# include <sys/syscall.h>
+#endif
+
+#if defined(__linux__) && defined(SYS_getdents64)
+# define DIR_LIST_GETDENTS 1
+
+/* Enough for a couple of thousand entries per system call */
+# define DIR_LIST_BUFFER_SIZE (64 * 1024)
+
+struct linux_dirent64
+{
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+#endif
+
+#define DIR_LIST_STAT_FIELDS (DIR_LIST_MODE | DIR_LIST_OWNER | DIR_LIST_SIZE | \
+                              DIR_LIST_MTIME | DIR_LIST_INODE)
+
+typedef struct
+{
+    DirList *list;
+    size_t capacity;
+    size_t *name_offsets;        /* names may still move */
+    size_t names_len;
+    size_t names_size;
+    char *path;                  /* directory path and separator, for lstat() */
+    size_t path_len;
+    size_t path_size;
+} DirListBuilder;
+
+#ifdef HAVE_STATX
+/* For kernels older than statx() */
+static bool statx_missing = false; /* GLOBAL_X */
+#endif
+
+static mode_t ModeFromDirentType_(unsigned char d_type)
+{
+#ifdef DT_UNKNOWN
+    switch (d_type)
+    {
+    case DT_REG:
+        return S_IFREG;
+    case DT_DIR:
+        return S_IFDIR;
+    case DT_LNK:
+        return S_IFLNK;
+    case DT_FIFO:
+        return S_IFIFO;
+    case DT_SOCK:
+        return S_IFSOCK;
+    case DT_CHR:
+        return S_IFCHR;
+    case DT_BLK:
+        return S_IFBLK;
+    default:
+        return 0;
+    }
+#else
+    UNUSED(d_type);
+    return 0;
+#endif
+}
+
+static void FillFromStat_(DirListEntry *entry, const struct stat *sb)
+{
+    entry->mode = sb->st_mode;
+    entry->uid = sb->st_uid;
+    entry->gid = sb->st_gid;
+    entry->size = sb->st_size;
+    entry->mtime = sb->st_mtime;
+    entry->dev = sb->st_dev;
+    entry->ino = sb->st_ino;
+}
+
+#ifdef HAVE_STATX
+static unsigned int StatxMask_(unsigned fields)
+{
+    unsigned int mask = STATX_TYPE;
+    if (fields & DIR_LIST_MODE)
+    {
+        mask |= STATX_MODE;
+    }
+    if (fields & DIR_LIST_OWNER)
+    {
+        mask |= STATX_UID | STATX_GID;
+    }
+    if (fields & DIR_LIST_SIZE)
+    {
+        mask |= STATX_SIZE;
+    }
+    if (fields & DIR_LIST_MTIME)
+    {
+        mask |= STATX_MTIME;
+    }
+    if (fields & DIR_LIST_INODE)
+    {
+        mask |= STATX_INO;
+    }
+    return mask;
+}
+
+/**
+ * Fill in the fields the kernel returned, which may be fewer than asked for
+ * (e.g. on some network filesystems).
+ * @return the DIR_LIST_* fields filled in
+ */
+static unsigned FillFromStatx_(DirListEntry *entry, const struct statx *stx)
+{
+    const unsigned int mask = stx->stx_mask;
+    unsigned filled = 0;
+
+    if (mask & STATX_TYPE)
+    {
+        entry->mode = stx->stx_mode & S_IFMT;
+        filled |= DIR_LIST_TYPE;
+        if (mask & STATX_MODE)
+        {
+            entry->mode = stx->stx_mode;
+            filled |= DIR_LIST_MODE;
+        }
+    }
+    if ((mask & (STATX_UID | STATX_GID)) == (STATX_UID | STATX_GID))
+    {
+        entry->uid = stx->stx_uid;
+        entry->gid = stx->stx_gid;
+        filled |= DIR_LIST_OWNER;
+    }
+    if (mask & STATX_SIZE)
+    {
+        entry->size = stx->stx_size;
+        filled |= DIR_LIST_SIZE;
+    }
+    if (mask & STATX_MTIME)
+    {
+        entry->mtime = stx->stx_mtime.tv_sec;
+        filled |= DIR_LIST_MTIME;
+    }
+    if (mask & STATX_INO)
+    {
+        entry->dev = makedev(stx->stx_dev_major, stx->stx_dev_minor);
+        entry->ino = stx->stx_ino;
+        filled |= DIR_LIST_INODE;
+    }
+    return filled;
+}
+#endif
+
+/**
+ * Stat the entry, either through #dir_fd or through the builder's path.
+ * @return false if it no longer exists
+ */
+static bool StatEntry_(DirListBuilder *builder, int dir_fd, const char *name,
+                       DirListEntry *entry, unsigned fields)
+{
+    const unsigned known = entry->fields;
+    struct stat sb;
+    int ret;
+
+#ifdef HAVE_STATX
+    if (dir_fd >= 0 && !statx_missing)
+    {
+        struct statx stx;
+        ret = statx(dir_fd, name, AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT,
+                    StatxMask_(fields), &stx);
+        if (ret == 0)
+        {
+            entry->fields = known | FillFromStatx_(entry, &stx);
+            return true;
+        }
+        if (errno != ENOSYS)
+        {
+            goto failed;
+        }
+        statx_missing = true;
+    }
+#endif
+
+    if (dir_fd >= 0)
+    {
+        ret = fstatat(dir_fd, name, &sb, AT_SYMLINK_NOFOLLOW);
+    }
+    else
+    {
+        const size_t name_len = strlen(name);
+        if (builder->path_len + name_len + 1 > builder->path_size)
+        {
+            builder->path_size = builder->path_len + name_len + 256;
+            builder->path = xrealloc(builder->path, builder->path_size);
+        }
+        memcpy(builder->path + builder->path_len, name, name_len + 1);
+        ret = lstat(builder->path, &sb);
+    }
+    if (ret == 0)
+    {
+        FillFromStat_(entry, &sb);
+        entry->fields = fields;
+        return true;
+    }
+
+#ifdef HAVE_STATX
+failed:
+#endif
+    /* Keep what the listing told, unless it is gone */
+    entry->fields = known;
+    return (errno != ENOENT);
+}
+
+static void AddEntry_(DirListBuilder *builder, int dir_fd, const char *name,
+                      unsigned char d_type, unsigned fields)
+{
+    DirList *list = builder->list;
+
+    if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+    {
+        return;
+    }
+
+    if (list->count == builder->capacity)
+    {
+        builder->capacity *= 2;
+        list->entries = xrealloc(list->entries, builder->capacity * sizeof(DirListEntry));
+        builder->name_offsets = xrealloc(builder->name_offsets, builder->capacity * sizeof(size_t));
+    }
+
+    DirListEntry *entry = &list->entries[list->count];
+    memset(entry, 0, sizeof(DirListEntry));
+
+    entry->mode = ModeFromDirentType_(d_type);
+    if (entry->mode != 0)
+    {
+        entry->fields = DIR_LIST_TYPE;
+    }
+
+    /* Only stat if the listing did not tell enough */
+    const unsigned missing = fields & ~entry->fields;
+    if (missing != 0 && !StatEntry_(builder, dir_fd, name, entry, fields))
+    {
+        return;
+    }
+    entry->fields &= fields | DIR_LIST_TYPE;
+    if (!(fields & DIR_LIST_MODE))
+    {
+        entry->mode &= S_IFMT;
+    }
+
+    const size_t name_size = strlen(name) + 1;
+    if (builder->names_len + name_size > builder->names_size)
+    {
+        builder->names_size = MAX(2 * builder->names_size, builder->names_len + name_size);
+        list->names = xrealloc(list->names, builder->names_size);
+    }
+    memcpy(list->names + builder->names_len, name, name_size);
+    builder->name_offsets[list->count] = builder->names_len;
+    builder->names_len += name_size;
+
+    list->count++;
+}
+
+#ifdef DIR_LIST_GETDENTS
+static bool ReadEntries_(DirListBuilder *builder, const char *path, unsigned fields)
+{
+    const int fd = safe_open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    char *buffer = xmalloc(DIR_LIST_BUFFER_SIZE);
+    bool ok = true;
+    while (true)
+    {
+        const long n = syscall(SYS_getdents64, fd, buffer, DIR_LIST_BUFFER_SIZE);
+        if (n == 0)
+        {
+            break;
+        }
+        if (n < 0)
+        {
+            ok = false;
+            break;
+        }
+
+        for (long offset = 0; offset < n; )
+        {
+            const struct linux_dirent64 *de = (const struct linux_dirent64 *) (buffer + offset);
+            AddEntry_(builder, fd, de->d_name, de->d_type, fields);
+            offset += de->d_reclen;
+        }
+    }
+
+    const int read_errno = errno;
+    free(buffer);
+    close(fd);
+    errno = read_errno;
+    return ok;
+}
+#else
+static bool ReadEntries_(DirListBuilder *builder, const char *path, unsigned fields)
+{
+    Dir *dirh = DirOpen(path);
+    if (dirh == NULL)
+    {
+        return false;
+    }
+
+    while (true)
+    {
+        /* DirRead() only sets errno on failure */
+        errno = 0;
+        const struct dirent *de = DirRead(dirh);
+        if (de == NULL)
+        {
+            break;
+        }
+# ifdef HAVE_STRUCT_DIRENT_D_TYPE
+        AddEntry_(builder, -1, de->d_name, de->d_type, fields);
+# else
+        AddEntry_(builder, -1, de->d_name, 0, fields);
+# endif
+    }
+
+    const int read_errno = errno;
+    DirClose(dirh);
+    errno = read_errno;
+    return (read_errno == 0);
+}
+#endif
+
+DirList *DirListRead(const char *path, unsigned fields)
+{
+    assert(path != NULL);
+
+    if (fields & DIR_LIST_MODE)
+    {
+        fields |= DIR_LIST_TYPE;
+    }
+
+    DirList *list = xcalloc(1, sizeof(DirList));
+    DirListBuilder builder = {
+        .list = list,
+        .capacity = 64,
+        .names_size = 1024,
+    };
+    list->entries = xmalloc(builder.capacity * sizeof(DirListEntry));
+    builder.name_offsets = xmalloc(builder.capacity * sizeof(size_t));
+    list->names = xmalloc(builder.names_size);
+
+    builder.path_len = strlen(path);
+    builder.path_size = builder.path_len + 256;
+    builder.path = xmalloc(builder.path_size);
+    memcpy(builder.path, path, builder.path_len);
+    if (builder.path_len == 0 || !IsFileSep(path[builder.path_len - 1]))
+    {
+        builder.path[builder.path_len++] = FILE_SEPARATOR;
+    }
+
+    const bool ok = ReadEntries_(&builder, path, fields);
+    const int read_errno = errno;
+
+    free(builder.path);
+    if (!ok)
+    {
+        free(builder.name_offsets);
+        DirListDestroy(list);
+        errno = read_errno;
+        return NULL;
+    }
+
+    for (size_t i = 0; i < list->count; i++)
+    {
+        list->entries[i].name = list->names + builder.name_offsets[i];
+    }
+    free(builder.name_offsets);
+
+    return list;
+}
+
+void DirListDestroy(DirList *list)
+{
+    if (list != NULL)
+    {
+        free(list->entries);
+        free(list->names);
+        free(list);
+    }
+}
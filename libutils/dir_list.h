@@ -0,0 +1,83 @@
+/*
+  Copyright 2023 Northern.tech AS
+
+  This file is part of CFEngine 3 - written and maintained by Northern.tech AS.
+
+  This program is free software; you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by the
+  Free Software Foundation; version 3.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA
+
+  To the extent this program is licensed as part of the Enterprise
+  versions of CFEngine, the applicable Commercial Open Source License
+  (COSL) may apply to this file if you as a licensee so wish it. See
+  included file COSL.txt.
+*/
+
+#ifndef CFENGINE_DIR_LIST_H
+#define CFENGINE_DIR_LIST_H
+
+#include <platform.h>
+
+/**
+ * Listing a whole directory with the metadata of its entries at once.
+ *
+ * On Linux the entries are read with getdents64() into a large buffer and
+ * statx() is asked for only the requested fields, elsewhere readdir() and
+ * lstat() are used.
+ */
+
+typedef enum
+{
+    DIR_LIST_TYPE  = 1 << 0,     /* S_IFMT bits of mode */
+    DIR_LIST_MODE  = 1 << 1,     /* all of mode, implies DIR_LIST_TYPE */
+    DIR_LIST_OWNER = 1 << 2,     /* uid and gid */
+    DIR_LIST_SIZE  = 1 << 3,
+    DIR_LIST_MTIME = 1 << 4,
+    DIR_LIST_INODE = 1 << 5,     /* dev and ino */
+} DirListField;
+
+#define DIR_LIST_ALL (DIR_LIST_TYPE | DIR_LIST_MODE | DIR_LIST_OWNER | \
+                      DIR_LIST_SIZE | DIR_LIST_MTIME | DIR_LIST_INODE)
+
+typedef struct
+{
+    const char *name;
+    unsigned fields;             /* the DirListField's set below, as requested
+                                  * unless the entry could not be stat'ed or
+                                  * the filesystem did not return them all,
+                                  * the others are unspecified */
+    mode_t mode;
+    uid_t uid;
+    gid_t gid;
+    off_t size;
+    time_t mtime;
+    dev_t dev;
+    ino_t ino;
+} DirListEntry;
+
+typedef struct
+{
+    DirListEntry *entries;       /* in directory order, without "." and ".." */
+    size_t count;
+    char *names;                 /* storage of the entries' names */
+} DirList;
+
+/**
+ * @brief List the directory #path, with the DirListField's in #fields for
+ *        every entry. Symlinks are not followed. Entries disappearing while
+ *        the directory is listed are left out.
+ * @return NULL if the directory could not be read, with errno set
+ */
+DirList *DirListRead(const char *path, unsigned fields);
+void DirListDestroy(DirList *list);
+
+#endif
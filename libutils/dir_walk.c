@@ -0,0 +1,482 @@
+/*
+  Copyright 2023 Northern.tech AS
+
+  This file is part of CFEngine 3 - written and maintained by Northern.tech AS.
+
+  This program is free software; you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by the
+  Free Software Foundation; version 3.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA
+
+  To the extent this program is licensed as part of the Enterprise
+  versions of CFEngine, the applicable Commercial Open Source License
+  (COSL) may apply to this file if you as a licensee so wish it. See
+  included file COSL.txt.
+*/
+
+#include <dir_walk.h>
+
+#include <alloc.h>
+#include <dir.h>
+#include <file_lib.h>
+#include <logging.h>
+#include <stack.h>
+
+/* Directories are read through descriptors relative to their parent where
+ * the platform allows it, through their path otherwise. */
+#if defined(HAVE_FDOPENDIR) && !defined(__MINGW32__)
+# define DIR_WALK_AT 1
+#endif
+
+#ifndef O_DIRECTORY
+# define O_DIRECTORY 0
+#endif
+#ifndef O_NOFOLLOW
+# define O_NOFOLLOW 0
+#endif
+#ifndef O_CLOEXEC
+# define O_CLOEXEC 0
+#endif
+
+typedef struct DirWalkDir_ DirWalkDir;
+
+struct DirWalkDir_
+{
+    DirWalkDir *parent;
+    char *path;
+    size_t name_offset;
+    size_t depth;
+    int fd;                      /* from reading it until it is done */
+    bool read;                   /* the contents could be read */
+    size_t pending;              /* itself until read, and its subdirectories
+                                  * until done, under the state's lock */
+    struct stat sb;              /* with DirWalkOptions.stat */
+};
+
+typedef struct
+{
+    const DirWalkOptions *options;
+    const char *root;
+
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    Stack *todo;                 /* last in first out keeps the walk depth
+                                  * first, so few directories are open */
+    size_t busy;                 /* threads reading a directory */
+    size_t idle;                 /* threads waiting for one */
+    pthread_t *workers;
+    size_t started;
+    bool stop;
+    bool failed;
+} DirWalkState;
+
+static void SetFailed_(DirWalkState *state, bool stop)
+{
+    pthread_mutex_lock(&state->lock);
+    state->failed = true;
+    state->stop = state->stop || stop;
+    pthread_mutex_unlock(&state->lock);
+}
+
+static DirWalkDir *DirWalkDirNew_(DirWalkDir *parent, const char *path, size_t name_offset,
+                                  const struct stat *sb)
+{
+    DirWalkDir *dir = xcalloc(1, sizeof(DirWalkDir));
+    dir->parent = parent;
+    dir->path = xstrdup(path);
+    dir->name_offset = name_offset;
+    dir->depth = (parent != NULL) ? parent->depth + 1 : 0;
+    dir->fd = -1;
+    dir->pending = 1;
+    if (sb != NULL)
+    {
+        dir->sb = *sb;
+    }
+    return dir;
+}
+
+/**
+ * Drop one of the things #dir waits for. Once there is nothing left, #dir is
+ * visited after its contents and the same happens to its parent.
+ */
+static void DirDone_(DirWalkState *state, DirWalkDir *dir)
+{
+    const DirWalkOptions *options = state->options;
+
+    while (dir != NULL)
+    {
+        pthread_mutex_lock(&state->lock);
+        const bool done = (--dir->pending == 0);
+        const bool stop = state->stop;
+        pthread_mutex_unlock(&state->lock);
+        if (!done)
+        {
+            return;
+        }
+
+        if (dir->fd >= 0)
+        {
+            close(dir->fd);
+        }
+
+        DirWalkDir *parent = dir->parent;
+        if (parent != NULL && dir->read && !stop && options->post != NULL)
+        {
+            const DirWalkEntry entry = {
+                .path = dir->path,
+                .name = dir->path + dir->name_offset,
+                .dir_fd = parent->fd,
+                .depth = dir->depth,
+                .type = DIR_WALK_TYPE_DIR,
+                .sb = options->stat ? &dir->sb : NULL,
+            };
+            const DirWalkAction action = options->post(&entry, options->data);
+            if (action == DIR_WALK_FAILED || action == DIR_WALK_STOP)
+            {
+                SetFailed_(state, action == DIR_WALK_STOP);
+            }
+        }
+
+        free(dir->path);
+        free(dir);
+        dir = parent;
+    }
+}
+
+static void *Worker_(void *arg);
+
+/* Called with the state's lock held */
+static void Push_(DirWalkState *state, DirWalkDir *dir)
+{
+    dir->parent->pending++;
+    StackPush(state->todo, dir);
+
+    if (state->idle > 0)
+    {
+        pthread_cond_signal(&state->cond);
+    }
+    else if (state->started + 1 < state->options->threads)
+    {
+        /* Threads are only started once there is work for them */
+        if (pthread_create(&state->workers[state->started], NULL, Worker_, state) == 0)
+        {
+            state->started++;
+        }
+    }
+}
+
+static DirWalkType TypeFromMode_(mode_t mode)
+{
+    if (S_ISREG(mode))
+    {
+        return DIR_WALK_TYPE_FILE;
+    }
+    if (S_ISDIR(mode))
+    {
+        return DIR_WALK_TYPE_DIR;
+    }
+    if (S_ISLNK(mode))
+    {
+        return DIR_WALK_TYPE_SYMLINK;
+    }
+    return DIR_WALK_TYPE_OTHER;
+}
+
+/* Type of #de without a stat() call, if the file system reports it */
+static bool TypeFromDirent_(const struct dirent *de, DirWalkType *type)
+{
+#ifdef HAVE_STRUCT_DIRENT_D_TYPE
+    switch (de->d_type)
+    {
+    case DT_REG:
+        *type = DIR_WALK_TYPE_FILE;
+        return true;
+    case DT_DIR:
+        *type = DIR_WALK_TYPE_DIR;
+        return true;
+    case DT_LNK:
+        *type = DIR_WALK_TYPE_SYMLINK;
+        return true;
+    case DT_UNKNOWN:
+        return false;
+    default:
+        *type = DIR_WALK_TYPE_OTHER;
+        return true;
+    }
+#else
+    UNUSED(de);
+    UNUSED(type);
+    return false;
+#endif
+}
+
+#ifdef DIR_WALK_AT
+typedef DIR DirWalkHandle;
+#else
+typedef Dir DirWalkHandle;
+#endif
+
+static DirWalkHandle *OpenDir_(DirWalkDir *dir)
+{
+#ifdef DIR_WALK_AT
+    if (dir->parent != NULL)
+    {
+        dir->fd = openat(dir->parent->fd, dir->path + dir->name_offset,
+                         O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    }
+    else
+    {
+        dir->fd = safe_open(dir->path, O_RDONLY);
+    }
+    if (dir->fd < 0)
+    {
+        return NULL;
+    }
+
+    /* The descriptor is kept for the *at() functions, the stream gets its own */
+    const int dup_fd = dup(dir->fd);
+    DIR *dirh = (dup_fd >= 0) ? fdopendir(dup_fd) : NULL;
+    if (dirh == NULL && dup_fd >= 0)
+    {
+        const int fdopendir_errno = errno;
+        close(dup_fd);
+        errno = fdopendir_errno;
+    }
+    return dirh;
+#else
+    return DirOpen(dir->path);
+#endif
+}
+
+static const struct dirent *ReadEntry_(DirWalkHandle *dirh)
+{
+    errno = 0;
+#ifdef DIR_WALK_AT
+    return readdir(dirh);
+#else
+    return DirRead(dirh);
+#endif
+}
+
+static void CloseDir_(DirWalkHandle *dirh)
+{
+#ifdef DIR_WALK_AT
+    closedir(dirh);
+#else
+    DirClose(dirh);
+#endif
+}
+
+static void ReadDir_(DirWalkState *state, DirWalkDir *dir, DirWalkHandle *dirh)
+{
+    const DirWalkOptions *options = state->options;
+    dir->read = true;
+
+    size_t path_len = strlen(dir->path);
+    const bool add_separator = (path_len > 0 && !IsFileSep(dir->path[path_len - 1]));
+    size_t path_size = path_len + 256;
+    char *path = xmalloc(path_size);
+    memcpy(path, dir->path, path_len);
+    if (add_separator)
+    {
+        path[path_len++] = FILE_SEPARATOR;
+    }
+
+    const struct dirent *de;
+    while ((de = ReadEntry_(dirh)) != NULL)
+    {
+        const char *name = de->d_name;
+        if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+        {
+            continue;
+        }
+
+        const size_t name_len = strlen(name);
+        if (path_len + name_len + 1 > path_size)
+        {
+            path_size = path_len + name_len + 256;
+            path = xrealloc(path, path_size);
+        }
+        memcpy(path + path_len, name, name_len + 1);
+
+        DirWalkType type;
+        struct stat sb;
+        if (options->stat || !TypeFromDirent_(de, &type))
+        {
+#ifdef DIR_WALK_AT
+            const int ret = fstatat(dir->fd, name, &sb, AT_SYMLINK_NOFOLLOW);
+#else
+            const int ret = lstat(path, &sb);
+#endif
+            if (ret == -1)
+            {
+                if (errno != ENOENT)
+                {
+                    Log(LOG_LEVEL_VERBOSE, "Unable to stat '%s' while walking '%s' (lstat: %s)",
+                        path, state->root, GetErrorStr());
+                    SetFailed_(state, false);
+                }
+                continue;
+            }
+            type = TypeFromMode_(sb.st_mode);
+        }
+
+        DirWalkAction action = DIR_WALK_CONTINUE;
+        if (options->pre != NULL)
+        {
+            const DirWalkEntry entry = {
+                .path = path,
+                .name = path + path_len,
+                .dir_fd = dir->fd,
+                .depth = dir->depth + 1,
+                .type = type,
+                .sb = options->stat ? &sb : NULL,
+            };
+            action = options->pre(&entry, options->data);
+        }
+
+        if (action == DIR_WALK_STOP)
+        {
+            SetFailed_(state, true);
+            break;
+        }
+        if (action == DIR_WALK_FAILED)
+        {
+            SetFailed_(state, false);
+        }
+
+        if (type == DIR_WALK_TYPE_DIR && action != DIR_WALK_SKIP &&
+            (options->max_depth == 0 || dir->depth + 1 < options->max_depth))
+        {
+            DirWalkDir *subdir = DirWalkDirNew_(dir, path, path_len,
+                                                options->stat ? &sb : NULL);
+            pthread_mutex_lock(&state->lock);
+            Push_(state, subdir);
+            pthread_mutex_unlock(&state->lock);
+        }
+    }
+
+    if (de == NULL && errno != 0)
+    {
+        Log(LOG_LEVEL_VERBOSE, "Unable to read directory '%s' while walking '%s' (readdir: %s)",
+            dir->path, state->root, GetErrorStr());
+        SetFailed_(state, false);
+    }
+
+    free(path);
+    CloseDir_(dirh);
+    DirDone_(state, dir);
+}
+
+static void *Worker_(void *arg)
+{
+    DirWalkState *state = arg;
+
+    pthread_mutex_lock(&state->lock);
+    while (true)
+    {
+        while (StackIsEmpty(state->todo) && state->busy > 0)
+        {
+            state->idle++;
+            pthread_cond_wait(&state->cond, &state->lock);
+            state->idle--;
+        }
+        if (StackIsEmpty(state->todo))
+        {
+            /* Nothing left to do, nor to wait for */
+            pthread_cond_broadcast(&state->cond);
+            break;
+        }
+
+        DirWalkDir *dir = StackPop(state->todo);
+        const bool stop = state->stop;
+        state->busy++;
+        pthread_mutex_unlock(&state->lock);
+
+        DirWalkHandle *dirh = stop ? NULL : OpenDir_(dir);
+        if (dirh != NULL)
+        {
+            ReadDir_(state, dir, dirh);
+        }
+        else
+        {
+            if (!stop && errno != ENOENT)
+            {
+                Log(LOG_LEVEL_VERBOSE, "Unable to open directory '%s' while walking '%s' (opendir: %s)",
+                    dir->path, state->root, GetErrorStr());
+                SetFailed_(state, false);
+            }
+            /* Not visited after its contents, when there are none */
+            DirDone_(state, dir);
+        }
+
+        pthread_mutex_lock(&state->lock);
+        state->busy--;
+    }
+    pthread_mutex_unlock(&state->lock);
+
+    return NULL;
+}
+
+bool DirWalk(const char *root, const DirWalkOptions *options)
+{
+    assert(root != NULL);
+    assert(options != NULL);
+
+    DirWalkDir *top = DirWalkDirNew_(NULL, root, 0, NULL);
+    DirWalkHandle *dirh = OpenDir_(top);
+    if (dirh == NULL)
+    {
+        const int open_errno = errno;
+        if (top->fd >= 0)
+        {
+            close(top->fd);
+        }
+        free(top->path);
+        free(top);
+        errno = open_errno;
+        return false;
+    }
+
+    DirWalkState state = {
+        .options = options,
+        .root = root,
+        .todo = StackNew(64, NULL),
+        .busy = 1,               /* this thread, reading the root */
+        .workers = xcalloc(MAX(options->threads, 1), sizeof(pthread_t)),
+    };
+    pthread_mutex_init(&state.lock, NULL);
+    pthread_cond_init(&state.cond, NULL);
+
+    ReadDir_(&state, top, dirh);
+
+    pthread_mutex_lock(&state.lock);
+    state.busy--;
+    pthread_mutex_unlock(&state.lock);
+    Worker_(&state);
+
+    for (size_t i = 0; i < state.started; i++)
+    {
+        pthread_join(state.workers[i], NULL);
+    }
+
+    pthread_cond_destroy(&state.cond);
+    pthread_mutex_destroy(&state.lock);
+    StackDestroy(state.todo);
+    free(state.workers);
+
+    if (state.failed)
+    {
+        errno = 0;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,96 @@
+/*
+  Copyright 2023 Northern.tech AS
+
+  This file is part of CFEngine 3 - written and maintained by Northern.tech AS.
+
+  This program is free software; you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by the
+  Free Software Foundation; version 3.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA
+
+  To the extent this program is licensed as part of the Enterprise
+  versions of CFEngine, the applicable Commercial Open Source License
+  (COSL) may apply to this file if you as a licensee so wish it. See
+  included file COSL.txt.
+*/
+
+#ifndef CFENGINE_DIR_WALK_H
+#define CFENGINE_DIR_WALK_H
+
+#include <platform.h>
+
+/**
+ * Walking directory trees.
+ *
+ * Directories are opened relative to the descriptor of their parent and
+ * entries are only stat'ed when the type reported by readdir() is not
+ * enough, so each entry costs no path resolution at all. Subdirectories can
+ * be handed out to a pool of threads.
+ */
+
+typedef enum
+{
+    DIR_WALK_TYPE_FILE,
+    DIR_WALK_TYPE_DIR,
+    DIR_WALK_TYPE_SYMLINK,
+    DIR_WALK_TYPE_OTHER,         /* devices, FIFOs, sockets */
+} DirWalkType;
+
+typedef enum
+{
+    DIR_WALK_CONTINUE,
+    DIR_WALK_SKIP,               /* do not descend into this directory */
+    DIR_WALK_FAILED,             /* go on, but make DirWalk() return false */
+    DIR_WALK_STOP,               /* end the walk, DirWalk() returns false */
+} DirWalkAction;
+
+typedef struct
+{
+    const char *path;            /* root path joined with the entry's name */
+    const char *name;
+    int dir_fd;                  /* of the containing directory, for the *at()
+                                  * functions, -1 where they are not used */
+    size_t depth;                /* 1 for the entries of the root */
+    DirWalkType type;
+    const struct stat *sb;       /* lstat() of the entry, only with
+                                  * DirWalkOptions.stat */
+} DirWalkEntry;
+
+/* The entry is only valid during the call */
+typedef DirWalkAction DirWalkFn(const DirWalkEntry *entry, void *data);
+
+typedef struct
+{
+    DirWalkFn *pre;              /* every entry, directories before their contents */
+    DirWalkFn *post;             /* directories after their contents */
+    void *data;
+
+    size_t max_depth;            /* 0 for no limit, 1 for only the root's entries */
+    size_t threads;              /* 0 or 1 to only walk in the calling thread */
+    bool stat;                   /* always lstat() the entries */
+} DirWalkOptions;
+
+/**
+ * @brief Walk the tree below #root, which is not visited itself. Symlinks
+ *        are not followed. Entries disappearing during the walk are ignored,
+ *        other errors are logged and make the walk fail.
+ *
+ * With more than one thread, the callbacks are called from several threads
+ * at once, though never for entries of the same directory. Directories are
+ * only visited after their contents if they were descended into and could
+ * be read, which with max_depth is not the case for those at max_depth.
+ *
+ * @return false if #root could not be opened, with errno set, or if an error
+ *         occurred, a callback failed or the walk was stopped, with errno 0.
+ */
+bool DirWalk(const char *root, const DirWalkOptions *options);
+
+#endif
@@ -25,7 +25,9 @@
 #include <platform.h>
 #include <file_lib.h>
 #include <misc_lib.h>
+#include <async_io.h>
 #include <dir.h>
+#include <dir_walk.h>
 #include <logging.h>
 
 #include <alloc.h>
@@ -41,8 +43,31 @@
 #include <windows.h>            /* LockFileEx and friends */
 #endif
 
+#ifdef HAVE_SYS_SENDFILE_H
+#include <sys/sendfile.h>
+#endif
+
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+# define FILE_MAP_SUPPORTED 1
+# if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+#  define MAP_ANONYMOUS MAP_ANON
+# endif
+#endif
+
 #define SYMLINK_MAX_DEPTH 32
 
+/* Size of the read()/write() buffer used when the kernel cannot copy files
+ * for us. Allocated page-aligned, to be friendly with O_DIRECT and DMA. */
+#define FILE_COPY_BUFSIZE (1024 * 1024)
+#define FILE_COPY_BUF_ALIGN 4096
+
+/* Largest chunk handed to copy_file_range()/sendfile() in one call. */
+#define FILE_COPY_KERNEL_CHUNK (64 * 1024 * 1024)
+
 bool FileCanOpen(const char *path, const char *modes)
 {
     FILE *test = NULL;
@@ -73,6 +98,41 @@ Writer *FileRead(const char *filename, size_t max_size, bool *truncated)
     return w;
 }
 
+static void FileReadBatchDone(AsyncIOResult *result, void *data)
+{
+    FileReadResult *file = data;
+    file->truncated = result->truncated;
+    if (result->data != NULL)
+    {
+        file->contents = StringWriterFromData(result->data, result->length, result->allocated);
+        result->data = NULL;
+    }
+}
+
+size_t FileReadBatch(const char *const *filenames, size_t n_files, size_t max_size,
+                     FileReadResult *results)
+{
+    assert(filenames != NULL || n_files == 0);
+    assert(results != NULL || n_files == 0);
+
+    AsyncIO *aio = AsyncIONew(ASYNC_IO_BACKEND_DEFAULT);
+    for (size_t i = 0; i < n_files; i++)
+    {
+        results[i].contents = NULL;
+        results[i].truncated = false;
+        AsyncIOReadFile(aio, filenames[i], max_size, FileReadBatchDone, &results[i]);
+    }
+    AsyncIOWait(aio);
+    AsyncIODestroy(aio);
+
+    size_t n_read = 0;
+    for (size_t i = 0; i < n_files; i++)
+    {
+        n_read += (results[i].contents != NULL) ? 1 : 0;
+    }
+    return n_read;
+}
+
 ssize_t ReadFileStreamToBuffer(FILE *file, size_t max_bytes, char *buf)
 {
     size_t bytes_read = 0;
@@ -97,63 +157,222 @@ ssize_t ReadFileStreamToBuffer(FILE *file, size_t max_bytes, char *buf)
     return bytes_read;
 }
 
-bool File_Copy(const char *src, const char *dst)
+static void *FileCopyBufferNew(size_t size)
 {
-    assert(src != NULL);
-    assert(dst != NULL);
+#ifdef HAVE_POSIX_MEMALIGN
+    void *buf;
+    if (posix_memalign(&buf, FILE_COPY_BUF_ALIGN, size) == 0)
+    {
+        return buf;
+    }
+#endif
+    return xmalloc(size);
+}
 
-    Log(LOG_LEVEL_INFO, "Copying: '%s' -> '%s'", src, dst);
+/**
+ * Whether the kernel copying nothing means EOF. Only once some data was copied
+ * and the length is not known: pseudo-files (procfs, sysfs) report size 0
+ * and the kernel may copy nothing from them although read() returns data, and
+ * a file shorter than expected is left to FileCopyBuffered() to find.
+ */
+static bool FileCopyKernelAtEOF(size_t copied, size_t len)
+{
+    return (copied > 0 && len == SIZE_MAX);
+}
 
-    FILE *in = safe_fopen(src, "r");
-    if (in == NULL)
+/**
+ * Copy up to #len bytes from the current offset of #sd to the current offset
+ * of #dd without going through userspace (copy_file_range(), then
+ * sendfile()). Both offsets are advanced by the amount copied.
+ *
+ * @param copied Set to the number of bytes copied, even on failure.
+ * @return true if #len bytes were copied or EOF was reached, false if the
+ *         kernel could not copy (all of) the data. The caller should then
+ *         fall back to FileCopyBuffered() for the rest, genuine IO errors are
+ *         reported there.
+ */
+static bool FileCopyKernel(int sd, int dd, size_t len, size_t *copied)
+{
+    *copied = 0;
+
+#ifdef HAVE_COPY_FILE_RANGE
+    while (*copied < len)
     {
-        Log(LOG_LEVEL_ERR, "Could not open '%s' (%s)", src, strerror(errno));
-        return false;
+        ssize_t ret = copy_file_range(sd, NULL, dd, NULL,
+                                      MIN(len - *copied, FILE_COPY_KERNEL_CHUNK), 0);
+        if (ret < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            /* ENOSYS, EXDEV (old kernels), EINVAL, EOPNOTSUPP... */
+            break;
+        }
+        else if (ret == 0)
+        {
+            return FileCopyKernelAtEOF(*copied, len);
+        }
+        *copied += ret;
+    }
+    if (*copied == len)
+    {
+        return true;
     }
+#endif
 
-    FILE *out = safe_fopen_create_perms(dst, "w", CF_PERMS_DEFAULT);
-    if (out == NULL)
+#if defined(HAVE_SENDFILE) && defined(HAVE_SYS_SENDFILE_H) && defined(__linux__)
+    while (*copied < len)
     {
-        Log(LOG_LEVEL_ERR, "Could not open '%s' (%s)", dst, strerror(errno));
-        fclose(in);
-        return false;
+        ssize_t ret = sendfile(dd, sd, NULL,
+                               MIN(len - *copied, FILE_COPY_KERNEL_CHUNK));
+        if (ret < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return false;
+        }
+        else if (ret == 0)
+        {
+            return FileCopyKernelAtEOF(*copied, len);
+        }
+        *copied += ret;
     }
+    return true;
+#else
+    (void) sd;
+    (void) dd;
+    return (*copied == len);
+#endif
+}
+
+/**
+ * Copy up to #len bytes (SIZE_MAX for "until EOF") with read()/write() through
+ * #buf. If #blk_size is not 0, blocks of #blk_size bytes containing only
+ * zeroes are skipped with lseek() on #dd (see FileSparseWrite()).
+ *
+ * @param copied Set to the number of bytes copied (or skipped), even on failure.
+ * @param last_write_was_a_hole Set if the last block was skipped, may be NULL
+ *                              if #blk_size is 0.
+ */
+static bool FileCopyBuffered(int sd, const char *src_name,
+                             int dd, const char *dst_name,
+                             size_t len, void *buf, size_t buf_size,
+                             size_t blk_size, size_t *copied,
+                             bool *last_write_was_a_hole)
+{
+    *copied = 0;
 
-    size_t bytes_in = 0;
-    size_t bytes_out = 0;
-    bool ret = true;
-    do
+    while (*copied < len)
     {
-#define BUFSIZE 1024
-        char buf[BUFSIZE] = {0};
+        ssize_t n_read = FullRead(sd, buf, MIN(buf_size, len - *copied));
+        if (n_read < 0)
+        {
+            Log(LOG_LEVEL_ERR,
+                "Unable to read source file while copying '%s' to '%s'"
+                " (read: %s)", src_name, dst_name, GetErrorStr());
+            return false;
+        }
+        else if (n_read == 0)                                   /* EOF */
+        {
+            return true;
+        }
 
-        bytes_in = fread(buf, sizeof(char), sizeof(buf), in);
-        bytes_out = fwrite(buf, sizeof(char), bytes_in, out);
-        while (bytes_out < bytes_in && !ferror(out))
+        if (blk_size == 0)
         {
-            bytes_out += fwrite(
-                buf + bytes_out, sizeof(char), bytes_in - bytes_out, out);
+            if (FullWrite(dd, buf, n_read) < 0)
+            {
+                Log(LOG_LEVEL_ERR,
+                    "Unable to write destination file while copying '%s' to '%s'"
+                    " (write: %s)", src_name, dst_name, GetErrorStr());
+                return false;
+            }
         }
-    } while (!feof(in) && !ferror(in) && !ferror(out) &&
-             bytes_in == bytes_out);
+        else
+        {
+            for (size_t off = 0; off < (size_t) n_read; off += blk_size)
+            {
+                if (!FileSparseWrite(dd, (char *) buf + off,
+                                     MIN(blk_size, n_read - off),
+                                     last_write_was_a_hole))
+                {
+                    Log(LOG_LEVEL_ERR, "Failed to copy '%s' to '%s'",
+                        src_name, dst_name);
+                    return false;
+                }
+            }
+        }
+
+        *copied += n_read;
+    }
+
+    return true;
+}
 
-    if (ferror(in))
+/**
+ * Copy up to #len bytes (SIZE_MAX for "until EOF") from the current offset of
+ * #sd, in the kernel if possible. See FileCopyBuffered() for the parameters.
+ */
+static bool FileCopyData(int sd, const char *src_name,
+                         int dd, const char *dst_name,
+                         size_t len, size_t blk_size, size_t *copied,
+                         bool *last_write_was_a_hole)
+{
+    size_t kernel_copied = 0;
+    bool done = FileCopyKernel(sd, dd, len, &kernel_copied);
+    *copied = kernel_copied;
+    if (done)
     {
-        Log(LOG_LEVEL_ERR, "Error encountered while reading '%s'", src);
-        ret = false;
+        return true;
+    }
+
+    const size_t buf_size = (blk_size == 0) ? FILE_COPY_BUFSIZE :
+        MAX(blk_size, FILE_COPY_BUFSIZE / blk_size * blk_size);
+    void *buf = FileCopyBufferNew(buf_size);
+    size_t buffered_copied = 0;
+    bool ret = FileCopyBuffered(sd, src_name, dd, dst_name,
+                                (len == SIZE_MAX) ? SIZE_MAX : len - kernel_copied,
+                                buf, buf_size, blk_size,
+                                &buffered_copied, last_write_was_a_hole);
+    free(buf);
+
+    *copied += buffered_copied;
+    return ret;
+}
+
+bool File_Copy(const char *src, const char *dst)
+{
+    assert(src != NULL);
+    assert(dst != NULL);
+
+    Log(LOG_LEVEL_INFO, "Copying: '%s' -> '%s'", src, dst);
+
+    int in = safe_open(src, O_RDONLY);
+    if (in < 0)
+    {
+        Log(LOG_LEVEL_ERR, "Could not open '%s' (%s)", src, strerror(errno));
+        return false;
     }
-    else if (ferror(out))
+
+    int out = safe_open_create_perms(dst, O_WRONLY | O_CREAT | O_TRUNC,
+                                     CF_PERMS_DEFAULT);
+    if (out < 0)
     {
-        Log(LOG_LEVEL_ERR, "Error encountered while writing '%s'", dst);
-        ret = false;
+        Log(LOG_LEVEL_ERR, "Could not open '%s' (%s)", dst, strerror(errno));
+        close(in);
+        return false;
     }
-    else if (bytes_in != bytes_out)
+
+    size_t copied;
+    bool ret = FileCopyData(in, src, out, dst, SIZE_MAX, 0, &copied, NULL);
+    if (!ret)
     {
         Log(LOG_LEVEL_ERR, "Did not copy the whole file");
-        ret = false;
     }
 
-    const int i = fclose(in);
+    const int i = close(in);
     if (i != 0)
     {
         Log(LOG_LEVEL_ERR,
@@ -162,7 +381,7 @@ bool File_Copy(const char *src, const char *dst)
             strerror(errno));
         ret = false;
     }
-    const int o = fclose(out);
+    const int o = close(out);
     if (o != 0)
     {
         Log(LOG_LEVEL_ERR,
@@ -250,6 +469,228 @@ Writer *FileReadFromFd(int fd, size_t max_size, bool *truncated)
     }
 }
 
+struct FileMapping_
+{
+    const char *data;
+    size_t length;
+    void *map_base;       /* NULL if the contents were read instead */
+    size_t map_size;
+    char *contents;       /* fallback copy for non-mappable files */
+};
+
+/**
+ * Read up to #max_size bytes of #fd into memory, followed by a '\0'. Unlike
+ * FileReadFromFd() this keeps '\0' bytes in the data, which may be binary.
+ */
+static bool FileMapRead(int fd, size_t max_size, bool *truncated, FileMapping *map)
+{
+    /* One byte beyond max_size is read to detect truncation */
+    const size_t limit = (max_size < SIZE_MAX) ? max_size + 1 : SIZE_MAX;
+
+    size_t allocated = READ_BUFSIZE;
+    size_t length = 0;
+    char *data = xmalloc(allocated);
+    while (length < limit)
+    {
+        if (allocated - length < 2)
+        {
+            allocated *= 2;
+            data = xrealloc(data, allocated);
+        }
+
+        const ssize_t read_ = read(fd, data + length,
+                                   MIN(allocated - length - 1, limit - length));
+        if (read_ == 0)
+        {
+            break;
+        }
+        else if (read_ < 0)
+        {
+            if (errno != EINTR)
+            {
+                free(data);
+                return false;
+            }
+        }
+        else
+        {
+            length += read_;
+        }
+    }
+
+    if (length > max_size)
+    {
+        length = max_size;
+        if (truncated != NULL)
+        {
+            *truncated = true;
+        }
+    }
+    data[length] = '\0';
+
+    map->contents = data;
+    map->data = data;
+    map->length = length;
+    return true;
+}
+
+#ifdef FILE_MAP_SUPPORTED
+/* Files modified less than this many seconds ago may still be being written,
+ * they are read instead of mapped. */
+#define FILE_MAP_MIN_AGE 2
+
+/**
+ * Whether the file open as #fd may well be rewritten while it is mapped:
+ * another process holds a write lock on it, or it was only just modified.
+ * Truncating a mapped file makes the pages past its new end raise SIGBUS,
+ * whereas a copy read into memory stays valid.
+ */
+static bool FileMayChange(int fd, const struct stat *sb)
+{
+    struct flock lock_spec = {
+        .l_type = F_RDLCK,
+        .l_whence = SEEK_SET,
+        .l_start = 0, /* start of the region to which the lock applies */
+        .l_len = 0    /* till EOF */
+    };
+    if (fcntl(fd, F_GETLK, &lock_spec) == -1 || lock_spec.l_type != F_UNLCK)
+    {
+        return true;
+    }
+
+    return (sb->st_mtime > time(NULL) - FILE_MAP_MIN_AGE);
+}
+
+/**
+ * Map the first #length bytes of #fd read-only. The mapping is placed at the
+ * start of a zero-filled anonymous reservation at least one byte larger, so
+ * the data is always followed by '\0' and can be handed to string parsers.
+ */
+static bool FileMapRegion(int fd, size_t length, FileMapping *map)
+{
+    assert(length > 0);
+
+    long page_size = sysconf(_SC_PAGESIZE);
+    if (page_size <= 0)
+    {
+        page_size = 4096;
+    }
+    const size_t map_size =
+        ((length / page_size) + 1) * (size_t) page_size;
+
+    void *base = mmap(NULL, map_size, PROT_READ,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED)
+    {
+        return false;
+    }
+
+    if (mmap(base, length, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0)
+        == MAP_FAILED)
+    {
+        munmap(base, map_size);
+        return false;
+    }
+
+#ifdef HAVE_MADVISE
+    /* Parsers walk the data front to back; ask for aggressive read-ahead. */
+    madvise(base, length, MADV_SEQUENTIAL);
+#endif
+
+    map->data = base;
+    map->length = length;
+    map->map_base = base;
+    map->map_size = map_size;
+    return true;
+}
+#endif /* FILE_MAP_SUPPORTED */
+
+FileMapping *FileMapFd(int fd, size_t max_size, bool *truncated)
+{
+    if (truncated != NULL)
+    {
+        *truncated = false;
+    }
+
+    FileMapping *map = xcalloc(1, sizeof(FileMapping));
+
+#ifdef FILE_MAP_SUPPORTED
+    /* Only regular files with a known size can be mapped; pipes, devices and
+     * pseudo-files (e.g. in /proc, which report a size of 0) are read.
+     * Files exceeding max_size are read as well, the bytes following the
+     * truncation point would otherwise be visible instead of the '\0'. So
+     * are files which look like they are being written. */
+    struct stat sb;
+    if (fstat(fd, &sb) == 0 && S_ISREG(sb.st_mode) && sb.st_size > 0 &&
+        (uintmax_t) sb.st_size <= max_size && !FileMayChange(fd, &sb))
+    {
+        if (FileMapRegion(fd, sb.st_size, map))
+        {
+            return map;
+        }
+
+        Log(LOG_LEVEL_DEBUG, "Failed to map file descriptor %d (mmap: %s), "
+            "reading it instead", fd, GetErrorStr());
+    }
+#endif
+
+    if (!FileMapRead(fd, max_size, truncated, map))
+    {
+        free(map);
+        return NULL;
+    }
+    return map;
+}
+
+FileMapping *FileMap(const char *filename, size_t max_size, bool *truncated)
+{
+    int fd = safe_open(filename, O_RDONLY);
+    if (fd == -1)
+    {
+        return NULL;
+    }
+
+    /* The mapping stays valid after the descriptor is closed. */
+    FileMapping *map = FileMapFd(fd, max_size, truncated);
+    close(fd);
+    return map;
+}
+
+const char *FileMappingData(const FileMapping *map)
+{
+    assert(map != NULL);
+    return map->data;
+}
+
+size_t FileMappingLength(const FileMapping *map)
+{
+    assert(map != NULL);
+    return map->length;
+}
+
+bool FileMappingIsMapped(const FileMapping *map)
+{
+    assert(map != NULL);
+    return (map->map_base != NULL);
+}
+
+void FileUnmap(FileMapping *map)
+{
+    if (map == NULL)
+    {
+        return;
+    }
+
+#ifdef FILE_MAP_SUPPORTED
+    if (map->map_base != NULL)
+    {
+        munmap(map->map_base, map->map_size);
+    }
+#endif
+    free(map->contents);
+    free(map);
+}
+
 ssize_t FullWrite(int desc, const char *ptr, size_t len)
 {
     ssize_t total_written = 0;
@@ -468,29 +909,54 @@ void switch_symlink_hook();
 #define TEST_SYMLINK_SWITCH_POINT
 #endif
 
-Seq *ListDir(const char *dir, const char *extension)
+typedef struct
 {
-    Dir *dirh = DirOpen(dir);
-    if (dirh == NULL)
+    Seq *contents;
+    const char *extension;
+} ListDirData;
+
+static void ListDirAppend(ListDirData *list, const char *name, char *path)
+{
+    if (list->extension == NULL || StringEndsWithCase(name, list->extension, true))
     {
-        return NULL;
+        SeqAppend(list->contents, path);
+    }
+    else
+    {
+        free(path);
     }
+}
+
+static DirWalkAction ListDirEntry(const DirWalkEntry *entry, void *data)
+{
+    ListDirAppend(data, entry->name, xstrdup(entry->path));
+    return DIR_WALK_CONTINUE;
+}
+
+Seq *ListDir(const char *dir, const char *extension)
+{
+    ListDirData list = {
+        .contents = SeqNew(10, free),
+        .extension = extension,
+    };
 
-    Seq *contents = SeqNew(10, free);
+    /* DirWalk() skips "." and "..", but readdir() lists them */
+    ListDirAppend(&list, ".", Path_JoinAlloc(dir, "."));
+    ListDirAppend(&list, "..", Path_JoinAlloc(dir, ".."));
 
-    const struct dirent *dirp;
+    const DirWalkOptions options = {
+        .pre = ListDirEntry,
+        .data = &list,
+        .max_depth = 1,
+    };
 
-    while ((dirp = DirRead(dirh)) != NULL)
+    if (!DirWalk(dir, &options) && errno != 0)
     {
-        const char *name = dirp->d_name;
-        if (extension == NULL || StringEndsWithCase(name, extension, true))
-        {
-            SeqAppend(contents, Path_JoinAlloc(dir, name));
-        }
+        SeqDestroy(list.contents);
+        return NULL;
     }
-    DirClose(dirh);
 
-    return contents;
+    return list.contents;
 }
 
 mode_t SetUmask(mode_t new_mask)
@@ -1224,86 +1690,71 @@ bool SetCloseOnExec(int fd, bool enable)
 }
 #endif // !_WIN32
 
-static bool DeleteDirectoryTreeInternal(const char *basepath, const char *path)
-{
-    Dir *dirh = DirOpen(path);
-    const struct dirent *dirp;
-    bool failed = false;
+/* Subtrees are removed in parallel, by up to this many threads */
+#define DELETE_DIRECTORY_TREE_THREADS 4
 
-    if (dirh == NULL)
+static DirWalkAction DeleteDirectoryTreeFile(const DirWalkEntry *entry, void *data)
+{
+    if (entry->type == DIR_WALK_TYPE_DIR)
     {
-        if (errno == ENOENT)
-        {
-            /* Directory disappeared on its own */
-            return true;
-        }
-
-        Log(LOG_LEVEL_INFO, "Unable to open directory '%s' during purge of directory tree '%s' (opendir: %s)",
-            path, basepath, GetErrorStr());
-        return false;
+        /* Removed once empty */
+        return DIR_WALK_CONTINUE;
     }
 
-    for (dirp = DirRead(dirh); dirp != NULL; dirp = DirRead(dirh))
+#ifdef HAVE_UNLINKAT
+    const int ret = (entry->dir_fd >= 0) ? unlinkat(entry->dir_fd, entry->name, 0) : unlink(entry->path);
+#else
+    const int ret = unlink(entry->path);
+#endif
+    if (ret == -1 && errno != ENOENT)
     {
-        if (!strcmp(dirp->d_name, ".") || !strcmp(dirp->d_name, ".."))
-        {
-            continue;
-        }
-
-        char subpath[PATH_MAX];
-        snprintf(subpath, sizeof(subpath), "%s" FILE_SEPARATOR_STR "%s", path, dirp->d_name);
-
-        struct stat lsb;
-        if (lstat(subpath, &lsb) == -1)
-        {
-            if (errno == ENOENT)
-            {
-                /* File disappeared on its own */
-                continue;
-            }
-
-            Log(LOG_LEVEL_VERBOSE, "Unable to stat file '%s' during purge of directory tree '%s' (lstat: %s)", path, basepath, GetErrorStr());
-            failed = true;
-        }
-        else
-        {
-            if (S_ISDIR(lsb.st_mode))
-            {
-                if (!DeleteDirectoryTreeInternal(basepath, subpath))
-                {
-                    failed = true;
-                }
-
-                if (rmdir(subpath) == -1)
-                {
-                    failed = true;
-                }
-            }
-            else
-            {
-                if (unlink(subpath) == -1)
-                {
-                    if (errno == ENOENT)
-                    {
-                        /* File disappeared on its own */
-                        continue;
-                    }
-
-                    Log(LOG_LEVEL_VERBOSE, "Unable to remove file '%s' during purge of directory tree '%s'. (unlink: %s)",
-                        subpath, basepath, GetErrorStr());
-                    failed = true;
-                }
-            }
-        }
+        Log(LOG_LEVEL_VERBOSE, "Unable to remove file '%s' during purge of directory tree '%s'. (unlink: %s)",
+            entry->path, (const char *) data, GetErrorStr());
+        return DIR_WALK_FAILED;
     }
+    return DIR_WALK_CONTINUE;
+}
 
-    DirClose(dirh);
-    return !failed;
+static DirWalkAction DeleteDirectoryTreeDir(const DirWalkEntry *entry, void *data)
+{
+#ifdef HAVE_UNLINKAT
+    const int ret = (entry->dir_fd >= 0) ? unlinkat(entry->dir_fd, entry->name, AT_REMOVEDIR) : rmdir(entry->path);
+#else
+    const int ret = rmdir(entry->path);
+#endif
+    if (ret == -1 && errno != ENOENT)
+    {
+        Log(LOG_LEVEL_VERBOSE, "Unable to remove directory '%s' during purge of directory tree '%s'. (rmdir: %s)",
+            entry->path, (const char *) data, GetErrorStr());
+        return DIR_WALK_FAILED;
+    }
+    return DIR_WALK_CONTINUE;
 }
 
 bool DeleteDirectoryTree(const char *path)
 {
-    return DeleteDirectoryTreeInternal(path, path);
+    const DirWalkOptions options = {
+        .pre = DeleteDirectoryTreeFile,
+        .post = DeleteDirectoryTreeDir,
+        .data = (void *) path,
+        .threads = DELETE_DIRECTORY_TREE_THREADS,
+    };
+
+    if (DirWalk(path, &options))
+    {
+        return true;
+    }
+    if (errno == ENOENT)
+    {
+        /* Directory disappeared on its own */
+        return true;
+    }
+    if (errno != 0)
+    {
+        Log(LOG_LEVEL_INFO, "Unable to open directory '%s' during purge of directory tree '%s' (opendir: %s)",
+            path, path, GetErrorStr());
+    }
+    return false;
 }
 
 /**
@@ -1349,6 +1800,12 @@ bool FileSparseWrite(int fd, const void *buf, size_t count,
  * Copy data jumping over areas filled by '\0' greater than blk_size, so
  * files automatically become sparse if possible.
  *
+ * If the source is a regular file on a filesystem supporting
+ * lseek(SEEK_DATA/SEEK_HOLE), its holes are reproduced in the destination
+ * without reading them, and its data is copied in the kernel
+ * (copy_file_range(), sendfile()) when possible. Otherwise the data is read
+ * in large blocks and zero-filled blocks of blk_size are skipped.
+ *
  * File descriptors should already be open, the filenames #source and
  * #destination are only for logging purposes.
  *
@@ -1363,45 +1820,122 @@ bool FileSparseCopy(int sd, const char *src_name,
 {
     assert(total_bytes_written   != NULL);
     assert(last_write_was_a_hole != NULL);
+    assert(blk_size > 0);
 
-    const size_t buf_size  = blk_size;
-    void *buf              = xmalloc(buf_size);
-
-    size_t n_read_total = 0;
-    bool   retval       = false;
+    size_t n_copied_total = 0;
+    size_t n_copied       = 0;
 
     *last_write_was_a_hole = false;
 
-    while (true)
+    /* Set if holes were detected with lseek(), rather than by scanning. */
+    bool seeked = false;
+
+#if defined(SEEK_DATA) && defined(SEEK_HOLE)
+    struct stat sb;
+    off_t offset = lseek(sd, 0, SEEK_CUR);
+    if (offset != (off_t) -1 && fstat(sd, &sb) == 0 && S_ISREG(sb.st_mode))
     {
-        ssize_t n_read = FullRead(sd, buf, buf_size);
-        if (n_read < 0)
-        {
-            Log(LOG_LEVEL_ERR,
-                "Unable to read source file while copying '%s' to '%s'"
-                " (read: %s)", src_name, dst_name, GetErrorStr());
-            break;
-        }
-        else if (n_read == 0)                                   /* EOF */
+        seeked = true;
+        while (offset < sb.st_size)
         {
-            retval = true;
-            break;
-        }
+            off_t data = lseek(sd, offset, SEEK_DATA);
+            if (data == (off_t) -1)
+            {
+                if (errno != ENXIO)
+                {
+                    /* EINVAL: not supported here, copy the rest normally */
+                    lseek(sd, offset, SEEK_SET);
+                    seeked = false;
+                    break;
+                }
+                data = sb.st_size;                      /* trailing hole */
+            }
 
-        bool ret = FileSparseWrite(dd, buf, n_read,
-                                   last_write_was_a_hole);
-        if (!ret)
-        {
-            Log(LOG_LEVEL_ERR, "Failed to copy '%s' to '%s'",
-                src_name, dst_name);
-            break;
+            off_t hole = (data < sb.st_size) ? lseek(sd, data, SEEK_HOLE) : data;
+            if (hole == (off_t) -1 || hole > sb.st_size)
+            {
+                hole = sb.st_size;
+            }
+
+            if (data > offset)                          /* skip the hole */
+            {
+                if (lseek(dd, data - offset, SEEK_CUR) == (off_t) -1)
+                {
+                    Log(LOG_LEVEL_ERR,
+                        "Failed to write a hole in sparse file (lseek: %s)",
+                        GetErrorStr());
+                    *total_bytes_written = n_copied_total;
+                    return false;
+                }
+                n_copied_total += data - offset;
+                *last_write_was_a_hole = true;
+            }
+
+            if (hole > data)
+            {
+                if (lseek(sd, data, SEEK_SET) == (off_t) -1)
+                {
+                    Log(LOG_LEVEL_ERR,
+                        "Unable to seek in source file while copying '%s' to '%s'"
+                        " (lseek: %s)", src_name, dst_name, GetErrorStr());
+                    *total_bytes_written = n_copied_total;
+                    return false;
+                }
+
+                bool wrote_hole = false;
+                bool ret = FileCopyData(sd, src_name, dd, dst_name,
+                                        hole - data, blk_size, &n_copied,
+                                        &wrote_hole);
+                n_copied_total += n_copied;
+                if (!ret)
+                {
+                    *total_bytes_written = n_copied_total;
+                    return false;
+                }
+                *last_write_was_a_hole = wrote_hole;
+
+                if (n_copied < (size_t) (hole - data))   /* file shrunk */
+                {
+                    break;
+                }
+            }
+            else
+            {
+                lseek(sd, data, SEEK_SET);
+            }
+
+            offset = hole;
         }
+    }
+#endif
 
-        n_read_total += n_read;
+    /* Copy whatever is left: data appended to the source while we were
+     * copying, or all of it if holes could not be detected. In the latter
+     * case, scan for zero-filled blocks. */
+    bool wrote_hole = *last_write_was_a_hole;
+    bool retval;
+    if (seeked)
+    {
+        retval = FileCopyData(sd, src_name, dd, dst_name, SIZE_MAX, blk_size,
+                              &n_copied, &wrote_hole);
+    }
+    else
+    {
+        const size_t buf_size = MAX(blk_size, FILE_COPY_BUFSIZE / blk_size * blk_size);
+        void *buf = FileCopyBufferNew(buf_size);
+        retval = FileCopyBuffered(sd, src_name, dd, dst_name, SIZE_MAX,
+                                  buf, buf_size, blk_size,
+                                  &n_copied, &wrote_hole);
+        free(buf);
     }
 
-    free(buf);
-    *total_bytes_written   = n_read_total;
+    n_copied_total += n_copied;
+    if (n_copied > 0)
+    {
+        *last_write_was_a_hole = wrote_hole;
+    }
+
+    *total_bytes_written = n_copied_total;
     return retval;
 }
 
@@ -44,6 +44,21 @@ typedef enum
  */
 Writer *FileRead(const char *filename, size_t size_max, bool *truncated);
 
+typedef struct
+{
+    Writer *contents;            /* NULL if the file could not be read */
+    bool truncated;
+} FileReadResult;
+
+/**
+ * Reads up to size_max bytes from each of many files like FileRead(), with
+ * the reads running concurrently, see async_io.h.
+ * @param results [out] Array of n_files results, results[i] is for filenames[i]
+ * @return Number of files read
+ */
+size_t FileReadBatch(const char *const *filenames, size_t n_files, size_t size_max,
+                     FileReadResult *results);
+
 /**
  * Reads up to max_bytes bytes from file and writes into buf.
  * Returns negative numbers in case of errors, bytes read/written otherwise.
@@ -66,6 +81,44 @@ bool File_CopyToDir(const char *src, const char *dst_dir);
  */
 Writer *FileReadFromFd(int fd, size_t size_max, bool *truncated);
 
+typedef struct FileMapping_ FileMapping;
+
+/**
+ * Makes up to size_max bytes of filename available read-only in memory.
+ *
+ * Regular files are mapped with mmap() so that large data files do not need
+ * to be copied; anything that cannot be mapped (pipes, devices, pseudo-files
+ * reporting size 0, files larger than size_max, platforms without mmap()) is
+ * read into memory instead. Either way the data is followed by a '\0' byte, so it can be
+ * passed directly to string based parsers.
+ *
+ * @note Shrinking a mapped file while the mapping is in use leads to SIGBUS
+ *       when accessing the pages beyond the new end of file, and rewriting
+ *       it in place changes the data under the reader. Files another process
+ *       holds a write lock on, or modified in the last couple of seconds,
+ *       are therefore read rather than mapped. Replacing a file with
+ *       rename() is always safe. Use FileRead() for files which may be
+ *       truncated or rewritten in place at any time.
+ * @return NULL if the file could not be opened or read
+ */
+FileMapping *FileMap(const char *filename, size_t size_max, bool *truncated);
+
+/**
+ * Same as FileMap(), but operates on an open file descriptor. The descriptor
+ * may be closed while the mapping is in use.
+ */
+FileMapping *FileMapFd(int fd, size_t size_max, bool *truncated);
+
+const char *FileMappingData(const FileMapping *map);
+size_t FileMappingLength(const FileMapping *map);
+
+/**
+ * @return true if the data is mapped, false if it was read into memory
+ */
+bool FileMappingIsMapped(const FileMapping *map);
+
+void FileUnmap(FileMapping *map);
+
 bool FileCanOpen(const char *path, const char *modes);
 
 /* Write LEN bytes at PTR to descriptor DESC, retrying if interrupted.
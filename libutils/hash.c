@@ -29,6 +29,7 @@
 #include <libcrypto-compat.h>
 
 #include <alloc.h>
+#include <async_io.h>
 #include <logging.h>
 #include <hash.h>
 #include <misc_lib.h>
@@ -115,6 +116,157 @@ void HashCalculatePrintableRepresentation(Hash *hash)
     hash->printable[4 + 2 * hash->size] = '\0';
 }
 
+/* Size of the read() buffer used for hashing files. Large enough to keep the
+ * number of syscalls per file low, small enough to have one per thread. */
+#define HASH_FILE_BUFSIZE (256 * 1024)
+#define HASH_FILE_BUF_ALIGN 4096
+
+/* Files are handed out to HashFiles() workers in chunks of this many, so
+ * that workers do not fight over the lock for every small file. */
+#define HASH_FILES_CHUNK 16
+
+static unsigned char *HashBufferNew(void)
+{
+#ifdef HAVE_POSIX_MEMALIGN
+    void *buf;
+    if (posix_memalign(&buf, HASH_FILE_BUF_ALIGN, HASH_FILE_BUFSIZE) == 0)
+    {
+        return buf;
+    }
+#endif
+    return xmalloc(HASH_FILE_BUFSIZE);
+}
+
+/**
+ * Set up one digest context per method, so that all digests are computed in
+ * a single pass over the data.
+ *
+ * @return false if a method is not supported, the contexts set up so far
+ *         still need HashContextsFinish() then
+ */
+static bool HashContextsInit(
+    EVP_MD_CTX *contexts[HASH_FILE_MAX_METHODS],
+    const HashMethod *const methods,
+    const size_t n_methods)
+{
+    assert(n_methods > 0 && n_methods <= HASH_FILE_MAX_METHODS);
+
+    memset(contexts, 0, HASH_FILE_MAX_METHODS * sizeof(EVP_MD_CTX *));
+    for (size_t i = 0; i < n_methods; i++)
+    {
+        const EVP_MD *const md = HashDigestFromId(methods[i]);
+        if (md == NULL)
+        {
+            Log(LOG_LEVEL_ERR,
+                "Could not determine function for file hashing (type=%d)",
+                (int) methods[i]);
+            return false;
+        }
+        else if ((contexts[i] = EVP_MD_CTX_new()) == NULL)
+        {
+            Log(LOG_LEVEL_ERR, "Failed to allocate openssl hashing context");
+            return false;
+        }
+        else if (EVP_DigestInit_ex(contexts[i], md, NULL) != 1)
+        {
+            Log(LOG_LEVEL_ERR, "Could not initialize openssl hash context");
+            return false;
+        }
+    }
+    return true;
+}
+
+static void HashContextsUpdate(
+    EVP_MD_CTX *contexts[HASH_FILE_MAX_METHODS],
+    const size_t n_methods,
+    const void *const data,
+    const size_t length)
+{
+    for (size_t i = 0; i < n_methods; i++)
+    {
+        EVP_DigestUpdate(contexts[i], data, length);
+    }
+}
+
+/* Free the contexts, writing the digests only if #success */
+static void HashContextsFinish(
+    EVP_MD_CTX *contexts[HASH_FILE_MAX_METHODS],
+    const size_t n_methods,
+    unsigned char digests[][EVP_MAX_MD_SIZE + 1],
+    const bool success)
+{
+    for (size_t i = 0; i < n_methods; i++)
+    {
+        if (contexts[i] != NULL)
+        {
+            if (success)
+            {
+                unsigned int digest_length;
+                EVP_DigestFinal_ex(contexts[i], digests[i], &digest_length);
+            }
+            EVP_MD_CTX_free(contexts[i]);
+        }
+    }
+}
+
+/**
+ * Read #descriptor until EOF, feeding the data to #contexts.
+ * @return false if reading failed
+ */
+static bool HashContextsUpdateFromDescriptor(
+    EVP_MD_CTX *contexts[HASH_FILE_MAX_METHODS],
+    const size_t n_methods,
+    const int descriptor,
+    unsigned char *const buffer,
+    const size_t buffer_size)
+{
+    while (true)
+    {
+        const ssize_t read_count = read(descriptor, buffer, buffer_size);
+        if (read_count == 0)
+        {
+            return true;
+        }
+        else if (read_count < 0)
+        {
+            if (errno != EINTR)
+            {
+                return false;
+            }
+            continue;
+        }
+
+        HashContextsUpdate(contexts, n_methods, buffer, (size_t) read_count);
+    }
+}
+
+/**
+ * Read #descriptor until EOF, feeding the data to one digest context per
+ * method so that all digests are computed in a single pass.
+ *
+ * @return false if a method is not supported or reading failed, the
+ *         contents of #digests are undefined in that case
+ */
+static bool HashDescriptor(
+    const int descriptor,
+    const HashMethod *const methods,
+    const size_t n_methods,
+    unsigned char digests[][EVP_MAX_MD_SIZE + 1],
+    unsigned char *const buffer,
+    const size_t buffer_size)
+{
+    EVP_MD_CTX *contexts[HASH_FILE_MAX_METHODS];
+    bool success = HashContextsInit(contexts, methods, n_methods);
+    if (success)
+    {
+        success = HashContextsUpdateFromDescriptor(contexts, n_methods, descriptor,
+                                                   buffer, buffer_size);
+    }
+
+    HashContextsFinish(contexts, n_methods, digests, success);
+    return success;
+}
+
 /*
  * Constructors
  * All constructors call two common methods: HashBasicInit(...) and HashCalculatePrintableRepresentation(...).
@@ -172,42 +324,21 @@ Hash *HashNewFromDescriptor(const int descriptor, HashMethod method)
         return NULL;
     }
 
-    const EVP_MD *const md = HashDigestFromId(method);
-    if (md == NULL)
-    {
-        Log(LOG_LEVEL_INFO, "Digest (type=%d) not supported by OpenSSL library", method);
-        return NULL;
-    }
-    EVP_MD_CTX *const context = EVP_MD_CTX_create();
-    if (context == NULL)
-    {
-        Log(LOG_LEVEL_ERR, "Could not allocate openssl hash context");
-        return NULL;
-    }
-
-    if (EVP_DigestInit_ex(context, md, NULL) != 1)
+    unsigned char digest[1][EVP_MAX_MD_SIZE + 1];
+    unsigned char *const buffer = HashBufferNew();
+    const bool success =
+        HashDescriptor(descriptor, &method, 1, digest, buffer, HASH_FILE_BUFSIZE);
+    free(buffer);
+    if (!success)
     {
-        Log(LOG_LEVEL_ERR, "Could not initialize openssl hash context");
-        EVP_MD_CTX_destroy(context);
         return NULL;
     }
 
-    ssize_t read_count = 0;
-    char buffer[1024];
-    do
-    {
-        read_count = read(descriptor, buffer, 1024);
-        EVP_DigestUpdate(context, buffer, (size_t) read_count);
-    } while (read_count > 0);
-
     Hash *const hash = HashBasicInit(method); // xcalloc, cannot be NULL
-    unsigned int md_len;
-    EVP_DigestFinal_ex(context, hash->digest, &md_len);
+    memcpy(hash->digest, digest[0], sizeof(hash->digest));
 
     /* Update the printable representation */
     HashCalculatePrintableRepresentation(hash);
-
-    EVP_MD_CTX_destroy(context);
     return hash;
 }
 
@@ -397,6 +528,333 @@ HashSize HashSizeFromId(HashMethod hash_id)
     return (hash_id >= HASH_METHOD_NONE) ? CF_NO_HASH : CF_DIGEST_SIZES[hash_id];
 }
 
+static bool HashFileWithBuffer(
+    const char *const filename,
+    const HashMethod *const methods,
+    const size_t n_methods,
+    unsigned char digests[][EVP_MAX_MD_SIZE + 1],
+    unsigned char *const buffer)
+{
+    memset(digests, 0, n_methods * sizeof(digests[0]));
+
+    const int fd = safe_open(filename, O_RDONLY | O_BINARY);
+    if (fd == -1)
+    {
+        Log(LOG_LEVEL_INFO,
+            "Cannot open file for hashing '%s'. (open: %s)",
+            filename, GetErrorStr());
+        return false;
+    }
+
+#if defined(HAVE_POSIX_FADVISE) && defined(POSIX_FADV_SEQUENTIAL)
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+    const bool success = HashDescriptor(fd, methods, n_methods, digests,
+                                        buffer, HASH_FILE_BUFSIZE);
+    if (!success)
+    {
+        Log(LOG_LEVEL_INFO, "Failed to hash file '%s'. (read: %s)",
+            filename, GetErrorStr());
+        memset(digests, 0, n_methods * sizeof(digests[0]));
+    }
+
+    close(fd);
+    return success;
+}
+
+bool HashFileMulti(
+    const char *const filename,
+    const HashMethod *const methods,
+    const size_t n_methods,
+    unsigned char digests[][EVP_MAX_MD_SIZE + 1])
+{
+    assert(filename != NULL);
+    assert(methods != NULL);
+    assert(digests != NULL);
+    assert(n_methods > 0 && n_methods <= HASH_FILE_MAX_METHODS);
+
+    unsigned char *const buffer = HashBufferNew();
+    const bool success =
+        HashFileWithBuffer(filename, methods, n_methods, digests, buffer);
+    free(buffer);
+    return success;
+}
+
+typedef struct
+{
+    pthread_mutex_t lock;
+    size_t next;
+    const char *const *filenames;
+    size_t n_files;
+    const HashMethod *methods;
+    size_t n_methods;
+    HashFileResult *results;
+    size_t n_hashed;
+} HashFilesBatch;
+
+static void *HashFilesWorker(void *arg)
+{
+    HashFilesBatch *const batch = arg;
+    unsigned char *const buffer = HashBufferNew();
+    size_t n_hashed = 0;
+
+    for (;;)
+    {
+        pthread_mutex_lock(&batch->lock);
+        const size_t start = batch->next;
+        const size_t end = MIN(start + HASH_FILES_CHUNK, batch->n_files);
+        batch->next = end;
+        pthread_mutex_unlock(&batch->lock);
+
+        if (start >= end)
+        {
+            break;
+        }
+
+        for (size_t i = start; i < end; i++)
+        {
+            HashFileResult *const result = &(batch->results[i]);
+            result->success = HashFileWithBuffer(
+                batch->filenames[i], batch->methods, batch->n_methods,
+                result->digests, buffer);
+            if (result->success)
+            {
+                n_hashed++;
+            }
+        }
+    }
+
+    free(buffer);
+
+    pthread_mutex_lock(&batch->lock);
+    batch->n_hashed += n_hashed;
+    pthread_mutex_unlock(&batch->lock);
+    return NULL;
+}
+
+size_t HashFiles(
+    const char *const *const filenames,
+    const size_t n_files,
+    const HashMethod *const methods,
+    const size_t n_methods,
+    HashFileResult *const results,
+    size_t n_threads)
+{
+    assert(filenames != NULL || n_files == 0);
+    assert(results != NULL || n_files == 0);
+    assert(methods != NULL);
+    assert(n_methods > 0 && n_methods <= HASH_FILE_MAX_METHODS);
+
+    if (n_threads == 0)
+    {
+        const long n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        n_threads = (n_cpus > 0) ? (size_t) n_cpus : 1;
+    }
+    n_threads = MIN(n_threads, (n_files + HASH_FILES_CHUNK - 1) / HASH_FILES_CHUNK);
+
+    HashFilesBatch batch = {
+        .next = 0,
+        .filenames = filenames,
+        .n_files = n_files,
+        .methods = methods,
+        .n_methods = n_methods,
+        .results = results,
+        .n_hashed = 0,
+    };
+    pthread_mutex_init(&batch.lock, NULL);
+
+    /* The calling thread is one of the workers, so failing to start the
+     * others only makes the batch slower. */
+    pthread_t *const threads = xcalloc(MAX(n_threads, 1), sizeof(pthread_t));
+    size_t n_started = 0;
+    for (size_t i = 1; i < n_threads; i++)
+    {
+        const int ret = pthread_create(&threads[n_started], NULL,
+                                       HashFilesWorker, &batch);
+        if (ret != 0)
+        {
+            Log(LOG_LEVEL_VERBOSE,
+                "Failed to start file hashing thread (pthread_create: %s)",
+                GetErrorStrFromCode(ret));
+            break;
+        }
+        n_started++;
+    }
+
+    HashFilesWorker(&batch);
+
+    for (size_t i = 0; i < n_started; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+    pthread_mutex_destroy(&batch.lock);
+
+    return batch.n_hashed;
+}
+
+/* Files up to this size are read whole by HashFilesAsync(), larger ones are
+ * hashed from what was read and then the rest of them, once the others are
+ * done. */
+#define HASH_FILES_ASYNC_MAX_SIZE (1024 * 1024)
+
+/* A large file, hashed up to HASH_FILES_ASYNC_MAX_SIZE */
+typedef struct
+{
+    EVP_MD_CTX *contexts[HASH_FILE_MAX_METHODS];
+    dev_t dev;                  /* of the file read, the one to finish */
+    ino_t ino;
+} HashFilesAsyncLarge;
+
+typedef struct
+{
+    const HashMethod *methods;
+    size_t n_methods;
+    HashFileResult *results;
+    HashFilesAsyncLarge **large; /* NULL for the other files */
+} HashFilesAsyncBatch;
+
+typedef struct
+{
+    HashFilesAsyncBatch *batch;
+    size_t index;
+} HashFilesAsyncFile;
+
+static void HashFilesAsyncDone(AsyncIOResult *result, void *data)
+{
+    const HashFilesAsyncFile *const file = data;
+    HashFilesAsyncBatch *const batch = file->batch;
+    HashFileResult *const hash_result = &(batch->results[file->index]);
+
+    if (result->error != 0)
+    {
+        Log(LOG_LEVEL_INFO, "Cannot read file for hashing '%s'. (%s)",
+            result->path, GetErrorStrFromCode(result->error));
+        return;
+    }
+
+    EVP_MD_CTX *contexts[HASH_FILE_MAX_METHODS];
+    const bool success = HashContextsInit(contexts, batch->methods, batch->n_methods);
+    if (success)
+    {
+        HashContextsUpdate(contexts, batch->n_methods, result->data, result->length);
+        if (result->truncated)
+        {
+            HashFilesAsyncLarge *const large = xmalloc(sizeof(HashFilesAsyncLarge));
+            memcpy(large->contexts, contexts, sizeof(contexts));
+            large->dev = result->sb.st_dev;
+            large->ino = result->sb.st_ino;
+            batch->large[file->index] = large;
+            return;
+        }
+    }
+    HashContextsFinish(contexts, batch->n_methods, hash_result->digests, success);
+    hash_result->success = success;
+}
+
+/* Hash the rest of a large file, after the part HashFilesAsyncDone() hashed,
+ * unless it was replaced since */
+static bool HashFilesAsyncFinishLarge(
+    const char *const filename,
+    HashFilesAsyncLarge *const large,
+    const size_t n_methods,
+    unsigned char digests[][EVP_MAX_MD_SIZE + 1],
+    unsigned char *const buffer)
+{
+    EVP_MD_CTX **const contexts = large->contexts;
+    bool success = false;
+    struct stat sb;
+    const int fd = safe_open(filename, O_RDONLY | O_BINARY);
+    if (fd == -1)
+    {
+        Log(LOG_LEVEL_INFO,
+            "Cannot open file for hashing '%s'. (open: %s)",
+            filename, GetErrorStr());
+    }
+    else if (fstat(fd, &sb) == -1 || sb.st_dev != large->dev || sb.st_ino != large->ino)
+    {
+        Log(LOG_LEVEL_INFO,
+            "File '%s' changed while hashing it, not hashing it", filename);
+        close(fd);
+    }
+    else
+    {
+#if defined(HAVE_POSIX_FADVISE) && defined(POSIX_FADV_SEQUENTIAL)
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+        success =
+            (lseek(fd, HASH_FILES_ASYNC_MAX_SIZE, SEEK_SET) == HASH_FILES_ASYNC_MAX_SIZE) &&
+            HashContextsUpdateFromDescriptor(contexts, n_methods, fd,
+                                             buffer, HASH_FILE_BUFSIZE);
+        if (!success)
+        {
+            Log(LOG_LEVEL_INFO, "Failed to hash file '%s'. (read: %s)",
+                filename, GetErrorStr());
+        }
+        close(fd);
+    }
+
+    HashContextsFinish(contexts, n_methods, digests, success);
+    return success;
+}
+
+size_t HashFilesAsync(
+    const char *const *const filenames,
+    const size_t n_files,
+    const HashMethod *const methods,
+    const size_t n_methods,
+    HashFileResult *const results)
+{
+    assert(filenames != NULL || n_files == 0);
+    assert(results != NULL || n_files == 0);
+    assert(methods != NULL);
+    assert(n_methods > 0 && n_methods <= HASH_FILE_MAX_METHODS);
+
+    HashFilesAsyncBatch batch = {
+        .methods = methods,
+        .n_methods = n_methods,
+        .results = results,
+        .large = xcalloc(MAX(n_files, 1), sizeof(batch.large[0])),
+    };
+    HashFilesAsyncFile *const files = xcalloc(MAX(n_files, 1), sizeof(HashFilesAsyncFile));
+
+    AsyncIO *const aio = AsyncIONew(ASYNC_IO_BACKEND_DEFAULT);
+    for (size_t i = 0; i < n_files; i++)
+    {
+        results[i].success = false;
+        memset(results[i].digests, 0, sizeof(results[i].digests));
+        files[i] = (HashFilesAsyncFile) { .batch = &batch, .index = i };
+        AsyncIOReadFile(aio, filenames[i], HASH_FILES_ASYNC_MAX_SIZE,
+                        HashFilesAsyncDone, &files[i]);
+    }
+    AsyncIOWait(aio);
+    AsyncIODestroy(aio);
+
+    unsigned char *buffer = NULL;
+    size_t n_hashed = 0;
+    for (size_t i = 0; i < n_files; i++)
+    {
+        if (batch.large[i] != NULL)
+        {
+            if (buffer == NULL)
+            {
+                buffer = HashBufferNew();
+            }
+            results[i].success = HashFilesAsyncFinishLarge(
+                filenames[i], batch.large[i], n_methods, results[i].digests, buffer);
+            free(batch.large[i]);
+        }
+        n_hashed += results[i].success ? 1 : 0;
+    }
+
+    free(buffer);
+    free(files);
+    free(batch.large);
+    return n_hashed;
+}
+
+#ifdef _WIN32
 static void HashFile_Stream(
     FILE *const file,
     unsigned char digest[EVP_MAX_MD_SIZE + 1],
@@ -434,6 +892,7 @@ static void HashFile_Stream(
 
     EVP_MD_CTX_free(context);
 }
+#endif /* _WIN32 */
 
 /**
  * @param text_mode whether to read the file in text mode or not (binary mode)
@@ -449,28 +908,33 @@ void HashFile(
     assert(filename != NULL);
     assert(digest != NULL);
 
-    memset(digest, 0, EVP_MAX_MD_SIZE + 1);
-
-    FILE *file = NULL;
+#ifdef _WIN32
+    /* Text mode changes newlines on Windows, only stdio knows how */
     if (text_mode)
     {
-        file = safe_fopen(filename, "rt");
-    }
-    else
-    {
-        file = safe_fopen(filename, "rb");
-    }
-    if (file == NULL)
-    {
-        Log(LOG_LEVEL_INFO,
-            "Cannot open file for hashing '%s'. (fopen: %s)",
-            filename,
-            GetErrorStr());
+        memset(digest, 0, EVP_MAX_MD_SIZE + 1);
+
+        FILE *file = safe_fopen(filename, "rt");
+        if (file == NULL)
+        {
+            Log(LOG_LEVEL_INFO,
+                "Cannot open file for hashing '%s'. (fopen: %s)",
+                filename,
+                GetErrorStr());
+            return;
+        }
+
+        HashFile_Stream(file, digest, type);
+        fclose(file);
         return;
     }
+#else
+    UNUSED(text_mode);
+#endif
 
-    HashFile_Stream(file, digest, type);
-    fclose(file);
+    unsigned char (*const digests)[EVP_MAX_MD_SIZE + 1] =
+        (unsigned char (*)[EVP_MAX_MD_SIZE + 1]) digest;
+    HashFileMulti(filename, &type, 1, digests);
 }
 
 /*******************************************************************/
@@ -152,6 +152,48 @@ HashSize HashSizeFromId(HashMethod hash_id);
 
 
 void HashFile(const char *filename, unsigned char digest[EVP_MAX_MD_SIZE + 1], HashMethod type, bool text_mode);
+
+/* Maximum number of digests computed in one pass by HashFileMulti() and
+ * HashFiles(). */
+#define HASH_FILE_MAX_METHODS 4
+
+/**
+  @brief Hash a file with several methods in a single pass over its data.
+  @param methods Hash methods, at most HASH_FILE_MAX_METHODS
+  @param digests [out] digests[i] is set to the digest for methods[i]
+  @return false if the file could not be read, digests are zeroed then
+  */
+bool HashFileMulti(const char *filename,
+                   const HashMethod *methods, size_t n_methods,
+                   unsigned char digests[][EVP_MAX_MD_SIZE + 1]);
+
+typedef struct
+{
+    bool success;
+    unsigned char digests[HASH_FILE_MAX_METHODS][EVP_MAX_MD_SIZE + 1];
+} HashFileResult;
+
+/**
+  @brief Hash many files concurrently, see HashFileMulti().
+  @param results [out] Array of n_files results, results[i] is for filenames[i]
+  @param n_threads Number of threads to use (including the calling one),
+                   0 to use one per online CPU
+  @return Number of files hashed successfully
+  */
+size_t HashFiles(const char *const *filenames, size_t n_files,
+                 const HashMethod *methods, size_t n_methods,
+                 HashFileResult *results, size_t n_threads);
+
+/**
+  @brief Hash many files like HashFiles(), but with the files read
+         concurrently through async_io.h and hashed in the calling thread.
+         Suits many small files, which HashFiles() threads mostly wait for.
+  @return Number of files hashed successfully
+  */
+size_t HashFilesAsync(const char *const *filenames, size_t n_files,
+                      const HashMethod *methods, size_t n_methods,
+                      HashFileResult *results);
+
 void HashString(const char *buffer, int len, unsigned char digest[EVP_MAX_MD_SIZE + 1], HashMethod type);
 bool HashesMatch(
     const unsigned char digest1[EVP_MAX_MD_SIZE + 1],
@@ -0,0 +1,537 @@
+/*
+  Copyright 2023 Northern.tech AS
+
+  This file is part of CFEngine 3 - written and maintained by Northern.tech AS.
+
+  This program is free software; you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by the
+  Free Software Foundation; version 3.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA
+
+  To the extent this program is licensed as part of the Enterprise
+  versions of CFEngine, the applicable Commercial Open Source License
+  (COSL) may apply to this file if you as a licensee so wish it. See
+  included file COSL.txt.
+*/
+
+#include <platform.h>
+
+#include <hash_cache.h>
+
+#include <alloc.h>
+#include <file_lib.h>                  /* FileMap(), ExclusiveFileLockPath() */
+#include <hash.h>
+#include <logging.h>
+#include <map.h>
+#include <set.h>
+
+#define HASH_CACHE_MAGIC "CFHC"
+#define HASH_CACHE_VERSION 1
+
+/* Upper bound for the number of entries in an index (about 120 MB), larger
+ * index files are not read. */
+#define HASH_CACHE_MAX_ENTRIES (1024 * 1024)
+
+/* Files whose ctime is less than this many seconds in the past are not
+ * cached, a modification right after hashing them could keep the same
+ * timestamps on filesystems with coarse timestamp granularity. */
+#define HASH_CACHE_RACY_WINDOW 1
+
+#if defined(HAVE_STRUCT_STAT_ST_MTIM)
+# define STAT_MTIME_NSEC(sb) ((sb)->st_mtim.tv_nsec)
+# define STAT_CTIME_NSEC(sb) ((sb)->st_ctim.tv_nsec)
+#elif defined(HAVE_STRUCT_STAT_ST_MTIMESPEC)
+# define STAT_MTIME_NSEC(sb) ((sb)->st_mtimespec.tv_nsec)
+# define STAT_CTIME_NSEC(sb) ((sb)->st_ctimespec.tv_nsec)
+#else
+# define STAT_MTIME_NSEC(sb) 0
+# define STAT_CTIME_NSEC(sb) 0
+#endif
+
+typedef struct
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t entry_size;
+    uint32_t count;
+} HashCacheHeader;
+
+/* On-disk and in-memory record, laid out without padding. */
+typedef struct
+{
+    uint64_t device;
+    uint64_t inode;
+    uint64_t size;
+    int64_t mtime;
+    int64_t ctime;
+    uint32_t mtime_nsec;
+    uint32_t ctime_nsec;
+    uint32_t method;
+    uint32_t digest_length;
+    unsigned char digest[EVP_MAX_MD_SIZE];
+} HashCacheEntry;
+
+/* Key of HashCache::invalidated, method is ignored */
+typedef struct
+{
+    uint64_t device;
+    uint64_t inode;
+} HashCacheFileId;
+
+struct HashCache_
+{
+    char *path;
+    pthread_mutex_t lock;
+    Map *entries;                 /* HashCacheEntry -> same HashCacheEntry */
+    Set *invalidated;             /* of HashCacheFileId */
+    bool cleared;
+};
+
+static unsigned int HashCacheFileIdHash(
+    uint64_t device, uint64_t inode, unsigned int seed)
+{
+    /* https://en.wikipedia.org/wiki/Jenkins_hash_function#one-at-a-time */
+    const uint64_t values[2] = { device, inode };
+    const unsigned char *p = (const unsigned char *) values;
+    unsigned int h = seed;
+    for (size_t i = 0; i < sizeof(values); i++)
+    {
+        h += p[i];
+        h += (h << 10);
+        h ^= (h >> 6);
+    }
+
+    h += (h << 3);
+    h ^= (h >> 11);
+    h += (h << 15);
+    return h;
+}
+
+static unsigned int HashCacheEntryHash(const void *key, unsigned int seed)
+{
+    const HashCacheEntry *const entry = key;
+    return HashCacheFileIdHash(entry->device, entry->inode, seed) ^ entry->method;
+}
+
+static bool HashCacheEntryEqual(const void *key1, const void *key2)
+{
+    const HashCacheEntry *const a = key1;
+    const HashCacheEntry *const b = key2;
+    return (a->device == b->device && a->inode == b->inode &&
+            a->method == b->method);
+}
+
+static unsigned int HashCacheFileIdHash_untyped(const void *key, unsigned int seed)
+{
+    const HashCacheFileId *const id = key;
+    return HashCacheFileIdHash(id->device, id->inode, seed);
+}
+
+static bool HashCacheFileIdEqual(const void *key1, const void *key2)
+{
+    const HashCacheFileId *const a = key1;
+    const HashCacheFileId *const b = key2;
+    return (a->device == b->device && a->inode == b->inode);
+}
+
+static void HashCacheEntryFromStat(
+    HashCacheEntry *entry, const struct stat *sb, HashMethod method)
+{
+    memset(entry, 0, sizeof(HashCacheEntry));
+    entry->device = (uint64_t) sb->st_dev;
+    entry->inode = (uint64_t) sb->st_ino;
+    entry->size = (uint64_t) sb->st_size;
+    entry->mtime = (int64_t) sb->st_mtime;
+    entry->ctime = (int64_t) sb->st_ctime;
+    entry->mtime_nsec = (uint32_t) STAT_MTIME_NSEC(sb);
+    entry->ctime_nsec = (uint32_t) STAT_CTIME_NSEC(sb);
+    entry->method = (uint32_t) method;
+}
+
+static bool HashCacheEntryIsCurrent(
+    const HashCacheEntry *entry, const HashCacheEntry *current)
+{
+    return (entry->size == current->size &&
+            entry->mtime == current->mtime &&
+            entry->mtime_nsec == current->mtime_nsec &&
+            entry->ctime == current->ctime &&
+            entry->ctime_nsec == current->ctime_nsec);
+}
+
+/**
+ * Read the index at #path and add its entries to #entries, skipping the ones
+ * #entries already has.
+ */
+static void HashCacheLoad(const char *path, Map *entries, const Set *skip)
+{
+    const size_t size_max =
+        sizeof(HashCacheHeader) + HASH_CACHE_MAX_ENTRIES * sizeof(HashCacheEntry);
+    bool truncated = false;
+    FileMapping *map = FileMap(path, size_max, &truncated);
+    if (map == NULL)
+    {
+        if (errno != ENOENT)
+        {
+            Log(LOG_LEVEL_VERBOSE, "Failed to read hash cache '%s' (open: %s)",
+                path, GetErrorStr());
+        }
+        return;
+    }
+    if (truncated)
+    {
+        Log(LOG_LEVEL_VERBOSE, "Ignoring hash cache '%s' larger than %zu bytes",
+            path, size_max);
+        FileUnmap(map);
+        return;
+    }
+
+    const char *const data = FileMappingData(map);
+    const size_t length = FileMappingLength(map);
+
+    HashCacheHeader header;
+    if (length < sizeof(header))
+    {
+        FileUnmap(map);
+        return;
+    }
+    memcpy(&header, data, sizeof(header));
+
+    if (memcmp(header.magic, HASH_CACHE_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != HASH_CACHE_VERSION ||
+        header.entry_size != sizeof(HashCacheEntry) ||
+        (length - sizeof(header)) / sizeof(HashCacheEntry) < header.count)
+    {
+        Log(LOG_LEVEL_VERBOSE, "Ignoring invalid hash cache '%s'", path);
+        FileUnmap(map);
+        return;
+    }
+
+    for (size_t i = 0; i < header.count; i++)
+    {
+        HashCacheEntry *entry = xmalloc(sizeof(HashCacheEntry));
+        memcpy(entry, data + sizeof(header) + i * sizeof(HashCacheEntry),
+               sizeof(HashCacheEntry));
+
+        const HashCacheFileId id = { entry->device, entry->inode };
+        if (entry->digest_length > EVP_MAX_MD_SIZE ||
+            (skip != NULL && SetContains(skip, &id)) ||
+            MapHasKey(entries, entry))
+        {
+            free(entry);
+            continue;
+        }
+        MapInsert(entries, entry, entry);
+    }
+
+    FileUnmap(map);
+}
+
+static bool HashCacheWrite(const char *path, Map *entries)
+{
+    char tmp_path[PATH_MAX];
+    if (snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path)
+        >= (int) sizeof(tmp_path))
+    {
+        Log(LOG_LEVEL_ERR, "Hash cache path '%s' too long", path);
+        return false;
+    }
+
+    int fd = safe_open_create_perms(tmp_path, O_WRONLY | O_CREAT | O_TRUNC,
+                                    0600);
+    if (fd == -1)
+    {
+        Log(LOG_LEVEL_ERR, "Failed to create hash cache '%s' (open: %s)",
+            tmp_path, GetErrorStr());
+        return false;
+    }
+
+    /* Entries beyond what HashCacheLoad() accepts are left out */
+    const size_t count = MIN(MapSize(entries), HASH_CACHE_MAX_ENTRIES);
+    HashCacheHeader header = {
+        .magic = HASH_CACHE_MAGIC,
+        .version = HASH_CACHE_VERSION,
+        .entry_size = sizeof(HashCacheEntry),
+        .count = (uint32_t) count,
+    };
+
+    /* Assemble the whole index, a single write() is much cheaper than one
+     * per entry. */
+    const size_t size = sizeof(header) + count * sizeof(HashCacheEntry);
+    char *const data = xmalloc(size);
+    memcpy(data, &header, sizeof(header));
+    char *p = data + sizeof(header);
+
+    MapIterator it = MapIteratorInit(entries);
+    MapKeyValue *item;
+    for (size_t i = 0; i < count && (item = MapIteratorNext(&it)) != NULL; i++)
+    {
+        memcpy(p, item->value, sizeof(HashCacheEntry));
+        p += sizeof(HashCacheEntry);
+    }
+
+    bool success = (FullWrite(fd, data, size) == (ssize_t) size) &&
+                   (fsync(fd) == 0);
+    free(data);
+
+    if (close(fd) != 0 || !success)
+    {
+        Log(LOG_LEVEL_ERR, "Failed to write hash cache '%s' (write: %s)",
+            tmp_path, GetErrorStr());
+        unlink(tmp_path);
+        return false;
+    }
+
+    if (rename(tmp_path, path) != 0)
+    {
+        Log(LOG_LEVEL_ERR, "Failed to replace hash cache '%s' (rename: %s)",
+            path, GetErrorStr());
+        unlink(tmp_path);
+        return false;
+    }
+
+    return true;
+}
+
+HashCache *HashCacheOpen(const char *path)
+{
+    assert(path != NULL);
+
+    HashCache *cache = xcalloc(1, sizeof(HashCache));
+    cache->path = xstrdup(path);
+    pthread_mutex_init(&cache->lock, NULL);
+    cache->entries = MapNew(HashCacheEntryHash, HashCacheEntryEqual, free, NULL);
+    cache->invalidated = SetNew(HashCacheFileIdHash_untyped, HashCacheFileIdEqual,
+                                free);
+
+    /* The index is replaced with rename(), no need to lock for reading */
+    HashCacheLoad(path, cache->entries, NULL);
+
+    return cache;
+}
+
+void HashCacheClose(HashCache *cache)
+{
+    if (cache != NULL)
+    {
+        MapDestroy(cache->entries);
+        SetDestroy(cache->invalidated);
+        pthread_mutex_destroy(&cache->lock);
+        free(cache->path);
+        free(cache);
+    }
+}
+
+bool HashCacheSave(HashCache *cache)
+{
+    assert(cache != NULL);
+
+    char lock_path[PATH_MAX];
+    if (snprintf(lock_path, sizeof(lock_path), "%s.lock", cache->path)
+        >= (int) sizeof(lock_path))
+    {
+        Log(LOG_LEVEL_ERR, "Hash cache path '%s' too long", cache->path);
+        return false;
+    }
+
+    FileLock lock = EMPTY_FILE_LOCK;
+    if (ExclusiveFileLockPath(&lock, lock_path, true) != 0)
+    {
+        Log(LOG_LEVEL_ERR, "Failed to lock hash cache '%s'", cache->path);
+        return false;
+    }
+
+    pthread_mutex_lock(&cache->lock);
+
+    if (!cache->cleared)
+    {
+        HashCacheLoad(cache->path, cache->entries, cache->invalidated);
+    }
+    const bool success = HashCacheWrite(cache->path, cache->entries);
+    if (success)
+    {
+        SetClear(cache->invalidated);
+        cache->cleared = false;
+    }
+
+    pthread_mutex_unlock(&cache->lock);
+
+    ExclusiveFileUnlock(&lock, true);
+    return success;
+}
+
+bool HashCacheLookup(
+    HashCache *cache,
+    const struct stat *sb,
+    HashMethod method,
+    unsigned char digest[EVP_MAX_MD_SIZE + 1])
+{
+    assert(cache != NULL);
+    assert(sb != NULL);
+
+    HashCacheEntry current;
+    HashCacheEntryFromStat(&current, sb, method);
+
+    bool found = false;
+    pthread_mutex_lock(&cache->lock);
+    const HashCacheEntry *const entry = MapGet(cache->entries, &current);
+    if (entry != NULL && HashCacheEntryIsCurrent(entry, &current))
+    {
+        memset(digest, 0, EVP_MAX_MD_SIZE + 1);
+        memcpy(digest, entry->digest, entry->digest_length);
+        found = true;
+    }
+    pthread_mutex_unlock(&cache->lock);
+
+    return found;
+}
+
+void HashCacheStore(
+    HashCache *cache,
+    const struct stat *sb,
+    HashMethod method,
+    const unsigned char digest[EVP_MAX_MD_SIZE + 1])
+{
+    assert(cache != NULL);
+    assert(sb != NULL);
+    assert(HashSizeFromId(method) <= EVP_MAX_MD_SIZE);
+
+    HashCacheEntry *entry = xmalloc(sizeof(HashCacheEntry));
+    HashCacheEntryFromStat(entry, sb, method);
+    entry->digest_length = HashSizeFromId(method);
+    memcpy(entry->digest, digest, entry->digest_length);
+
+    pthread_mutex_lock(&cache->lock);
+    /* The key is the entry itself, drop the old one before inserting */
+    MapRemove(cache->entries, entry);
+    MapInsert(cache->entries, entry, entry);
+    pthread_mutex_unlock(&cache->lock);
+}
+
+bool HashCacheInvalidate(HashCache *cache, const char *filename)
+{
+    assert(cache != NULL);
+    assert(filename != NULL);
+
+    struct stat sb;
+    if (stat(filename, &sb) == -1)
+    {
+        return false;
+    }
+
+    bool removed = false;
+    HashCacheEntry key;
+    HashCacheEntryFromStat(&key, &sb, HASH_METHOD_MD5);
+
+    pthread_mutex_lock(&cache->lock);
+    for (int method = 0; method < HASH_METHOD_NONE; method++)
+    {
+        key.method = method;
+        removed = MapRemove(cache->entries, &key) || removed;
+    }
+
+    HashCacheFileId *id = xmalloc(sizeof(HashCacheFileId));
+    id->device = key.device;
+    id->inode = key.inode;
+    if (SetContains(cache->invalidated, id))
+    {
+        free(id);
+    }
+    else
+    {
+        SetAdd(cache->invalidated, id);
+    }
+    pthread_mutex_unlock(&cache->lock);
+
+    return removed;
+}
+
+void HashCacheClear(HashCache *cache)
+{
+    assert(cache != NULL);
+
+    pthread_mutex_lock(&cache->lock);
+    MapClear(cache->entries);
+    SetClear(cache->invalidated);
+    cache->cleared = true;
+    pthread_mutex_unlock(&cache->lock);
+}
+
+size_t HashCacheSize(const HashCache *cache)
+{
+    assert(cache != NULL);
+    return MapSize(cache->entries);
+}
+
+bool HashCacheHashFile(
+    HashCache *cache,
+    const char *filename,
+    unsigned char digest[EVP_MAX_MD_SIZE + 1],
+    HashMethod method)
+{
+    assert(filename != NULL);
+    assert(digest != NULL);
+
+    memset(digest, 0, EVP_MAX_MD_SIZE + 1);
+
+    const int fd = safe_open(filename, O_RDONLY | O_BINARY);
+    if (fd == -1)
+    {
+        Log(LOG_LEVEL_INFO, "Cannot open file for hashing '%s'. (open: %s)",
+            filename, GetErrorStr());
+        return false;
+    }
+
+    struct stat before;
+    if (fstat(fd, &before) == -1)
+    {
+        Log(LOG_LEVEL_INFO, "Cannot stat file for hashing '%s'. (fstat: %s)",
+            filename, GetErrorStr());
+        close(fd);
+        return false;
+    }
+
+    if (cache != NULL && HashCacheLookup(cache, &before, method, digest))
+    {
+        close(fd);
+        return true;
+    }
+
+    Hash *hash = HashNewFromDescriptor(fd, method);
+    if (hash == NULL)
+    {
+        Log(LOG_LEVEL_INFO, "Failed to hash file '%s'", filename);
+        close(fd);
+        return false;
+    }
+
+    unsigned int length;
+    const unsigned char *const data = HashData(hash, &length);
+    memcpy(digest, data, MIN(length, EVP_MAX_MD_SIZE));
+
+    struct stat after;
+    if (cache != NULL && fstat(fd, &after) == 0 && before.st_ino != 0)
+    {
+        HashCacheEntry entry_before, entry_after;
+        HashCacheEntryFromStat(&entry_before, &before, method);
+        HashCacheEntryFromStat(&entry_after, &after, method);
+
+        const bool racy =
+            ((time_t) entry_after.ctime + HASH_CACHE_RACY_WINDOW >= time(NULL));
+        if (!racy && HashCacheEntryIsCurrent(&entry_before, &entry_after))
+        {
+            HashCacheStore(cache, &after, method, digest);
+        }
+    }
+
+    HashDestroy(&hash);
+    close(fd);
+    return true;
+}
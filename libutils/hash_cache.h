@@ -0,0 +1,109 @@
+/*
+  Copyright 2023 Northern.tech AS
+
+  This file is part of CFEngine 3 - written and maintained by Northern.tech AS.
+
+  This program is free software; you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by the
+  Free Software Foundation; version 3.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA
+
+  To the extent this program is licensed as part of the Enterprise
+  versions of CFEngine, the applicable Commercial Open Source License
+  (COSL) may apply to this file if you as a licensee so wish it. See
+  included file COSL.txt.
+*/
+
+#ifndef CFENGINE_HASH_CACHE_H
+#define CFENGINE_HASH_CACHE_H
+
+/**
+  @brief Persistent cache of file digests
+
+  Maps (device, inode, hash method) to the digest of a file, together with
+  the size, mtime and ctime the file had when it was hashed. A lookup only
+  succeeds if all of these still match, so unchanged files can be verified
+  with a stat() instead of reading them.
+
+  The on-disk index is a flat array of fixed-size records in native byte
+  order, it is only meant to be read on the host that wrote it. Updates are
+  serialized with an exclusive lock on "<path>.lock" and replace the index
+  atomically, entries written by other processes in the meantime are merged.
+  */
+
+#include <sys/stat.h>
+#include <openssl/evp.h>                                /* EVP_MAX_MD_SIZE */
+
+#include <hash_method.h>
+
+typedef struct HashCache_ HashCache;
+
+/**
+  @brief Load the cache stored at #path.
+  @note A missing, unreadable or incompatible index results in an empty cache,
+        it will be replaced by HashCacheSave().
+  */
+HashCache *HashCacheOpen(const char *path);
+
+/**
+  @brief Destroy the cache object, without saving it.
+  */
+void HashCacheClose(HashCache *cache);
+
+/**
+  @brief Write the cache to its index, merging entries other processes have
+         saved since it was opened.
+  @return false if the index could not be locked or written
+  */
+bool HashCacheSave(HashCache *cache);
+
+/**
+  @brief Look up the digest of the file described by #sb.
+  @return true if an entry exists and the file is unchanged since
+  */
+bool HashCacheLookup(HashCache *cache, const struct stat *sb, HashMethod method,
+                     unsigned char digest[EVP_MAX_MD_SIZE + 1]);
+
+/**
+  @brief Remember #digest for the file described by #sb.
+  @warning #sb must be from before the file was hashed, see HashCacheHashFile()
+  */
+void HashCacheStore(HashCache *cache, const struct stat *sb, HashMethod method,
+                    const unsigned char digest[EVP_MAX_MD_SIZE + 1]);
+
+/**
+  @brief Drop all entries for #filename.
+  @return true if there was anything to drop
+  */
+bool HashCacheInvalidate(HashCache *cache, const char *filename);
+
+/**
+  @brief Drop all entries, including the ones saved in the index.
+  */
+void HashCacheClear(HashCache *cache);
+
+size_t HashCacheSize(const HashCache *cache);
+
+/**
+  @brief HashFile() through the cache.
+
+  The file is only read if it has no valid entry. Files that changed while
+  being hashed, or so recently that a further change could go unnoticed in
+  their timestamps, are not added.
+
+  @param cache Cache to use, may be NULL to always hash the file
+  @return false if the file could not be read, digest is zeroed then
+  */
+bool HashCacheHashFile(HashCache *cache, const char *filename,
+                       unsigned char digest[EVP_MAX_MD_SIZE + 1],
+                       HashMethod method);
+
+#endif // CFENGINE_HASH_CACHE_H
@@ -40,8 +40,7 @@ struct IPV6Address {
 };
 
 struct IPAddress {
-    void *address;
-    int type;
+    IPAddr addr;
 };
 
 #define Char2Dec(o, c) \
@@ -113,8 +112,8 @@ static int IPV4_hex_parser(const char *source, struct IPV4Address *address)
 }
 
 /*
- * This function parses the source pointer and checks if it conforms to the
- * RFC 791.
+ * This function parses the first len characters of source and checks if they
+ * conform to the RFC 791.
  *
  * xxx.xxx.xxx.xxx[:ppppp]
  *
@@ -122,9 +121,9 @@ static int IPV4_hex_parser(const char *source, struct IPV4Address *address)
  *
  * Returns 0 on success.
  */
-static int IPV4_parser(const char *source, struct IPV4Address *address)
+static int IPV4_parser_len(const char *source, size_t len, struct IPV4Address *address)
 {
-    char *p = NULL;
+    const char *p = NULL;
     int octet = 0;
     int port = 0;
     int period_counter = 0;
@@ -170,12 +169,12 @@ static int IPV4_parser(const char *source, struct IPV4Address *address)
      */
     int state = 0;
     bool state_change = false;
-    for (p = (char *)source; *p != '\0'; ++p)
+    for (p = source; p < source + len; ++p)
     {
         /*
          * Do some character recognition
          */
-        is_digit = isdigit(*p);
+        is_digit = isdigit((unsigned char) *p);
         is_period = (*p == '.') ? 1 : 0;
         is_port = (*p == ':') ? 1 : 0;
         /*
@@ -366,6 +365,12 @@ static int IPV4_parser(const char *source, struct IPV4Address *address)
     return 0;
 }
 
+FUNC_UNUSED /* used by the unit tests */
+static int IPV4_parser(const char *source, struct IPV4Address *address)
+{
+    return IPV4_parser_len(source, strlen(source), address);
+}
+
 /*
  * This function parses the address and checks if it conforms to the
  * 0a0b0c0d0e0f0g0h or 0a0b0c0d0e0f0g0h:0i0j format (commonly used in procfs)
@@ -412,8 +417,8 @@ static int IPV6_hex_parser(const char *source, struct IPV6Address *address)
 }
 
 /*
- * This function parses the address and checks if it conforms to the
- * RFCs 2373, 2460 and 5952.
+ * This function parses the first len characters of source and checks if they
+ * conform to the RFCs 2373, 2460 and 5952.
  * We do not support Microsoft UNC encoding, i.e.
  * hhhh-hhhh-hhhh-hhhh-hhhh-hhhh-hhhh-hhhh.ipv6-literal.net
  * Despite following RFC 5292 we do not signal errors derived from bad
@@ -422,7 +427,7 @@ static int IPV6_hex_parser(const char *source, struct IPV6Address *address)
  *
  * Returns 0 on success.
  */
-static int IPV6_parser(const char *source, struct IPV6Address *address)
+static int IPV6_parser_len(const char *source, size_t len, struct IPV6Address *address)
 {
     /*
      * IPV6 parsing is more complex than IPV4 parsing. There are a few ground rules:
@@ -444,7 +449,7 @@ static int IPV6_parser(const char *source, struct IPV6Address *address)
      * This is a simplified state machine since I assume that we keep the square brackets inside
      * the same state as hexadecimal digits, which in practice is not true.
      */
-    char *p = NULL;
+    const char *p = NULL;
     int sixteen = 0;
     int unsorted_sixteen[6];
     int unsorted_pointer = 0;
@@ -483,21 +488,21 @@ static int IPV6_parser(const char *source, struct IPV6Address *address)
         address->port = 0;
     }
 
-    for (p = (char *)source; *p != '\0'; ++p)
+    for (p = source; p < source + len; ++p)
     {
         /*
          * Take a closer look at the character
          */
         is_start_bracket = (*p == '[') ? 1 : 0;
         is_end_bracket = (*p == ']') ? 1 : 0;
-        is_hexdigit = isxdigit(*p);
-        is_digit = isdigit(*p);
+        is_hexdigit = isxdigit((unsigned char) *p);
+        is_digit = isdigit((unsigned char) *p);
         is_colon = (*p == ':') ? 1 : 0;
         if (is_hexdigit)
         {
-            if (isalpha(*p))
+            if (isalpha((unsigned char) *p))
             {
-                is_upper_hexdigit = isupper(*p);
+                is_upper_hexdigit = isupper((unsigned char) *p);
             }
         }
 
@@ -721,7 +726,12 @@ static int IPV6_parser(const char *source, struct IPV6Address *address)
                 if (bracket_expected)
                 {
                     bracket_expected = 0;
-                    if (address)
+                    if (zero_compression)
+                    {
+                        unsorted_sixteen[unsorted_pointer] = sixteen;
+                        ++unsorted_pointer;
+                    }
+                    else if (address)
                     {
                         address->sixteen[state] = sixteen;
                     }
@@ -886,40 +896,14 @@ static int IPV6_parser(const char *source, struct IPV6Address *address)
              */
             return -1;
         }
-        if (address)
+        if (zero_compression)
         {
-            address->sixteen[7] = sixteen;
+            unsorted_sixteen[unsorted_pointer] = sixteen;
+            ++unsorted_pointer;
         }
-    }
-    if (state == 8)
-    {
-        /*
-         * This state corresponds to the final state if brackets were present.
-         * We still need to check if zero compression was activated and copy
-         * the values if so.
-         */
-        if (zero_compression)
+        else if (address)
         {
-            /*
-             * If there is no address, then we can just return :-)
-             */
-            if (address)
-            {
-                /*
-                 * We need to find the rightful positions for those numbers.
-                 * We use a simple trick:
-                 * We know how many unsorted addresses we have from unsorted pointer,
-                 * and we know that once zero_compression is activated we do not fill
-                 * any more numbers to the address structure. Therefore the right way
-                 * to do this is to take the array of unsorted_sixteen and start assigning
-                 * numbers backwards.
-                 */
-                int i = 0;
-                for (i = 0; i < unsorted_pointer; ++i)
-                {
-                    address->sixteen[7 - i] = unsorted_sixteen[i];
-                }
-            }
+            address->sixteen[7] = sixteen;
         }
     }
     if (state == 9)
@@ -941,6 +925,23 @@ static int IPV6_parser(const char *source, struct IPV6Address *address)
             address->port = port;
         }
     }
+    if ((state == 7) || (state == 8) || (state == 9))
+    {
+        /*
+         * These are the final states of full addresses and of addresses in
+         * brackets (state 8 without a port, 9 with one). If zero compression
+         * was activated the fields after it still need to be put into place,
+         * backwards as above.
+         */
+        if (zero_compression && address)
+        {
+            int i = 0;
+            for (i = 0; i < unsorted_pointer; ++i)
+            {
+                address->sixteen[7 - i] = unsorted_sixteen[unsorted_pointer - i - 1];
+            }
+        }
+    }
     if (state == 11)
     {
         /*
@@ -951,82 +952,271 @@ static int IPV6_parser(const char *source, struct IPV6Address *address)
     return 0;
 }
 
-IPAddress *IPAddressNew(Buffer *source)
+FUNC_UNUSED /* used by the unit tests */
+static int IPV6_parser(const char *source, struct IPV6Address *address)
 {
-    if (!source || !BufferData(source))
+    return IPV6_parser_len(source, strlen(source), address);
+}
+
+static void IPAddrFromIPV4(const struct IPV4Address *ipv4, IPAddr *addr)
+{
+    memset(addr, 0, sizeof(*addr));
+    addr->type = IP_ADDRESS_TYPE_IPV4;
+    memcpy(addr->bytes, ipv4->octets, sizeof(ipv4->octets));
+    addr->port = ipv4->port;
+}
+
+static void IPAddrFromIPV6(const struct IPV6Address *ipv6, IPAddr *addr)
+{
+    memset(addr, 0, sizeof(*addr));
+    addr->type = IP_ADDRESS_TYPE_IPV6;
+    for (int i = 0; i < 8; ++i)
     {
-        return NULL;
+        addr->bytes[2 * i] = ipv6->sixteen[i] >> 8;
+        addr->bytes[2 * i + 1] = ipv6->sixteen[i] & 0xFF;
+    }
+    addr->port = ipv6->port;
+}
+
+bool IPAddrParse(const char *str, size_t len, IPAddr *addr)
+{
+    if (str == NULL)
+    {
+        return false;
+    }
+
+    struct IPV4Address ipv4;
+    if (IPV4_parser_len(str, len, &ipv4) == 0)
+    {
+        if (addr != NULL)
+        {
+            IPAddrFromIPV4(&ipv4, addr);
+        }
+        return true;
+    }
+
+    struct IPV6Address ipv6;
+    if (IPV6_parser_len(str, len, &ipv6) == 0)
+    {
+        if (addr != NULL)
+        {
+            IPAddrFromIPV6(&ipv6, addr);
+        }
+        return true;
+    }
+
+    return false;
+}
+
+bool IPAddrParseHex(const char *str, size_t len, IPAddr *addr)
+{
+    /* The hex parsers use sscanf(), they need a terminated string, which
+     * is never longer than the IPv6 format with a port. */
+    char source[32 + 1 + 4 + 1];
+    if (str == NULL || len >= sizeof(source))
+    {
+        return false;
+    }
+    memcpy(source, str, len);
+    source[len] = '\0';
+
+    struct IPV4Address ipv4 = { .port = 0 };
+    if (IPV4_hex_parser(source, &ipv4) == 0)
+    {
+        if (addr != NULL)
+        {
+            IPAddrFromIPV4(&ipv4, addr);
+        }
+        return true;
+    }
+
+    struct IPV6Address ipv6 = { .port = 0 };
+    if (IPV6_hex_parser(source, &ipv6) == 0)
+    {
+        if (addr != NULL)
+        {
+            IPAddrFromIPV6(&ipv6, addr);
+        }
+        return true;
     }
-    IPAddress *address = NULL;
-    const char *pad = BufferData(source);
-    struct IPV4Address *ipv4 = NULL;
-    struct IPV6Address *ipv6 = NULL;
-    ipv4 = (struct IPV4Address *)xmalloc(sizeof(struct IPV4Address));
-    ipv6 = (struct IPV6Address *)xmalloc(sizeof(struct IPV6Address));
-
-    if (IPV4_parser(pad, ipv4) == 0)
+
+    return false;
+}
+
+bool IPAddrParseCidr(const char *str, size_t len, IPAddr *addr, unsigned int *prefix_len)
+{
+    assert(addr != NULL);
+    assert(prefix_len != NULL);
+
+    if (str == NULL)
     {
-        free (ipv6);
-        address = (IPAddress *)xmalloc(sizeof(IPAddress));
-        address->type = IP_ADDRESS_TYPE_IPV4;
-        address->address = (void *)ipv4;
+        return false;
     }
-    else if (IPV6_parser(pad, ipv6) == 0)
+
+    const char *slash = memchr(str, '/', len);
+    const size_t addr_len = (slash != NULL) ? (size_t) (slash - str) : len;
+    if (!IPAddrParse(str, addr_len, addr) || addr->port != 0)
     {
-        free (ipv4);
-        address = (IPAddress *)xmalloc(sizeof(IPAddress));
-        address->type = IP_ADDRESS_TYPE_IPV6;
-        address->address = (void *)ipv6;
+        return false;
+    }
+
+    const unsigned int bits = IP_ADDR_BITS(addr->type);
+    if (slash == NULL)
+    {
+        *prefix_len = bits;
+        return true;
+    }
+
+    const char *p = slash + 1;
+    const char *end = str + len;
+    unsigned int prefix = 0;
+    if (p == end || end - p > 3)
+    {
+        return false;
+    }
+    for (; p < end; p++)
+    {
+        if (!isdigit((unsigned char) *p))
+        {
+            return false;
+        }
+        prefix = Char2Dec(prefix, *p);
+    }
+    if (prefix > bits)
+    {
+        return false;
+    }
+
+    /* Clear the host part */
+    for (unsigned int i = prefix; i < bits; i++)
+    {
+        addr->bytes[i / 8] &= ~(0x80 >> (i % 8));
+    }
+
+    *prefix_len = prefix;
+    return true;
+}
+
+bool IPAddrToString(const IPAddr *addr, char *buf, size_t size)
+{
+    assert(addr != NULL);
+    assert(buf != NULL);
+
+    const uint8_t *b = addr->bytes;
+    int result;
+    if (addr->type == IP_ADDRESS_TYPE_IPV4)
+    {
+        result = snprintf(buf, size, "%u.%u.%u.%u", b[0], b[1], b[2], b[3]);
     }
     else
     {
-        /*
-         * It was not a valid IP address.
-         */
-        free (ipv4);
-        free (ipv6);
-        return NULL;
+        assert(addr->type == IP_ADDRESS_TYPE_IPV6);
+        result = snprintf(buf, size, "%x:%x:%x:%x:%x:%x:%x:%x",
+                          (b[0] << 8) | b[1], (b[2] << 8) | b[3],
+                          (b[4] << 8) | b[5], (b[6] << 8) | b[7],
+                          (b[8] << 8) | b[9], (b[10] << 8) | b[11],
+                          (b[12] << 8) | b[13], (b[14] << 8) | b[15]);
+    }
+    return (result >= 0 && (size_t) result < size);
+}
+
+int IPAddrCompare(const IPAddr *a, const IPAddr *b)
+{
+    assert(a != NULL);
+    assert(b != NULL);
+
+    /* IPv4 before IPv6, then the address bytes, which are in network byte
+     * order, so memcmp() gives the numerical order */
+    if (a->type != b->type)
+    {
+        return (a->type == IP_ADDRESS_TYPE_IPV4) ? -1 : 1;
+    }
+    return memcmp(a->bytes, b->bytes, sizeof(a->bytes));
+}
+
+bool IPAddrEqual(const IPAddr *a, const IPAddr *b)
+{
+    return IPAddrCompare(a, b) == 0;
+}
+
+unsigned int IPAddrHash(const IPAddr *addr, unsigned int seed)
+{
+    assert(addr != NULL);
+
+    /* https://en.wikipedia.org/wiki/Jenkins_hash_function#one-at-a-time */
+    unsigned int h = seed + addr->type;
+    for (size_t i = 0; i < sizeof(addr->bytes); i++)
+    {
+        h += addr->bytes[i];
+        h += (h << 10);
+        h ^= (h >> 6);
     }
+
+    h += (h << 3);
+    h ^= (h >> 11);
+    h += (h << 15);
+    return h;
+}
+
+unsigned int IPAddrHash_untyped(const void *addr, unsigned int seed)
+{
+    return IPAddrHash(addr, seed);
+}
+
+bool IPAddrEqual_untyped(const void *a, const void *b)
+{
+    return IPAddrEqual(a, b);
+}
+
+IPAddress *IPAddressNewFromAddr(const IPAddr *addr)
+{
+    assert(addr != NULL);
+
+    IPAddress *address = xmalloc(sizeof(IPAddress));
+    address->addr = *addr;
     return address;
 }
 
-IPAddress *IPAddressNewHex(Buffer *source)
+const IPAddr *IPAddressGetAddr(const IPAddress *address)
+{
+    assert(address != NULL);
+    return &address->addr;
+}
+
+IPAddress *IPAddressNew(Buffer *source)
 {
     if (!source || !BufferData(source))
     {
         return NULL;
     }
-    IPAddress *address = NULL;
-    const char *pad = BufferData(source);
-    struct IPV4Address *ipv4 = NULL;
-    struct IPV6Address *ipv6 = NULL;
-    ipv4 = (struct IPV4Address *)xmalloc(sizeof(struct IPV4Address));
-    ipv6 = (struct IPV6Address *)xmalloc(sizeof(struct IPV6Address));
-
-    if (IPV4_hex_parser(pad, ipv4) == 0)
+
+    IPAddr addr;
+    if (!IPAddrParse(BufferData(source), BufferSize(source), &addr))
     {
-        free (ipv6);
-        address = (IPAddress *)xmalloc(sizeof(IPAddress));
-        address->type = IP_ADDRESS_TYPE_IPV4;
-        address->address = (void *)ipv4;
+        /*
+         * It was not a valid IP address.
+         */
+        return NULL;
     }
-    else if (IPV6_hex_parser(pad, ipv6) == 0)
+    return IPAddressNewFromAddr(&addr);
+}
+
+IPAddress *IPAddressNewHex(Buffer *source)
+{
+    if (!source || !BufferData(source))
     {
-        free (ipv4);
-        address = (IPAddress *)xmalloc(sizeof(IPAddress));
-        address->type = IP_ADDRESS_TYPE_IPV6;
-        address->address = (void *)ipv6;
+        return NULL;
     }
-    else
+
+    IPAddr addr;
+    if (!IPAddrParseHex(BufferData(source), BufferSize(source), &addr))
     {
         /*
          * It was not a valid IP address.
          */
-        free (ipv4);
-        free (ipv6);
         return NULL;
     }
-    return address;
+    return IPAddressNewFromAddr(&addr);
 }
 
 int IPAddressDestroy(IPAddress **address)
@@ -1035,10 +1225,6 @@ int IPAddressDestroy(IPAddress **address)
     {
         return 0;
     }
-    if ((*address)->address)
-    {
-        free ((*address)->address);
-    }
     free (*address);
     *address = NULL;
     return 0;
@@ -1050,7 +1236,7 @@ int IPAddressType(IPAddress *address)
     {
         return -1;
     }
-    return address->type;
+    return address->addr.type;
 }
 
 Buffer *IPAddressGetAddress(IPAddress *address)
@@ -1059,47 +1245,15 @@ Buffer *IPAddressGetAddress(IPAddress *address)
     {
         return NULL;
     }
-    Buffer *buffer = NULL;
-    int result = 0;
 
-    if (address->type == IP_ADDRESS_TYPE_IPV4)
+    char str[IP_ADDR_STRING_SIZE];
+    if (!IPAddrToString(&address->addr, str, sizeof(str)))
     {
-        struct IPV4Address *ipv4 = (struct IPV4Address *)address->address;
-        buffer = BufferNew();
-#if BIG_ENDIAN
-        result = BufferPrintf(buffer, "%u.%u.%u.%u", ipv4->octets[0], ipv4->octets[1], ipv4->octets[2], ipv4->octets[3]);
-#elif LITTLE_ENDIAN
-        result = BufferPrintf(buffer, "%u.%u.%u.%u", ipv4->octets[3], ipv4->octets[2], ipv4->octets[1], ipv4->octets[0]);
-#else
-#warning "Unrecognized endianness, assuming big endian"
-        result = BufferPrintf(buffer, "%u.%u.%u.%u", ipv4->octets[0], ipv4->octets[1], ipv4->octets[2], ipv4->octets[3]);
-#endif
-    }
-    else if (address->type == IP_ADDRESS_TYPE_IPV6)
-    {
-        struct IPV6Address *ipv6 = (struct IPV6Address *)address->address;
-        buffer = BufferNew();
-#if BIG_ENDIAN
-        result = BufferPrintf(buffer, "%x:%x:%x:%x:%x:%x:%x:%x", ipv6->sixteen[0], ipv6->sixteen[1], ipv6->sixteen[2],
-                              ipv6->sixteen[3], ipv6->sixteen[4], ipv6->sixteen[5], ipv6->sixteen[6], ipv6->sixteen[7]);
-#elif LITTLE_ENDIAN
-        result = BufferPrintf(buffer, "%x:%x:%x:%x:%x:%x:%x:%x", ipv6->sixteen[7], ipv6->sixteen[6], ipv6->sixteen[5],
-                              ipv6->sixteen[4], ipv6->sixteen[3], ipv6->sixteen[2], ipv6->sixteen[1], ipv6->sixteen[0]);
-#else
-#warning "Unrecognized endianness, assuming big endian"
-        result = BufferPrintf(buffer, "%x:%x:%x:%x:%x:%x:%x:%x", ipv6->sixteen[0], ipv6->sixteen[1], ipv6->sixteen[2],
-                              ipv6->sixteen[3], ipv6->sixteen[4], ipv6->sixteen[5], ipv6->sixteen[6], ipv6->sixteen[7]);
-#endif
-    }
-    else
-    {
-        buffer = NULL;
-    }
-    if (result < 0)
-    {
-        BufferDestroy(buffer);
         return NULL;
     }
+
+    Buffer *buffer = BufferNewSmall();
+    BufferAppendString(buffer, str);
     return buffer;
 }
 
@@ -1109,54 +1263,7 @@ int IPAddressGetPort(IPAddress *address)
     {
         return -1;
     }
-    int port = -1;
-    if (address->type == IP_ADDRESS_TYPE_IPV4)
-    {
-        struct IPV4Address *ipv4 = (struct IPV4Address *)address->address;
-        port = ipv4->port;
-    }
-    else if (address->type == IP_ADDRESS_TYPE_IPV6)
-    {
-        struct IPV6Address *ipv6 = (struct IPV6Address *)address->address;
-        port = ipv6->port;
-    }
-    else
-    {
-        return -1;
-    }
-    return port;
-}
-
-/*
- * Comparison for IPV4 addresses
- */
-static int IPV4Compare(struct IPV4Address *a, struct IPV4Address *b)
-{
-    int i = 0;
-    for (i = 0; i < 4; ++i)
-    {
-        if (a->octets[i] != b->octets[i])
-        {
-            return 0;
-        }
-    }
-    return 1;
-}
-
-/*
- * Comparison for IPV6 addresses
- */
-static int IPV6Compare(struct IPV6Address *a, struct IPV6Address *b)
-{
-    int i = 0;
-    for (i = 0; i < 8; ++i)
-    {
-        if (a->sixteen[i] != b->sixteen[i])
-        {
-            return 0;
-        }
-    }
-    return 1;
+    return address->addr.port;
 }
 
 int IPAddressIsEqual(IPAddress *a, IPAddress *b)
@@ -1170,103 +1277,27 @@ int IPAddressIsEqual(IPAddress *a, IPAddress *b)
      {
          return -1;
      }
-     if (a->type != b->type)
+     if (a->addr.type != b->addr.type)
      {
          return -1;
      }
-     if (a->type == IP_ADDRESS_TYPE_IPV4)
-     {
-         return IPV4Compare((struct IPV4Address *)a->address, (struct IPV4Address *)b->address);
-     }
-     else if (a->type == IP_ADDRESS_TYPE_IPV6)
-     {
-         return IPV6Compare((struct IPV6Address *)a->address, (struct IPV6Address *)b->address);
-     }
-     return -1;
-}
-
-/*
- * Sorting comparison for IPV4 addresses
- */
-static bool IPV4CompareLess(struct IPV4Address *a, struct IPV4Address *b)
-{
-    int i = 0;
-    for (i = 0; i < 4; ++i)
-    {
-        if (a->octets[i] > b->octets[i])
-        {
-            return false;
-        }
-        else if (a->octets[i] < b->octets[i])
-        {
-            return true;
-        }
-    }
-
-    return false;
-}
-
-/*
- * Sorting comparison for IPV6 addresses
- */
-static bool IPV6CompareLess(struct IPV6Address *a, struct IPV6Address *b)
-{
-    int i = 0;
-    for (i = 0; i < 8; ++i)
-    {
-        if (a->sixteen[i] > b->sixteen[i])
-        {
-            return false;
-        }
-        else if (a->sixteen[i] < b->sixteen[i])
-        {
-            return true;
-        }
-    }
-
-    return false;
+     return IPAddrEqual(&a->addr, &b->addr) ? 1 : 0;
 }
 
 bool IPAddressCompareLess(IPAddress *a, IPAddress *b)
 {
     /*
-     * We do not support IPV4 versus IPV6 comparisons.
-     * This is trickier than what it seems, since even the IPV6 representation of an IPV6 address is not
-     * clear yet.
+     * IPV4 addresses are sorted before IPV6 ones, see IPAddrCompare().
      */
     if (a == NULL || b == NULL)
     {
         return true;
     }
 
-    assert(a->type == IP_ADDRESS_TYPE_IPV4 || a->type == IP_ADDRESS_TYPE_IPV6);
-    assert(b->type == IP_ADDRESS_TYPE_IPV4 || b->type == IP_ADDRESS_TYPE_IPV6);
+    assert(a->addr.type == IP_ADDRESS_TYPE_IPV4 || a->addr.type == IP_ADDRESS_TYPE_IPV6);
+    assert(b->addr.type == IP_ADDRESS_TYPE_IPV4 || b->addr.type == IP_ADDRESS_TYPE_IPV6);
 
-    // If not same type - Sort IPv4 BEFORE any other types:
-    if (a->type != b->type)
-    {
-        if (a->type == IP_ADDRESS_TYPE_IPV4)
-        {
-            return true;
-        }
-        else
-        {
-            assert(b->type == IP_ADDRESS_TYPE_IPV4);
-            return false;
-        }
-    }
-
-    assert(a->type == b->type);
-    IPAddressVersion type = a->type;
-
-    if (type == IP_ADDRESS_TYPE_IPV4)
-    {
-        return IPV4CompareLess((struct IPV4Address *)a->address, (struct IPV4Address *)b->address);
-    }
-
-    assert(type == IP_ADDRESS_TYPE_IPV6);
-
-    return IPV6CompareLess((struct IPV6Address *)a->address, (struct IPV6Address *)b->address);
+    return IPAddrCompare(&a->addr, &b->addr) < 0;
 }
 
 bool IPAddressIsIPAddress(Buffer *source, IPAddress **address)
@@ -1275,61 +1306,19 @@ bool IPAddressIsIPAddress(Buffer *source, IPAddress **address)
     {
         return false;
     }
-    bool create_object = false;
-    if (address)
-    {
-        create_object = true;
-    }
-    const char *pad = BufferData(source);
-    struct IPV4Address *ipv4 = NULL;
-    struct IPV6Address *ipv6 = NULL;
-    ipv4 = (struct IPV4Address *)xmalloc(sizeof(struct IPV4Address));
-    ipv6 = (struct IPV6Address *)xmalloc(sizeof(struct IPV6Address));
-    if (IPV4_parser(pad, ipv4) == 0)
-    {
-        free (ipv6);
-        if (create_object)
-        {
-            *address = (IPAddress *)xmalloc(sizeof(IPAddress));
-            (*address)->type = IP_ADDRESS_TYPE_IPV4;
-            (*address)->address = (void *)ipv4;
-        }
-        else
-        {
-            /*
-             * We know it is a valid IPV4 address and we know we don't need the
-             * IPV4 structure.
-             */
-            free (ipv4);
-        }
-    }
-    else if (IPV6_parser(pad, ipv6) == 0)
-    {
-        free (ipv4);
-        if (create_object)
-        {
-            *address = (IPAddress *)xmalloc(sizeof(IPAddress));
-            (*address)->type = IP_ADDRESS_TYPE_IPV6;
-            (*address)->address = (void *)ipv6;
-        }
-        else
-        {
-            /*
-             * We know it is a valid IPV6 address and we know we don't need the
-             * IPV6 structure.
-             */
-            free (ipv6);
-        }
-    }
-    else
+
+    IPAddr addr;
+    if (!IPAddrParse(BufferData(source), BufferSize(source), &addr))
     {
         /*
          * It was not a valid IP address.
          */
-        free (ipv4);
-        free (ipv6);
         return false;
     }
+    if (address)
+    {
+        *address = IPAddressNewFromAddr(&addr);
+    }
     return true;
 }
 
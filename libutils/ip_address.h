@@ -25,6 +25,7 @@
 #ifndef CFENGINE_IP_ADDRESS_H
 #define CFENGINE_IP_ADDRESS_H
 
+#include <stdint.h>
 #include <buffer.h>
 
 typedef struct IPAddress IPAddress;
@@ -34,6 +35,79 @@ typedef enum
     IP_ADDRESS_TYPE_IPV6
 } IPAddressVersion;
 
+/**
+  @brief IP address as a plain value, to parse and compare addresses without
+         allocating anything.
+
+  The address is kept in network byte order and everything not used by it
+  is zero, so equal addresses are equal byte by byte (the port aside) and the
+  whole struct can be used as a Map key, see IPAddrHash_untyped() and
+  IPAddrEqual_untyped().
+  */
+typedef struct
+{
+    uint8_t bytes[16];  /* IPv4 addresses use the first 4 */
+    uint16_t port;      /* 0 if no port was given */
+    uint8_t type;       /* IPAddressVersion */
+    uint8_t reserved;   /* always 0 */
+} IPAddr;
+
+/* Enough for any address printed by IPAddrToString(), with the '\0' */
+#define IP_ADDR_STRING_SIZE 40
+
+/**
+  @brief Parses an IPv4 or IPv6 address (with an optional port) from the
+         first #len characters of #str, which need not be '\0'-terminated.
+  @param addr Where to store the result, may be NULL to only validate #str.
+  @return true if #str is a valid IP address.
+  */
+bool IPAddrParse(const char *str, size_t len, IPAddr *addr);
+
+/**
+  @brief Same as IPAddrParse() for hex strings (as in procfs).
+  */
+bool IPAddrParseHex(const char *str, size_t len, IPAddr *addr);
+
+/**
+  @brief Parses a network in CIDR notation ("10.0.0.0/8", "fe80::/10"), or a
+         single address, which is taken as a network of its full length.
+  @note The bits of #addr beyond the prefix are cleared, ports are not allowed.
+  @return true if #str is a valid network.
+  */
+bool IPAddrParseCidr(const char *str, size_t len, IPAddr *addr, unsigned int *prefix_len);
+
+/* Number of bits in an address of the given version, 32 or 128 */
+#define IP_ADDR_BITS(type) (((type) == IP_ADDRESS_TYPE_IPV4) ? 32 : 128)
+
+/**
+  @brief Prints the address (without the port) the way IPAddressGetAddress() does.
+  @return false if #size is too small, IP_ADDR_STRING_SIZE is always enough.
+  */
+bool IPAddrToString(const IPAddr *addr, char *buf, size_t size);
+
+/**
+  @brief Orders IPv4 addresses before IPv6 ones, then by address. The port
+         is ignored, as in IPAddressIsEqual() and IPAddressCompareLess().
+  @return <0, 0 or >0 like memcmp().
+  */
+int IPAddrCompare(const IPAddr *a, const IPAddr *b);
+bool IPAddrEqual(const IPAddr *a, const IPAddr *b);
+unsigned int IPAddrHash(const IPAddr *addr, unsigned int seed);
+
+/* For Maps and Sets keyed by IPAddr pointers */
+unsigned int IPAddrHash_untyped(const void *addr, unsigned int seed);
+bool IPAddrEqual_untyped(const void *a, const void *b);
+
+/**
+  @brief Creates an IPAddress object for the given address value.
+  */
+IPAddress *IPAddressNewFromAddr(const IPAddr *addr);
+
+/**
+  @brief The address value of an IPAddress object.
+  */
+const IPAddr *IPAddressGetAddr(const IPAddress *address);
+
 /**
   @brief Creates a new IPAddress object from a string.
   @param source Buffer containing the string representation of the ip address.
@@ -0,0 +1,1126 @@
+/*
+  Copyright 2023 Northern.tech AS
+
+  This file is part of CFEngine 3 - written and maintained by Northern.tech AS.
+
+  This program is free software; you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by the
+  Free Software Foundation; version 3.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA
+
+  To the extent this program is licensed as part of the Enterprise
+  versions of CFEngine, the applicable Commercial Open Source License
+  (COSL) may apply to this file if you as a licensee so wish it. See
+  included file COSL.txt.
+*/
+
+#include <platform.h>
+#include <json-binary.h>
+#include <json-priv.h>
+
+#include <alloc.h>
+#include <file_lib.h>
+#include <logging.h>
+#include <map.h>
+#include <misc_lib.h>
+#include <sequence.h>
+#include <set.h>
+#include <string_lib.h>
+
+/*
+  Document:  "CFJB" version(u8) 0(u8 x 3) key_count(u32)
+             key_count x (length(u32) bytes '\0')
+             value
+  Value:     tag(u8) followed by
+             NULL, FALSE, TRUE:           nothing
+             INTEGER:                     i64
+             REAL:                        IEEE 754 double
+             STRING, *_TEXT:              length(u32) bytes '\0'
+             ARRAY:                       count(u32) size(u64) count x value
+             OBJECT:                      count(u32) size(u64) count x (key_index(u32) value)
+  where size is the number of bytes of the elements of a container.
+*/
+
+#define JSON_BINARY_MAGIC "CFJB"
+#define JSON_BINARY_VERSION 1
+#define JSON_BINARY_HEADER_SIZE 12
+#define JSON_BINARY_CONTAINER_HEADER_SIZE 13
+#define JSON_BINARY_MAX_DEPTH 512
+
+typedef enum
+{
+    JSON_BINARY_TAG_NULL = 0,
+    JSON_BINARY_TAG_FALSE,
+    JSON_BINARY_TAG_TRUE,
+    JSON_BINARY_TAG_INTEGER,
+    JSON_BINARY_TAG_REAL,
+    JSON_BINARY_TAG_STRING,
+    // numbers which would not be written out the same way as native numbers
+    JSON_BINARY_TAG_INTEGER_TEXT,
+    JSON_BINARY_TAG_REAL_TEXT,
+    JSON_BINARY_TAG_ARRAY,
+    JSON_BINARY_TAG_OBJECT,
+} JsonBinaryTag;
+
+struct JsonBinary_
+{
+    FileMapping *mapping;
+    const unsigned char *root;
+    uint32_t key_count;
+    const char **keys;
+    uint32_t *key_lengths;
+};
+
+static uint32_t ReadU32(const unsigned char *const p)
+{
+    return (uint32_t) p[0] | ((uint32_t) p[1] << 8) |
+        ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static uint64_t ReadU64(const unsigned char *const p)
+{
+    return (uint64_t) ReadU32(p) | ((uint64_t) ReadU32(p + 4) << 32);
+}
+
+static double ReadDouble(const unsigned char *const p)
+{
+    const uint64_t bits = ReadU64(p);
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+static void StoreU32(unsigned char *const p, const uint32_t value)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        p[i] = (value >> (8 * i)) & 0xff;
+    }
+}
+
+static void StoreU64(unsigned char *const p, const uint64_t value)
+{
+    StoreU32(p, value & 0xffffffff);
+    StoreU32(p + 4, value >> 32);
+}
+
+// *******************************************************************************************
+// Writing
+// *******************************************************************************************
+
+typedef struct
+{
+    // output goes to out, or to fd through buffer
+    Buffer *out;
+    int fd;
+    bool write_failed;
+
+    // property name -> (index in key_names + 1)
+    Map *key_indices;
+    Seq *key_names;
+
+    // sizes of the elements of all the containers, in the order they are written
+    uint64_t *sizes;
+    size_t sizes_count;
+    size_t sizes_capacity;
+    size_t next_size;
+
+    // key indices of all the object members, in the order they are written
+    uint32_t *members;
+    size_t members_count;
+    size_t members_capacity;
+    size_t next_member;
+
+    bool too_big;
+
+    unsigned char buffer[4096];
+    size_t buffer_used;
+} JsonBinaryEncoder;
+
+/**
+  @brief Numbers are stored natively when JsonIntegerCreate64() would give
+         back the same text, i.e. for the integers without leading zeros, signs
+         or exponents that fit in 64 bits.
+  */
+static bool IntegerIsNative(const char *text, int64_t *const value_out)
+{
+    const bool negative = (*text == '-');
+    if (negative)
+    {
+        text++;
+    }
+
+    const size_t digits = strspn(text, "0123456789");
+    if (digits == 0 || digits > 18 || text[digits] != '\0' ||
+        (text[0] == '0' && (digits > 1 || negative)))
+    {
+        return false;
+    }
+
+    int64_t value = 0;
+    for (size_t i = 0; i < digits; i++)
+    {
+        value = value * 10 + (text[i] - '0');
+    }
+    *value_out = negative ? -value : value;
+    return true;
+}
+
+/**
+  @brief Like IntegerIsNative(), for the text JsonRealCreate() makes.
+  */
+static bool RealIsNative(const char *text, double *const value_out)
+{
+    const bool negative = (*text == '-');
+    const char *const digits = negative ? text + 1 : text;
+    const size_t integral = strspn(digits, "0123456789");
+
+    if (integral == 0 || (digits[0] == '0' && integral > 1) ||
+        digits[integral] != '.' ||
+        strspn(digits + integral + 1, "0123456789") != 4 ||
+        digits[integral + 5] != '\0')
+    {
+        return false;
+    }
+
+    if (integral + 4 <= 15)
+    {
+        // exact as an integer, and dividing by 10000 gives the double nearest
+        // to the text, which "%.4f" turns back into the text
+        int64_t mantissa = 0;
+        for (const char *c = digits; *c != '\0'; c++)
+        {
+            if (*c != '.')
+            {
+                mantissa = mantissa * 10 + (*c - '0');
+            }
+        }
+        const double value = (double) mantissa / 10000.0;
+        *value_out = negative ? -value : value;
+        return true;
+    }
+
+    char *end;
+    const double value = strtod(text, &end);
+    if (*end != '\0' || !isfinite(value))
+    {
+        return false;
+    }
+
+    char formatted[32];
+    if (snprintf(formatted, sizeof(formatted), "%.4f", value) >= (int) sizeof(formatted) ||
+        !StringEqual(formatted, text))
+    {
+        return false;
+    }
+
+    *value_out = value;
+    return true;
+}
+
+static uint64_t MeasureString(JsonBinaryEncoder *const enc, const size_t length)
+{
+    if (length > UINT32_MAX)
+    {
+        enc->too_big = true;
+    }
+    return 1 + 4 + length + 1;
+}
+
+static uint64_t MeasureValue(JsonBinaryEncoder *const enc, const JsonElement *const element)
+{
+    if (JsonGetElementType(element) == JSON_ELEMENT_TYPE_PRIMITIVE)
+    {
+        const char *const text = JsonPrimitiveGetAsString(element);
+        int64_t integer;
+        double real;
+
+        switch (JsonGetPrimitiveType(element))
+        {
+        case JSON_PRIMITIVE_TYPE_INTEGER:
+            return IntegerIsNative(text, &integer) ? 9 : MeasureString(enc, strlen(text));
+        case JSON_PRIMITIVE_TYPE_REAL:
+            return RealIsNative(text, &real) ? 9 : MeasureString(enc, strlen(text));
+        case JSON_PRIMITIVE_TYPE_STRING:
+            return MeasureString(enc, strlen(text));
+        case JSON_PRIMITIVE_TYPE_BOOL:
+        case JSON_PRIMITIVE_TYPE_NULL:
+            return 1;
+        }
+        UnexpectedError("Unknown JSON primitive type: %d", JsonGetPrimitiveType(element));
+        return 0;
+    }
+
+    // reserve the slot of this container before those of its children
+    if (enc->sizes_count == enc->sizes_capacity)
+    {
+        enc->sizes_capacity = MAX(64, enc->sizes_capacity * 2);
+        enc->sizes = xrealloc(enc->sizes, enc->sizes_capacity * sizeof(uint64_t));
+    }
+    const size_t slot = enc->sizes_count++;
+
+    const bool object = (JsonGetContainerType(element) == JSON_CONTAINER_TYPE_OBJECT);
+    const size_t length = JsonLength(element);
+    if (length > UINT32_MAX)
+    {
+        enc->too_big = true;
+    }
+
+    uint64_t size = 0;
+    for (size_t i = 0; i < length; i++)
+    {
+        const JsonElement *const child = JsonContainerChildAt(element, i);
+        if (object)
+        {
+            char *const key = (char *) JsonGetPropertyAsString(child);
+            uintptr_t index = (uintptr_t) MapGet(enc->key_indices, key);
+            if (index == 0)
+            {
+                SeqAppend(enc->key_names, key);
+                index = SeqLength(enc->key_names);
+                MapInsert(enc->key_indices, key, (void *) index);
+                MeasureString(enc, strlen(key));
+            }
+
+            if (enc->members_count == enc->members_capacity)
+            {
+                enc->members_capacity = MAX(64, enc->members_capacity * 2);
+                enc->members = xrealloc(enc->members, enc->members_capacity * sizeof(uint32_t));
+            }
+            enc->members[enc->members_count++] = index - 1;
+            size += 4;
+        }
+        size += MeasureValue(enc, child);
+    }
+
+    enc->sizes[slot] = size;
+    return JSON_BINARY_CONTAINER_HEADER_SIZE + size;
+}
+
+static void EncoderFlush(JsonBinaryEncoder *const enc)
+{
+    if (enc->buffer_used > 0 &&
+        FullWrite(enc->fd, (const char *) enc->buffer, enc->buffer_used) < 0)
+    {
+        enc->write_failed = true;
+    }
+    enc->buffer_used = 0;
+}
+
+static void EncoderWrite(
+    JsonBinaryEncoder *const enc, const void *const data, const size_t length)
+{
+    if (enc->out != NULL)
+    {
+        BufferAppend(enc->out, data, length);
+        return;
+    }
+    if (enc->write_failed)
+    {
+        return;
+    }
+
+    if (enc->buffer_used + length > sizeof(enc->buffer))
+    {
+        EncoderFlush(enc);
+        if (length > sizeof(enc->buffer))
+        {
+            if (FullWrite(enc->fd, data, length) < 0)
+            {
+                enc->write_failed = true;
+            }
+            return;
+        }
+    }
+    memcpy(enc->buffer + enc->buffer_used, data, length);
+    enc->buffer_used += length;
+}
+
+static void EncodeString(
+    JsonBinaryEncoder *const enc, const JsonBinaryTag tag, const char *const value)
+{
+    const size_t length = strlen(value);
+    unsigned char header[5] = { tag };
+    StoreU32(header + 1, length);
+    EncoderWrite(enc, header, sizeof(header));
+    EncoderWrite(enc, value, length + 1);
+}
+
+static void EncodeValue(JsonBinaryEncoder *const enc, const JsonElement *const element)
+{
+    unsigned char header[JSON_BINARY_CONTAINER_HEADER_SIZE];
+
+    if (JsonGetElementType(element) == JSON_ELEMENT_TYPE_PRIMITIVE)
+    {
+        const char *const text = JsonPrimitiveGetAsString(element);
+        int64_t integer;
+        double real;
+
+        switch (JsonGetPrimitiveType(element))
+        {
+        case JSON_PRIMITIVE_TYPE_INTEGER:
+            if (!IntegerIsNative(text, &integer))
+            {
+                EncodeString(enc, JSON_BINARY_TAG_INTEGER_TEXT, text);
+                return;
+            }
+            header[0] = JSON_BINARY_TAG_INTEGER;
+            StoreU64(header + 1, (uint64_t) integer);
+            EncoderWrite(enc, header, 9);
+            return;
+
+        case JSON_PRIMITIVE_TYPE_REAL:
+            if (!RealIsNative(text, &real))
+            {
+                EncodeString(enc, JSON_BINARY_TAG_REAL_TEXT, text);
+                return;
+            }
+            {
+                uint64_t bits;
+                memcpy(&bits, &real, sizeof(bits));
+                header[0] = JSON_BINARY_TAG_REAL;
+                StoreU64(header + 1, bits);
+            }
+            EncoderWrite(enc, header, 9);
+            return;
+
+        case JSON_PRIMITIVE_TYPE_STRING:
+            EncodeString(enc, JSON_BINARY_TAG_STRING, text);
+            return;
+
+        case JSON_PRIMITIVE_TYPE_BOOL:
+            header[0] = JsonPrimitiveGetAsBool(element) ?
+                JSON_BINARY_TAG_TRUE : JSON_BINARY_TAG_FALSE;
+            EncoderWrite(enc, header, 1);
+            return;
+
+        case JSON_PRIMITIVE_TYPE_NULL:
+            header[0] = JSON_BINARY_TAG_NULL;
+            EncoderWrite(enc, header, 1);
+            return;
+        }
+        UnexpectedError("Unknown JSON primitive type: %d", JsonGetPrimitiveType(element));
+        return;
+    }
+
+    const bool object = (JsonGetContainerType(element) == JSON_CONTAINER_TYPE_OBJECT);
+    const size_t length = JsonLength(element);
+
+    assert(enc->next_size < enc->sizes_count);
+    header[0] = object ? JSON_BINARY_TAG_OBJECT : JSON_BINARY_TAG_ARRAY;
+    StoreU32(header + 1, length);
+    StoreU64(header + 5, enc->sizes[enc->next_size++]);
+    EncoderWrite(enc, header, sizeof(header));
+
+    for (size_t i = 0; i < length; i++)
+    {
+        const JsonElement *const child = JsonContainerChildAt(element, i);
+        if (object)
+        {
+            assert(enc->next_member < enc->members_count);
+            unsigned char key_index[4];
+            StoreU32(key_index, enc->members[enc->next_member++]);
+            EncoderWrite(enc, key_index, sizeof(key_index));
+        }
+        EncodeValue(enc, child);
+    }
+}
+
+static bool JsonEncodeBinary(JsonBinaryEncoder *const enc, const JsonElement *const json)
+{
+    assert(json != NULL);
+
+    enc->key_indices = MapNew(StringHash_untyped, StringEqual_untyped, NULL, NULL);
+    enc->key_names = SeqNew(64, NULL);
+
+    MeasureValue(enc, json);
+
+    const size_t key_count = SeqLength(enc->key_names);
+    const bool ok = !enc->too_big && key_count <= UINT32_MAX;
+    if (ok)
+    {
+        unsigned char header[JSON_BINARY_HEADER_SIZE] = { 0 };
+        memcpy(header, JSON_BINARY_MAGIC, 4);
+        header[4] = JSON_BINARY_VERSION;
+        StoreU32(header + 8, key_count);
+        EncoderWrite(enc, header, sizeof(header));
+
+        for (size_t i = 0; i < key_count; i++)
+        {
+            const char *const key = SeqAt(enc->key_names, i);
+            const size_t length = strlen(key);
+            unsigned char key_length[4];
+            StoreU32(key_length, length);
+            EncoderWrite(enc, key_length, sizeof(key_length));
+            EncoderWrite(enc, key, length + 1);
+        }
+
+        EncodeValue(enc, json);
+    }
+
+    free(enc->sizes);
+    free(enc->members);
+    SeqDestroy(enc->key_names);
+    MapDestroy(enc->key_indices);
+    return ok;
+}
+
+bool JsonWriteBinary(Buffer *const buffer, const JsonElement *const json)
+{
+    assert(buffer != NULL);
+
+    BufferSetMode(buffer, BUFFER_BEHAVIOR_BYTEARRAY);
+
+    JsonBinaryEncoder *const enc = xcalloc(1, sizeof(JsonBinaryEncoder));
+    enc->out = buffer;
+    const bool ok = JsonEncodeBinary(enc, json);
+    free(enc);
+    return ok;
+}
+
+bool JsonWriteBinaryFd(const int fd, const JsonElement *const json)
+{
+    assert(fd >= 0);
+
+    JsonBinaryEncoder *const enc = xcalloc(1, sizeof(JsonBinaryEncoder));
+    enc->fd = fd;
+    bool ok = JsonEncodeBinary(enc, json);
+    EncoderFlush(enc);
+    if (enc->write_failed)
+    {
+        Log(LOG_LEVEL_ERR, "Failed to write binary JSON data (write: %s)", GetErrorStr());
+        ok = false;
+    }
+    free(enc);
+    return ok;
+}
+
+// *******************************************************************************************
+// Reading
+// *******************************************************************************************
+
+typedef struct
+{
+    const unsigned char *end;
+    uint32_t key_count;
+
+    // for finding duplicate keys, the number of the object each key was last seen in
+    uint32_t *key_seen;
+    uint32_t objects;
+} JsonBinaryValidator;
+
+/**
+  @return Where the value at #p ends, for values in validated documents only.
+  */
+static const unsigned char *SkipValue(const unsigned char *const p)
+{
+    switch (*p)
+    {
+    case JSON_BINARY_TAG_NULL:
+    case JSON_BINARY_TAG_FALSE:
+    case JSON_BINARY_TAG_TRUE:
+        return p + 1;
+    case JSON_BINARY_TAG_INTEGER:
+    case JSON_BINARY_TAG_REAL:
+        return p + 9;
+    case JSON_BINARY_TAG_STRING:
+    case JSON_BINARY_TAG_INTEGER_TEXT:
+    case JSON_BINARY_TAG_REAL_TEXT:
+        return p + 5 + ReadU32(p + 1) + 1;
+    case JSON_BINARY_TAG_ARRAY:
+    case JSON_BINARY_TAG_OBJECT:
+        return p + JSON_BINARY_CONTAINER_HEADER_SIZE + ReadU64(p + 5);
+    }
+    ProgrammingError("Invalid binary JSON tag %d", *p);
+}
+
+static bool ValidateString(
+    const JsonBinaryValidator *const v, const unsigned char **const p)
+{
+    if ((size_t) (v->end - *p) < 4)
+    {
+        return false;
+    }
+    const uint32_t length = ReadU32(*p);
+    *p += 4;
+    if ((size_t) (v->end - *p) <= length || (*p)[length] != '\0')
+    {
+        return false;
+    }
+    *p += length + 1;
+    return true;
+}
+
+static bool ValidateValue(
+    JsonBinaryValidator *const v, const unsigned char **const p, const size_t depth)
+{
+    if (*p >= v->end)
+    {
+        return false;
+    }
+
+    const unsigned char *const start = *p;
+    const unsigned char tag = *((*p)++);
+    switch (tag)
+    {
+    case JSON_BINARY_TAG_NULL:
+    case JSON_BINARY_TAG_FALSE:
+    case JSON_BINARY_TAG_TRUE:
+        return true;
+
+    case JSON_BINARY_TAG_INTEGER:
+    case JSON_BINARY_TAG_REAL:
+        if (v->end - *p < 8)
+        {
+            return false;
+        }
+        *p += 8;
+        return true;
+
+    case JSON_BINARY_TAG_STRING:
+        return ValidateString(v, p);
+
+    case JSON_BINARY_TAG_INTEGER_TEXT:
+    case JSON_BINARY_TAG_REAL_TEXT:
+        if (!ValidateString(v, p))
+        {
+            return false;
+        }
+        {
+            const char *const text = (const char *) start + 5;
+            const size_t length = ReadU32(start + 1);
+            return length > 0 && strspn(text, "0123456789+-.eE") == length;
+        }
+
+    case JSON_BINARY_TAG_ARRAY:
+    case JSON_BINARY_TAG_OBJECT:
+        break;
+
+    default:
+        return false;
+    }
+
+    if (depth >= JSON_BINARY_MAX_DEPTH || v->end - *p < 12)
+    {
+        return false;
+    }
+
+    const bool object = (tag == JSON_BINARY_TAG_OBJECT);
+    const uint32_t count = ReadU32(*p);
+    const uint64_t size = ReadU64(*p + 4);
+    *p += 12;
+    if (size > (uint64_t) (v->end - *p))
+    {
+        return false;
+    }
+
+    const unsigned char *const end = v->end;
+    const unsigned char *const contents = *p;
+    v->end = *p + size;
+
+    bool valid = true;
+    for (uint32_t i = 0; valid && i < count; i++)
+    {
+        if (object)
+        {
+            if (v->end - *p < 4 || ReadU32(*p) >= v->key_count)
+            {
+                valid = false;
+                break;
+            }
+            *p += 4;
+        }
+        valid = ValidateValue(v, p, depth + 1);
+    }
+    valid = valid && (*p == v->end);
+    v->end = end;
+
+    if (valid && object)
+    {
+        // the nested objects are done with key_seen, so it is ours now
+        const uint32_t number = ++(v->objects);
+        const unsigned char *member = contents;
+        for (uint32_t i = 0; i < count; i++)
+        {
+            const uint32_t key = ReadU32(member);
+            if (v->key_seen[key] == number)
+            {
+                return false;
+            }
+            v->key_seen[key] = number;
+            member = SkipValue(member + 4);
+        }
+    }
+
+    return valid;
+}
+
+JsonBinary *JsonBinaryOpen(const char *const data, const size_t length)
+{
+    assert(data != NULL || length == 0);
+
+    const unsigned char *p = (const unsigned char *) data;
+    const unsigned char *const end = p + length;
+
+    if (length < JSON_BINARY_HEADER_SIZE ||
+        memcmp(p, JSON_BINARY_MAGIC, 4) != 0 ||
+        p[4] != JSON_BINARY_VERSION)
+    {
+        return NULL;
+    }
+
+    const uint32_t key_count = ReadU32(p + 8);
+    p += JSON_BINARY_HEADER_SIZE;
+
+    // each key takes at least 5 bytes, which bounds the allocations below
+    if (key_count > (size_t) (end - p) / 5)
+    {
+        return NULL;
+    }
+
+    JsonBinary *const doc = xcalloc(1, sizeof(JsonBinary));
+    doc->key_count = key_count;
+    doc->keys = xcalloc(key_count, sizeof(const char *));
+    doc->key_lengths = xcalloc(key_count, sizeof(uint32_t));
+
+    JsonBinaryValidator v = {
+        .end = end,
+        .key_count = key_count,
+        .key_seen = xcalloc(key_count, sizeof(uint32_t)),
+        .objects = 0,
+    };
+
+    bool valid = true;
+    // keys must be unique as strings, as which they end up in objects
+    Set *const unique_keys = SetNew(StringHash_untyped, StringEqual_untyped, NULL);
+    for (uint32_t i = 0; valid && i < key_count; i++)
+    {
+        // the length is only there to read once ValidateString() checked it
+        const unsigned char *const key = p;
+        if (!ValidateString(&v, &p))
+        {
+            valid = false;
+            break;
+        }
+        doc->key_lengths[i] = ReadU32(key);
+        doc->keys[i] = (const char *) key + 4;
+        valid = !SetContains(unique_keys, doc->keys[i]);
+        SetAdd(unique_keys, (void *) doc->keys[i]);
+    }
+    SetDestroy(unique_keys);
+
+    doc->root = p;
+    valid = valid && ValidateValue(&v, &p, 0) && p == end;
+    free(v.key_seen);
+
+    if (!valid)
+    {
+        JsonBinaryClose(doc);
+        return NULL;
+    }
+    return doc;
+}
+
+JsonBinary *JsonBinaryOpenFile(const char *const path, const size_t size_max)
+{
+    assert(path != NULL);
+
+    bool truncated = false;
+    FileMapping *const mapping = FileMap(path, size_max, &truncated);
+    if (mapping == NULL)
+    {
+        return NULL;
+    }
+
+    JsonBinary *const doc = truncated ? NULL :
+        JsonBinaryOpen(FileMappingData(mapping), FileMappingLength(mapping));
+    if (doc == NULL)
+    {
+        FileUnmap(mapping);
+        return NULL;
+    }
+
+    doc->mapping = mapping;
+    return doc;
+}
+
+void JsonBinaryClose(JsonBinary *const doc)
+{
+    if (doc != NULL)
+    {
+        if (doc->mapping != NULL)
+        {
+            FileUnmap(doc->mapping);
+        }
+        free(doc->keys);
+        free(doc->key_lengths);
+        free(doc);
+    }
+}
+
+JsonBinaryValue JsonBinaryRoot(const JsonBinary *const doc)
+{
+    assert(doc != NULL);
+
+    return (JsonBinaryValue) { .doc = doc, .data = doc->root };
+}
+
+JsonType JsonBinaryGetType(const JsonBinaryValue value)
+{
+    assert(value.data != NULL);
+
+    switch (*value.data)
+    {
+    case JSON_BINARY_TAG_NULL:
+        return JSON_TYPE_NULL;
+    case JSON_BINARY_TAG_FALSE:
+    case JSON_BINARY_TAG_TRUE:
+        return JSON_TYPE_BOOL;
+    case JSON_BINARY_TAG_INTEGER:
+    case JSON_BINARY_TAG_INTEGER_TEXT:
+        return JSON_TYPE_INTEGER;
+    case JSON_BINARY_TAG_REAL:
+    case JSON_BINARY_TAG_REAL_TEXT:
+        return JSON_TYPE_REAL;
+    case JSON_BINARY_TAG_STRING:
+        return JSON_TYPE_STRING;
+    case JSON_BINARY_TAG_ARRAY:
+        return JSON_TYPE_ARRAY;
+    case JSON_BINARY_TAG_OBJECT:
+        return JSON_TYPE_OBJECT;
+    }
+    ProgrammingError("Invalid binary JSON tag %d", *value.data);
+}
+
+size_t JsonBinaryLength(const JsonBinaryValue value)
+{
+    assert(value.data != NULL);
+
+    if (*value.data == JSON_BINARY_TAG_ARRAY || *value.data == JSON_BINARY_TAG_OBJECT)
+    {
+        return ReadU32(value.data + 1);
+    }
+    return 0;
+}
+
+JsonBinaryIterator JsonBinaryIteratorInit(const JsonBinaryValue container)
+{
+    JsonBinaryIterator iter = {
+        .doc = container.doc,
+        .object = (*container.data == JSON_BINARY_TAG_OBJECT),
+        .remaining = JsonBinaryLength(container),
+        .next = container.data + JSON_BINARY_CONTAINER_HEADER_SIZE,
+    };
+    return iter;
+}
+
+bool JsonBinaryIteratorNext(
+    JsonBinaryIterator *const iter, const char **const key_out,
+    JsonBinaryValue *const value_out)
+{
+    assert(iter != NULL);
+    assert(value_out != NULL);
+
+    if (iter->remaining == 0)
+    {
+        return false;
+    }
+    iter->remaining--;
+
+    const char *key = NULL;
+    if (iter->object)
+    {
+        key = iter->doc->keys[ReadU32(iter->next)];
+        iter->next += 4;
+    }
+    if (key_out != NULL)
+    {
+        *key_out = key;
+    }
+
+    value_out->doc = iter->doc;
+    value_out->data = iter->next;
+    iter->next = SkipValue(iter->next);
+    return true;
+}
+
+bool JsonBinaryObjectGet(
+    const JsonBinaryValue object, const char *const key,
+    JsonBinaryValue *const value_out)
+{
+    assert(key != NULL);
+    assert(value_out != NULL);
+
+    if (*object.data != JSON_BINARY_TAG_OBJECT)
+    {
+        return false;
+    }
+
+    const JsonBinary *const doc = object.doc;
+    const size_t length = strlen(key);
+    JsonBinaryIterator iter = JsonBinaryIteratorInit(object);
+    while (iter.remaining > 0)
+    {
+        const uint32_t index = ReadU32(iter.next);
+        const bool found = (doc->key_lengths[index] == length &&
+                            memcmp(doc->keys[index], key, length) == 0);
+        iter.next += 4;
+        if (found)
+        {
+            value_out->doc = doc;
+            value_out->data = iter.next;
+            return true;
+        }
+        iter.next = SkipValue(iter.next);
+        iter.remaining--;
+    }
+    return false;
+}
+
+bool JsonBinaryArrayGet(
+    const JsonBinaryValue array, const size_t index, JsonBinaryValue *const value_out)
+{
+    assert(value_out != NULL);
+
+    if (*array.data != JSON_BINARY_TAG_ARRAY || index >= JsonBinaryLength(array))
+    {
+        return false;
+    }
+
+    JsonBinaryIterator iter = JsonBinaryIteratorInit(array);
+    for (size_t i = 0; i < index; i++)
+    {
+        iter.next = SkipValue(iter.next);
+    }
+    value_out->doc = array.doc;
+    value_out->data = iter.next;
+    return true;
+}
+
+const char *JsonBinaryGetString(const JsonBinaryValue value)
+{
+    if (*value.data != JSON_BINARY_TAG_STRING)
+    {
+        return NULL;
+    }
+    return (const char *) value.data + 5;
+}
+
+bool JsonBinaryGetBool(const JsonBinaryValue value, bool *const value_out)
+{
+    assert(value_out != NULL);
+
+    if (*value.data != JSON_BINARY_TAG_TRUE && *value.data != JSON_BINARY_TAG_FALSE)
+    {
+        return false;
+    }
+    *value_out = (*value.data == JSON_BINARY_TAG_TRUE);
+    return true;
+}
+
+bool JsonBinaryGetInteger(const JsonBinaryValue value, int64_t *const value_out)
+{
+    assert(value_out != NULL);
+
+    switch (*value.data)
+    {
+    case JSON_BINARY_TAG_INTEGER:
+        *value_out = (int64_t) ReadU64(value.data + 1);
+        return true;
+    case JSON_BINARY_TAG_INTEGER_TEXT:
+        return StringToInt64((const char *) value.data + 5, value_out) == 0;
+    default:
+        return false;
+    }
+}
+
+bool JsonBinaryGetReal(const JsonBinaryValue value, double *const value_out)
+{
+    assert(value_out != NULL);
+
+    switch (*value.data)
+    {
+    case JSON_BINARY_TAG_REAL:
+        *value_out = ReadDouble(value.data + 1);
+        return true;
+    case JSON_BINARY_TAG_INTEGER:
+        *value_out = (double) (int64_t) ReadU64(value.data + 1);
+        return true;
+    case JSON_BINARY_TAG_INTEGER_TEXT:
+    case JSON_BINARY_TAG_REAL_TEXT:
+    {
+        const char *const text = (const char *) value.data + 5;
+        char *end;
+        *value_out = strtod(text, &end);
+        return end != text && *end == '\0';
+    }
+    default:
+        return false;
+    }
+}
+
+/**
+  @brief Number with the same text as JsonIntegerCreate64() and
+         JsonRealCreate() make, without going through printf().
+  */
+static JsonElement *FormatNumber(
+    const JsonPrimitiveType type, const bool negative, uint64_t magnitude,
+    const int decimals)
+{
+    char text[32];
+    char *const end = text + sizeof(text);
+    char *start = end;
+    for (int i = 0; i < decimals; i++)
+    {
+        *(--start) = '0' + (magnitude % 10);
+        magnitude /= 10;
+    }
+    if (decimals > 0)
+    {
+        *(--start) = '.';
+    }
+    do
+    {
+        *(--start) = '0' + (magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude > 0);
+    if (negative)
+    {
+        *(--start) = '-';
+    }
+    return JsonPrimitiveCreateLen(type, start, end - start);
+}
+
+static JsonElement *BuildValue(
+    const JsonBinary *const doc, JsonSharedKey **const keys,
+    const unsigned char *const p)
+{
+    switch (*p)
+    {
+    case JSON_BINARY_TAG_NULL:
+        return JsonNullCreate();
+    case JSON_BINARY_TAG_FALSE:
+        return JsonBoolCreate(false);
+    case JSON_BINARY_TAG_TRUE:
+        return JsonBoolCreate(true);
+    case JSON_BINARY_TAG_INTEGER:
+    {
+        const int64_t value = (int64_t) ReadU64(p + 1);
+        return FormatNumber(JSON_PRIMITIVE_TYPE_INTEGER, value < 0,
+                            (value < 0) ? -((uint64_t) value) : (uint64_t) value, 0);
+    }
+    case JSON_BINARY_TAG_REAL:
+    {
+        const double value = ReadDouble(p + 1);
+        if (!(fabs(value) < 1e11))
+        {
+            return JsonRealCreate(value);
+        }
+        // the reverse of RealIsNative()
+        return FormatNumber(JSON_PRIMITIVE_TYPE_REAL, signbit(value),
+                            llround(fabs(value) * 10000.0), 4);
+    }
+    case JSON_BINARY_TAG_STRING:
+        return JsonPrimitiveCreateLen(
+            JSON_PRIMITIVE_TYPE_STRING, (const char *) p + 5, ReadU32(p + 1));
+    case JSON_BINARY_TAG_INTEGER_TEXT:
+        return JsonPrimitiveCreateLen(
+            JSON_PRIMITIVE_TYPE_INTEGER, (const char *) p + 5, ReadU32(p + 1));
+    case JSON_BINARY_TAG_REAL_TEXT:
+        return JsonPrimitiveCreateLen(
+            JSON_PRIMITIVE_TYPE_REAL, (const char *) p + 5, ReadU32(p + 1));
+    }
+
+    const JsonBinaryValue container = { .doc = doc, .data = p };
+    const size_t length = JsonBinaryLength(container);
+    JsonBinaryIterator iter = JsonBinaryIteratorInit(container);
+
+    if (*p == JSON_BINARY_TAG_ARRAY)
+    {
+        JsonElement *const array = JsonArrayCreate(length);
+        for (size_t i = 0; i < length; i++)
+        {
+            JsonArrayAppendElement(array, BuildValue(doc, keys, iter.next));
+            iter.next = SkipValue(iter.next);
+        }
+        return array;
+    }
+
+    assert(*p == JSON_BINARY_TAG_OBJECT);
+    JsonElement *const object = JsonObjectCreate(length);
+    for (size_t i = 0; i < length; i++)
+    {
+        const uint32_t index = ReadU32(iter.next);
+        iter.next += 4;
+        if (keys[index] == NULL)
+        {
+            keys[index] = JsonSharedKeyNew(doc->keys[index], doc->key_lengths[index]);
+        }
+        JsonObjectAppendElementSharedKey(object, keys[index], BuildValue(doc, keys, iter.next));
+        iter.next = SkipValue(iter.next);
+    }
+    return object;
+}
+
+JsonElement *JsonBinaryToJson(const JsonBinaryValue value)
+{
+    assert(value.doc != NULL);
+
+    JsonSharedKey **const keys = xcalloc(value.doc->key_count, sizeof(JsonSharedKey *));
+    JsonElement *const json = BuildValue(value.doc, keys, value.data);
+
+    for (uint32_t i = 0; i < value.doc->key_count; i++)
+    {
+        JsonSharedKeyRelease(keys[i]);
+    }
+    free(keys);
+    return json;
+}
+
+JsonParseError JsonParseBinary(
+    const char *const data, const size_t length, JsonElement **const json_out)
+{
+    assert(json_out != NULL);
+
+    JsonBinary *const doc = JsonBinaryOpen(data, length);
+    if (doc == NULL)
+    {
+        return JSON_PARSE_ERROR_BINARY_FORMAT;
+    }
+
+    *json_out = JsonBinaryToJson(JsonBinaryRoot(doc));
+    JsonBinaryClose(doc);
+    return JSON_PARSE_OK;
+}
+
+JsonParseError JsonParseBinaryFile(
+    const char *const path, const size_t size_max, JsonElement **const json_out)
+{
+    assert(path != NULL);
+    assert(json_out != NULL);
+
+    bool truncated = false;
+    FileMapping *const mapping = FileMap(path, size_max, &truncated);
+    if (mapping == NULL)
+    {
+        return JSON_PARSE_ERROR_NO_SUCH_FILE;
+    }
+    else if (truncated)
+    {
+        FileUnmap(mapping);
+        return JSON_PARSE_ERROR_TRUNCATED;
+    }
+
+    const JsonParseError err = JsonParseBinary(
+        FileMappingData(mapping), FileMappingLength(mapping), json_out);
+    FileUnmap(mapping);
+    return err;
+}
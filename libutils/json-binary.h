@@ -0,0 +1,158 @@
+/*
+  Copyright 2023 Northern.tech AS
+
+  This file is part of CFEngine 3 - written and maintained by Northern.tech AS.
+
+  This program is free software; you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by the
+  Free Software Foundation; version 3.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA
+
+  To the extent this program is licensed as part of the Enterprise
+  versions of CFEngine, the applicable Commercial Open Source License
+  (COSL) may apply to this file if you as a licensee so wish it. See
+  included file COSL.txt.
+*/
+
+#ifndef CFENGINE_JSON_BINARY_H
+#define CFENGINE_JSON_BINARY_H
+
+#include <json.h>
+#include <buffer.h>
+
+/*
+  Binary JSON, for saving and loading state faster than with JSON text.
+
+  A document is a header followed by a table of all the property names in it
+  and the root value. Integers and reals are stored as native numbers (or as
+  text, for those whose text would not survive the round trip), strings and
+  property names are length prefixed and each name is stored once however many
+  objects use it. Arrays and objects carry the size of their contents, so they
+  can be skipped over without decoding them, which is what JsonBinaryOpen()
+  and the functions using the JsonBinaryValue type below do to read values
+  straight from the data (e.g. a mapped file) without building a JsonElement
+  tree.
+
+  All numbers in the format are little-endian, a document written on one
+  platform can be read on any other.
+*/
+
+/**
+  @brief Append #json to #buffer in binary JSON format, after switching
+         #buffer to BUFFER_BEHAVIOR_BYTEARRAY mode.
+  @return false if #json is too big for the format (strings and containers
+          larger than 4 GiB), in which case nothing was written
+  */
+bool JsonWriteBinary(Buffer *buffer, const JsonElement *json);
+
+/**
+  @brief Like JsonWriteBinary(), writing to #fd.
+  @return false also if writing fails, in which case only part of the
+          document may have been written
+  */
+bool JsonWriteBinaryFd(int fd, const JsonElement *json);
+
+/**
+  @brief Parse a binary JSON document.
+  @param json_out The parsed document, property names are shared by all the
+                  objects using them (see JsonObjectAppendElementSharedKey())
+  @return JSON_PARSE_ERROR_BINARY_FORMAT if #data is not a complete and
+          valid binary JSON document
+  */
+JsonParseError JsonParseBinary(const char *data, size_t length, JsonElement **json_out);
+JsonParseError JsonParseBinaryFile(const char *path, size_t size_max, JsonElement **json_out);
+
+typedef struct JsonBinary_ JsonBinary;
+
+/**
+  @brief A value in a JsonBinary document, only valid until it is closed.
+  */
+typedef struct
+{
+    const JsonBinary *doc;
+    const unsigned char *data;
+} JsonBinaryValue;
+
+typedef struct
+{
+    const JsonBinary *doc;
+    bool object;
+    size_t remaining;
+    const unsigned char *next;
+} JsonBinaryIterator;
+
+/**
+  @brief Check #data is a valid binary JSON document and read it in place.
+  @note #data is not copied and must stay around until JsonBinaryClose().
+  @return NULL if #data is not a valid document
+  */
+JsonBinary *JsonBinaryOpen(const char *data, size_t length);
+
+/**
+  @brief Map a binary JSON file into memory and read it in place (see
+         FileMap()).
+  @return NULL if the file cannot be read, is larger than #size_max or is not
+          a valid document
+  */
+JsonBinary *JsonBinaryOpenFile(const char *path, size_t size_max);
+void JsonBinaryClose(JsonBinary *doc);
+
+JsonBinaryValue JsonBinaryRoot(const JsonBinary *doc);
+JsonType JsonBinaryGetType(JsonBinaryValue value);
+
+/**
+  @return Number of elements of an array or object, 0 for primitives
+  */
+size_t JsonBinaryLength(JsonBinaryValue value);
+
+/**
+  @brief Find the value of #key in #object, skipping over the values of the
+         other properties.
+  @return false if #object is not an object or does not have #key
+  */
+bool JsonBinaryObjectGet(JsonBinaryValue object, const char *key, JsonBinaryValue *value_out);
+
+/**
+  @return false if #array is not an array or #index is out of its bounds
+  */
+bool JsonBinaryArrayGet(JsonBinaryValue array, size_t index, JsonBinaryValue *value_out);
+
+/**
+  @brief Iterate over the elements of an array or object, a primitive has none.
+  */
+JsonBinaryIterator JsonBinaryIteratorInit(JsonBinaryValue container);
+
+/**
+  @param key_out The property name for objects, NULL for arrays. May be NULL.
+  @return false when there are no more elements
+  */
+bool JsonBinaryIteratorNext(JsonBinaryIterator *iter, const char **key_out,
+                            JsonBinaryValue *value_out);
+
+/**
+  @return The '\0' terminated string pointing into the document, NULL if
+          #value is not a string
+  */
+const char *JsonBinaryGetString(JsonBinaryValue value);
+bool JsonBinaryGetBool(JsonBinaryValue value, bool *value_out);
+bool JsonBinaryGetInteger(JsonBinaryValue value, int64_t *value_out);
+
+/**
+  @brief Get a real, or an integer as a real.
+  */
+bool JsonBinaryGetReal(JsonBinaryValue value, double *value_out);
+
+/**
+  @brief Build a JsonElement tree from #value and everything in it.
+  */
+JsonElement *JsonBinaryToJson(JsonBinaryValue value);
+
+#endif // CFENGINE_JSON_BINARY_H
@@ -0,0 +1,834 @@
+/*
+  Copyright 2023 Northern.tech AS
+
+  This file is part of CFEngine 3 - written and maintained by Northern.tech AS.
+
+  This program is free software; you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by the
+  Free Software Foundation; version 3.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA
+
+  To the extent this program is licensed as part of the Enterprise
+  versions of CFEngine, the applicable Commercial Open Source License
+  (COSL) may apply to this file if you as a licensee so wish it. See
+  included file COSL.txt.
+*/
+
+#include <platform.h>
+#include <json-path.h>
+
+#include <alloc.h>
+#include <logging.h>
+#include <misc_lib.h>           /* ProgrammingError */
+#include <string_lib.h>         /* StringToInt64 */
+
+typedef enum
+{
+    JSON_PATH_ITEM_KEY,
+    JSON_PATH_ITEM_INDEX,
+    JSON_PATH_ITEM_SLICE,
+    JSON_PATH_ITEM_WILDCARD,
+} JsonPathItemType;
+
+typedef struct
+{
+    JsonPathItemType type;
+    char *key;
+    long index;
+    long start, end, step;      // slice
+    bool has_start, has_end;
+} JsonPathItem;
+
+typedef enum
+{
+    JSON_PATH_OP_EXISTS,
+    JSON_PATH_OP_EQ,
+    JSON_PATH_OP_NE,
+    JSON_PATH_OP_LT,
+    JSON_PATH_OP_LE,
+    JSON_PATH_OP_GT,
+    JSON_PATH_OP_GE,
+} JsonPathOperator;
+
+typedef struct
+{
+    JsonPath *operand;          // relative to the member/element tested
+    JsonPathOperator op;
+    JsonElement *literal;       // NULL for JSON_PATH_OP_EXISTS
+} JsonPathFilter;
+
+typedef struct
+{
+    bool descendant;            // applied at any depth (..)
+    size_t n_items;
+    JsonPathItem *items;
+    JsonPathFilter *filter;     // instead of items
+} JsonPathStep;
+
+struct JsonPath_
+{
+    size_t n_steps;
+    JsonPathStep *steps;
+};
+
+// *******************************************************************************************
+// Compilation
+// *******************************************************************************************
+
+typedef struct
+{
+    const char *p;
+    const char *error;
+} JsonPathParser;
+
+static JsonPath *ParsePath(JsonPathParser *parser, bool relative);
+
+static void SkipSpaces(JsonPathParser *parser)
+{
+    while (*parser->p == ' ' || *parser->p == '\t')
+    {
+        parser->p++;
+    }
+}
+
+static bool Fail(JsonPathParser *parser, const char *error)
+{
+    parser->error = error;
+    return false;
+}
+
+static bool IsNameEnd(char c, bool relative)
+{
+    if (c == '\0' || c == '.' || c == '[' || c == ']')
+    {
+        return true;
+    }
+    // in a filter, the path ends where the comparison starts
+    return relative && strchr(" \t)=!<>", c) != NULL;
+}
+
+static bool ParseName(JsonPathParser *parser, bool relative, char **name)
+{
+    const char *start = parser->p;
+    while (!IsNameEnd(*parser->p, relative))
+    {
+        parser->p++;
+    }
+    if (parser->p == start)
+    {
+        return Fail(parser, "expected a name");
+    }
+
+    *name = xstrndup(start, parser->p - start);
+    return true;
+}
+
+static bool ParseQuoted(JsonPathParser *parser, char **string)
+{
+    const char quote = *parser->p++;
+    assert(quote == '\'' || quote == '"');
+
+    char *const result = xmalloc(strlen(parser->p) + 1);
+    size_t length = 0;
+    while (*parser->p != quote)
+    {
+        if (*parser->p == '\\' && parser->p[1] != '\0')
+        {
+            parser->p++;
+        }
+        if (*parser->p == '\0')
+        {
+            free(result);
+            return Fail(parser, "unterminated string");
+        }
+        result[length++] = *parser->p++;
+    }
+    parser->p++;
+
+    result[length] = '\0';
+    *string = result;
+    return true;
+}
+
+static bool ParseLong(JsonPathParser *parser, long *value)
+{
+    char *end;
+    errno = 0;
+    *value = strtol(parser->p, &end, 10);
+    if (end == parser->p || errno != 0)
+    {
+        return Fail(parser, "expected an integer");
+    }
+    parser->p = end;
+    return true;
+}
+
+static bool ParseIndexOrSlice(JsonPathParser *parser, JsonPathItem *item)
+{
+    item->type = JSON_PATH_ITEM_INDEX;
+    if (*parser->p != ':')
+    {
+        if (!ParseLong(parser, &item->index))
+        {
+            return false;
+        }
+        SkipSpaces(parser);
+        if (*parser->p != ':')
+        {
+            return true;
+        }
+        item->start = item->index;
+        item->has_start = true;
+    }
+
+    item->type = JSON_PATH_ITEM_SLICE;
+    item->step = 1;
+    parser->p++;
+    SkipSpaces(parser);
+    if (*parser->p != ':' && *parser->p != ']' && *parser->p != ',')
+    {
+        if (!ParseLong(parser, &item->end))
+        {
+            return false;
+        }
+        item->has_end = true;
+        SkipSpaces(parser);
+    }
+    if (*parser->p == ':')
+    {
+        parser->p++;
+        SkipSpaces(parser);
+        if (*parser->p != ']' && *parser->p != ',')
+        {
+            if (!ParseLong(parser, &item->step))
+            {
+                return false;
+            }
+            if (item->step == 0)
+            {
+                return Fail(parser, "slice step must not be 0");
+            }
+        }
+    }
+    return true;
+}
+
+static bool ParseLiteral(JsonPathParser *parser, JsonElement **literal)
+{
+    const char *const p = parser->p;
+    if (*p == '\'' || *p == '"')
+    {
+        char *string;
+        if (!ParseQuoted(parser, &string))
+        {
+            return false;
+        }
+        *literal = JsonStringCreate(string);
+        free(string);
+        return true;
+    }
+
+    static const char *const keywords[] = { "true", "false", "null" };
+    for (size_t i = 0; i < sizeof(keywords) / sizeof(keywords[0]); i++)
+    {
+        const size_t length = strlen(keywords[i]);
+        if (strncmp(p, keywords[i], length) == 0)
+        {
+            parser->p += length;
+            *literal = (i == 2) ? JsonNullCreate() : JsonBoolCreate(i == 0);
+            return true;
+        }
+    }
+
+    char *end;
+    errno = 0;
+    const long long integer = strtoll(p, &end, 10);
+    if (end != p && errno == 0 && strchr(".eE", *end) == NULL)
+    {
+        parser->p = end;
+        *literal = JsonIntegerCreate64(integer);
+        return true;
+    }
+
+    const double real = strtod(p, &end);
+    if (end != p)
+    {
+        // e.g. 1e400, or inf and nan which strtod() also accepts
+        if (!isfinite(real))
+        {
+            return Fail(parser, "number out of range");
+        }
+        parser->p = end;
+        *literal = JsonRealCreate(real);
+        return true;
+    }
+
+    return Fail(parser, "expected a number, string, true, false or null");
+}
+
+static bool ParseOperator(JsonPathParser *parser, JsonPathOperator *op)
+{
+    static const struct
+    {
+        const char *text;
+        JsonPathOperator op;
+    } operators[] = {
+        // longer ones first
+        { "==", JSON_PATH_OP_EQ }, { "!=", JSON_PATH_OP_NE },
+        { "<=", JSON_PATH_OP_LE }, { ">=", JSON_PATH_OP_GE },
+        { "<", JSON_PATH_OP_LT }, { ">", JSON_PATH_OP_GT },
+    };
+
+    for (size_t i = 0; i < sizeof(operators) / sizeof(operators[0]); i++)
+    {
+        const size_t length = strlen(operators[i].text);
+        if (strncmp(parser->p, operators[i].text, length) == 0)
+        {
+            parser->p += length;
+            *op = operators[i].op;
+            return true;
+        }
+    }
+    return Fail(parser, "expected ')' or a comparison");
+}
+
+static void FilterDestroy(JsonPathFilter *filter)
+{
+    if (filter != NULL)
+    {
+        JsonPathDestroy(filter->operand);
+        JsonDestroy(filter->literal);
+        free(filter);
+    }
+}
+
+static bool ParseFilter(JsonPathParser *parser, JsonPathStep *step)
+{
+    // at '?'
+    parser->p++;
+    SkipSpaces(parser);
+    if (*parser->p != '(')
+    {
+        return Fail(parser, "expected '(' after '?'");
+    }
+    parser->p++;
+    SkipSpaces(parser);
+
+    JsonPathFilter *const filter = xcalloc(1, sizeof(JsonPathFilter));
+    step->filter = filter;
+
+    filter->operand = ParsePath(parser, true);
+    if (filter->operand == NULL)
+    {
+        return false;
+    }
+
+    SkipSpaces(parser);
+    filter->op = JSON_PATH_OP_EXISTS;
+    if (*parser->p != ')')
+    {
+        if (!ParseOperator(parser, &filter->op))
+        {
+            return false;
+        }
+        SkipSpaces(parser);
+        if (!ParseLiteral(parser, &filter->literal))
+        {
+            return false;
+        }
+        SkipSpaces(parser);
+        if (*parser->p != ')')
+        {
+            return Fail(parser, "expected ')'");
+        }
+    }
+    parser->p++;
+    return true;
+}
+
+static bool ParseBracket(JsonPathParser *parser, JsonPathStep *step)
+{
+    // at '['
+    parser->p++;
+    SkipSpaces(parser);
+
+    if (*parser->p == '?')
+    {
+        if (!ParseFilter(parser, step))
+        {
+            return false;
+        }
+    }
+    else
+    {
+        while (true)
+        {
+            step->items = xrealloc(step->items,
+                                   (step->n_items + 1) * sizeof(JsonPathItem));
+            JsonPathItem *const item = &step->items[step->n_items++];
+            memset(item, 0, sizeof(*item));
+
+            if (*parser->p == '*')
+            {
+                item->type = JSON_PATH_ITEM_WILDCARD;
+                parser->p++;
+            }
+            else if (*parser->p == '\'' || *parser->p == '"')
+            {
+                item->type = JSON_PATH_ITEM_KEY;
+                if (!ParseQuoted(parser, &item->key))
+                {
+                    return false;
+                }
+            }
+            else if (!ParseIndexOrSlice(parser, item))
+            {
+                return false;
+            }
+
+            SkipSpaces(parser);
+            if (*parser->p != ',')
+            {
+                break;
+            }
+            parser->p++;
+            SkipSpaces(parser);
+        }
+    }
+
+    SkipSpaces(parser);
+    if (*parser->p != ']')
+    {
+        return Fail(parser, "expected ']'");
+    }
+    parser->p++;
+    return true;
+}
+
+static JsonPathStep *AddStep(JsonPath *path)
+{
+    path->steps = xrealloc(path->steps,
+                           (path->n_steps + 1) * sizeof(JsonPathStep));
+    JsonPathStep *const step = &path->steps[path->n_steps++];
+    memset(step, 0, sizeof(*step));
+    return step;
+}
+
+static bool ParseNameStep(JsonPathParser *parser, bool relative,
+                          JsonPathStep *step)
+{
+    step->items = xcalloc(1, sizeof(JsonPathItem));
+    step->n_items = 1;
+
+    if (*parser->p == '*')
+    {
+        parser->p++;
+        step->items[0].type = JSON_PATH_ITEM_WILDCARD;
+        return true;
+    }
+
+    step->items[0].type = JSON_PATH_ITEM_KEY;
+    return ParseName(parser, relative, &step->items[0].key);
+}
+
+static JsonPath *ParsePath(JsonPathParser *parser, bool relative)
+{
+    JsonPath *const path = xcalloc(1, sizeof(JsonPath));
+
+    bool ok = true;
+    if (relative)
+    {
+        if (*parser->p == '@')
+        {
+            parser->p++;
+        }
+        else
+        {
+            ok = Fail(parser, "expected '@'");
+        }
+    }
+    else if (*parser->p == '$')
+    {
+        parser->p++;
+    }
+    else if (*parser->p != '\0' && *parser->p != '.' && *parser->p != '[')
+    {
+        // "a.b" for "$.a.b"
+        ok = ParseNameStep(parser, false, AddStep(path));
+    }
+
+    while (ok && *parser->p != '\0')
+    {
+        if (*parser->p == '[')
+        {
+            ok = ParseBracket(parser, AddStep(path));
+        }
+        else if (*parser->p == '.')
+        {
+            parser->p++;
+
+            JsonPathStep *const step = AddStep(path);
+            if (*parser->p == '.')
+            {
+                parser->p++;
+                step->descendant = true;
+            }
+
+            if (step->descendant && *parser->p == '[')
+            {
+                ok = ParseBracket(parser, step);
+            }
+            else
+            {
+                ok = ParseNameStep(parser, relative, step);
+            }
+        }
+        else if (relative)
+        {
+            // the comparison or the end of the filter
+            break;
+        }
+        else
+        {
+            ok = Fail(parser, "expected '.' or '['");
+        }
+    }
+
+    if (!ok)
+    {
+        JsonPathDestroy(path);
+        return NULL;
+    }
+    return path;
+}
+
+JsonPath *JsonPathCompile(const char *const expression)
+{
+    assert(expression != NULL);
+
+    JsonPathParser parser = { .p = expression, .error = NULL };
+    JsonPath *const path = ParsePath(&parser, false);
+    if (path == NULL)
+    {
+        Log(LOG_LEVEL_ERR, "Invalid JSON path '%s' at position %zu: %s",
+            expression, (size_t) (parser.p - expression), parser.error);
+    }
+    return path;
+}
+
+void JsonPathDestroy(JsonPath *const path)
+{
+    if (path != NULL)
+    {
+        for (size_t i = 0; i < path->n_steps; i++)
+        {
+            JsonPathStep *const step = &path->steps[i];
+            for (size_t j = 0; j < step->n_items; j++)
+            {
+                free(step->items[j].key);
+            }
+            free(step->items);
+            FilterDestroy(step->filter);
+        }
+        free(path->steps);
+        free(path);
+    }
+}
+
+// *******************************************************************************************
+// Evaluation
+// *******************************************************************************************
+
+static bool IsNumber(JsonType type)
+{
+    return type == JSON_TYPE_INTEGER || type == JSON_TYPE_REAL;
+}
+
+static bool CompareToLiteral(const JsonElement *const value,
+                             const JsonPathOperator op,
+                             const JsonElement *const literal)
+{
+    const JsonType type = JsonGetType(value);
+    const JsonType literal_type = JsonGetType(literal);
+
+    int cmp;
+    if (IsNumber(type) && IsNumber(literal_type))
+    {
+        const char *const a = JsonPrimitiveGetAsString(value);
+        const char *const b = JsonPrimitiveGetAsString(literal);
+
+        int64_t int_a, int_b;
+        if (type == JSON_TYPE_INTEGER && literal_type == JSON_TYPE_INTEGER
+            && StringToInt64(a, &int_a) == 0 && StringToInt64(b, &int_b) == 0)
+        {
+            cmp = (int_a > int_b) - (int_a < int_b);
+        }
+        else
+        {
+            const double real_a = strtod(a, NULL);
+            const double real_b = strtod(b, NULL);
+            cmp = (real_a > real_b) - (real_a < real_b);
+        }
+    }
+    else if (type == literal_type && type == JSON_TYPE_STRING)
+    {
+        cmp = strcmp(JsonPrimitiveGetAsString(value),
+                     JsonPrimitiveGetAsString(literal));
+    }
+    else if (type == literal_type
+             && (type == JSON_TYPE_BOOL || type == JSON_TYPE_NULL))
+    {
+        // only equal or not
+        if (op != JSON_PATH_OP_EQ && op != JSON_PATH_OP_NE)
+        {
+            return false;
+        }
+        cmp = strcmp(JsonPrimitiveGetAsString(value),
+                     JsonPrimitiveGetAsString(literal));
+    }
+    else
+    {
+        return op == JSON_PATH_OP_NE;
+    }
+
+    switch (op)
+    {
+    case JSON_PATH_OP_EQ:
+        return cmp == 0;
+    case JSON_PATH_OP_NE:
+        return cmp != 0;
+    case JSON_PATH_OP_LT:
+        return cmp < 0;
+    case JSON_PATH_OP_LE:
+        return cmp <= 0;
+    case JSON_PATH_OP_GT:
+        return cmp > 0;
+    case JSON_PATH_OP_GE:
+        return cmp >= 0;
+    case JSON_PATH_OP_EXISTS:
+        break;
+    }
+
+    ProgrammingError("Unexpected JSON path operator %d", op);
+}
+
+static bool FilterMatches(const JsonPathFilter *const filter,
+                          JsonElement *const element)
+{
+    const JsonElement *const value =
+        JsonPathSelectFirst(filter->operand, element);
+    if (value == NULL)
+    {
+        // nothing there is not equal to anything
+        return filter->op == JSON_PATH_OP_NE;
+    }
+    if (filter->op == JSON_PATH_OP_EXISTS)
+    {
+        return true;
+    }
+    return CompareToLiteral(value, filter->op, filter->literal);
+}
+
+static bool EvaluateSteps(const JsonPath *path, size_t i, JsonElement *element,
+                          JsonElementVisitor visitor, void *data);
+
+static bool EvaluateSlice(const JsonPath *const path, const size_t i,
+                          JsonElement *const array, const JsonPathItem *const item,
+                          JsonElementVisitor visitor, void *const data)
+{
+    // as in Python
+    const long length = JsonLength(array);
+    long start, end;
+    if (item->step > 0)
+    {
+        start = item->has_start ? item->start : 0;
+        end = item->has_end ? item->end : length;
+        start = (start < 0) ? MAX(start + length, 0) : MIN(start, length);
+        end = (end < 0) ? MAX(end + length, 0) : MIN(end, length);
+    }
+    else
+    {
+        start = item->has_start ? item->start : length - 1;
+        end = item->has_end ? item->end : -length - 1;
+        start = (start < 0) ? MAX(start + length, -1) : MIN(start, length - 1);
+        end = (end < 0) ? MAX(end + length, -1) : MIN(end, length - 1);
+    }
+
+    for (long j = start; (item->step > 0) ? (j < end) : (j > end); j += item->step)
+    {
+        if (!EvaluateSteps(path, i + 1, JsonAt(array, j), visitor, data))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool EvaluateItem(const JsonPath *const path, const size_t i,
+                         JsonElement *const container, const JsonPathItem *const item,
+                         JsonElementVisitor visitor, void *const data)
+{
+    const JsonType type = JsonGetType(container);
+
+    switch (item->type)
+    {
+    case JSON_PATH_ITEM_KEY:
+        if (type == JSON_TYPE_OBJECT)
+        {
+            JsonElement *const child = JsonObjectGet(container, item->key);
+            if (child != NULL)
+            {
+                return EvaluateSteps(path, i + 1, child, visitor, data);
+            }
+        }
+        return true;
+
+    case JSON_PATH_ITEM_INDEX:
+        if (type == JSON_TYPE_ARRAY)
+        {
+            const long length = JsonLength(container);
+            const long index = (item->index < 0) ? item->index + length
+                                                 : item->index;
+            if (index >= 0 && index < length)
+            {
+                return EvaluateSteps(path, i + 1, JsonAt(container, index),
+                                     visitor, data);
+            }
+        }
+        return true;
+
+    case JSON_PATH_ITEM_SLICE:
+        if (type == JSON_TYPE_ARRAY)
+        {
+            return EvaluateSlice(path, i, container, item, visitor, data);
+        }
+        return true;
+
+    case JSON_PATH_ITEM_WILDCARD:
+    {
+        JsonIterator iter = JsonIteratorInit(container);
+        JsonElement *child;
+        while ((child = JsonIteratorNextValue(&iter)) != NULL)
+        {
+            if (!EvaluateSteps(path, i + 1, child, visitor, data))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+    }
+
+    ProgrammingError("Unexpected JSON path item type %d", item->type);
+}
+
+static bool EvaluateStep(const JsonPath *const path, const size_t i,
+                         JsonElement *const container,
+                         JsonElementVisitor visitor, void *const data)
+{
+    const JsonPathStep *const step = &path->steps[i];
+
+    if (step->filter != NULL)
+    {
+        JsonIterator iter = JsonIteratorInit(container);
+        JsonElement *child;
+        while ((child = JsonIteratorNextValue(&iter)) != NULL)
+        {
+            if (FilterMatches(step->filter, child)
+                && !EvaluateSteps(path, i + 1, child, visitor, data))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    for (size_t j = 0; j < step->n_items; j++)
+    {
+        if (!EvaluateItem(path, i, container, &step->items[j], visitor, data))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool EvaluateSteps(const JsonPath *const path, const size_t i,
+                          JsonElement *const element,
+                          JsonElementVisitor visitor, void *const data)
+{
+    if (i == path->n_steps)
+    {
+        return visitor(element, data);
+    }
+
+    if (JsonGetElementType(element) != JSON_ELEMENT_TYPE_CONTAINER)
+    {
+        return true;
+    }
+
+    if (!EvaluateStep(path, i, element, visitor, data))
+    {
+        return false;
+    }
+
+    if (path->steps[i].descendant)
+    {
+        // the same step, one level further down
+        JsonIterator iter = JsonIteratorInit(element);
+        JsonElement *child;
+        while ((child = JsonIteratorNextValueByType(
+                    &iter, JSON_ELEMENT_TYPE_CONTAINER, false)) != NULL)
+        {
+            if (!EvaluateSteps(path, i, child, visitor, data))
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool JsonPathEvaluate(const JsonPath *const path, JsonElement *const json,
+                      JsonElementVisitor visitor, void *const data)
+{
+    assert(path != NULL);
+    assert(json != NULL);
+    assert(visitor != NULL);
+
+    return EvaluateSteps(path, 0, json, visitor, data);
+}
+
+static bool AppendMatch(JsonElement *const element, void *const data)
+{
+    SeqAppend(data, element);
+    return true;
+}
+
+Seq *JsonPathSelect(const JsonPath *const path, JsonElement *const json)
+{
+    Seq *const matches = SeqNew(8, NULL);
+    JsonPathEvaluate(path, json, AppendMatch, matches);
+    return matches;
+}
+
+static bool KeepFirstMatch(JsonElement *const element, void *const data)
+{
+    *(JsonElement **) data = element;
+    return false;
+}
+
+JsonElement *JsonPathSelectFirst(const JsonPath *const path, JsonElement *const json)
+{
+    JsonElement *first = NULL;
+    JsonPathEvaluate(path, json, KeepFirstMatch, &first);
+    return first;
+}
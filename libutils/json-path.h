@@ -0,0 +1,89 @@
+/*
+  Copyright 2023 Northern.tech AS
+
+  This file is part of CFEngine 3 - written and maintained by Northern.tech AS.
+
+  This program is free software; you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by the
+  Free Software Foundation; version 3.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA
+
+  To the extent this program is licensed as part of the Enterprise
+  versions of CFEngine, the applicable Commercial Open Source License
+  (COSL) may apply to this file if you as a licensee so wish it. See
+  included file COSL.txt.
+*/
+
+#ifndef CFENGINE_JSON_PATH_H
+#define CFENGINE_JSON_PATH_H
+
+#include <json.h>
+#include <sequence.h>
+
+/**
+  @brief Queries on JSON documents with JSONPath-like expressions.
+
+  An expression is compiled once into a list of steps and can then be
+  evaluated against any number of documents (also from several threads at
+  once). Matches are the elements in the document, nothing is copied.
+
+  The exception are shared copies (JsonCopyShared(), JsonMergeShared()): like
+  JsonObjectGet() and friends, evaluation gives the containers it goes through
+  in such a copy children of their own, so that matches can be changed without
+  changing the original. A ..step does so for the whole copy, and a shared
+  copy must not be evaluated against from several threads at once.
+
+  The expression starts with an optional '$' (the root) followed by steps:
+
+  - .name or ['name'] or ["name"]  member of an object
+  - [3], [-1]                      element of an array, from the end if negative
+  - [start:end:step]               slice of an array, as in Python
+  - .* or [*]                      all members/elements
+  - [0,2,'a']                      several of the above, in the given order
+  - [?(@.x.y)]                     members/elements having @.x.y
+  - [?(@.x < 10)]                  members/elements where @.x compares to a
+                                   number, 'string', true, false or null with
+                                   ==, !=, <, <=, > or >= (a missing @.x
+                                   is only != anything)
+  - ..step                         step applied at any depth, e.g. ..name or ..*
+
+  The leading '.' of the first step may be left out, so "a.b[3].c" is the
+  same as "$.a.b[3].c". Bare names run up to the next '.', '[' or ']'.
+*/
+
+typedef struct JsonPath_ JsonPath;
+
+/**
+ * @brief Compile #expression for JsonPathEvaluate() and friends.
+ * @return NULL if #expression is not valid (the problem is logged)
+ */
+JsonPath *JsonPathCompile(const char *expression);
+void JsonPathDestroy(JsonPath *path);
+
+/**
+ * @brief Call #visitor on every match of #path in #json.
+ * @return whether all matches were visited, false if #visitor stopped it
+ */
+bool JsonPathEvaluate(const JsonPath *path, JsonElement *json,
+                      JsonElementVisitor visitor, void *data);
+
+/**
+ * @brief All matches of #path in #json.
+ * @return a Seq of the matching elements, which stay owned by #json
+ */
+Seq *JsonPathSelect(const JsonPath *path, JsonElement *json);
+
+/**
+ * @brief First match of #path in #json, NULL if there is none.
+ */
+JsonElement *JsonPathSelectFirst(const JsonPath *path, JsonElement *json);
+
+#endif
@@ -8,6 +8,6 @@
 #include <regex.h>
 
 JsonElement *StringCaptureData(
-    pcre *pattern, const char *regex, const char *data);
+    const Regex *pattern, const char *regex, const char *data);
 
 #endif
@@ -33,4 +33,38 @@ JsonParseError JsonParseAnyFile(const char *path, size_t size_max, JsonElement *
                                 const bool yaml_format);
 JsonParseError JsonParseAsNumber(const char **data, JsonElement **json_out);
 
+/**
+  @brief Refcounted property name, shared by the elements of many objects
+         (e.g. the objects made from the rows of a table) instead of each of
+         them having its own copy.
+  @note The refcount is atomic, objects sharing keys may be detached and
+        destroyed by different threads.
+  */
+typedef struct JsonSharedKey_ JsonSharedKey;
+
+JsonSharedKey *JsonSharedKeyNew(const char *key, size_t length);
+void JsonSharedKeyRelease(JsonSharedKey *key);
+
+/**
+  @brief Like JsonObjectAppendElement(), but takes a reference to #key instead
+         of copying it.
+  @warning Unlike JsonObjectAppendElement(), the key must not be in #object
+           already.
+  */
+void JsonObjectAppendElementSharedKey(
+    JsonElement *object, JsonSharedKey *key, JsonElement *element);
+
+/**
+  @brief Like JsonAt(), but for reading only: a copy sharing its children
+         with the original (see JsonCopyShared()) is left sharing them.
+  */
+const JsonElement *JsonContainerChildAt(const JsonElement *container, size_t index);
+
+/**
+  @brief Create a string or number from its text, numbers keep the text as it
+         is instead of being formatted like JsonIntegerCreate64() and
+         JsonRealCreate() do.
+  */
+JsonElement *JsonPrimitiveCreateLen(JsonPrimitiveType type, const char *value, size_t length);
+
 #endif // CFENGINE_JSON_PRIV_H
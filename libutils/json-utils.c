@@ -29,6 +29,7 @@
 #include <string_lib.h> // TrimWhitespace()
 #include <csv_parser.h>
 #include <json-yaml.h>  // JsonParseYamlFile()
+#include <json-priv.h>  // JsonSharedKey
 #include <alloc.h>
 #define ENV_BYTE_LIMIT 4096
 
@@ -186,23 +187,32 @@ bool JsonParseEnvFile(const char *input_path, size_t size_max, JsonElement **jso
     size_t line_size = ENV_BYTE_LIMIT;
     char *key, *value;
     int linenumber = 0;
-    size_t byte_count = 0;
-    FILE *fin = safe_fopen(input_path, "r");
-    if (fin == NULL)
+
+    /* A file larger than size_max is parsed up to the last line ending
+     * before the limit, nothing after it is read. */
+    bool truncated = false;
+    FileMapping *contents = FileMap(input_path, size_max, &truncated);
+    if (contents == NULL)
     {
-        Log(LOG_LEVEL_VERBOSE, "%s cannot open the ENV file '%s' (fopen: %s)",
+        Log(LOG_LEVEL_VERBOSE, "%s cannot open the ENV file '%s' (open: %s)",
             myname, input_path, GetErrorStr());
         return false;
     }
 
     JsonElement *json = JsonObjectCreate(10);
 
+    const char *data = FileMappingData(contents);
+    const char *const end = data + FileMappingLength(contents);
     char *raw_line = xmalloc(line_size);
-    while (CfReadLine(&raw_line, &line_size, fin) != -1)
+    while (data < end || truncated)
     {
+        const char *const newline =
+            (data < end) ? memchr(data, '\n', end - data) : NULL;
+        const size_t line_length = (newline != NULL) ? (size_t) (newline - data)
+                                                     : (size_t) (end - data);
+
         ++linenumber;
-        byte_count += strlen(raw_line);
-        if (byte_count > size_max)
+        if (newline == NULL && truncated)
         {
             Log(LOG_LEVEL_VERBOSE, "%s: ENV file '%s' exceeded byte limit %zu at line %d",
                 myname, input_path, size_max, linenumber);
@@ -210,6 +220,16 @@ bool JsonParseEnvFile(const char *input_path, size_t size_max, JsonElement **jso
             break;
         }
 
+        /* ParseEnvLine() modifies the line, copy it out of the mapping. */
+        if (line_length >= line_size)
+        {
+            line_size = line_length + 1;
+            raw_line = xrealloc(raw_line, line_size);
+        }
+        memcpy(raw_line, data, line_length);
+        raw_line[line_length] = '\0';
+        data += line_length + ((newline != NULL) ? 1 : 0);
+
         ParseEnvLine(raw_line, &key, &value, input_path, linenumber);
         if (key != NULL && value != NULL)
         {
@@ -217,109 +237,218 @@ bool JsonParseEnvFile(const char *input_path, size_t size_max, JsonElement **jso
         }
     }
 
-    bool reached_eof = feof(fin);
-    fclose(fin);
+    FileUnmap(contents);
     free(raw_line);
 
-    if (!reached_eof && byte_count <= size_max)
-    {
-        Log(LOG_LEVEL_ERR,
-            "%s: failed to read ENV file '%s'. (fread: %s)",
-            myname, input_path, GetErrorStr());
-        JsonDestroy(json);
-        return false;
-    }
-
     *json_out = json;
     return true;
 }
 
-bool JsonParseCsvFile(const char *input_path, size_t size_max, JsonElement **json_out)
-{
-    assert(json_out != NULL);
-
-    const char *myname = "JsonParseCsvFile";
-    char *line;
-    size_t byte_count = 0;
-
-    int linenumber = 0;
+/* Upper bound for the number of records the result array is pre-sized for,
+ * the estimate is only based on the length of the first record. */
+#define CSV_JSON_MAX_PRESIZE (1024 * 1024)
 
-    FILE *fin = safe_fopen(input_path, "r");
-    if (fin == NULL)
+static JsonElement *JsonCsvRecordToArray(const CsvField *fields, size_t n_fields)
+{
+    JsonElement *array = JsonArrayCreate(n_fields);
+    for (size_t i = 0; i < n_fields; i++)
     {
-        Log(LOG_LEVEL_VERBOSE, "%s cannot open the csv file '%s' (fopen: %s)",
-            myname, input_path, GetErrorStr());
-        return false;
+        JsonArrayAppendElement(array,
+                               JsonStringCreateLen(fields[i].data, fields[i].length));
     }
+    return array;
+}
 
-    JsonElement *const json = JsonArrayCreate(50);
-
-    if (feof(fin))
+static JsonElement *JsonCsvRecordToObject(
+    const CsvField *fields, size_t n_fields,
+    JsonSharedKey *const *keys, size_t n_keys)
+{
+    JsonElement *object = JsonObjectCreate(n_keys);
+    const size_t n = MIN(n_fields, n_keys);
+    for (size_t i = 0; i < n; i++)
     {
-        *json_out = json;
-        Log(LOG_LEVEL_VERBOSE,
-            "%s: CSV file '%s' was empty, so nothing was parsed",
-            myname, input_path);
-        return true;
+        /* NULL for columns overridden by a later one with the same name */
+        if (keys[i] != NULL)
+        {
+            JsonObjectAppendElementSharedKey(
+                object, keys[i],
+                JsonStringCreateLen(fields[i].data, fields[i].length));
+        }
     }
+    return object;
+}
 
-    while ((line = GetCsvLineNext(fin)) != NULL)
+/**
+ * Make one shared key per header field. If a name appears more than once, the
+ * last column with it wins, same as with JsonObjectAppendString().
+ */
+static JsonSharedKey **JsonCsvHeaderKeys(const CsvField *fields, size_t n_fields)
+{
+    JsonSharedKey **keys = xcalloc(n_fields, sizeof(JsonSharedKey *));
+    for (size_t i = 0; i < n_fields; i++)
     {
-        ++linenumber;
+        bool overridden = false;
+        for (size_t j = i + 1; !overridden && j < n_fields; j++)
+        {
+            overridden = (fields[i].length == fields[j].length &&
+                          memcmp(fields[i].data, fields[j].data, fields[i].length) == 0);
+        }
+        if (!overridden)
+        {
+            keys[i] = JsonSharedKeyNew(fields[i].data, fields[i].length);
+        }
+    }
+    return keys;
+}
+
+bool JsonParseCsvData(
+    const char *const data,
+    const size_t length,
+    const size_t size_max,
+    const JsonCsvOptions *const options,
+    const char *const log_identifier,
+    JsonElement **const json_out)
+{
+    assert(data != NULL || length == 0);
+    assert(json_out != NULL);
+
+    const char *const myname = "JsonParseCsvData";
+    const char *const name = (log_identifier != NULL) ? log_identifier : "(data)";
+    const JsonCsvOptions defaults = JSON_CSV_OPTIONS_DEFAULT;
+    const JsonCsvOptions *const opts = (options != NULL) ? options : &defaults;
+
+    /* Never look at more than one byte past the limit, the record it is part
+     * of is dropped anyway. */
+    const size_t parse_length = (size_max < length) ? size_max + 1 : length;
+    CsvReader *reader = CsvReaderNew(data, parse_length, opts->separator,
+                                     opts->line_ending);
 
-        byte_count += strlen(line);
-        if (byte_count > size_max)
+    JsonElement *json = NULL;
+    JsonSharedKey **keys = NULL;
+    size_t n_keys = 0;
+
+    CsvReaderStatus status;
+    while ((status = CsvReaderNextRecord(reader)) != CSV_READER_EOF)
+    {
+        const size_t record_number = CsvReaderRecordNumber(reader);
+        if (CsvReaderOffset(reader) > size_max)
         {
-            Log(LOG_LEVEL_VERBOSE, "%s: CSV file '%s' exceeded byte limit %zu at line %d",
-                myname, input_path, size_max, linenumber);
+            Log(LOG_LEVEL_VERBOSE, "%s: CSV file '%s' exceeded byte limit %zu at line %zu",
+                myname, name, size_max, record_number);
             Log(LOG_LEVEL_VERBOSE, "Done with CSV file, the rest will not be parsed");
-            free(line);
             break;
         }
+        if (status != CSV_READER_OK)
+        {
+            Log(LOG_LEVEL_VERBOSE, "%s: Skipping malformed record %zu in CSV file '%s'",
+                myname, record_number, name);
+            continue;
+        }
 
-        Seq *list = SeqParseCsvString(line);
-        free(line);
+        const CsvField *const fields = CsvReaderFields(reader);
+        const size_t n_fields = CsvReaderFieldCount(reader);
 
-        if (list != NULL)
+        if (json == NULL)
         {
-            JsonElement *line_arr = JsonArrayCreate(SeqLength(list));
+            /* Estimate the number of records from the first one */
+            const size_t record_length = MAX(CsvReaderOffset(reader), 1);
+            json = JsonArrayCreate(MIN(parse_length / record_length + 1,
+                                       CSV_JSON_MAX_PRESIZE));
+        }
 
-            for (size_t i = 0; i < SeqLength(list); i++)
+        if (!opts->header)
+        {
+            JsonArrayAppendArray(json, JsonCsvRecordToArray(fields, n_fields));
+        }
+        else if (keys == NULL)
+        {
+            keys = JsonCsvHeaderKeys(fields, n_fields);
+            n_keys = n_fields;
+        }
+        else
+        {
+            if (n_fields > n_keys)
             {
-                JsonArrayAppendString(line_arr, SeqAt(list, i));
+                Log(LOG_LEVEL_VERBOSE,
+                    "%s: Record %zu in CSV file '%s' has more fields than the header, "
+                    "ignoring the extra ones", myname, record_number, name);
             }
-
-            SeqDestroy(list);
-            JsonArrayAppendArray(json, line_arr);
+            JsonArrayAppendObject(json,
+                                  JsonCsvRecordToObject(fields, n_fields, keys, n_keys));
         }
     }
 
-    bool reached_eof = feof(fin);
+    CsvReaderDestroy(reader);
+    for (size_t i = 0; i < n_keys; i++)
+    {
+        JsonSharedKeyRelease(keys[i]);
+    }
+    free(keys);
 
-    if (!reached_eof && byte_count <= size_max)
+    if (json == NULL)
     {
-        Log(LOG_LEVEL_ERR,
-            "%s: unable to read line from CSV file '%s'. (fread: %s)",
-            myname, input_path, GetErrorStr());
-        JsonDestroy(json);
-        fclose(fin);
-        return false;
+        json = JsonArrayCreate(0);
     }
 
-    if (JsonLength(json) == 0)
+    if (length > 0 && JsonLength(json) == 0 && !(opts->header && n_keys > 0))
     {
         Log(LOG_LEVEL_WARNING,
             "%s: CSV file '%s' is not empty, but nothing was parsed",
-            myname, input_path);
-        Log(LOG_LEVEL_WARNING,
-            "Make sure the file contains DOS (CRLF) line endings");
+            myname, name);
+        if (opts->line_ending == CSV_LINE_ENDING_CRLF)
+        {
+            Log(LOG_LEVEL_WARNING,
+                "Make sure the file contains DOS (CRLF) line endings");
+        }
     }
 
-    fclose(fin);
     *json_out = json;
     return true;
 }
 
+bool JsonParseCsvFileWithOptions(
+    const char *input_path,
+    size_t size_max,
+    const JsonCsvOptions *options,
+    JsonElement **json_out)
+{
+    assert(json_out != NULL);
+
+    const char *myname = "JsonParseCsvFile";
+
+    /* JsonParseCsvData() looks at one byte past size_max to tell whether
+     * the last record ends within the limit, nothing after it is read. */
+    const size_t read_max = (size_max < SIZE_MAX) ? size_max + 1 : SIZE_MAX;
+    FileMapping *contents = FileMap(input_path, read_max, NULL);
+    if (contents == NULL)
+    {
+        Log(LOG_LEVEL_VERBOSE, "%s cannot open the csv file '%s' (open: %s)",
+            myname, input_path, GetErrorStr());
+        return false;
+    }
+
+    if (FileMappingLength(contents) == 0)
+    {
+        FileUnmap(contents);
+        *json_out = JsonArrayCreate(0);
+        Log(LOG_LEVEL_VERBOSE,
+            "%s: CSV file '%s' was empty, so nothing was parsed",
+            myname, input_path);
+        return true;
+    }
+
+    const bool ret = JsonParseCsvData(FileMappingData(contents),
+                                      FileMappingLength(contents), size_max,
+                                      options, input_path, json_out);
+    FileUnmap(contents);
+    return ret;
+}
+
+bool JsonParseCsvFile(const char *input_path, size_t size_max, JsonElement **json_out)
+{
+    return JsonParseCsvFileWithOptions(input_path, size_max, NULL, json_out);
+}
+
 JsonElement *JsonReadDataFile(const char *log_identifier, const char *input_path,
                               const DataFileType requested_mode, size_t size_max)
 {
@@ -26,6 +26,7 @@
 #define CFENGINE_JSON_UTILS_H
 
 #include <json.h>
+#include <csv_parser.h>     // CsvLineEnding
 
 typedef enum {
     DATAFILETYPE_UNKNOWN = 0,
@@ -38,6 +39,33 @@ typedef enum {
 void ParseEnvLine(char *raw_line, char **key_out, char **value_out, const char *filename_for_log, int linenumber);
 bool JsonParseEnvFile(const char *input_path, size_t size_max, JsonElement **json_out);
 bool JsonParseCsvFile(const char *path, size_t size_max, JsonElement **json_out);
+
+typedef struct
+{
+    char separator;
+    CsvLineEnding line_ending;
+
+    /* Use the first record as the header and make an array of objects keyed
+     * by it, instead of an array of arrays. */
+    bool header;
+} JsonCsvOptions;
+
+#define JSON_CSV_OPTIONS_DEFAULT \
+    { .separator = ',', .line_ending = CSV_LINE_ENDING_CRLF, .header = false }
+
+/**
+ * @brief Parse CSV data into an array of arrays (or objects, see
+ *        JsonCsvOptions), skipping malformed records.
+ * @param size_max Records ending beyond this many bytes are not parsed
+ * @param options  NULL for JSON_CSV_OPTIONS_DEFAULT
+ * @param log_identifier Name of the data source for log messages, may be NULL
+ */
+bool JsonParseCsvData(const char *data, size_t length, size_t size_max,
+                      const JsonCsvOptions *options, const char *log_identifier,
+                      JsonElement **json_out);
+bool JsonParseCsvFileWithOptions(const char *path, size_t size_max,
+                                 const JsonCsvOptions *options,
+                                 JsonElement **json_out);
 JsonElement *JsonReadDataFile(
         const char *log_identifier,
         const char *input_path,
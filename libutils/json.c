@@ -47,9 +47,26 @@ static const char *const JSON_TRUE = "true";
 static const char *const JSON_FALSE = "false";
 static const char *const JSON_NULL = "null";
 
+// A container made by JsonCopyShared() does not copy its children, it borrows them
+// from the container it was copied from (its source) until either of the two
+// is changed. The borrowers of a container are kept in a list, so that they
+// can be given children of their own (one level deep, borrowing the next
+// level) before the source, or anything below it, changes or goes away.
+typedef struct
+{
+    JsonElement *source;
+    JsonElement *prev;
+    JsonElement *next;
+} JsonBorrow;
+
+// Protects the borrower lists, so that read-only trees can still be copied
+// from several threads.
+static pthread_mutex_t json_borrowers_mutex = PTHREAD_MUTEX_INITIALIZER; /* GLOBAL_T */
+
 struct JsonElement_
 {
     JsonElementType type;
+    bool propertyNameShared;    // propertyName is a JsonSharedKey's name
 
     // We don't have a separate struct for the key-value pairs in a JSON
     // Object. Instead, a JSON Object has a JsonElement Seq, where each element
@@ -57,12 +74,22 @@ struct JsonElement_
     // called a JSON Object property.
     char *propertyName;
 
+    // The container this element is a child of, used to find the borrowers
+    // which must not see a change to it, and the hashes it invalidates.
+    JsonElement *parent;
+
+    // Structural hash, 0 until JsonHash() computes it. Not kept for
+    // borrowing containers, they have the hash of their source.
+    uint64_t hash;
+
     union
     {
         struct JsonContainer
         {
             JsonContainerType type;
-            Seq *children;
+            Seq *children;          // NULL while borrowing
+            JsonBorrow *borrow;     // non-NULL while borrowing
+            JsonElement *borrowers; // list of containers borrowing from this
         } container;
         struct JsonPrimitive
         {
@@ -93,16 +120,64 @@ const char *JsonPrimitiveTypeToString(const JsonPrimitiveType type)
     }
 }
 
-static void JsonElementSetPropertyName(
-    JsonElement *const element, const char *const propertyName)
+struct JsonSharedKey_
+{
+    size_t refcount;            // atomic, see JsonSharedKeyRelease()
+    char name[];
+};
+
+JsonSharedKey *JsonSharedKeyNew(const char *const key, const size_t length)
+{
+    assert(key != NULL || length == 0);
+
+    JsonSharedKey *shared = xmalloc(sizeof(JsonSharedKey) + length + 1);
+    shared->refcount = 1;
+    memcpy(shared->name, key, length);
+    shared->name[length] = '\0';
+    return shared;
+}
+
+void JsonSharedKeyRelease(JsonSharedKey *const key)
+{
+    if (key != NULL)
+    {
+        // objects sharing a key may be destroyed by different threads
+        const size_t refcount =
+            __atomic_sub_fetch(&key->refcount, 1, __ATOMIC_ACQ_REL);
+        assert(refcount != SIZE_MAX);
+        if (refcount == 0)
+        {
+            free(key);
+        }
+    }
+}
+
+static void JsonElementFreePropertyName(JsonElement *const element)
 {
     assert(element != NULL);
 
     if (element->propertyName != NULL)
     {
-        free(element->propertyName);
+        if (element->propertyNameShared)
+        {
+            JsonSharedKeyRelease((JsonSharedKey *) (element->propertyName
+                                  - offsetof(JsonSharedKey, name)));
+        }
+        else
+        {
+            free(element->propertyName);
+        }
         element->propertyName = NULL;
+        element->propertyNameShared = false;
     }
+}
+
+static void JsonElementSetPropertyName(
+    JsonElement *const element, const char *const propertyName)
+{
+    assert(element != NULL);
+
+    JsonElementFreePropertyName(element);
 
     if (propertyName != NULL)
     {
@@ -147,62 +222,186 @@ static JsonElement *JsonElementCreatePrimitive(
     return element;
 }
 
-static JsonElement *JsonArrayCopy(const JsonElement *array)
+// *******************************************************************************************
+// Sharing of containers between copies
+// *******************************************************************************************
+
+static const JsonElement *JsonContainerSource(const JsonElement *const container)
 {
-    assert(array != NULL);
-    assert(array->type == JSON_ELEMENT_TYPE_CONTAINER);
-    assert(array->container.type == JSON_CONTAINER_TYPE_ARRAY);
+    assert(container != NULL);
+    assert(container->type == JSON_ELEMENT_TYPE_CONTAINER);
 
-    JsonElement *copy = JsonArrayCreate(JsonLength(array));
+    const JsonBorrow *const borrow = container->container.borrow;
+    return (borrow != NULL) ? borrow->source : container;
+}
 
-    JsonIterator iter = JsonIteratorInit(array);
-    const JsonElement *child;
-    while ((child = JsonIteratorNextValue(&iter)) != NULL)
+/**
+ * Children of a container, for reading only: a borrowing container reads
+ * those of its source.
+ */
+static Seq *JsonContainerChildren(const JsonElement *const container)
+{
+    return JsonContainerSource(container)->container.children;
+}
+
+static JsonElement *JsonContainerShare(const JsonElement *const container)
+{
+    // borrow from the source of a borrower, copies of copies stay one level
+    // away from the data
+    JsonElement *const source = (JsonElement *) JsonContainerSource(container);
+    assert(source->container.borrow == NULL);
+
+    JsonElement *const element = xcalloc(1, sizeof(JsonElement));
+    element->type = JSON_ELEMENT_TYPE_CONTAINER;
+    element->container.type = source->container.type;
+
+    JsonBorrow *const borrow = xcalloc(1, sizeof(JsonBorrow));
+    borrow->source = source;
+
+    pthread_mutex_lock(&json_borrowers_mutex);
+    borrow->next = source->container.borrowers;
+    if (borrow->next != NULL)
     {
-        JsonArrayAppendElement(copy, JsonCopy(child));
+        borrow->next->container.borrow->prev = element;
     }
+    source->container.borrowers = element;
+    element->container.borrow = borrow;
+    pthread_mutex_unlock(&json_borrowers_mutex);
 
-    return copy;
+    return element;
 }
 
-static JsonElement *JsonObjectCopy(const JsonElement *const object)
+static void JsonContainerStopBorrowing(JsonElement *const container)
 {
-    assert(object != NULL);
-    assert(object->type == JSON_ELEMENT_TYPE_CONTAINER);
-    assert(object->container.type == JSON_CONTAINER_TYPE_OBJECT);
+    assert(container != NULL);
+    assert(container->type == JSON_ELEMENT_TYPE_CONTAINER);
 
-    JsonElement *copy = JsonObjectCreate(JsonLength(object));
+    JsonBorrow *const borrow = container->container.borrow;
+    assert(borrow != NULL);
 
-    JsonIterator iter = JsonIteratorInit(object);
-    const JsonElement *child;
-    while ((child = JsonIteratorNextValue(&iter)) != NULL)
+    pthread_mutex_lock(&json_borrowers_mutex);
+    if (borrow->prev != NULL)
+    {
+        borrow->prev->container.borrow->next = borrow->next;
+    }
+    else
     {
-        JsonObjectAppendElement(
-            copy, JsonIteratorCurrentKey(&iter), JsonCopy(child));
+        borrow->source->container.borrowers = borrow->next;
     }
+    if (borrow->next != NULL)
+    {
+        borrow->next->container.borrow->prev = borrow->prev;
+    }
+    container->container.borrow = NULL;
+    pthread_mutex_unlock(&json_borrowers_mutex);
+
+    free(borrow);
+}
+
+typedef JsonElement *JsonCopyFn(const JsonElement *element);
 
+/**
+ * Copy of #child made by #copy_fn (JsonCopy() or JsonCopyShared()), with its
+ * key, for adding to #parent.
+ */
+static JsonElement *JsonElementCopyChild(
+    const JsonElement *const child, JsonElement *const parent,
+    JsonCopyFn *const copy_fn)
+{
+    JsonElement *const copy = copy_fn(child);
+    JsonElementSetPropertyName(copy, child->propertyName);
+    copy->parent = parent;
     return copy;
 }
 
+/**
+ * Give a borrowing container children of its own, which in turn borrow from
+ * the children of its source. Does nothing for other containers.
+ */
+static void JsonContainerUnborrow(JsonElement *const container)
+{
+    assert(container != NULL);
+    assert(container->type == JSON_ELEMENT_TYPE_CONTAINER);
 
-static JsonElement *JsonContainerCopy(const JsonElement *const container)
+    if (container->container.borrow == NULL)
+    {
+        return;
+    }
+
+    Seq *const source_children = JsonContainerChildren(container);
+    const size_t length = SeqLength(source_children);
+
+    Seq *const children = SeqNew(length, JsonDestroy);
+    for (size_t i = 0; i < length; i++)
+    {
+        const JsonElement *const child = SeqAt(source_children, i);
+        SeqAppend(children,
+                  JsonElementCopyChild(child, container, JsonCopyShared));
+    }
+
+    JsonContainerStopBorrowing(container);
+    container->container.children = children;
+}
+
+static void JsonContainerUnborrowAll(JsonElement *const container)
 {
     assert(container != NULL);
     assert(container->type == JSON_ELEMENT_TYPE_CONTAINER);
 
-    const JsonContainerType type = container->container.type;
-    switch (type)
+    while (true)
     {
-    case JSON_CONTAINER_TYPE_ARRAY:
-        return JsonArrayCopy(container);
+        pthread_mutex_lock(&json_borrowers_mutex);
+        JsonElement *const borrower = container->container.borrowers;
+        pthread_mutex_unlock(&json_borrowers_mutex);
 
-    case JSON_CONTAINER_TYPE_OBJECT:
-        return JsonObjectCopy(container);
+        if (borrower == NULL)
+        {
+            break;
+        }
+        JsonContainerUnborrow(borrower);
+    }
+}
 
-    default:
-        UnexpectedError("Unknown JSON container type: %d", type);
-        return NULL;
+/**
+ * Children of a container which are handed out to the caller, who may change
+ * them: a borrowing container gets children of its own first.
+ */
+static Seq *JsonContainerOwnChildren(const JsonElement *const container)
+{
+    // the contents stay the same, so this does not break const
+    JsonContainerUnborrow((JsonElement *) container);
+    return container->container.children;
+}
+
+static void JsonElementUnshare(JsonElement *const element)
+{
+    assert(element != NULL);
+
+    if (element->parent != NULL)
+    {
+        JsonElementUnshare(element->parent);
+    }
+    if (element->type == JSON_ELEMENT_TYPE_CONTAINER)
+    {
+        JsonContainerUnborrowAll(element);
     }
+    __atomic_store_n(&element->hash, 0, __ATOMIC_RELAXED);
+}
+
+/**
+ * Children of a container which is about to be changed. Nothing may borrow
+ * from the container or any of its parents while it changes, and the
+ * container itself may not borrow either. Their hashes become invalid.
+ */
+static Seq *JsonContainerChildrenForWrite(const JsonElement *const container)
+{
+    assert(container != NULL);
+    assert(container->type == JSON_ELEMENT_TYPE_CONTAINER);
+
+    JsonElement *const element = (JsonElement *) container;
+    JsonElementUnshare(element);
+    JsonContainerUnborrow(element);
+    return element->container.children;
 }
 
 static JsonElement *JsonPrimitiveCopy(const JsonElement *const primitive)
@@ -217,23 +416,40 @@ static JsonElement *JsonPrimitiveCopy(const JsonElement *const primitive)
     case JSON_PRIMITIVE_TYPE_BOOL:
         return JsonBoolCreate(JsonPrimitiveGetAsBool(primitive));
 
-    case JSON_PRIMITIVE_TYPE_INTEGER:
-        return JsonIntegerCreate(JsonPrimitiveGetAsInteger(primitive));
-
     case JSON_PRIMITIVE_TYPE_NULL:
         return JsonNullCreate();
 
+    case JSON_PRIMITIVE_TYPE_INTEGER:
     case JSON_PRIMITIVE_TYPE_REAL:
-        return JsonRealCreate(JsonPrimitiveGetAsReal(primitive));
-
     case JSON_PRIMITIVE_TYPE_STRING:
-        return JsonStringCreate(JsonPrimitiveGetAsString(primitive));
+        // numbers keep their text, it may not fit a long or a double
+        return JsonPrimitiveCreateLen(type, primitive->primitive.value,
+                                      strlen(primitive->primitive.value));
     }
 
     UnexpectedError("Unknown JSON primitive type: %d", type);
     return NULL;
 }
 
+static JsonElement *JsonContainerCopy(const JsonElement *const container)
+{
+    assert(container != NULL);
+    assert(container->type == JSON_ELEMENT_TYPE_CONTAINER);
+
+    Seq *const source_children = JsonContainerChildren(container);
+    const size_t length = SeqLength(source_children);
+
+    JsonElement *const copy = JsonElementCreateContainer(
+        container->container.type, NULL, length);
+    for (size_t i = 0; i < length; i++)
+    {
+        const JsonElement *const child = SeqAt(source_children, i);
+        SeqAppend(copy->container.children,
+                  JsonElementCopyChild(child, copy, JsonCopy));
+    }
+    return copy;
+}
+
 JsonElement *JsonCopy(const JsonElement *const element)
 {
     assert(element != NULL);
@@ -249,6 +465,231 @@ JsonElement *JsonCopy(const JsonElement *const element)
     return NULL;
 }
 
+JsonElement *JsonCopyShared(const JsonElement *const element)
+{
+    assert(element != NULL);
+    switch (element->type)
+    {
+    case JSON_ELEMENT_TYPE_CONTAINER:
+        return JsonContainerShare(element);
+    case JSON_ELEMENT_TYPE_PRIMITIVE:
+        return JsonPrimitiveCopy(element);
+    }
+
+    UnexpectedError("Unknown JSON element type: %d", element->type);
+    return NULL;
+}
+
+// *******************************************************************************************
+// Hashing
+// *******************************************************************************************
+
+static uint64_t JsonHashString(const char *const str)
+{
+    // FNV-1a
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (const unsigned char *p = (const unsigned char *) str; *p != '\0'; p++)
+    {
+        hash = (hash ^ *p) * 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+static uint64_t JsonHashMix(uint64_t hash)
+{
+    // splitmix64 finalizer
+    hash ^= hash >> 30;
+    hash *= 0xbf58476d1ce4e5b9ULL;
+    hash ^= hash >> 27;
+    hash *= 0x94d049bb133111ebULL;
+    hash ^= hash >> 31;
+    return hash;
+}
+
+uint64_t JsonHash(const JsonElement *const element)
+{
+    assert(element != NULL);
+
+    // the hash of a copy is that of the element it borrows from
+    JsonElement *const hashed = (element->type == JSON_ELEMENT_TYPE_CONTAINER)
+        ? (JsonElement *) JsonContainerSource(element)
+        : (JsonElement *) element;
+    // elements are hashed by readers, which may share them with other
+    // threads, so the cached hash is only accessed atomically
+    const uint64_t cached = __atomic_load_n(&hashed->hash, __ATOMIC_RELAXED);
+    if (cached != 0)
+    {
+        return cached;
+    }
+
+    uint64_t hash;
+    if (hashed->type == JSON_ELEMENT_TYPE_PRIMITIVE)
+    {
+        // primitives compare by their values only, see JsonCompare()
+        hash = JsonHashMix(JsonHashString(hashed->primitive.value));
+    }
+    else
+    {
+        Seq *const children = hashed->container.children;
+        const size_t length = SeqLength(children);
+
+        hash = JsonHashMix(hashed->container.type + length);
+        if (hashed->container.type == JSON_CONTAINER_TYPE_ARRAY)
+        {
+            for (size_t i = 0; i < length; i++)
+            {
+                hash = JsonHashMix(hash + JsonHash(SeqAt(children, i)));
+            }
+        }
+        else
+        {
+            // the order of the members does not matter
+            uint64_t members = 0;
+            for (size_t i = 0; i < length; i++)
+            {
+                const JsonElement *const child = SeqAt(children, i);
+                members += JsonHashMix(JsonHashString(child->propertyName)
+                                       ^ JsonHash(child));
+            }
+            hash = JsonHashMix(hash + members);
+        }
+    }
+
+    // threads hashing the same element store the same value
+    hash = (hash != 0) ? hash : 1;
+    __atomic_store_n(&hashed->hash, hash, __ATOMIC_RELAXED);
+    return hash;
+}
+
+/**
+ * Temporary hash index of the members of an object, for looking up many keys
+ * without scanning the members for each.
+ */
+typedef struct
+{
+    Seq *children;
+    size_t mask;
+    size_t *slots;              // index in children + 1, 0 if free
+} JsonKeyIndex;
+
+static void JsonKeyIndexInit(JsonKeyIndex *const index, Seq *const children)
+{
+    const size_t length = SeqLength(children);
+
+    size_t capacity = 8;
+    while (capacity < 2 * length)
+    {
+        capacity *= 2;
+    }
+
+    index->children = children;
+    index->mask = capacity - 1;
+    index->slots = xcalloc(capacity, sizeof(size_t));
+
+    for (size_t i = 0; i < length; i++)
+    {
+        const JsonElement *const child = SeqAt(children, i);
+        size_t slot = StringHash(child->propertyName, 0) & index->mask;
+        while (index->slots[slot] != 0)
+        {
+            slot = (slot + 1) & index->mask;
+        }
+        index->slots[slot] = i + 1;
+    }
+}
+
+static JsonElement *JsonKeyIndexGet(
+    const JsonKeyIndex *const index, const char *const key)
+{
+    size_t slot = StringHash(key, 0) & index->mask;
+    while (index->slots[slot] != 0)
+    {
+        JsonElement *const child = SeqAt(index->children, index->slots[slot] - 1);
+        if (strcmp(child->propertyName, key) == 0)
+        {
+            return child;
+        }
+        slot = (slot + 1) & index->mask;
+    }
+    return NULL;
+}
+
+static void JsonKeyIndexDestroy(JsonKeyIndex *const index)
+{
+    free(index->slots);
+}
+
+bool JsonEqual(const JsonElement *const a, const JsonElement *const b)
+{
+    assert(a != NULL);
+    assert(b != NULL);
+
+    if (a == b)
+    {
+        return true;
+    }
+    if (a->type != b->type)
+    {
+        return false;
+    }
+    if (a->type == JSON_ELEMENT_TYPE_CONTAINER)
+    {
+        if (a->container.type != b->container.type)
+        {
+            return false;
+        }
+        if (JsonContainerSource(a) == JsonContainerSource(b))
+        {
+            return true;
+        }
+    }
+
+    if (JsonHash(a) != JsonHash(b))
+    {
+        return false;
+    }
+
+    if (a->type == JSON_ELEMENT_TYPE_PRIMITIVE)
+    {
+        return StringEqual(a->primitive.value, b->primitive.value);
+    }
+
+    Seq *const children_a = JsonContainerChildren(a);
+    Seq *const children_b = JsonContainerChildren(b);
+    const size_t length = SeqLength(children_a);
+    if (length != SeqLength(children_b))
+    {
+        return false;
+    }
+
+    if (a->container.type == JSON_CONTAINER_TYPE_ARRAY)
+    {
+        for (size_t i = 0; i < length; i++)
+        {
+            if (!JsonEqual(SeqAt(children_a, i), SeqAt(children_b, i)))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    JsonKeyIndex index;
+    JsonKeyIndexInit(&index, children_b);
+
+    bool equal = true;
+    for (size_t i = 0; equal && i < length; i++)
+    {
+        const JsonElement *const child_a = SeqAt(children_a, i);
+        const JsonElement *const child_b =
+            JsonKeyIndexGet(&index, child_a->propertyName);
+        equal = (child_b != NULL && JsonEqual(child_a, child_b));
+    }
+
+    JsonKeyIndexDestroy(&index);
+    return equal;
+}
+
 static int JsonArrayCompare(
     const JsonElement *const a, const JsonElement *const b)
 {
@@ -265,13 +706,13 @@ static int JsonArrayCompare(
         return ret;
     }
 
-    JsonIterator iter_a = JsonIteratorInit(a);
-    JsonIterator iter_b = JsonIteratorInit(a);
+    Seq *const children_a = JsonContainerChildren(a);
+    Seq *const children_b = JsonContainerChildren(b);
 
-    for (size_t i = 0; i < JsonLength(a); i++)
+    for (size_t i = 0; i < SeqLength(children_a); i++)
     {
-        const JsonElement *child_a = JsonIteratorNextValue(&iter_a);
-        const JsonElement *child_b = JsonIteratorNextValue(&iter_b);
+        const JsonElement *child_a = SeqAt(children_a, i);
+        const JsonElement *child_b = SeqAt(children_b, i);
 
         ret = JsonCompare(child_a, child_b);
         if (ret != 0)
@@ -283,6 +724,8 @@ static int JsonArrayCompare(
     return ret;
 }
 
+int JsonElementPropertyCompare(const void *e1, const void *e2, void *user_data);
+
 static int JsonObjectCompare(
     const JsonElement *const a, const JsonElement *const b)
 {
@@ -299,30 +742,30 @@ static int JsonObjectCompare(
         return ret;
     }
 
-    JsonIterator iter_a = JsonIteratorInit(a);
-    JsonIterator iter_b = JsonIteratorInit(a);
+    // members are compared in the order of their keys, the order they were
+    // added in does not matter
+    Seq *const sorted_a = SeqSoftSort(
+        JsonContainerChildren(a), JsonElementPropertyCompare, NULL);
+    Seq *const sorted_b = SeqSoftSort(
+        JsonContainerChildren(b), JsonElementPropertyCompare, NULL);
 
-    for (size_t i = 0; i < JsonLength(a); i++)
+    for (size_t i = 0; ret == 0 && i < SeqLength(sorted_a); i++)
     {
-        const JsonElement *child_a = JsonIteratorNextValue(&iter_a);
-        const JsonElement *child_b = JsonIteratorNextValue(&iter_b);
+        const JsonElement *child_a = SeqAt(sorted_a, i);
+        const JsonElement *child_b = SeqAt(sorted_b, i);
 
-        const char *const key_a = JsonIteratorCurrentKey(&iter_a);
-        const char *const key_b = JsonIteratorCurrentKey(&iter_b);
+        const char *const key_a = child_a->propertyName;
+        const char *const key_b = child_b->propertyName;
 
         ret = strcmp(key_a, key_b);
-        if (ret != 0)
+        if (ret == 0)
         {
-            return ret;
-        }
-
-        ret = JsonCompare(child_a, child_b);
-        if (ret != 0)
-        {
-            return ret;
+            ret = JsonCompare(child_a, child_b);
         }
     }
 
+    SeqSoftDestroy(sorted_a);
+    SeqSoftDestroy(sorted_b);
     return ret;
 }
 
@@ -343,6 +786,12 @@ static int JsonContainerCompare(
         return type_a - type_b;
     }
 
+    if (JsonContainerSource(a) == JsonContainerSource(b))
+    {
+        // copies sharing their children
+        return 0;
+    }
+
     switch (type_a)
     {
     case JSON_CONTAINER_TYPE_ARRAY:
@@ -392,6 +841,12 @@ void JsonDestroy(JsonElement *const element)
         switch (element->type)
         {
         case JSON_ELEMENT_TYPE_CONTAINER:
+            if (element->container.borrow != NULL)
+            {
+                JsonContainerStopBorrowing(element);
+                break;
+            }
+            JsonContainerUnborrowAll(element);
             assert(element->container.children);
             SeqDestroy(element->container.children);
             element->container.children = NULL;
@@ -412,10 +867,7 @@ void JsonDestroy(JsonElement *const element)
             UnexpectedError("Unknown JSON element type: %d", element->type);
         }
 
-        if (element->propertyName != NULL)
-        {
-            free(element->propertyName);
-        }
+        JsonElementFreePropertyName(element);
 
         free(element);
     }
@@ -429,68 +881,115 @@ void JsonDestroyMaybe(JsonElement *const element, const bool allocated)
     }
 }
 
-JsonElement *JsonArrayMergeArray(
-    const JsonElement *const a, const JsonElement *const b)
+static JsonElement *JsonArrayMergeArrayWith(
+    const JsonElement *const a, const JsonElement *const b,
+    JsonCopyFn *const copy_fn)
 {
     assert(JsonGetElementType(a) == JsonGetElementType(b));
     assert(JsonGetElementType(a) == JSON_ELEMENT_TYPE_CONTAINER);
     assert(JsonGetContainerType(a) == JsonGetContainerType(b));
     assert(JsonGetContainerType(a) == JSON_CONTAINER_TYPE_ARRAY);
 
+    Seq *const children_a = JsonContainerChildren(a);
+    Seq *const children_b = JsonContainerChildren(b);
+
     JsonElement *result = JsonArrayCreate(JsonLength(a) + JsonLength(b));
-    for (size_t i = 0; i < JsonLength(a); i++)
+    for (size_t i = 0; i < SeqLength(children_a); i++)
     {
-        JsonArrayAppendElement(result, JsonCopy(JsonAt(a, i)));
+        JsonArrayAppendElement(result, copy_fn(SeqAt(children_a, i)));
     }
 
-    for (size_t i = 0; i < JsonLength(b); i++)
+    for (size_t i = 0; i < SeqLength(children_b); i++)
     {
-        JsonArrayAppendElement(result, JsonCopy(JsonAt(b, i)));
+        JsonArrayAppendElement(result, copy_fn(SeqAt(children_b, i)));
     }
 
     return result;
 }
 
-JsonElement *JsonObjectMergeArray(
+JsonElement *JsonArrayMergeArray(
     const JsonElement *const a, const JsonElement *const b)
+{
+    return JsonArrayMergeArrayWith(a, b, JsonCopy);
+}
+
+static JsonElement *JsonObjectMergeArrayWith(
+    const JsonElement *const a, const JsonElement *const b,
+    JsonCopyFn *const copy_fn)
 {
     assert(JsonGetElementType(a) == JsonGetElementType(b));
     assert(JsonGetElementType(a) == JSON_ELEMENT_TYPE_CONTAINER);
     assert(JsonGetContainerType(a) == JSON_CONTAINER_TYPE_OBJECT);
     assert(JsonGetContainerType(b) == JSON_CONTAINER_TYPE_ARRAY);
 
-    JsonElement *result = JsonObjectCopy(a);
-    for (size_t i = 0; i < JsonLength(b); i++)
+    Seq *const children_b = JsonContainerChildren(b);
+
+    JsonElement *result = copy_fn(a);
+    for (size_t i = 0; i < SeqLength(children_b); i++)
     {
         char *key = StringFromLong(i);
-        JsonObjectAppendElement(result, key, JsonCopy(JsonAt(b, i)));
+        JsonObjectAppendElement(result, key, copy_fn(SeqAt(children_b, i)));
         free(key);
     }
 
     return result;
 }
 
-JsonElement *JsonObjectMergeObject(
+JsonElement *JsonObjectMergeArray(
     const JsonElement *const a, const JsonElement *const b)
+{
+    return JsonObjectMergeArrayWith(a, b, JsonCopy);
+}
+
+static JsonElement *JsonObjectMergeObjectWith(
+    const JsonElement *const a, const JsonElement *const b,
+    JsonCopyFn *const copy_fn)
 {
     assert(JsonGetElementType(a) == JsonGetElementType(b));
     assert(JsonGetElementType(a) == JSON_ELEMENT_TYPE_CONTAINER);
     assert(JsonGetContainerType(a) == JSON_CONTAINER_TYPE_OBJECT);
     assert(JsonGetContainerType(b) == JSON_CONTAINER_TYPE_OBJECT);
 
-    JsonElement *result = JsonObjectCopy(a);
-    JsonIterator iter = JsonIteratorInit(b);
-    const char *key;
-    while ((key = JsonIteratorNextKey(&iter)))
+    Seq *const children_a = JsonContainerChildren(a);
+    Seq *const children_b = JsonContainerChildren(b);
+
+    // the members of a which b does not replace, followed by those of b, as
+    // JsonObjectAppendElement() would have it, without scanning the result
+    // for every key of b
+    JsonKeyIndex index_b;
+    JsonKeyIndexInit(&index_b, children_b);
+
+    JsonElement *result =
+        JsonObjectCreate(SeqLength(children_a) + SeqLength(children_b));
+    Seq *const children = result->container.children;
+    for (size_t i = 0; i < SeqLength(children_a); i++)
+    {
+        const JsonElement *const child = SeqAt(children_a, i);
+        if (JsonKeyIndexGet(&index_b, child->propertyName) == NULL)
+        {
+            SeqAppend(children, JsonElementCopyChild(child, result, copy_fn));
+        }
+    }
+    JsonKeyIndexDestroy(&index_b);
+
+    for (size_t i = 0; i < SeqLength(children_b); i++)
     {
-        JsonObjectAppendElement(
-            result, key, JsonCopy(JsonIteratorCurrentValue(&iter)));
+        const JsonElement *const child = SeqAt(children_b, i);
+        SeqAppend(children, JsonElementCopyChild(child, result, copy_fn));
     }
 
     return result;
 }
 
-JsonElement *JsonMerge(const JsonElement *const a, const JsonElement *const b)
+JsonElement *JsonObjectMergeObject(
+    const JsonElement *const a, const JsonElement *const b)
+{
+    return JsonObjectMergeObjectWith(a, b, JsonCopy);
+}
+
+static JsonElement *JsonMergeWith(
+    const JsonElement *const a, const JsonElement *const b,
+    JsonCopyFn *const copy_fn)
 {
     assert(JsonGetElementType(a) == JsonGetElementType(b));
     assert(JsonGetElementType(a) == JSON_ELEMENT_TYPE_CONTAINER);
@@ -501,9 +1000,9 @@ JsonElement *JsonMerge(const JsonElement *const a, const JsonElement *const b)
         switch (JsonGetContainerType(b))
         {
         case JSON_CONTAINER_TYPE_OBJECT:
-            return JsonObjectMergeArray(b, a);
+            return JsonObjectMergeArrayWith(b, a, copy_fn);
         case JSON_CONTAINER_TYPE_ARRAY:
-            return JsonArrayMergeArray(a, b);
+            return JsonArrayMergeArrayWith(a, b, copy_fn);
         }
         UnexpectedError(
             "Unknown JSON container type: %d", JsonGetContainerType(b));
@@ -513,9 +1012,9 @@ JsonElement *JsonMerge(const JsonElement *const a, const JsonElement *const b)
         switch (JsonGetContainerType(b))
         {
         case JSON_CONTAINER_TYPE_OBJECT:
-            return JsonObjectMergeObject(a, b);
+            return JsonObjectMergeObjectWith(a, b, copy_fn);
         case JSON_CONTAINER_TYPE_ARRAY:
-            return JsonObjectMergeArray(a, b);
+            return JsonObjectMergeArrayWith(a, b, copy_fn);
         }
         UnexpectedError(
             "Unknown JSON container type: %d", JsonGetContainerType(b));
@@ -529,6 +1028,25 @@ JsonElement *JsonMerge(const JsonElement *const a, const JsonElement *const b)
     return NULL;
 }
 
+JsonElement *JsonMerge(const JsonElement *const a, const JsonElement *const b)
+{
+    return JsonMergeWith(a, b, JsonCopy);
+}
+
+JsonElement *JsonMergeShared(const JsonElement *const a, const JsonElement *const b)
+{
+    return JsonMergeWith(a, b, JsonCopyShared);
+}
+
+
+const JsonElement *JsonContainerChildAt(
+    const JsonElement *const container, const size_t index)
+{
+    assert(container != NULL);
+    assert(container->type == JSON_ELEMENT_TYPE_CONTAINER);
+
+    return SeqAt(JsonContainerChildren(container), index);
+}
 
 size_t JsonLength(const JsonElement *const element)
 {
@@ -537,7 +1055,7 @@ size_t JsonLength(const JsonElement *const element)
     switch (element->type)
     {
     case JSON_ELEMENT_TYPE_CONTAINER:
-        return SeqLength(element->container.children);
+        return SeqLength(JsonContainerChildren(element));
 
     case JSON_ELEMENT_TYPE_PRIMITIVE:
         return strlen(element->primitive.value);
@@ -563,8 +1081,14 @@ const char *JsonIteratorNextKey(JsonIterator *const iter)
     assert(iter->container->type == JSON_ELEMENT_TYPE_CONTAINER);
     assert(iter->container->container.type == JSON_CONTAINER_TYPE_OBJECT);
 
-    const JsonElement *child = JsonIteratorNextValue(iter);
-    return child ? child->propertyName : NULL;
+    if (iter->index >= JsonLength(iter->container))
+    {
+        return NULL;
+    }
+
+    Seq *const children = JsonContainerOwnChildren(iter->container);
+    const JsonElement *const child = SeqAt(children, iter->index++);
+    return child->propertyName;
 }
 
 JsonElement *JsonIteratorNextValue(JsonIterator *const iter)
@@ -578,7 +1102,7 @@ JsonElement *JsonIteratorNextValue(JsonIterator *const iter)
         return NULL;
     }
 
-    Seq *const children = iter->container->container.children;
+    Seq *const children = JsonContainerOwnChildren(iter->container);
     return SeqAt(children, iter->index++);
 }
 
@@ -613,7 +1137,22 @@ JsonElement *JsonIteratorCurrentValue(const JsonIterator *const iter)
         return NULL;
     }
 
-    Seq *const children = iter->container->container.children;
+    Seq *const children = JsonContainerOwnChildren(iter->container);
+    return SeqAt(children, iter->index - 1);
+}
+
+static const JsonElement *JsonIteratorCurrentChild(const JsonIterator *const iter)
+{
+    assert(iter != NULL);
+    assert(iter->container != NULL);
+    assert(iter->container->type == JSON_ELEMENT_TYPE_CONTAINER);
+
+    if (iter->index == 0 || iter->index > JsonLength(iter->container))
+    {
+        return NULL;
+    }
+
+    Seq *const children = JsonContainerChildren(iter->container);
     return SeqAt(children, iter->index - 1);
 }
 
@@ -633,7 +1172,7 @@ JsonElementType JsonIteratorCurrentElementType(const JsonIterator *const iter)
 {
     assert(iter != NULL);
 
-    const JsonElement *child = JsonIteratorCurrentValue(iter);
+    const JsonElement *child = JsonIteratorCurrentChild(iter);
     return child->type;
 }
 
@@ -642,7 +1181,7 @@ JsonContainerType JsonIteratorCurrentContainerType(
 {
     assert(iter != NULL);
 
-    const JsonElement *child = JsonIteratorCurrentValue(iter);
+    const JsonElement *child = JsonIteratorCurrentChild(iter);
     assert(child->type == JSON_ELEMENT_TYPE_CONTAINER);
 
     return child->container.type;
@@ -653,7 +1192,7 @@ JsonPrimitiveType JsonIteratorCurrentPrimitiveType(
 {
     assert(iter != NULL);
 
-    const JsonElement *child = JsonIteratorCurrentValue(iter);
+    const JsonElement *child = JsonIteratorCurrentChild(iter);
     assert(child->type == JSON_ELEMENT_TYPE_PRIMITIVE);
 
     return child->primitive.type;
@@ -810,7 +1349,7 @@ void JsonSort(
     assert(container != NULL);
     assert(container->type == JSON_ELEMENT_TYPE_CONTAINER);
 
-    Seq *const children = container->container.children;
+    Seq *const children = JsonContainerChildrenForWrite(container);
     SeqSort(children, (SeqItemComparator) Compare, user_data);
 }
 
@@ -820,7 +1359,7 @@ JsonElement *JsonAt(const JsonElement *container, const size_t index)
     assert(container->type == JSON_ELEMENT_TYPE_CONTAINER);
     assert(index < JsonLength(container));
 
-    return SeqAt(container->container.children, index);
+    return SeqAt(JsonContainerOwnChildren(container), index);
 }
 
 JsonElement *JsonSelect(
@@ -1117,6 +1656,24 @@ void JsonObjectAppendObject(
     JsonObjectAppendElement(object, key, childObject);
 }
 
+static int JsonElementHasProperty(
+    const void *const propertyName,
+    const void *const jsonElement,
+    ARG_UNUSED void *const user_data)
+{
+    assert(propertyName != NULL);
+
+    const JsonElement *element = jsonElement;
+
+    assert(element->propertyName != NULL);
+
+    if (strcmp(propertyName, element->propertyName) == 0)
+    {
+        return 0;
+    }
+    return -1;
+}
+
 void JsonObjectAppendElement(
     JsonElement *const object,
     const char *const key,
@@ -1131,25 +1688,29 @@ void JsonObjectAppendElement(
     JsonObjectRemoveKey(object, key);
 
     JsonElementSetPropertyName(element, key);
-    SeqAppend(object->container.children, element);
+    element->parent = object;
+    SeqAppend(JsonContainerChildrenForWrite(object), element);
 }
 
-static int JsonElementHasProperty(
-    const void *const propertyName,
-    const void *const jsonElement,
-    ARG_UNUSED void *const user_data)
+void JsonObjectAppendElementSharedKey(
+    JsonElement *const object,
+    JsonSharedKey *const key,
+    JsonElement *const element)
 {
-    assert(propertyName != NULL);
-
-    const JsonElement *element = jsonElement;
-
-    assert(element->propertyName != NULL);
+    assert(object != NULL);
+    assert(object->type == JSON_ELEMENT_TYPE_CONTAINER);
+    assert(object->container.type == JSON_CONTAINER_TYPE_OBJECT);
+    assert(key != NULL);
+    assert(element != NULL);
+    assert(SeqLookup(JsonContainerChildren(object), key->name,
+                     JsonElementHasProperty) == NULL);
 
-    if (strcmp(propertyName, element->propertyName) == 0)
-    {
-        return 0;
-    }
-    return -1;
+    JsonElementFreePropertyName(element);
+    __atomic_add_fetch(&key->refcount, 1, __ATOMIC_RELAXED);
+    element->propertyName = key->name;
+    element->propertyNameShared = true;
+    element->parent = object;
+    SeqAppend(JsonContainerChildrenForWrite(object), element);
 }
 
 static int CompareKeyToPropertyName(
@@ -1169,7 +1730,7 @@ static ssize_t JsonElementIndexInParentObject(
     assert(parent->container.type == JSON_CONTAINER_TYPE_OBJECT);
     assert(key != NULL);
 
-    Seq *const children = parent->container.children;
+    Seq *const children = JsonContainerChildren(parent);
     return SeqIndexOf(children, key, CompareKeyToPropertyName);
 }
 
@@ -1183,7 +1744,7 @@ bool JsonObjectRemoveKey(JsonElement *const object, const char *const key)
     const ssize_t index = JsonElementIndexInParentObject(object, key);
     if (index != -1)
     {
-        SeqRemove(object->container.children, index);
+        SeqRemove(JsonContainerChildrenForWrite(object), index);
         return true;
     }
     return false;
@@ -1202,9 +1763,10 @@ JsonElement *JsonObjectDetachKey(
     ssize_t index = JsonElementIndexInParentObject(object, key);
     if (index != -1)
     {
-        Seq *const children = object->container.children;
-        detached = SeqLookup(children, key, JsonElementHasProperty);
+        Seq *const children = JsonContainerChildrenForWrite(object);
+        detached = SeqAt(children, index);
         SeqSoftRemove(children, index);
+        detached->parent = NULL;
     }
 
     return detached;
@@ -1218,8 +1780,8 @@ const char *JsonObjectGetAsString(
     assert(object->container.type == JSON_CONTAINER_TYPE_OBJECT);
     assert(key != NULL);
 
-    JsonElement *childPrimitive =
-        SeqLookup(object->container.children, key, JsonElementHasProperty);
+    JsonElement *childPrimitive = SeqLookup(
+        JsonContainerOwnChildren(object), key, JsonElementHasProperty);
 
     if (childPrimitive != NULL)
     {
@@ -1237,7 +1799,8 @@ bool JsonObjectGetAsBool(
     assert(JsonGetType(object) == JSON_TYPE_OBJECT);
     assert(key != NULL);
 
-    JsonElement *childPrimitive = JsonObjectGet(object, key);
+    const JsonElement *childPrimitive =
+        SeqLookup(JsonContainerChildren(object), key, JsonElementHasProperty);
 
     if (childPrimitive != NULL)
     {
@@ -1256,8 +1819,8 @@ JsonElement *JsonObjectGetAsObject(
     assert(object->container.type == JSON_CONTAINER_TYPE_OBJECT);
     assert(key != NULL);
 
-    JsonElement *childPrimitive =
-        SeqLookup(object->container.children, key, JsonElementHasProperty);
+    JsonElement *childPrimitive = SeqLookup(
+        JsonContainerOwnChildren(object), key, JsonElementHasProperty);
 
     if (childPrimitive != NULL)
     {
@@ -1277,8 +1840,8 @@ JsonElement *JsonObjectGetAsArray(
     assert(object->container.type == JSON_CONTAINER_TYPE_OBJECT);
     assert(key != NULL);
 
-    JsonElement *childPrimitive =
-        SeqLookup(object->container.children, key, JsonElementHasProperty);
+    JsonElement *childPrimitive = SeqLookup(
+        JsonContainerOwnChildren(object), key, JsonElementHasProperty);
 
     if (childPrimitive != NULL)
     {
@@ -1298,7 +1861,8 @@ JsonElement *JsonObjectGet(
     assert(object->container.type == JSON_CONTAINER_TYPE_OBJECT);
     assert(key != NULL);
 
-    return SeqLookup(object->container.children, key, JsonElementHasProperty);
+    return SeqLookup(
+        JsonContainerOwnChildren(object), key, JsonElementHasProperty);
 }
 
 // *******************************************************************************************
@@ -1368,7 +1932,8 @@ void JsonArrayAppendElement(
     assert(array->container.type == JSON_CONTAINER_TYPE_ARRAY);
     assert(element != NULL);
 
-    SeqAppend(array->container.children, element);
+    element->parent = array;
+    SeqAppend(JsonContainerChildrenForWrite(array), element);
 }
 
 void JsonArrayExtend(JsonElement *a, JsonElement *b)
@@ -1380,12 +1945,16 @@ void JsonArrayExtend(JsonElement *a, JsonElement *b)
     assert(b->type == JSON_ELEMENT_TYPE_CONTAINER);
     assert(b->container.type == JSON_CONTAINER_TYPE_ARRAY);
 
-    SeqAppendSeq(a->container.children, b->container.children);
-    SeqSoftDestroy(b->container.children);
-    if (b->propertyName != NULL)
+    Seq *const children_a = JsonContainerChildrenForWrite(a);
+    Seq *const children_b = JsonContainerChildrenForWrite(b);
+    for (size_t i = 0; i < SeqLength(children_b); i++)
     {
-        free(b->propertyName);
+        ((JsonElement *) SeqAt(children_b, i))->parent = a;
     }
+
+    SeqAppendSeq(children_a, children_b);
+    SeqSoftDestroy(children_b);
+    JsonElementFreePropertyName(b);
     free(b);
 }
 
@@ -1395,10 +1964,10 @@ void JsonArrayRemoveRange(
     assert(array != NULL);
     assert(array->type == JSON_ELEMENT_TYPE_CONTAINER);
     assert(array->container.type == JSON_CONTAINER_TYPE_ARRAY);
-    assert(end < SeqLength(array->container.children));
+    assert(end < JsonLength(array));
     assert(start <= end);
 
-    SeqRemoveRange(array->container.children, start, end);
+    SeqRemoveRange(JsonContainerChildrenForWrite(array), start, end);
 }
 
 const char *JsonArrayGetAsString(JsonElement *const array, const size_t index)
@@ -1406,9 +1975,9 @@ const char *JsonArrayGetAsString(JsonElement *const array, const size_t index)
     assert(array != NULL);
     assert(array->type == JSON_ELEMENT_TYPE_CONTAINER);
     assert(array->container.type == JSON_CONTAINER_TYPE_ARRAY);
-    assert(index < SeqLength(array->container.children));
+    assert(index < JsonLength(array));
 
-    JsonElement *childPrimitive = SeqAt(array->container.children, index);
+    JsonElement *childPrimitive = SeqAt(JsonContainerOwnChildren(array), index);
 
     if (childPrimitive != NULL)
     {
@@ -1425,9 +1994,9 @@ JsonElement *JsonArrayGetAsObject(JsonElement *const array, const size_t index)
     assert(array != NULL);
     assert(array->type == JSON_ELEMENT_TYPE_CONTAINER);
     assert(array->container.type == JSON_CONTAINER_TYPE_ARRAY);
-    assert(index < SeqLength(array->container.children));
+    assert(index < JsonLength(array));
 
-    JsonElement *child = SeqAt(array->container.children, index);
+    JsonElement *child = SeqAt(JsonContainerOwnChildren(array), index);
 
     if (child != NULL)
     {
@@ -1455,9 +2024,10 @@ bool JsonArrayContainsOnlyPrimitives(JsonElement *const array)
     assert(array->container.type == JSON_CONTAINER_TYPE_ARRAY);
 
 
-    for (size_t i = 0; i < JsonLength(array); i++)
+    Seq *const children = JsonContainerChildren(array);
+    for (size_t i = 0; i < SeqLength(children); i++)
     {
-        JsonElement *child = JsonArrayGet(array, i);
+        const JsonElement *child = SeqAt(children, i);
 
         if (child->type != JSON_ELEMENT_TYPE_PRIMITIVE)
         {
@@ -1474,7 +2044,7 @@ void JsonContainerReverse(JsonElement *const array)
     assert(array->type == JSON_ELEMENT_TYPE_CONTAINER);
     assert(array->container.type == JSON_CONTAINER_TYPE_ARRAY);
 
-    SeqReverse(array->container.children);
+    SeqReverse(JsonContainerChildrenForWrite(array));
 }
 
 // *******************************************************************************************
@@ -1489,6 +2059,28 @@ JsonElement *JsonStringCreate(const char *const value)
         JSON_PRIMITIVE_TYPE_STRING, xstrdup(value));
 }
 
+JsonElement *JsonStringCreateLen(const char *const value, const size_t length)
+{
+    assert(value != NULL || length == 0);
+
+    char *const copy = xmalloc(length + 1);
+    memcpy(copy, value, length);
+    copy[length] = '\0';
+    return JsonElementCreatePrimitive(JSON_PRIMITIVE_TYPE_STRING, copy);
+}
+
+JsonElement *JsonPrimitiveCreateLen(
+    const JsonPrimitiveType type, const char *const value, const size_t length)
+{
+    assert(type == JSON_PRIMITIVE_TYPE_STRING ||
+           type == JSON_PRIMITIVE_TYPE_INTEGER ||
+           type == JSON_PRIMITIVE_TYPE_REAL);
+
+    JsonElement *const element = JsonStringCreateLen(value, length);
+    element->primitive.type = type;
+    return element;
+}
+
 JsonElement *JsonIntegerCreate(const int value)
 {
     char *buffer;
@@ -1598,7 +2190,7 @@ static void JsonArrayWrite(
     assert(array != NULL);
     assert(array->type == JSON_ELEMENT_TYPE_CONTAINER);
     assert(array->container.type == JSON_CONTAINER_TYPE_ARRAY);
-    assert(array->container.children != NULL);
+    assert(JsonContainerChildren(array) != NULL);
 
     if (JsonLength(array) == 0)
     {
@@ -1608,7 +2200,7 @@ static void JsonArrayWrite(
 
     WriterWrite(writer, "[\n");
 
-    Seq *const children = array->container.children;
+    Seq *const children = JsonContainerChildren(array);
     const size_t length = SeqLength(children);
     for (size_t i = 0; i < length; i++)
     {
@@ -1663,7 +2255,7 @@ static bool all_children_have_keys(const JsonElement *const object)
     assert(object != NULL);
     assert(object->type == JSON_ELEMENT_TYPE_CONTAINER);
 
-    Seq *const children = object->container.children;
+    Seq *const children = JsonContainerChildren(object);
     const size_t length = SeqLength(children);
     for (size_t i = 0; i < length; i++)
     {
@@ -1686,17 +2278,18 @@ void JsonObjectWrite(
     assert(object != NULL);
     assert(object->type == JSON_ELEMENT_TYPE_CONTAINER);
     assert(object->container.type == JSON_CONTAINER_TYPE_OBJECT);
-    assert(object->container.children != NULL);
+    assert(JsonContainerChildren(object) != NULL);
 
     WriterWrite(writer, "{\n");
 
     assert(all_children_have_keys(object));
 
-    // sort the children Seq so the output is canonical (keys are sorted)
+    // sort a view of the children so the output is canonical (keys are
+    // sorted) without reordering the children themselves, which copies may
+    // share and others may be iterating
     // we've already asserted that the children have a valid propertyName
-    JsonSort(object, (JsonComparator *) JsonElementPropertyCompare, NULL);
-
-    Seq *const children = object->container.children;
+    Seq *const children = SeqSoftSort(
+        JsonContainerChildren(object), JsonElementPropertyCompare, NULL);
     const size_t length = SeqLength(children);
     for (size_t i = 0; i < length; i++)
     {
@@ -1727,6 +2320,7 @@ void JsonObjectWrite(
         }
         WriterWrite(writer, "\n");
     }
+    SeqSoftDestroy(children);
 
     PrintIndent(writer, indent_level);
     WriterWriteChar(writer, '}');
@@ -1780,7 +2374,7 @@ static void JsonArrayWriteCompact(
     assert(array != NULL);
     assert(array->type == JSON_ELEMENT_TYPE_CONTAINER);
     assert(array->container.type == JSON_CONTAINER_TYPE_ARRAY);
-    assert(array->container.children != NULL);
+    assert(JsonContainerChildren(array) != NULL);
 
     if (JsonLength(array) == 0)
     {
@@ -1789,7 +2383,7 @@ static void JsonArrayWriteCompact(
     }
 
     WriterWrite(writer, "[");
-    Seq *const children = array->container.children;
+    Seq *const children = JsonContainerChildren(array);
     const size_t length = SeqLength(children);
     for (size_t i = 0; i < length; i++)
     {
@@ -1830,11 +2424,12 @@ static void JsonObjectWriteCompact(
 
     assert(all_children_have_keys(object));
 
-    // sort the children Seq so the output is canonical (keys are sorted)
+    // sort a view of the children so the output is canonical (keys are
+    // sorted) without reordering the children themselves, which copies may
+    // share and others may be iterating
     // we've already asserted that the children have a valid propertyName
-    JsonSort(object, (JsonComparator *) JsonElementPropertyCompare, NULL);
-
-    Seq *const children = object->container.children;
+    Seq *const children = SeqSoftSort(
+        JsonContainerChildren(object), JsonElementPropertyCompare, NULL);
     const size_t length = SeqLength(children);
     for (size_t i = 0; i < length; i++)
     {
@@ -1861,6 +2456,7 @@ static void JsonObjectWriteCompact(
             WriterWriteChar(writer, ',');
         }
     }
+    SeqSoftDestroy(children);
 
     WriterWriteChar(writer, '}');
 }
@@ -2020,7 +2616,8 @@ const char *JsonParseErrorToString(const JsonParseError error)
             "CFEngine was not built with libyaml support",
         [JSON_PARSE_ERROR_LIBYAML_FAILURE] = "libyaml internal failure",
         [JSON_PARSE_ERROR_NO_SUCH_FILE] = "No such file or directory",
-        [JSON_PARSE_ERROR_NO_DATA] = "No data"};
+        [JSON_PARSE_ERROR_NO_DATA] = "No data",
+        [JSON_PARSE_ERROR_BINARY_FORMAT] = "Not a valid binary JSON document"};
 
     return parse_errors[error];
 }
@@ -2752,18 +3349,19 @@ JsonParseError JsonParseAnyFile(
     assert(json_out != NULL);
 
     bool truncated = false;
-    Writer *contents = FileRead(path, size_max, &truncated);
+    FileMapping *contents = FileMap(path, size_max, &truncated);
     if (contents == NULL)
     {
         return JSON_PARSE_ERROR_NO_SUCH_FILE;
     }
     else if (truncated)
     {
+        FileUnmap(contents);
         return JSON_PARSE_ERROR_TRUNCATED;
     }
     assert(json_out);
     *json_out = NULL;
-    const char *data = StringWriterData(contents);
+    const char *data = FileMappingData(contents);
     JsonParseError err;
 
     if (yaml_format)
@@ -2775,7 +3373,7 @@ JsonParseError JsonParseAnyFile(
         err = JsonParse(&data, json_out);
     }
 
-    WriterClose(contents);
+    FileUnmap(contents);
     return err;
 }
 
@@ -2856,7 +3454,7 @@ bool JsonErrorVisitor(ARG_UNUSED JsonElement *element, ARG_UNUSED void *data)
 // takes either a pre-compiled pattern OR a regex (one of the two shouldn't be
 // NULL)
 JsonElement *StringCaptureData(
-    pcre *const pattern, const char *const regex, const char *const data)
+    const Regex *const pattern, const char *const regex, const char *const data)
 {
     assert(regex != NULL || pattern != NULL);
     assert(data != NULL);
@@ -2865,7 +3463,7 @@ JsonElement *StringCaptureData(
 
     if (pattern != NULL)
     {
-        s = StringMatchCapturesWithPrecompiledRegex(pattern, data, true);
+        s = StringMatchCapturesWithPrecompiledRegex(pattern, data, strlen(data), true);
     }
     else
     {
@@ -34,10 +34,20 @@
   This is a JSON Document Object Model (DOM). Clients deal only with the opaque
   JsonElement, which may be either a container or a primitive (client should
   probably not deal much with primitive elements). A JSON container may be
-  either an object or an array. The JSON DOM currently supports copy semantics
-  for primitive values, but not for container types. In practice, this means
-  that clients always just free the parent element, but an element should just
-  have a single parent, or none.
+  either an object or an array. Clients always just free the parent element,
+  and an element should just have a single parent, or none.
+
+  JsonCopy() and JsonMerge() copy everything, their results are independent
+  of their inputs. Shared copies (JsonCopyShared(), JsonMergeShared()) instead
+  share the contents of containers with their inputs until either of them is
+  changed, at which point only the changed containers and the ones above them
+  get contents of their own. Getting a child of a shared copy
+  (JsonObjectGet(), JsonAt(), iterators, ...) gives the copy its own children
+  one level deep, so the child can be changed and stays valid as long as the
+  copy does. Elements can be copied from several threads at once, but since
+  getting children of a shared copy changes it, a shared copy must not be read
+  from several threads at once, and an element must not be changed while
+  shared copies of it are used in other threads.
 
   JSON primitives as JsonElement are currently not well supported.
 
@@ -116,6 +126,7 @@ typedef enum
     JSON_PARSE_ERROR_NO_SUCH_FILE,
     JSON_PARSE_ERROR_NO_DATA,
     JSON_PARSE_ERROR_TRUNCATED,
+    JSON_PARSE_ERROR_BINARY_FORMAT,
 
     JSON_PARSE_ERROR_MAX
 } JsonParseError;
@@ -155,10 +166,52 @@ char *Json5EscapeData(Slice unescaped_data);
 // Generic JSONElement functions
 //////////////////////////////////////////////////////////////////////////////
 
+/**
+  @brief Copy a JSON element and everything below it.
+  */
 JsonElement *JsonCopy(const JsonElement *json);
+
+/**
+  @brief Copy a JSON element, in constant time for containers.
+  @note The copy shares the contents of #json until either is changed, see
+        above for what this means for reading it.
+  */
+JsonElement *JsonCopyShared(const JsonElement *json);
+
+/**
+  @brief Order two JSON elements, 0 if they are equal.
+  @note Objects are compared member by member in the order of their keys, the
+        order the members were added in does not matter.
+  */
 int JsonCompare(const JsonElement *a, const JsonElement *b);
+
+/**
+  @brief Structural hash of a JSON element, equal for elements JsonCompare()
+         finds equal.
+  @note The hash is kept in the element (and its children) until they are
+        changed, so it is only computed once.
+  */
+uint64_t JsonHash(const JsonElement *element);
+
+/**
+  @brief Whether JsonCompare() would return 0, but faster: elements with
+         different hashes are not compared further and object members are
+         looked up through a temporary hash index.
+  */
+bool JsonEqual(const JsonElement *a, const JsonElement *b);
+
+/**
+  @brief Merge two containers into a new one, copying their contents.
+  */
 JsonElement *JsonMerge(const JsonElement *a, const JsonElement *b);
 
+/**
+  @brief Like JsonMerge(), but takes time in the number of children of #a and
+         #b: the grandchildren are shared with the inputs as by
+         JsonCopyShared().
+  */
+JsonElement *JsonMergeShared(const JsonElement *a, const JsonElement *b);
+
 /**
   @brief Destroy a JSON element
   @param element [in] The JSON element to destroy.
@@ -205,6 +258,12 @@ int64_t JsonPrimitiveGetAsInt64ExitOnError(const JsonElement *primitive);
 double JsonPrimitiveGetAsReal(const JsonElement *primitive);
 
 JsonElement *JsonStringCreate(const char *value);
+
+/**
+  @brief Create a string from the first #length bytes of #value, which does not
+         need to be '\0'-terminated.
+  */
+JsonElement *JsonStringCreateLen(const char *value, size_t length);
 JsonElement *JsonIntegerCreate(int value);
 JsonElement *JsonIntegerCreate64(int64_t value);
 JsonElement *JsonRealCreate(double value);
@@ -0,0 +1,252 @@
+/*
+  Copyright 2023 Northern.tech AS
+
+  This file is part of CFEngine 3 - written and maintained by Northern.tech AS.
+
+  This program is free software; you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by the
+  Free Software Foundation; version 3.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA
+
+  To the extent this program is licensed as part of the Enterprise
+  versions of CFEngine, the applicable Commercial Open Source License
+  (COSL) may apply to this file if you as a licensee so wish it. See
+  included file COSL.txt.
+*/
+
+#include <platform.h>
+#include <lru_cache.h>
+
+#include <alloc.h>
+#include <map.h>
+
+struct LRUCacheEntry_
+{
+    void *item;
+    size_t refcount;
+    bool cached;
+    struct LRUCacheEntry_ *prev;
+    struct LRUCacheEntry_ *next;
+};
+
+/*
+ * Entries are kept in a Map (for lookups) and in a doubly-linked list ordered
+ * from most to least recently used (for eviction).
+ */
+struct LRUCache_
+{
+    pthread_mutex_t mutex;
+    size_t capacity;
+    void (*destroy_fn)(void *item);
+    Map *map;                   /* item -> LRUCacheEntry */
+    LRUCacheEntry *head;
+    LRUCacheEntry *tail;
+    LRUCacheStats stats;
+};
+
+LRUCache *LRUCacheNew(size_t capacity, MapHashFn hash_fn,
+                      MapKeyEqualFn equal_fn, void (*destroy_fn)(void *item))
+{
+    assert(capacity > 0);
+    assert(hash_fn != NULL);
+    assert(equal_fn != NULL);
+    assert(destroy_fn != NULL);
+
+    LRUCache *cache = xcalloc(1, sizeof(LRUCache));
+    pthread_mutex_init(&cache->mutex, NULL);
+    cache->capacity = capacity;
+    cache->destroy_fn = destroy_fn;
+    cache->map = MapNew(hash_fn, equal_fn, NULL, NULL);
+    return cache;
+}
+
+void LRUCacheDestroy(LRUCache *cache)
+{
+    if (cache != NULL)
+    {
+        LRUCacheClear(cache);
+        MapDestroy(cache->map);
+        pthread_mutex_destroy(&cache->mutex);
+        free(cache);
+    }
+}
+
+static void LRUCacheEntryDestroy(LRUCache *cache, LRUCacheEntry *entry)
+{
+    cache->destroy_fn(entry->item);
+    free(entry);
+}
+
+/* The functions below must be called with cache->mutex held. */
+
+static void LRUCacheUnlink(LRUCache *cache, LRUCacheEntry *entry)
+{
+    if (entry->prev != NULL)
+    {
+        entry->prev->next = entry->next;
+    }
+    else
+    {
+        cache->head = entry->next;
+    }
+
+    if (entry->next != NULL)
+    {
+        entry->next->prev = entry->prev;
+    }
+    else
+    {
+        cache->tail = entry->prev;
+    }
+
+    entry->prev = NULL;
+    entry->next = NULL;
+}
+
+static void LRUCachePushFront(LRUCache *cache, LRUCacheEntry *entry)
+{
+    entry->prev = NULL;
+    entry->next = cache->head;
+    if (cache->head != NULL)
+    {
+        cache->head->prev = entry;
+    }
+    cache->head = entry;
+    if (cache->tail == NULL)
+    {
+        cache->tail = entry;
+    }
+}
+
+static void LRUCacheDrop(LRUCache *cache, LRUCacheEntry *entry)
+{
+    MapRemove(cache->map, entry->item);
+    LRUCacheUnlink(cache, entry);
+    entry->cached = false;
+    cache->stats.entries--;
+
+    if (entry->refcount == 0)
+    {
+        LRUCacheEntryDestroy(cache, entry);
+    }
+}
+
+LRUCacheEntry *LRUCacheAcquire(LRUCache *cache, const void *key)
+{
+    assert(cache != NULL);
+    assert(key != NULL);
+
+    pthread_mutex_lock(&cache->mutex);
+
+    LRUCacheEntry *entry = MapGet(cache->map, key);
+    if (entry != NULL)
+    {
+        cache->stats.hits++;
+        entry->refcount++;
+        if (entry != cache->head)
+        {
+            LRUCacheUnlink(cache, entry);
+            LRUCachePushFront(cache, entry);
+        }
+    }
+    else
+    {
+        cache->stats.misses++;
+    }
+
+    pthread_mutex_unlock(&cache->mutex);
+    return entry;
+}
+
+LRUCacheEntry *LRUCacheInsert(LRUCache *cache, void *item)
+{
+    assert(cache != NULL);
+    assert(item != NULL);
+
+    pthread_mutex_lock(&cache->mutex);
+
+    LRUCacheEntry *entry = MapGet(cache->map, item);
+    if (entry != NULL)
+    {
+        entry->refcount++;
+        pthread_mutex_unlock(&cache->mutex);
+        cache->destroy_fn(item);
+        return entry;
+    }
+
+    while (cache->stats.entries >= cache->capacity)
+    {
+        LRUCacheDrop(cache, cache->tail);
+        cache->stats.evictions++;
+    }
+
+    entry = xcalloc(1, sizeof(LRUCacheEntry));
+    entry->item = item;
+    entry->refcount = 1;
+    entry->cached = true;
+    MapInsert(cache->map, item, entry);
+    LRUCachePushFront(cache, entry);
+    cache->stats.entries++;
+
+    pthread_mutex_unlock(&cache->mutex);
+    return entry;
+}
+
+void LRUCacheRelease(LRUCache *cache, LRUCacheEntry *entry)
+{
+    assert(cache != NULL);
+    assert(entry != NULL);
+
+    pthread_mutex_lock(&cache->mutex);
+
+    assert(entry->refcount > 0);
+    entry->refcount--;
+    const bool destroy = (entry->refcount == 0 && !entry->cached);
+
+    pthread_mutex_unlock(&cache->mutex);
+
+    if (destroy)
+    {
+        LRUCacheEntryDestroy(cache, entry);
+    }
+}
+
+void *LRUCacheEntryGet(const LRUCacheEntry *entry)
+{
+    assert(entry != NULL);
+    return entry->item;
+}
+
+void LRUCacheGetStats(LRUCache *cache, LRUCacheStats *stats)
+{
+    assert(cache != NULL);
+    assert(stats != NULL);
+
+    pthread_mutex_lock(&cache->mutex);
+    *stats = cache->stats;
+    pthread_mutex_unlock(&cache->mutex);
+}
+
+void LRUCacheClear(LRUCache *cache)
+{
+    assert(cache != NULL);
+
+    pthread_mutex_lock(&cache->mutex);
+
+    while (cache->tail != NULL)
+    {
+        LRUCacheDrop(cache, cache->tail);
+    }
+
+    cache->stats = (LRUCacheStats) { 0 };
+
+    pthread_mutex_unlock(&cache->mutex);
+}
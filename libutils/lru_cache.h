@@ -0,0 +1,82 @@
+/*
+  Copyright 2023 Northern.tech AS
+
+  This file is part of CFEngine 3 - written and maintained by Northern.tech AS.
+
+  This program is free software; you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by the
+  Free Software Foundation; version 3.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA
+
+  To the extent this program is licensed as part of the Enterprise
+  versions of CFEngine, the applicable Commercial Open Source License
+  (COSL) may apply to this file if you as a licensee so wish it. See
+  included file COSL.txt.
+*/
+
+#ifndef CFENGINE_LRU_CACHE_H
+#define CFENGINE_LRU_CACHE_H
+
+#include <platform.h>
+#include <map_common.h>                       /* MapHashFn, MapKeyEqualFn */
+
+/*
+ * Bounded, thread-safe cache of items, evicting the least recently used one
+ * when full. Items are their own keys: #hash_fn and #equal_fn are applied to
+ * items, and lookups are done with a (usually stack allocated) item holding
+ * just the key fields.
+ *
+ * Acquired items are reference counted, an item evicted while another thread
+ * still uses it is only destroyed once the last reference is released.
+ */
+typedef struct LRUCache_ LRUCache;
+typedef struct LRUCacheEntry_ LRUCacheEntry;
+
+typedef struct
+{
+    size_t hits;                /* lookups served from the cache */
+    size_t misses;              /* lookups which found nothing */
+    size_t evictions;           /* entries dropped to make room for new ones */
+    size_t entries;             /* items currently cached */
+} LRUCacheStats;
+
+LRUCache *LRUCacheNew(size_t capacity, MapHashFn hash_fn,
+                      MapKeyEqualFn equal_fn, void (*destroy_fn)(void *item));
+void LRUCacheDestroy(LRUCache *cache);
+
+/**
+ * @brief Look up the item equal to #key.
+ * @return An entry which must be given back with LRUCacheRelease(), or NULL
+ *         on a miss.
+ */
+LRUCacheEntry *LRUCacheAcquire(LRUCache *cache, const void *key);
+
+/**
+ * @brief Add #item to the cache, evicting the oldest items if it is full.
+ *
+ * If an equal item was inserted meanwhile (e.g. by another thread which
+ * missed at the same time), #item is destroyed and the existing one is
+ * returned instead.
+ *
+ * @return An entry which must be given back with LRUCacheRelease().
+ */
+LRUCacheEntry *LRUCacheInsert(LRUCache *cache, void *item);
+
+void LRUCacheRelease(LRUCache *cache, LRUCacheEntry *entry);
+
+void *LRUCacheEntryGet(const LRUCacheEntry *entry);
+
+void LRUCacheGetStats(LRUCache *cache, LRUCacheStats *stats);
+
+/* Drop all cached items and reset the counters. */
+void LRUCacheClear(LRUCache *cache);
+
+#endif  /* CFENGINE_LRU_CACHE_H */
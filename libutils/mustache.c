@@ -29,6 +29,9 @@
 #include <logging.h>
 #include <alloc.h>
 #include <sequence.h>
+#include <lru_cache.h>
+#include <misc_lib.h>         /* xsnprintf */
+#include <printsize.h>
 
 typedef enum
 {
@@ -56,6 +59,71 @@ typedef struct
 
 #define MUSTACHE_MAX_DELIM_SIZE 10
 
+/* Size of the buffer used when rendering into a Writer. */
+#define MUSTACHE_OUTPUT_BUFSIZE 8192
+
+/* Maximum number of compiled templates kept by MustacheRender(). */
+#define MUSTACHE_CACHE_CAPACITY 32
+
+typedef struct
+{
+    char start[MUSTACHE_MAX_DELIM_SIZE + 1];
+    size_t start_len;
+    char end[MUSTACHE_MAX_DELIM_SIZE + 1];
+    size_t end_len;
+
+    /* The same delimiters, but pointing into the template (or to static
+     * storage) so that they outlive compilation. */
+    const char *start_text;
+    const char *end_text;
+} MustacheDelimiters;
+
+/* A variable name split on '.', e.g. "-top-.a.b" */
+typedef struct
+{
+    char **components;          /* at least one, possibly "" */
+    size_t num_components;
+    bool top;                   /* first component is -top- */
+} MustachePath;
+
+typedef enum
+{
+    MUSTACHE_OP_TEXT,
+    MUSTACHE_OP_VAR,
+    MUSTACHE_OP_SECTION,
+    MUSTACHE_OP_SECTION_END
+} MustacheOpType;
+
+/*
+ * One step of a compiled template. Delimiter changes, comments and
+ * standalone lines are dealt with by the compiler, what is left is literal
+ * text, variables and (inverted) sections.
+ */
+typedef struct
+{
+    MustacheOpType type;
+    TagType tag_type;           /* conversion of a variable, SECTION or INVERTED */
+
+    /* literal text for MUSTACHE_OP_TEXT, tag content otherwise */
+    const char *text;
+    size_t text_len;
+
+    MustachePath path;
+    bool item_mode;             /* {{.}} */
+    bool key_mode;              /* {{@}} */
+
+    /* sections only */
+    bool iterate_object;        /* the section directly contains {{@}} */
+    size_t end;                 /* index of the matching MUSTACHE_OP_SECTION_END */
+} MustacheOp;
+
+struct MustacheTemplate_
+{
+    char *source;
+    MustacheOp *ops;
+    size_t num_ops;
+};
+
 static bool IsSpace(char c)
 {
     return c == '\t' || c == ' ';
@@ -147,70 +215,6 @@ static bool IsTagTypeRenderable(TagType type)
     }
 }
 
-static JsonElement *LookupVariable(Seq *hash_stack, const char *name, size_t name_len)
-{
-    assert(SeqLength(hash_stack) > 0);
-
-    size_t num_comps = StringCountTokens(name, name_len, ".");
-
-    JsonElement *base_var = NULL;
-    {
-        StringRef base_comp = StringGetToken(name, name_len, 0, ".");
-        char *base_comp_str = xstrndup(base_comp.data, base_comp.len);
-
-        if (strcmp("-top-", base_comp_str) == 0)
-        {
-            base_var = SeqAt(hash_stack, 0);
-        }
-
-        for (ssize_t i = SeqLength(hash_stack) - 1; i >= 0; i--)
-        {
-            JsonElement *hash = SeqAt(hash_stack, i);
-            if (!hash)
-            {
-                continue;
-            }
-
-            if (JsonGetType(hash) == JSON_TYPE_OBJECT)
-            {
-                JsonElement *var = JsonObjectGet(hash, base_comp_str);
-                if (var)
-                {
-                    base_var = var;
-                    break;
-                }
-            }
-        }
-        free(base_comp_str);
-    }
-
-    if (!base_var)
-    {
-        return NULL;
-    }
-
-    for (size_t i = 1; i < num_comps; i++)
-    {
-        if (JsonGetType(base_var) != JSON_TYPE_OBJECT)
-        {
-            return NULL;
-        }
-
-        StringRef comp = StringGetToken(name, name_len, i, ".");
-        char *comp_str = xstrndup(comp.data, comp.len);
-        base_var = JsonObjectGet(base_var, comp_str);
-        free(comp_str);
-
-        if (!base_var)
-        {
-            return NULL;
-        }
-    }
-
-    assert(base_var);
-    return base_var;
-}
-
 static Mustache NextTag(const char *input,
                         const char *delim_start, size_t delim_start_len,
                         const char *delim_end, size_t delim_end_len)
@@ -313,53 +317,107 @@ static Mustache NextTag(const char *input,
     return ret;
 }
 
-static void RenderHTMLContent(Buffer *out, const char *input, size_t len)
+/*
+ * Where rendered output goes: straight into a Buffer, or into a Writer
+ * through a local buffer, so that the Writer sees a few large writes instead
+ * of one per span of text or escaped character.
+ */
+typedef struct
+{
+    Buffer *buffer;
+    Writer *writer;
+    bool write_failed;
+    char *data;                 /* MUSTACHE_OUTPUT_BUFSIZE bytes, Writer only */
+    size_t used;
+} MustacheOutput;
+
+static void OutputWrite(MustacheOutput *out, const char *data, size_t len)
+{
+    if (WriterWriteLen(out->writer, data, len) != len)
+    {
+        out->write_failed = true;
+    }
+}
+
+static void OutputFlush(MustacheOutput *out)
+{
+    if (out->writer != NULL && out->used > 0)
+    {
+        OutputWrite(out, out->data, out->used);
+        out->used = 0;
+    }
+}
+
+static void OutputAppend(MustacheOutput *out, const char *data, size_t len)
 {
+    if (len == 0)
+    {
+        return;
+    }
+
+    if (out->buffer != NULL)
+    {
+        BufferAppend(out->buffer, data, len);
+        return;
+    }
+
+    if (out->used + len > MUSTACHE_OUTPUT_BUFSIZE)
+    {
+        OutputFlush(out);
+        if (len >= MUSTACHE_OUTPUT_BUFSIZE)
+        {
+            OutputWrite(out, data, len);
+            return;
+        }
+    }
+
+    memcpy(out->data + out->used, data, len);
+    out->used += len;
+}
+
+static void OutputAppendString(MustacheOutput *out, const char *str)
+{
+    OutputAppend(out, str, strlen(str));
+}
+
+/* Copies the runs between characters which need escaping in one go. */
+static void RenderHTMLContent(MustacheOutput *out, const char *input, size_t len)
+{
+    size_t run_start = 0;
     for (size_t i = 0; i < len; i++)
     {
+        const char *entity;
         switch (input[i])
         {
         case '&':
-            BufferAppendString(out, "&amp;");
+            entity = "&amp;";
             break;
 
         case '"':
-            BufferAppendString(out, "&quot;");
+            entity = "&quot;";
             break;
 
         case '<':
-            BufferAppendString(out, "&lt;");
+            entity = "&lt;";
             break;
 
         case '>':
-            BufferAppendString(out, "&gt;");
+            entity = "&gt;";
             break;
 
         default:
-            BufferAppendChar(out, input[i]);
-            break;
+            continue;
         }
-    }
-}
 
-static void RenderContent(Buffer *out, const char *content, size_t len, bool html, bool skip_content)
-{
-    if (skip_content)
-    {
-        return;
+        OutputAppend(out, input + run_start, i - run_start);
+        OutputAppendString(out, entity);
+        run_start = i + 1;
     }
 
-    if (html)
-    {
-        RenderHTMLContent(out, content, len);
-    }
-    else
-    {
-        BufferAppend(out, content, len);
-    }
+    OutputAppend(out, input + run_start, len - run_start);
 }
 
-static bool RenderVariablePrimitive(Buffer *out, const JsonElement *primitive, const bool escaped, const char* json_key)
+static bool RenderVariablePrimitive(MustacheOutput *out, const JsonElement *primitive, const bool escaped, const char* json_key)
 {
     if (json_key != NULL)
     {
@@ -369,7 +427,7 @@ static bool RenderVariablePrimitive(Buffer *out, const JsonElement *primitive, c
         }
         else
         {
-            BufferAppendString(out, json_key);
+            OutputAppendString(out, json_key);
         }
         return true;
     }
@@ -383,28 +441,28 @@ static bool RenderVariablePrimitive(Buffer *out, const JsonElement *primitive, c
         }
         else
         {
-            BufferAppendString(out, JsonPrimitiveGetAsString(primitive));
+            OutputAppendString(out, JsonPrimitiveGetAsString(primitive));
         }
         return true;
 
     case JSON_PRIMITIVE_TYPE_INTEGER:
         {
-            char *str = StringFromLong(JsonPrimitiveGetAsInteger(primitive));
-            BufferAppendString(out, str);
-            free(str);
+            char str[PRINTSIZE(long)];
+            xsnprintf(str, sizeof(str), "%ld", JsonPrimitiveGetAsInteger(primitive));
+            OutputAppendString(out, str);
         }
         return true;
 
     case JSON_PRIMITIVE_TYPE_REAL:
         {
             char *str = StringFromDouble(JsonPrimitiveGetAsReal(primitive));
-            BufferAppendString(out, str);
+            OutputAppendString(out, str);
             free(str);
         }
         return true;
 
     case JSON_PRIMITIVE_TYPE_BOOL:
-        BufferAppendString(out, JsonPrimitiveGetAsBool(primitive) ? "true" : "false");
+        OutputAppendString(out, JsonPrimitiveGetAsBool(primitive) ? "true" : "false");
         return true;
 
     case JSON_PRIMITIVE_TYPE_NULL:
@@ -416,9 +474,19 @@ static bool RenderVariablePrimitive(Buffer *out, const JsonElement *primitive, c
     return false;
 }
 
-static bool RenderVariableContainer(Buffer *out, const JsonElement *container, bool compact)
+static bool RenderVariableContainer(MustacheOutput *out, const JsonElement *container, bool compact)
 {
-    Writer *w = StringWriter();
+    Writer *w = out->writer;
+    if (w != NULL)
+    {
+        /* serialize straight into the destination */
+        OutputFlush(out);
+    }
+    else
+    {
+        w = StringWriter();
+    }
+
     if (compact)
     {
         JsonWriteCompact(w, container);
@@ -428,41 +496,105 @@ static bool RenderVariableContainer(Buffer *out, const JsonElement *container, b
         JsonWrite(w, container, 0);
     }
 
-    BufferAppendString(out, StringWriterData(w));
-    WriterClose(w);
+    if (out->writer == NULL)
+    {
+        BufferAppend(out->buffer, StringWriterData(w), StringWriterLength(w));
+        WriterClose(w);
+    }
     return true;
 }
 
-static bool RenderVariable(Buffer *out,
-                           const char *content, size_t content_len,
-                           TagType conversion,
-                           Seq *hash_stack,
-                           const char *json_key)
+static void MustachePathInit(MustachePath *path, const char *name, size_t name_len)
+{
+    assert(path != NULL);
+
+    const size_t num_comps = StringCountTokens(name, name_len, ".");
+
+    path->num_components = MAX(num_comps, 1);
+    path->components = xcalloc(path->num_components, sizeof(char *));
+    for (size_t i = 0; i < path->num_components; i++)
+    {
+        StringRef comp = StringGetToken(name, name_len, i, ".");
+        path->components[i] = (comp.data != NULL) ? xstrndup(comp.data, comp.len) : xstrdup("");
+    }
+    path->top = StringEqual(path->components[0], "-top-");
+}
+
+static void MustachePathDestroy(MustachePath *path)
+{
+    for (size_t i = 0; i < path->num_components; i++)
+    {
+        free(path->components[i]);
+    }
+    free(path->components);
+}
+
+static JsonElement *LookupVariable(Seq *hash_stack, const MustachePath *path)
+{
+    assert(SeqLength(hash_stack) > 0);
+
+    JsonElement *base_var = path->top ? SeqAt(hash_stack, 0) : NULL;
+
+    for (ssize_t i = SeqLength(hash_stack) - 1; i >= 0; i--)
+    {
+        JsonElement *hash = SeqAt(hash_stack, i);
+        if (!hash)
+        {
+            continue;
+        }
+
+        if (JsonGetType(hash) == JSON_TYPE_OBJECT)
+        {
+            JsonElement *var = JsonObjectGet(hash, path->components[0]);
+            if (var)
+            {
+                base_var = var;
+                break;
+            }
+        }
+    }
+
+    if (!base_var)
+    {
+        return NULL;
+    }
+
+    for (size_t i = 1; i < path->num_components; i++)
+    {
+        if (JsonGetType(base_var) != JSON_TYPE_OBJECT)
+        {
+            return NULL;
+        }
+
+        base_var = JsonObjectGet(base_var, path->components[i]);
+        if (!base_var)
+        {
+            return NULL;
+        }
+    }
+
+    assert(base_var);
+    return base_var;
+}
+
+static bool RenderVariable(MustacheOutput *out, const MustacheOp *op,
+                           Seq *hash_stack, const char *json_key)
 {
     JsonElement *var = NULL;
-    bool escape = conversion == TAG_TYPE_VAR;
-    bool serialize = conversion == TAG_TYPE_VAR_SERIALIZED;
-    bool serialize_compact = conversion == TAG_TYPE_VAR_SERIALIZED_COMPACT;
+    bool escape = op->tag_type == TAG_TYPE_VAR;
+    bool serialize = op->tag_type == TAG_TYPE_VAR_SERIALIZED;
+    bool serialize_compact = op->tag_type == TAG_TYPE_VAR_SERIALIZED_COMPACT;
 
-    const bool item_mode = strncmp(content, ".", content_len) == 0;
-    const bool key_mode = strncmp(content, "@", content_len) == 0;
+    const bool item_mode = op->item_mode;
+    const bool key_mode = op->key_mode;
 
     if (item_mode || key_mode)
     {
         var = SeqAt(hash_stack, SeqLength(hash_stack) - 1);
-
-        // Leave this in, it's really useful when debugging here but useless otherwise
-        // for (int i=1; i < SeqLength(hash_stack); i++)
-        // {
-        //     JsonElement *dump = SeqAt(hash_stack, i);
-        //     Writer *w = StringWriter();
-        //     JsonWrite(w, dump, 0);
-        //     Log(LOG_LEVEL_ERR, "RenderVariable: at hash_stack position %d, we found var '%s'", i, StringWriterClose(w));
-        // }
     }
     else
     {
-        var = LookupVariable(hash_stack, content, content_len);
+        var = LookupVariable(hash_stack, &op->path);
     }
 
     if (key_mode && json_key == NULL)
@@ -512,8 +644,7 @@ static bool RenderVariable(Buffer *out,
 }
 
 static bool SetDelimiters(const char *content, size_t content_len,
-                          char *delim_start, size_t *delim_start_len,
-                          char *delim_end, size_t *delim_end_len)
+                          MustacheDelimiters *delims)
 {
     size_t num_tokens = StringCountTokens(content, content_len, " \t");
     if (num_tokens != 2)
@@ -530,9 +661,6 @@ static bool SetDelimiters(const char *content, size_t content_len,
             MUSTACHE_MAX_DELIM_SIZE, content);
         return false;
     }
-    strncpy(delim_start, first.data, first.len);
-    delim_start[first.len] = '\0';
-    *delim_start_len = first.len;
 
     StringRef second = StringGetToken(content, content_len, 1, " \t");
     if (second.len > MUSTACHE_MAX_DELIM_SIZE)
@@ -541,25 +669,31 @@ static bool SetDelimiters(const char *content, size_t content_len,
             MUSTACHE_MAX_DELIM_SIZE, content);
         return false;
     }
-    strncpy(delim_end, second.data, second.len);
-    delim_end[second.len] = '\0';
-    *delim_end_len = second.len;
+
+    memcpy(delims->start, first.data, first.len);
+    delims->start[first.len] = '\0';
+    delims->start_len = first.len;
+    delims->start_text = first.data;
+
+    memcpy(delims->end, second.data, second.len);
+    delims->end[second.len] = '\0';
+    delims->end_len = second.len;
+    delims->end_text = second.data;
 
     return true;
 }
 
 static bool IsKeyExtensionVar(TagType tag_type, const char *tag_start,
-                              char *delim_start, size_t delim_start_len,
-                              char *delim_end, size_t delim_end_len)
+                              const MustacheDelimiters *delims)
 {
     /* This whole function is ugly, but tries to avoid memory allocation and copying. */
 
     /* the easiest case first: {{@}} */
     if (tag_type == TAG_TYPE_VAR)
     {
-        if (StringStartsWith(tag_start, delim_start) &&
-            *(tag_start + delim_start_len) == '@' &&
-            StringStartsWith(tag_start + delim_start_len + 1, delim_end))
+        if (StringStartsWith(tag_start, delims->start) &&
+            *(tag_start + delims->start_len) == '@' &&
+            StringStartsWith(tag_start + delims->start_len + 1, delims->end))
         {
             return true;
         }
@@ -573,18 +707,17 @@ static bool IsKeyExtensionVar(TagType tag_type, const char *tag_start,
     if (tag_type == TAG_TYPE_VAR_UNESCAPED)
     {
         /* the case with unescaped form using &: {{&@}} */
-        if  (StringStartsWith(tag_start, delim_start) &&
-             StringStartsWith(tag_start + delim_start_len, "&@") &&
-             StringStartsWith(tag_start + delim_start_len + 2, delim_end))
+        if  (StringStartsWith(tag_start, delims->start) &&
+             StringStartsWith(tag_start + delims->start_len, "&@") &&
+             StringStartsWith(tag_start + delims->start_len + 2, delims->end))
         {
             return true;
         }
 
         /* the special case of unescaped form using {{{@}}} iff "{{" and "}}" are
          * used as delimiters */
-        if ((delim_start_len == 2) && (delim_end_len == 2) &&
-            StringEqual(delim_start, "{{") &&
-            StringEqual(delim_end, "}}") &&
+        if (StringEqual(delims->start, "{{") &&
+            StringEqual(delims->end, "}}") &&
             StringStartsWith(tag_start, "{{{@}}}"))
         {
             return true;
@@ -595,295 +728,181 @@ static bool IsKeyExtensionVar(TagType tag_type, const char *tag_start,
     return false;
 }
 
-/**
- * Checks if a Json object in the current context (specified by #input) should
- * be iterated over or not.
- *
- * We need to iterate over a Json object if the current section directly
- * contains (not in a subsection) our {{@}} mustache extension.
- */
-static bool ShouldIterateObject(const char *input,
-                                char *delim_start, size_t delim_start_len,
-                                char *delim_end, size_t delim_end_len)
+/*********************************************************************/
+/* Compilation                                                       */
+/*********************************************************************/
+
+typedef struct
 {
-    assert (input != NULL);
+    MustacheTemplate *tmpl;
+    size_t ops_capacity;
 
-    size_t loc_delim_start_len = delim_start_len;
-    char loc_delim_start[MUSTACHE_MAX_DELIM_SIZE] = {0};
-    strncpy(loc_delim_start, delim_start, delim_start_len);
+    /* indices of the sections not closed yet, innermost last */
+    size_t *open_sections;
+    size_t num_open_sections;
+    size_t open_sections_capacity;
+} MustacheCompiler;
 
-    size_t loc_delim_end_len = delim_end_len;
-    char loc_delim_end[MUSTACHE_MAX_DELIM_SIZE] = {0};
-    strncpy(loc_delim_end, delim_end, delim_end_len);
+static MustacheOp *CompilerAppendOp(MustacheCompiler *compiler, MustacheOpType type)
+{
+    MustacheTemplate *tmpl = compiler->tmpl;
+    if (tmpl->num_ops == compiler->ops_capacity)
+    {
+        compiler->ops_capacity = MAX(16, compiler->ops_capacity * 2);
+        tmpl->ops = xrealloc(tmpl->ops, compiler->ops_capacity * sizeof(MustacheOp));
+    }
 
-    /* This loop should only terminate when the answer is clear and thus the
-     * whole function returns. It's iterating over the template which has to end
-     * somewhere (if it's not NUL-terminated, we have a much bigger issue than
-     * this loop). */
-    while (true)
+    MustacheOp *op = &tmpl->ops[tmpl->num_ops++];
+    memset(op, 0, sizeof(MustacheOp));
+    op->type = type;
+    return op;
+}
+
+static void CompilerAppendText(MustacheCompiler *compiler, const char *text, size_t len)
+{
+    if (len > 0)
     {
-        Mustache tag = NextTag(input,
-                               loc_delim_start, loc_delim_start_len,
-                               loc_delim_end, loc_delim_end_len);
-        switch (tag.type)
-        {
-        case TAG_TYPE_ERR:
-        case TAG_TYPE_NONE:
-        case TAG_TYPE_SECTION:
-        case TAG_TYPE_SECTION_END:
-            /* these clearly mean there cannot be {{@}} directly in the current section */
-            return false;
-        case TAG_TYPE_VAR:
-        case TAG_TYPE_VAR_UNESCAPED:
-            /* check if the variable is {{@}} respecting possibly changed delimiters */
-            if (IsKeyExtensionVar(tag.type, tag.begin,
-                                  loc_delim_start, loc_delim_start_len,
-                                  loc_delim_end, loc_delim_end_len))
-            {
-                return true;
-            }
-            else
-            {
-                /* just continue to the next tag */
-                break;
-            }
-        case TAG_TYPE_DELIM:
-            if (!SetDelimiters(tag.content, tag.content_len,
-                               loc_delim_start, &loc_delim_start_len,
-                               loc_delim_end, &loc_delim_end_len))
-            {
-                return false;
-            }
-            break;
+        MustacheOp *op = CompilerAppendOp(compiler, MUSTACHE_OP_TEXT);
+        op->text = text;
+        op->text_len = len;
+    }
+}
 
-        default:
-            /* just continue to the next tag */
-            break;
-        }
-        /* move on in the template */
-        input = tag.end;
+static void CompilerOpenSection(MustacheCompiler *compiler, size_t index)
+{
+    if (compiler->num_open_sections == compiler->open_sections_capacity)
+    {
+        compiler->open_sections_capacity = MAX(8, compiler->open_sections_capacity * 2);
+        compiler->open_sections = xrealloc(compiler->open_sections,
+                                           compiler->open_sections_capacity * sizeof(size_t));
     }
-    return false;
+    compiler->open_sections[compiler->num_open_sections++] = index;
 }
 
-static bool Render(Buffer *out, const char *start, const char *input, Seq *hash_stack,
-                   const char *json_key,
-                   char *delim_start, size_t *delim_start_len,
-                   char *delim_end, size_t *delim_end_len,
-                   bool skip_content,
-                   const char *section,
-                   const char **section_end)
+static bool CompileTemplate(MustacheCompiler *compiler)
 {
+    MustacheTemplate *tmpl = compiler->tmpl;
+    const char *start = tmpl->source;
+    const char *input = start;
+
+    MustacheDelimiters delims = {
+        .start = "{{", .start_len = 2, .start_text = "{{",
+        .end = "}}", .end_len = 2, .end_text = "}}",
+    };
+
+    /* A section just opened, which has to be iterated if it is an object and
+     * the first variable in it (before any other section tag) is {{@}}. */
+    bool pending_iteration_check = false;
+
     while (true)
     {
-        if (!input)
+        Mustache tag = NextTag(input, delims.start, delims.start_len, delims.end, delims.end_len);
+
+        if (tag.type == TAG_TYPE_NONE)
+        {
+            CompilerAppendText(compiler, input, strlen(input));
+            if (compiler->num_open_sections > 0)
+            {
+                Log(LOG_LEVEL_ERR, "Unexpected end to Mustache template");
+                return false;
+            }
+            return true;
+        }
+        else if (tag.type == TAG_TYPE_ERR)
         {
-            Log(LOG_LEVEL_ERR, "Unexpected end to Mustache template");
             return false;
         }
 
-        Mustache tag = NextTag(input, delim_start, *delim_start_len, delim_end, *delim_end_len);
-
         {
             const char *line_begin = NULL;
             const char *line_end = NULL;
             if (!IsTagTypeRenderable(tag.type)
-                && tag.end != NULL
                 && IsTagStandalone(start, tag.begin, tag.end, &line_begin, &line_end))
             {
-                RenderContent(out, input, line_begin - input, false, skip_content);
+                CompilerAppendText(compiler, input, (line_begin > input) ? (size_t) (line_begin - input) : 0);
                 input = line_end;
             }
             else
             {
-                RenderContent(out, input, tag.begin - input, false, skip_content);
+                CompilerAppendText(compiler, input, tag.begin - input);
                 input = tag.end;
             }
         }
 
         switch (tag.type)
         {
-        case TAG_TYPE_ERR:
-            return false;
-
         case TAG_TYPE_DELIM:
-            if (!SetDelimiters(tag.content, tag.content_len,
-                               delim_start, delim_start_len,
-                               delim_end, delim_end_len))
+            if (!SetDelimiters(tag.content, tag.content_len, &delims))
             {
                 return false;
             }
-            continue;
+            break;
 
         case TAG_TYPE_COMMENT:
-            continue;
-
-        case TAG_TYPE_NONE:
-            return true;
+            break;
 
         case TAG_TYPE_VAR_SERIALIZED:
         case TAG_TYPE_VAR_SERIALIZED_COMPACT:
         case TAG_TYPE_VAR_UNESCAPED:
         case TAG_TYPE_VAR:
-            if (!skip_content)
+            if (pending_iteration_check &&
+                IsKeyExtensionVar(tag.type, tag.begin, &delims))
             {
-                if (tag.content_len > 0)
-                {
-                    if (!RenderVariable(out, tag.content, tag.content_len, tag.type, hash_stack, json_key))
-                    {
-                        return false;
-                    }
-                }
-                else
+                MustacheOp *section = &tmpl->ops[compiler->open_sections[compiler->num_open_sections - 1]];
+                section->iterate_object = true;
+                pending_iteration_check = false;
+            }
+
+            if (tag.content_len > 0)
+            {
+                MustacheOp *op = CompilerAppendOp(compiler, MUSTACHE_OP_VAR);
+                op->tag_type = tag.type;
+                op->text = tag.content;
+                op->text_len = tag.content_len;
+                op->item_mode = (tag.content_len == 1 && tag.content[0] == '.');
+                op->key_mode = (tag.content_len == 1 && tag.content[0] == '@');
+                if (!op->item_mode && !op->key_mode)
                 {
-                    RenderContent(out, delim_start, *delim_start_len, false, false);
-                    RenderContent(out, delim_end, *delim_end_len, false, false);
+                    MustachePathInit(&op->path, tag.content, tag.content_len);
                 }
             }
-            continue;
+            else
+            {
+                /* an empty tag renders the delimiters */
+                CompilerAppendText(compiler, delims.start_text, delims.start_len);
+                CompilerAppendText(compiler, delims.end_text, delims.end_len);
+            }
+            break;
 
         case TAG_TYPE_INVERTED:
         case TAG_TYPE_SECTION:
             {
-                char *cur_section = xstrndup(tag.content, tag.content_len);
-                JsonElement *var = LookupVariable(hash_stack, tag.content, tag.content_len);
-                SeqAppend(hash_stack, var);
-
-                if (!var)
-                {
-                    /* XXX: no variable with the name of the section, why are we renderning anything? */
-                    const char *cur_section_end = NULL;
-                    if (!Render(out, start, input, hash_stack, NULL, delim_start, delim_start_len, delim_end, delim_end_len,
-                                skip_content || tag.type != TAG_TYPE_INVERTED, cur_section, &cur_section_end))
-                    {
-                        free(cur_section);
-                        return false;
-                    }
-                    free(cur_section);
-                    input = cur_section_end;
-                    continue;
-                }
-
-                switch (JsonGetElementType(var))
-                {
-                case JSON_ELEMENT_TYPE_PRIMITIVE:
-                    if (JsonGetPrimitiveType(var) == JSON_PRIMITIVE_TYPE_BOOL)
-                    {
-                        bool skip = skip_content || (!JsonPrimitiveGetAsBool(var) ^ (tag.type == TAG_TYPE_INVERTED));
-
-                        const char *cur_section_end = NULL;
-                        if (!Render(out, start, input, hash_stack, NULL, delim_start, delim_start_len, delim_end, delim_end_len,
-                                    skip, cur_section, &cur_section_end))
-                        {
-                            free(cur_section);
-                            return false;
-                        }
-                        free(cur_section);
-                        input = cur_section_end;
-                        continue;
-                    }
-                    else
-                    {
-                        Log(LOG_LEVEL_WARNING, "Mustache sections can only take a boolean or a container (array or map) value, but section '%s' isn't getting one of those.",
-                            cur_section);
-                        free(cur_section);
-                        return false;
-                    }
-                    break;
-
-                case JSON_ELEMENT_TYPE_CONTAINER:
-                    switch (JsonGetContainerType(var))
-                    {
-                    case JSON_CONTAINER_TYPE_OBJECT:
-                        {
-                            if (!ShouldIterateObject(input, delim_start, *delim_start_len, delim_end, *delim_end_len))
-                            {
-                                const char *cur_section_end = NULL;
-
-                                if (!Render(out, start, input,
-                                            hash_stack,
-                                            NULL,
-                                            delim_start, delim_start_len, delim_end, delim_end_len,
-                                            skip_content || tag.type == TAG_TYPE_INVERTED, cur_section, &cur_section_end))
-                                {
-                                    free(cur_section);
-                                    return false;
-                                }
-                                input = cur_section_end;
-                                free(cur_section);
-                                break;
-                            }
-                        }
-                        /* fall through */
-                        /* Because iterated objects and arrays are processed in the
-                         * same way */
-                    case JSON_CONTAINER_TYPE_ARRAY:
-                        if (JsonLength(var) > 0)
-                        {
-                            const char *cur_section_end = NULL;
-                            for (size_t i = 0; i < JsonLength(var); i++)
-                            {
-                                JsonElement *child_hash = JsonAt(var, i);
-                                SeqAppend(hash_stack, child_hash);
-
-                                Buffer *kstring = BufferNew();
-                                if (JSON_CONTAINER_TYPE_OBJECT == JsonGetContainerType(var))
-                                {
-                                    BufferAppendString(kstring, JsonElementGetPropertyName(child_hash));
-                                }
-                                else
-                                {
-                                    BufferAppendF(kstring, "%zu", i);
-                                }
-
-                                if (!Render(out, start, input,
-                                            hash_stack,
-                                            BufferData(kstring),
-                                            delim_start, delim_start_len, delim_end, delim_end_len,
-                                            skip_content || tag.type == TAG_TYPE_INVERTED, cur_section, &cur_section_end))
-                                {
-                                    free(cur_section);
-                                    BufferDestroy(kstring);
-                                    return false;
-                                }
-
-                                BufferDestroy(kstring);
-                            }
-                            input = cur_section_end;
-                            free(cur_section);
-                        }
-                        else
-                        {
-                            /* XXX: empty array -- why are we rendering anything? */
-                            const char *cur_section_end = NULL;
-                            if (!Render(out, start, input, hash_stack, NULL, delim_start, delim_start_len, delim_end, delim_end_len,
-                                        tag.type != TAG_TYPE_INVERTED, cur_section, &cur_section_end))
-                            {
-                                free(cur_section);
-                                return false;
-                            }
-                            free(cur_section);
-                            input = cur_section_end;
-                        }
-                        break;
-                    }
-                    break;
-                }
+                MustacheOp *op = CompilerAppendOp(compiler, MUSTACHE_OP_SECTION);
+                op->tag_type = tag.type;
+                op->text = tag.content;
+                op->text_len = tag.content_len;
+                MustachePathInit(&op->path, tag.content, tag.content_len);
+
+                CompilerOpenSection(compiler, tmpl->num_ops - 1);
+                pending_iteration_check = true;
             }
-            continue;
+            break;
+
         case TAG_TYPE_SECTION_END:
-            if (!section)
+            if (compiler->num_open_sections == 0)
             {
-                char *varname = xstrndup(tag.content, tag.content_len);
-                Log(LOG_LEVEL_WARNING, "Unknown section close in mustache template '%s'", varname);
-                free(varname);
+                Log(LOG_LEVEL_WARNING, "Unknown section close in mustache template '%.*s'",
+                    (int) tag.content_len, tag.content);
                 return false;
             }
             else
             {
-                SeqRemove(hash_stack, SeqLength(hash_stack) - 1);
-                *section_end = input;
-                return true;
+                const size_t section = compiler->open_sections[--compiler->num_open_sections];
+                MustacheOp *op = CompilerAppendOp(compiler, MUSTACHE_OP_SECTION_END);
+                op->text = tag.content;
+                op->text_len = tag.content_len;
+                tmpl->ops[section].end = tmpl->num_ops - 1;
+                pending_iteration_check = false;
             }
             break;
 
@@ -892,29 +911,319 @@ static bool Render(Buffer *out, const char *start, const char *input, Seq *hash_
             return false;
         }
     }
+}
+
+MustacheTemplate *MustacheCompile(const char *input)
+{
+    assert(input != NULL);
+
+    MustacheCompiler compiler = { 0 };
+    compiler.tmpl = xcalloc(1, sizeof(MustacheTemplate));
+    compiler.tmpl->source = xstrdup(input);
+
+    const bool success = CompileTemplate(&compiler);
+    free(compiler.open_sections);
+
+    if (!success)
+    {
+        MustacheTemplateDestroy(compiler.tmpl);
+        return NULL;
+    }
+    return compiler.tmpl;
+}
+
+void MustacheTemplateDestroy(MustacheTemplate *tmpl)
+{
+    if (tmpl != NULL)
+    {
+        for (size_t i = 0; i < tmpl->num_ops; i++)
+        {
+            if (tmpl->ops[i].path.components != NULL)
+            {
+                MustachePathDestroy(&tmpl->ops[i].path);
+            }
+        }
+        free(tmpl->ops);
+        free(tmpl->source);
+        free(tmpl);
+    }
+}
+
+/*********************************************************************/
+/* Rendering                                                         */
+/*********************************************************************/
+
+static bool RenderOps(MustacheOutput *out, const MustacheTemplate *tmpl,
+                      size_t begin, size_t end,
+                      Seq *hash_stack, const char *json_key);
+
+static bool RenderSectionBody(MustacheOutput *out, const MustacheTemplate *tmpl, size_t section,
+                              Seq *hash_stack, JsonElement *context, const char *json_key)
+{
+    SeqAppend(hash_stack, context);
+    const bool success = RenderOps(out, tmpl, section + 1, tmpl->ops[section].end,
+                                   hash_stack, json_key);
+    SeqRemove(hash_stack, SeqLength(hash_stack) - 1);
+    return success;
+}
+
+static bool RenderSection(MustacheOutput *out, const MustacheTemplate *tmpl, size_t section,
+                          Seq *hash_stack)
+{
+    const MustacheOp *op = &tmpl->ops[section];
+    const bool inverted = (op->tag_type == TAG_TYPE_INVERTED);
+
+    JsonElement *var = LookupVariable(hash_stack, &op->path);
+    if (!var)
+    {
+        return !inverted || RenderSectionBody(out, tmpl, section, hash_stack, NULL, NULL);
+    }
+
+    switch (JsonGetElementType(var))
+    {
+    case JSON_ELEMENT_TYPE_PRIMITIVE:
+        if (JsonGetPrimitiveType(var) == JSON_PRIMITIVE_TYPE_BOOL)
+        {
+            if (JsonPrimitiveGetAsBool(var) == inverted)
+            {
+                return true;
+            }
+            return RenderSectionBody(out, tmpl, section, hash_stack, var, NULL);
+        }
+
+        Log(LOG_LEVEL_WARNING, "Mustache sections can only take a boolean or a container (array or map) value, but section '%.*s' isn't getting one of those.",
+            (int) op->text_len, op->text);
+        return false;
+
+    case JSON_ELEMENT_TYPE_CONTAINER:
+        if (JsonGetContainerType(var) == JSON_CONTAINER_TYPE_OBJECT && !op->iterate_object)
+        {
+            return inverted || RenderSectionBody(out, tmpl, section, hash_stack, var, NULL);
+        }
+
+        /* iterated objects and arrays are processed in the same way */
+        if (JsonLength(var) == 0)
+        {
+            return !inverted || RenderSectionBody(out, tmpl, section, hash_stack, var, NULL);
+        }
+        else if (inverted)
+        {
+            return true;
+        }
+
+        SeqAppend(hash_stack, var);
+
+        bool success = true;
+        for (size_t i = 0; success && i < JsonLength(var); i++)
+        {
+            JsonElement *child_hash = JsonAt(var, i);
+
+            char index[PRINTSIZE(i)];
+            const char *key = NULL;
+            if (JsonGetContainerType(var) == JSON_CONTAINER_TYPE_OBJECT)
+            {
+                key = JsonElementGetPropertyName(child_hash);
+            }
+            else
+            {
+                xsnprintf(index, sizeof(index), "%zu", i);
+                key = index;
+            }
+
+            success = RenderSectionBody(out, tmpl, section, hash_stack, child_hash, key);
+        }
+
+        SeqRemove(hash_stack, SeqLength(hash_stack) - 1);
+        return success;
+    }
 
     assert(false);
+    return false;
 }
 
-bool MustacheRender(Buffer *out, const char *input, const JsonElement *hash)
+static bool RenderOps(MustacheOutput *out, const MustacheTemplate *tmpl,
+                      size_t begin, size_t end,
+                      Seq *hash_stack, const char *json_key)
 {
-    char delim_start[MUSTACHE_MAX_DELIM_SIZE] = "{{";
-    size_t delim_start_len = strlen(delim_start);
+    for (size_t i = begin; i < end; i++)
+    {
+        const MustacheOp *op = &tmpl->ops[i];
+        switch (op->type)
+        {
+        case MUSTACHE_OP_TEXT:
+            OutputAppend(out, op->text, op->text_len);
+            break;
+
+        case MUSTACHE_OP_VAR:
+            if (!RenderVariable(out, op, hash_stack, json_key))
+            {
+                return false;
+            }
+            break;
 
-    char delim_end[MUSTACHE_MAX_DELIM_SIZE] = "}}";
-    size_t delim_end_len = strlen(delim_end);
+        case MUSTACHE_OP_SECTION:
+            if (!RenderSection(out, tmpl, i, hash_stack))
+            {
+                return false;
+            }
+            i = op->end;
+            break;
+
+        case MUSTACHE_OP_SECTION_END:
+            /* section ends are skipped over by RenderSection() */
+            assert(false);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool RenderTemplate(MustacheOutput *out, const MustacheTemplate *tmpl, const JsonElement *hash)
+{
+    assert(tmpl != NULL);
 
     Seq *hash_stack = SeqNew(10, NULL);
     SeqAppend(hash_stack, (JsonElement*)hash);
 
-    bool success = Render(out, input, input,
-                          hash_stack,
-                          NULL,
-                          delim_start, &delim_start_len,
-                          delim_end, &delim_end_len,
-                          false, NULL, NULL);
+    bool success = RenderOps(out, tmpl, 0, tmpl->num_ops, hash_stack, NULL);
 
     SeqDestroy(hash_stack);
 
+    OutputFlush(out);
+    if (out->write_failed)
+    {
+        Log(LOG_LEVEL_ERR, "Failed to write rendered Mustache template");
+        return false;
+    }
+
+    return success;
+}
+
+bool MustacheRenderTemplate(Buffer *out, const MustacheTemplate *tmpl, const JsonElement *hash)
+{
+    assert(out != NULL);
+
+    MustacheOutput output = { .buffer = out };
+    return RenderTemplate(&output, tmpl, hash);
+}
+
+bool MustacheRenderTemplateToWriter(Writer *out, const MustacheTemplate *tmpl, const JsonElement *hash)
+{
+    assert(out != NULL);
+
+    MustacheOutput output = {
+        .writer = out,
+        .data = xmalloc(MUSTACHE_OUTPUT_BUFSIZE),
+    };
+
+    bool success = RenderTemplate(&output, tmpl, hash);
+
+    free(output.data);
+    return success;
+}
+
+/*********************************************************************/
+/* Compiled template cache                                           */
+/*********************************************************************/
+
+/* Cached templates are their own keys, compared by their source text. */
+
+static pthread_once_t mustache_cache_once = PTHREAD_ONCE_INIT; /* GLOBAL_T */
+static LRUCache *mustache_cache = NULL;                        /* GLOBAL_T, initialized by pthread_once */
+
+static unsigned int MustacheCacheItemHash(const void *item, unsigned int seed)
+{
+    const MustacheTemplate *tmpl = item;
+    return StringHash(tmpl->source, seed);
+}
+
+static bool MustacheCacheItemEqual(const void *item1, const void *item2)
+{
+    const MustacheTemplate *tmpl1 = item1;
+    const MustacheTemplate *tmpl2 = item2;
+    return StringEqual(tmpl1->source, tmpl2->source);
+}
+
+static void MustacheCacheItemDestroy(void *item)
+{
+    MustacheTemplateDestroy(item);
+}
+
+static void MustacheCacheInitializeOnce(void)
+{
+    mustache_cache = LRUCacheNew(MUSTACHE_CACHE_CAPACITY, MustacheCacheItemHash,
+                                 MustacheCacheItemEqual, MustacheCacheItemDestroy);
+}
+
+static LRUCache *GetMustacheCache(void)
+{
+    pthread_once(&mustache_cache_once, MustacheCacheInitializeOnce);
+    return mustache_cache;
+}
+
+/**
+ * @brief Get a compiled template from the cache, compiling it on a miss.
+ * @return An entry which must be given back with LRUCacheRelease(), or
+ *         NULL if the template does not compile.
+ */
+static LRUCacheEntry *MustacheCacheAcquire(const char *input)
+{
+    assert(input != NULL);
+
+    LRUCache *cache = GetMustacheCache();
+    const MustacheTemplate key = { .source = (char *) input };
+
+    LRUCacheEntry *entry = LRUCacheAcquire(cache, &key);
+    if (entry != NULL)
+    {
+        return entry;
+    }
+
+    /* Compile outside of the lock, other threads may use the cache meanwhile. */
+    MustacheTemplate *tmpl = MustacheCompile(input);
+    if (tmpl == NULL)
+    {
+        return NULL;
+    }
+
+    return LRUCacheInsert(cache, tmpl);
+}
+
+void MustacheCacheGetStats(MustacheCacheStats *stats)
+{
+    LRUCacheGetStats(GetMustacheCache(), stats);
+}
+
+void MustacheCacheClear(void)
+{
+    LRUCacheClear(GetMustacheCache());
+}
+
+bool MustacheRender(Buffer *out, const char *input, const JsonElement *hash)
+{
+    LRUCacheEntry *entry = MustacheCacheAcquire(input);
+    if (entry == NULL)
+    {
+        return false;
+    }
+
+    bool success = MustacheRenderTemplate(out, LRUCacheEntryGet(entry), hash);
+
+    LRUCacheRelease(GetMustacheCache(), entry);
+    return success;
+}
+
+bool MustacheRenderToWriter(Writer *out, const char *input, const JsonElement *hash)
+{
+    LRUCacheEntry *entry = MustacheCacheAcquire(input);
+    if (entry == NULL)
+    {
+        return false;
+    }
+
+    bool success = MustacheRenderTemplateToWriter(out, LRUCacheEntryGet(entry), hash);
+
+    LRUCacheRelease(GetMustacheCache(), entry);
     return success;
 }
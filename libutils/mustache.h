@@ -26,7 +26,46 @@
 
 #include <json.h>
 #include <buffer.h>
+#include <writer.h>
+#include <lru_cache.h>
 
 bool MustacheRender(Buffer *out, const char *input, const JsonElement *hash);
 
+/**
+ * @brief Render into a Writer as the output is produced, e.g. a FileWriter to
+ *        stream a large result to disk without holding all of it in memory.
+ * @return false if the template is broken, rendering fails or writing fails
+ *         (some output may have been written already)
+ */
+bool MustacheRenderToWriter(Writer *out, const char *input, const JsonElement *hash);
+
+/*
+ * A template compiled once and rendered any number of times (also from
+ * several threads at once): tags are parsed, delimiter changes and standalone
+ * lines resolved and variable names split up front.
+ */
+typedef struct MustacheTemplate_ MustacheTemplate;
+
+/**
+ * @brief Compile a template for MustacheRenderTemplate().
+ * @return NULL if the template is broken (the problem is logged)
+ */
+MustacheTemplate *MustacheCompile(const char *input);
+void MustacheTemplateDestroy(MustacheTemplate *tmpl);
+
+/* Same as MustacheRender() and MustacheRenderToWriter() with a precompiled template. */
+bool MustacheRenderTemplate(Buffer *out, const MustacheTemplate *tmpl, const JsonElement *hash);
+bool MustacheRenderTemplateToWriter(Writer *out, const MustacheTemplate *tmpl, const JsonElement *hash);
+
+/*
+ * MustacheRender() keeps recently rendered templates compiled in a small,
+ * thread-safe LRU cache keyed by the template text.
+ */
+typedef LRUCacheStats MustacheCacheStats;
+
+void MustacheCacheGetStats(MustacheCacheStats *stats);
+
+/* Drop all cached templates and reset the counters. */
+void MustacheCacheClear(void);
+
 #endif
@@ -257,15 +257,7 @@ pcre_wrap_job *pcre_wrap_free_job(pcre_wrap_job *job)
 
     // grab the next node and destroy the current head
     pcre_wrap_job *next = job->next;
-    if (job->pattern != NULL)
-    {
-        free(job->pattern);
-    }
-
-    if (job->hints != NULL)
-    {
-        free(job->hints);
-    }
+    RegexDestroy(job->regex);
 
     if (job->substitute != NULL)
     {
@@ -308,27 +300,16 @@ pcre_wrap_job *pcre_wrap_compile(const char *pattern, const char *substitute, co
     newjob->options = pcre_wrap_parse_perl_options(options, &flags);
     newjob->flags = flags;
 
-    newjob->pattern = pcre_compile(pattern, newjob->options, &error, errptr, NULL);
-    if (newjob->pattern == NULL)
-    {
-        pcre_wrap_free_job(newjob);
-        return NULL;
-    }
-
-    newjob->hints = pcre_study(newjob->pattern, 0, &error);
-    if (error != NULL)
+    pcre *rx = pcre_compile(pattern, newjob->options, &error, errptr, NULL);
+    if (rx == NULL)
     {
-        *errptr = PCRE_WRAP_ERR_STUDY;
         pcre_wrap_free_job(newjob);
         return NULL;
     }
 
-    *errptr = pcre_fullinfo(newjob->pattern, newjob->hints, PCRE_INFO_CAPTURECOUNT, &capturecount);
-    if (*errptr < 0)
-    {
-        pcre_wrap_free_job(newjob);
-        return NULL;
-    }
+    // studies (and JIT-compiles, if available) the pattern
+    newjob->regex = RegexNew(rx);
+    capturecount = RegexGetCaptureCount(newjob->regex);
 
     newjob->substitute = pcre_wrap_compile_replacement(substitute, newjob->flags & PCRE_WRAP_TRIVIAL, capturecount, errptr);
     if (newjob->substitute == NULL)
@@ -350,7 +331,7 @@ int pcre_wrap_execute(pcre_wrap_job *job, char *subject, size_t subject_length,
     char *result_offset;
     int submatches = 0;
 
-    if (job == NULL || job->pattern == NULL || job->substitute == NULL)
+    if (job == NULL || job->regex == NULL || job->substitute == NULL)
     {
         *result = NULL;
         return(PCRE_WRAP_ERR_BADJOB);
@@ -369,7 +350,7 @@ int pcre_wrap_execute(pcre_wrap_job *job, char *subject, size_t subject_length,
     int current_match = 0;
     while (TRUE)
     {
-        submatches = pcre_exec(job->pattern, job->hints, subject, (int)subject_length, offset, 0, offsets, 3 * PCRE_WRAP_MAX_SUBMATCHES);
+        submatches = RegexExecute(job->regex, subject, subject_length, offset, 0, offsets, 3 * PCRE_WRAP_MAX_SUBMATCHES);
 
         if (submatches <= 0)
         {
@@ -22,29 +22,73 @@
   included file COSL.txt.
 */
 
-
 #include <platform.h>
 #include <regex.h>
 
 #include <alloc.h>
+#include <cleanup.h>
 #include <logging.h>
 #include <string_lib.h>
 
 #include <buffer.h>
+#include <lru_cache.h>
 
 #define STRING_MATCH_OVECCOUNT 30
+#define STRING_MATCH_OPTIONS (PCRE_MULTILINE | PCRE_DOTALL)
 
-pcre *CompileRegex(const char *regex)
+/* Maximum number of compiled patterns kept by the regex cache. */
+#define REGEX_CACHE_CAPACITY 256
+
+/* Sizes of the per-thread stack used by JIT-compiled patterns. */
+#define REGEX_JIT_STACK_START (32 * 1024)
+#define REGEX_JIT_STACK_MAX   (1024 * 1024)
+
+struct Regex_
+{
+    pcre *rx;
+    pcre_extra *extra;          /* study data, NULL if pcre_study() found nothing useful */
+    int captures;
+};
+
+/*
+ * Scratch space reused by every match done on the current thread, so that
+ * matching does not allocate an ovector (and a JIT stack) each time.
+ */
+typedef struct
+{
+    int *ovector;
+    int ovector_size;
+#ifdef PCRE_STUDY_JIT_COMPILE
+    pcre_jit_stack *jit_stack;
+#endif
+} RegexThreadState;
+
+static pthread_once_t regex_thread_state_once = PTHREAD_ONCE_INIT; /* GLOBAL_T */
+static pthread_key_t regex_thread_state_key; /* GLOBAL_T, initialized by pthread_key_create */
+
+/* Process-wide cache of compiled patterns used by StringMatch() and friends. */
+typedef struct
+{
+    char *pattern;
+    int options;
+    Regex *regex;               /* NULL if the pattern does not compile */
+    char *error;                /* what to log then, NULL otherwise */
+} RegexCacheItem;
+
+static pthread_once_t regex_cache_once = PTHREAD_ONCE_INIT; /* GLOBAL_T */
+static LRUCache *regex_cache = NULL;                        /* GLOBAL_T, initialized by pthread_once */
+
+/* @param error set to the message to log if the pattern does not compile */
+static pcre *CompileRegexWithError(const char *regex, int options, char **error)
 {
     const char *errorstr;
     int erroffset;
 
-    pcre *rx = pcre_compile(regex, PCRE_MULTILINE | PCRE_DOTALL,
-                            &errorstr, &erroffset, NULL);
+    pcre *rx = pcre_compile(regex, options, &errorstr, &erroffset, NULL);
 
-    if (!rx)
+    if (rx == NULL)
     {
-        Log(LOG_LEVEL_ERR,
+        *error = StringFormat(
             "Regular expression error: pcre_compile() '%s' in expression '%s' (offset: %d)",
             errorstr, regex, erroffset);
     }
@@ -52,79 +96,244 @@ pcre *CompileRegex(const char *regex)
     return rx;
 }
 
-bool StringMatchWithPrecompiledRegex(pcre *regex, const char *str, size_t *start, size_t *end)
+static pcre *CompileRegexWithOptions(const char *regex, int options, bool log_errors)
 {
-    assert(regex);
-    assert(str);
+    char *error = NULL;
+    pcre *rx = CompileRegexWithError(regex, options, &error);
 
-    int ovector[STRING_MATCH_OVECCOUNT] = { 0 };
-    int result = pcre_exec(regex, NULL, str, strlen(str),
-                           0, 0, ovector, STRING_MATCH_OVECCOUNT);
+    if (rx == NULL && log_errors)
+    {
+        Log(LOG_LEVEL_ERR, "%s", error);
+    }
+    free(error);
+
+    return rx;
+}
+
+pcre *CompileRegex(const char *regex)
+{
+    return CompileRegexWithOptions(regex, STRING_MATCH_OPTIONS, true);
+}
+
+/*********************************************************************/
+/* Per-thread match state                                            */
+/*********************************************************************/
 
-    if (result)
+static void RegexThreadStateDestroy(void *data)
+{
+    RegexThreadState *state = data;
+    if (state != NULL)
     {
-        if (start)
+#ifdef PCRE_STUDY_JIT_COMPILE
+        if (state->jit_stack != NULL)
         {
-            *start = ovector[0];
-        }
-        if (end)
-        {
-            *end = ovector[1];
+            pcre_jit_stack_free(state->jit_stack);
         }
+#endif
+        free(state->ovector);
+        free(state);
     }
-    else
+}
+
+static void RegexThreadStateInitializeOnce(void)
+{
+    if (pthread_key_create(&regex_thread_state_key, &RegexThreadStateDestroy) != 0)
     {
-        if (start)
-        {
-            *start = 0;
-        }
-        if (end)
-        {
-            *end = 0;
-        }
+        /* Same as in logging.c, there is no way to signal error out of
+         * pthread_once callback. */
+        fprintf(stderr, "Unable to initialize regex subsystem\n");
+        DoCleanupAndExit(255);
     }
+}
 
-    return result >= 0;
+static RegexThreadState *GetRegexThreadState(void)
+{
+    pthread_once(&regex_thread_state_once, &RegexThreadStateInitializeOnce);
+    RegexThreadState *state = pthread_getspecific(regex_thread_state_key);
+    if (state == NULL)
+    {
+        state = xcalloc(1, sizeof(RegexThreadState));
+        pthread_setspecific(regex_thread_state_key, state);
+    }
+    return state;
 }
 
-bool StringMatch(const char *regex, const char *str, size_t *start, size_t *end)
+/**
+ * @return The calling thread's ovector, grown to hold at least #size ints.
+ */
+static int *GetThreadOvector(int size)
 {
-    pcre *pattern = CompileRegex(regex);
+    RegexThreadState *state = GetRegexThreadState();
+    if (state->ovector_size < size)
+    {
+        state->ovector = xrealloc(state->ovector, sizeof(int) * size);
+        state->ovector_size = size;
+    }
+    return state->ovector;
+}
 
-    if (pattern == NULL)
+#ifdef PCRE_STUDY_JIT_COMPILE
+/* Called by PCRE on every JIT match to get the calling thread's stack. */
+static pcre_jit_stack *RegexJitStackCallback(ARG_UNUSED void *data)
+{
+    RegexThreadState *state = GetRegexThreadState();
+    if (state->jit_stack == NULL)
     {
-        return false;
+        /* On failure PCRE falls back to its small on-machine-stack default. */
+        state->jit_stack = pcre_jit_stack_alloc(REGEX_JIT_STACK_START,
+                                                REGEX_JIT_STACK_MAX);
     }
+    return state->jit_stack;
+}
+#endif
 
-    bool ret = StringMatchWithPrecompiledRegex(pattern, str, start, end);
+/*********************************************************************/
+/* Compiled regex handles                                            */
+/*********************************************************************/
 
-    pcre_free(pattern);
-    return ret;
+Regex *RegexNew(pcre *rx)
+{
+    assert(rx != NULL);
+
+    Regex *regex = xcalloc(1, sizeof(Regex));
+    regex->rx = rx;
+
+    int study_options = 0;
+#ifdef PCRE_STUDY_JIT_COMPILE
+    int jit_available = 0;
+    if (pcre_config(PCRE_CONFIG_JIT, &jit_available) == 0 && jit_available)
+    {
+        study_options |= PCRE_STUDY_JIT_COMPILE;
+    }
+#endif
+
+    const char *errorstr = NULL;
+    regex->extra = pcre_study(rx, study_options, &errorstr);
+    if (errorstr != NULL)
+    {
+        /* Not fatal, the pattern just gets matched without study data. */
+        Log(LOG_LEVEL_DEBUG, "pcre_study() failed: %s", errorstr);
+        regex->extra = NULL;
+    }
 
+#ifdef PCRE_STUDY_JIT_COMPILE
+    if (regex->extra != NULL && (study_options & PCRE_STUDY_JIT_COMPILE))
+    {
+        pcre_assign_jit_stack(regex->extra, RegexJitStackCallback, NULL);
+    }
+#endif
+
+    if (pcre_fullinfo(rx, regex->extra, PCRE_INFO_CAPTURECOUNT, &regex->captures) != 0)
+    {
+        regex->captures = 0;
+    }
+
+    return regex;
 }
 
-bool StringMatchFull(const char *regex, const char *str)
+Regex *RegexCompile(const char *pattern, int options)
 {
-    pcre *pattern = CompileRegex(regex);
+    assert(pattern != NULL);
 
-    if (pattern == NULL)
+    pcre *rx = CompileRegexWithOptions(pattern, options, true);
+    if (rx == NULL)
     {
-        return false;
+        return NULL;
+    }
+    return RegexNew(rx);
+}
+
+void RegexDestroy(Regex *regex)
+{
+    if (regex != NULL)
+    {
+        if (regex->extra != NULL)
+        {
+#ifdef PCRE_STUDY_JIT_COMPILE
+            pcre_free_study(regex->extra);
+#else
+            pcre_free(regex->extra);
+#endif
+        }
+        pcre_free(regex->rx);
+        free(regex);
     }
+}
 
-    bool ret = StringMatchFullWithPrecompiledRegex(pattern, str);
+const pcre *RegexGetPattern(const Regex *regex)
+{
+    assert(regex != NULL);
+    return regex->rx;
+}
 
-    pcre_free(pattern);
-    return ret;
+int RegexGetCaptureCount(const Regex *regex)
+{
+    assert(regex != NULL);
+    return regex->captures;
+}
+
+int RegexExecute(const Regex *regex, const char *subject, size_t length,
+                 size_t start_offset, int options, int *ovector, int ovecsize)
+{
+    assert(regex != NULL);
+    assert(subject != NULL);
+    assert(length <= INT_MAX);
+    assert(start_offset <= length);
+
+    return pcre_exec(regex->rx, regex->extra, subject, (int) length,
+                     (int) start_offset, options, ovector, ovecsize);
 }
 
-bool StringMatchFullWithPrecompiledRegex(pcre *pattern, const char *str)
+/*********************************************************************/
+/* Matching                                                          */
+/*********************************************************************/
+
+static bool MatchWithExtra(const pcre *rx, const pcre_extra *extra,
+                           const char *str, size_t len,
+                           size_t *start, size_t *end)
+{
+    assert(rx != NULL);
+    assert(str != NULL);
+    assert(len <= INT_MAX);
+
+    int *ovector = GetThreadOvector(STRING_MATCH_OVECCOUNT);
+    int result = pcre_exec(rx, extra, str, (int) len,
+                           0, 0, ovector, STRING_MATCH_OVECCOUNT);
+
+    if (result >= 0)
+    {
+        if (start)
+        {
+            *start = ovector[0];
+        }
+        if (end)
+        {
+            *end = ovector[1];
+        }
+    }
+    else
+    {
+        if (start)
+        {
+            *start = 0;
+        }
+        if (end)
+        {
+            *end = 0;
+        }
+    }
+
+    return result >= 0;
+}
+
+static bool MatchFullWithExtra(const pcre *rx, const pcre_extra *extra,
+                               const char *str, size_t len)
 {
     size_t start = 0, end = 0;
 
-    if (StringMatchWithPrecompiledRegex(pattern, str, &start, &end))
+    if (MatchWithExtra(rx, extra, str, len, &start, &end))
     {
-        return (start == 0U) && (end == strlen(str));
+        return (start == 0U) && (end == len);
     }
     else
     {
@@ -141,14 +350,11 @@ bool StringMatchFullWithPrecompiledRegex(pcre *pattern, const char *str)
 
 // If return_names is not set, only the captured data is returned (so
 // for N captures you can expect N elements in the Sequence).
-Seq *StringMatchCapturesWithPrecompiledRegex(const pcre *pattern, const char *str, const bool return_names)
+static Seq *MatchCapturesWithExtra(const pcre *pattern, const pcre_extra *extra,
+                                   int captures, const char *str, size_t len,
+                                   const bool return_names)
 {
-    int captures;
-    int res = pcre_fullinfo(pattern, NULL, PCRE_INFO_CAPTURECOUNT, &captures);
-    if (res != 0)
-    {
-        return NULL;
-    }
+    assert(len <= INT_MAX);
 
     // Get the table of named captures.
     unsigned char *name_table = NULL; // Doesn't have to be freed as per docs.
@@ -156,24 +362,23 @@ Seq *StringMatchCapturesWithPrecompiledRegex(const pcre *pattern, const char *st
     int name_entry_size = 0;
     unsigned char *tabptr;
 
-    pcre_fullinfo(pattern, NULL, PCRE_INFO_NAMECOUNT, &namecount);
+    pcre_fullinfo(pattern, extra, PCRE_INFO_NAMECOUNT, &namecount);
 
     const bool have_named_captures = (namecount > 0 && return_names);
 
     if (have_named_captures)
     {
-        pcre_fullinfo(pattern, NULL, PCRE_INFO_NAMETABLE, &name_table);
-        pcre_fullinfo(pattern, NULL, PCRE_INFO_NAMEENTRYSIZE, &name_entry_size);
+        pcre_fullinfo(pattern, extra, PCRE_INFO_NAMETABLE, &name_table);
+        pcre_fullinfo(pattern, extra, PCRE_INFO_NAMEENTRYSIZE, &name_entry_size);
     }
 
-    int *ovector = xmalloc(sizeof(int) * (captures + 1) * 3);
+    int *ovector = GetThreadOvector((captures + 1) * 3);
 
-    int result = pcre_exec(pattern, NULL, str, strlen(str),
+    int result = pcre_exec(pattern, extra, str, (int) len,
                            0, 0, ovector, (captures + 1) * 3);
 
     if (result <= 0)
     {
-        free(ovector);
         return NULL;
     }
 
@@ -202,7 +407,7 @@ Seq *StringMatchCapturesWithPrecompiledRegex(const pcre *pattern, const char *st
         {
             if (capture == NULL)
             {
-                capture = BufferNew();
+                capture = BufferNewSmall();
                 BufferAppendF(capture, "%d", i);
             }
 
@@ -215,7 +420,173 @@ Seq *StringMatchCapturesWithPrecompiledRegex(const pcre *pattern, const char *st
         SeqAppend(ret, data);
     }
 
-    free(ovector);
+    return ret;
+}
+
+bool StringMatchWithPrecompiledRegex(const Regex *regex, const char *str, size_t len,
+                                     size_t *start, size_t *end)
+{
+    assert(regex != NULL);
+    assert(str != NULL);
+
+    return MatchWithExtra(regex->rx, regex->extra, str, len, start, end);
+}
+
+bool StringMatchFullWithPrecompiledRegex(const Regex *regex, const char *str, size_t len)
+{
+    assert(regex != NULL);
+    assert(str != NULL);
+
+    return MatchFullWithExtra(regex->rx, regex->extra, str, len);
+}
+
+Seq *StringMatchCapturesWithPrecompiledRegex(const Regex *regex, const char *str, size_t len,
+                                             const bool return_names)
+{
+    assert(regex != NULL);
+    assert(str != NULL);
+
+    return MatchCapturesWithExtra(regex->rx, regex->extra, regex->captures,
+                                  str, len, return_names);
+}
+
+/*********************************************************************/
+/* Compiled pattern cache                                            */
+/*********************************************************************/
+
+static unsigned int RegexCacheItemHash(const void *item, unsigned int seed)
+{
+    const RegexCacheItem *i = item;
+    return StringHash(i->pattern, seed) ^ (unsigned int) i->options;
+}
+
+static bool RegexCacheItemEqual(const void *item1, const void *item2)
+{
+    const RegexCacheItem *i1 = item1;
+    const RegexCacheItem *i2 = item2;
+    return (i1->options == i2->options) && StringEqual(i1->pattern, i2->pattern);
+}
+
+static void RegexCacheItemDestroy(void *item)
+{
+    RegexCacheItem *i = item;
+    RegexDestroy(i->regex);
+    free(i->error);
+    free(i->pattern);
+    free(i);
+}
+
+static void RegexCacheInitializeOnce(void)
+{
+    regex_cache = LRUCacheNew(REGEX_CACHE_CAPACITY, RegexCacheItemHash,
+                              RegexCacheItemEqual, RegexCacheItemDestroy);
+}
+
+static LRUCache *GetRegexCache(void)
+{
+    pthread_once(&regex_cache_once, RegexCacheInitializeOnce);
+    return regex_cache;
+}
+
+/**
+ * @brief Get a compiled pattern from the cache, compiling it on a miss.
+ *
+ * Patterns that fail to compile are cached too, so a bad pattern is only
+ * compiled once. Its error is logged on every call with #log_errors.
+ *
+ * @return An entry which must be given back with LRUCacheRelease(), or
+ *         NULL if the pattern does not compile.
+ */
+static LRUCacheEntry *RegexCacheAcquire(const char *regex, int options, bool log_errors)
+{
+    assert(regex != NULL);
+
+    LRUCache *cache = GetRegexCache();
+    RegexCacheItem key = { .pattern = (char *) regex, .options = options };
+
+    LRUCacheEntry *entry = LRUCacheAcquire(cache, &key);
+    if (entry == NULL)
+    {
+        /* Compile outside of the lock, other threads may use the cache meanwhile. */
+        char *error = NULL;
+        pcre *rx = CompileRegexWithError(regex, options, &error);
+
+        RegexCacheItem *item = xmalloc(sizeof(RegexCacheItem));
+        item->pattern = xstrdup(regex);
+        item->options = options;
+        item->regex = (rx != NULL) ? RegexNew(rx) : NULL;
+        item->error = error;
+
+        entry = LRUCacheInsert(cache, item);
+    }
+
+    const RegexCacheItem *item = LRUCacheEntryGet(entry);
+    if (item->regex == NULL)
+    {
+        if (log_errors)
+        {
+            Log(LOG_LEVEL_ERR, "%s", item->error);
+        }
+        LRUCacheRelease(cache, entry);
+        return NULL;
+    }
+    return entry;
+}
+
+static Regex *RegexCacheEntryGetRegex(const LRUCacheEntry *entry)
+{
+    const RegexCacheItem *item = LRUCacheEntryGet(entry);
+    return item->regex;
+}
+
+void RegexCacheGetStats(RegexCacheStats *stats)
+{
+    LRUCacheGetStats(GetRegexCache(), stats);
+}
+
+void RegexCacheClear(void)
+{
+    LRUCacheClear(GetRegexCache());
+}
+
+/*********************************************************************/
+/* Matching by pattern text                                          */
+/*********************************************************************/
+
+bool StringMatch(const char *regex, const char *str, size_t *start, size_t *end)
+{
+    assert(str != NULL);
+
+    LRUCacheEntry *entry = RegexCacheAcquire(regex, STRING_MATCH_OPTIONS, true);
+
+    if (entry == NULL)
+    {
+        return false;
+    }
+
+    bool ret = StringMatchWithPrecompiledRegex(RegexCacheEntryGetRegex(entry),
+                                               str, strlen(str), start, end);
+
+    LRUCacheRelease(GetRegexCache(), entry);
+    return ret;
+
+}
+
+bool StringMatchFull(const char *regex, const char *str)
+{
+    assert(str != NULL);
+
+    LRUCacheEntry *entry = RegexCacheAcquire(regex, STRING_MATCH_OPTIONS, true);
+
+    if (entry == NULL)
+    {
+        return false;
+    }
+
+    bool ret = StringMatchFullWithPrecompiledRegex(RegexCacheEntryGetRegex(entry),
+                                                   str, strlen(str));
+
+    LRUCacheRelease(GetRegexCache(), entry);
     return ret;
 }
 
@@ -234,21 +605,16 @@ Seq *StringMatchCaptures(const char *regex, const char *str, const bool return_n
     assert(regex);
     assert(str);
 
-    pcre *pattern = NULL;
-    {
-        const char *errorstr;
-        int erroffset;
-        pattern = pcre_compile(regex, PCRE_MULTILINE | PCRE_DOTALL,
-                               &errorstr, &erroffset, NULL);
-    }
+    LRUCacheEntry *entry = RegexCacheAcquire(regex, STRING_MATCH_OPTIONS, false);
 
-    if (pattern == NULL)
+    if (entry == NULL)
     {
         return NULL;
     }
 
-    Seq *ret = StringMatchCapturesWithPrecompiledRegex(pattern, str, return_names);
-    pcre_free(pattern);
+    Seq *ret = StringMatchCapturesWithPrecompiledRegex(RegexCacheEntryGetRegex(entry),
+                                                       str, strlen(str), return_names);
+    LRUCacheRelease(GetRegexCache(), entry);
     return ret;
 }
 
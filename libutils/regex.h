@@ -30,21 +30,58 @@
 #include <pcre.h>
 
 #include <sequence.h>                                           /* Seq */
+#include <lru_cache.h>                                     /* LRUCacheStats */
 
 #define CFENGINE_REGEX_WHITESPACE_IN_CONTEXTS ".*[_A-Za-z0-9][ \\t]+[_A-Za-z0-9].*"
 
-/* Try to use CompileRegex() and StringMatchWithPrecompiledRegex(). */
 pcre *CompileRegex(const char *regex);
 bool StringMatch(const char *regex, const char *str, size_t *start, size_t *end);
-bool StringMatchWithPrecompiledRegex(pcre *regex, const char *str,
-                                     size_t *start, size_t *end);
 bool StringMatchFull(const char *regex, const char *str);
-bool StringMatchFullWithPrecompiledRegex(pcre *regex, const char *str);
 Seq *StringMatchCaptures(const char *regex, const char *str, const bool return_names);
-Seq *StringMatchCapturesWithPrecompiledRegex(const pcre *pattern, const char *str, const bool return_names);
 bool CompareStringOrRegex(const char *value, const char *compareTo, bool regex);
 
 /* Does not free rx! */
 bool RegexPartialMatch(const pcre *rx, const char *teststring);
 
+/*
+ * Compiled pattern together with its pcre_study() data, JIT-compiled when
+ * the PCRE library supports it. Matching reuses a per-thread ovector and JIT
+ * stack and takes an explicit subject length, so it neither allocates nor
+ * calls strlen(). A Regex may be used from several threads at once.
+ */
+typedef struct Regex_ Regex;
+
+/* Compile #pattern with PCRE #options, logging an error on failure. */
+Regex *RegexCompile(const char *pattern, int options);
+/* Study an already compiled pattern. Takes ownership of #rx. */
+Regex *RegexNew(pcre *rx);
+void RegexDestroy(Regex *regex);
+
+const pcre *RegexGetPattern(const Regex *regex);
+int RegexGetCaptureCount(const Regex *regex);
+
+/* Try to use RegexCompile() and StringMatchWithPrecompiledRegex(). */
+bool StringMatchWithPrecompiledRegex(const Regex *regex, const char *str, size_t len,
+                                     size_t *start, size_t *end);
+bool StringMatchFullWithPrecompiledRegex(const Regex *regex, const char *str, size_t len);
+Seq *StringMatchCapturesWithPrecompiledRegex(const Regex *regex, const char *str, size_t len,
+                                             const bool return_names);
+
+/* pcre_exec() using the study/JIT data of #regex, same return values. */
+int RegexExecute(const Regex *regex, const char *subject, size_t length,
+                 size_t start_offset, int options, int *ovector, int ovecsize);
+
+/*
+ * StringMatch(), StringMatchFull(), StringMatchCaptures() and
+ * CompareStringOrRegex() keep recently used patterns compiled in a bounded,
+ * thread-safe LRU cache, so matching the same pattern repeatedly only
+ * compiles it once.
+ */
+typedef LRUCacheStats RegexCacheStats;
+
+void RegexCacheGetStats(RegexCacheStats *stats);
+
+/* Drop all cached patterns and reset the counters. */
+void RegexCacheClear(void);
+
 #endif  /* CFENGINE_REGEX_H */
@@ -0,0 +1,575 @@
+/*
+  Copyright 2023 Northern.tech AS
+
+  This file is part of CFEngine 3 - written and maintained by Northern.tech AS.
+
+  This program is free software; you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by the
+  Free Software Foundation; version 3.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA
+
+  To the extent this program is licensed as part of the Enterprise
+  versions of CFEngine, the applicable Commercial Open Source License
+  (COSL) may apply to this file if you as a licensee so wish it. See
+  included file COSL.txt.
+*/
+
+#include <platform.h>
+#include <regex_set.h>
+
+#include <alloc.h>
+#include <buffer.h>
+#include <logging.h>
+#include <regex.h>
+
+/* Same options as StringMatch() and friends. */
+#define REGEX_SET_OPTIONS (PCRE_MULTILINE | PCRE_DOTALL)
+
+/* ovectors up to this size live on the stack when matching */
+#define REGEX_SET_STACK_OVECCOUNT (3 * 64)
+
+typedef struct
+{
+    const char *text;           /* points into RegexSet->patterns */
+    size_t len;
+    size_t index;               /* index of the pattern in the set */
+} RegexSetLiteral;
+
+typedef struct
+{
+    Regex *regex;
+    size_t index;
+} RegexSetSingle;
+
+struct RegexSet_
+{
+    bool anchored;
+    size_t count;               /* number of patterns */
+    char **patterns;
+
+    RegexSetLiteral *literals;  /* sorted by text if anchored */
+    size_t n_literals;
+
+    /* Patterns combined into one program. */
+    size_t n_combined;
+    size_t *combined_index;     /* pattern index of each combined pattern */
+    int *combined_group;        /* capture group flagging the pattern matched */
+    int combined_ovecsize;
+    Regex *combined_all;        /* tells which patterns matched */
+    Regex *combined_any;        /* plain alternation, stops at first match */
+
+    /* Patterns matched on their own. */
+    RegexSetSingle *singles;
+    size_t n_singles;
+};
+
+static bool PatternIsLiteral(const char *pattern)
+{
+    return pattern[strcspn(pattern, "\\^$.|?*+()[]{}")] == '\0';
+}
+
+/**
+ * Can the pattern be wrapped in a group and combined with others without
+ * changing its meaning? Backreferences and recursion refer to group numbers
+ * which shift once combined, named groups may clash, and \Q, (?x) comments or
+ * control verbs may extend past the end of the pattern.
+ */
+static bool PatternIsCombinable(const char *pattern)
+{
+    for (const char *p = pattern; *p != '\0'; p++)
+    {
+        if (*p == '\\')
+        {
+            p++;
+            if (*p == '\0' ||
+                (*p >= '1' && *p <= '9') ||
+                strchr("gkQ", *p) != NULL)
+            {
+                return false;
+            }
+        }
+        else if (*p == '[')
+        {
+            /* Skip the character class, '(' is not special in it. */
+            p++;
+            if (*p == '^')
+            {
+                p++;
+            }
+            if (*p == ']')
+            {
+                p++;
+            }
+            while (*p != ']')
+            {
+                if (*p == '\0')
+                {
+                    return false;
+                }
+                if (*p == '\\' && p[1] != '\0')
+                {
+                    p++;
+                }
+                else if (*p == '[' && p[1] == ':')
+                {
+                    const char *end = strstr(p + 2, ":]");
+                    if (end != NULL)
+                    {
+                        p = end + 1;
+                    }
+                }
+                p++;
+            }
+        }
+        else if (*p == '(' && p[1] == '*')
+        {
+            return false;
+        }
+        else if (*p == '(' && p[1] == '?')
+        {
+            const char *q = p + 2;
+            if (*q == ':' || *q == '=' || *q == '!' ||
+                (*q == '<' && (q[1] == '=' || q[1] == '!')))
+            {
+                continue;
+            }
+
+            /* Inline options are scoped to the enclosing group, except for
+             * 'x' which turns the rest of the line into a comment. */
+            while (*q != '\0' && strchr("imsJU-", *q) != NULL)
+            {
+                q++;
+            }
+            if (q == p + 2 || (*q != ')' && *q != ':'))
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static pcre *CompileQuiet(const char *pattern)
+{
+    const char *errorstr;
+    int erroffset;
+    return pcre_compile(pattern, REGEX_SET_OPTIONS, &errorstr, &erroffset, NULL);
+}
+
+static int RegexSetLiteralCompare(const void *a, const void *b)
+{
+    const RegexSetLiteral *l1 = a;
+    const RegexSetLiteral *l2 = b;
+
+    const size_t len = MIN(l1->len, l2->len);
+    int ret = memcmp(l1->text, l2->text, len);
+    if (ret != 0)
+    {
+        return ret;
+    }
+    if (l1->len != l2->len)
+    {
+        return (l1->len < l2->len) ? -1 : 1;
+    }
+    return (l1->index < l2->index) ? -1 : (l1->index > l2->index);
+}
+
+/**
+ * Compile the combined patterns. For anchored sets, with patterns p1 ... pn:
+ *
+ *   all: \A(?:(?=(?:p1)\z()))?...(?:(?=(?:pn)\z()))?
+ *   any: \A(?:(?:p1)|...|(?:pn))\z
+ *
+ * In the 'all' program, the empty group after each pattern is set if and only
+ * if the pattern matched. Unanchored sets use (?s:.)*? instead of \A and no
+ * \z.
+ */
+static bool RegexSetCompileCombined(RegexSet *set, Seq *combinable)
+{
+    const size_t n = SeqLength(combinable);
+    if (n == 0)
+    {
+        return true;
+    }
+
+    Buffer *all = BufferNew();
+    Buffer *any = BufferNew();
+
+    set->combined_index = xmalloc(n * sizeof(size_t));
+    set->combined_group = xmalloc(n * sizeof(int));
+
+    BufferAppendString(all, "\\A");
+    BufferAppendString(any, set->anchored ? "\\A(?:" : "(?:");
+
+    int group = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        const size_t index = (size_t) SeqAt(combinable, i);
+        const char *pattern = set->patterns[index];
+
+        /* The pattern's own groups come before its marker group. */
+        pcre *rx = CompileQuiet(pattern);
+        assert(rx != NULL); /* already checked in RegexSetNew() */
+        int captures = 0;
+        pcre_fullinfo(rx, NULL, PCRE_INFO_CAPTURECOUNT, &captures);
+        pcre_free(rx);
+
+        group += captures + 1;
+        set->combined_index[i] = index;
+        set->combined_group[i] = group;
+
+        BufferAppendF(all, "(?:(?=%s(?:%s)%s()))?",
+                      set->anchored ? "" : "(?s:.)*?",
+                      pattern,
+                      set->anchored ? "\\z" : "");
+        BufferAppendF(any, "%s(?:%s)", (i == 0) ? "" : "|", pattern);
+    }
+
+    BufferAppendString(any, set->anchored ? ")\\z" : ")");
+
+    set->n_combined = n;
+    set->combined_ovecsize = (group + 1) * 3;
+    pcre *rx_all = CompileQuiet(BufferData(all));
+    pcre *rx_any = CompileQuiet(BufferData(any));
+    set->combined_all = (rx_all != NULL) ? RegexNew(rx_all) : NULL;
+    set->combined_any = (rx_any != NULL) ? RegexNew(rx_any) : NULL;
+
+    BufferDestroy(all);
+    BufferDestroy(any);
+
+    return (set->combined_all != NULL && set->combined_any != NULL);
+}
+
+static void RegexSetFreeCombined(RegexSet *set)
+{
+    RegexDestroy(set->combined_all);
+    RegexDestroy(set->combined_any);
+    free(set->combined_index);
+    free(set->combined_group);
+    set->combined_all = NULL;
+    set->combined_any = NULL;
+    set->combined_index = NULL;
+    set->combined_group = NULL;
+    set->n_combined = 0;
+}
+
+/**
+ * Compile #pattern so that it only matches the whole string, whichever of its
+ * alternatives does: \A(?:pattern)\z. Leading control verbs such as (*UTF8)
+ * stay in front, an unterminated \Q is ended (a stray \E is ignored) and a
+ * trailing (?x) comment is ended before the closing parenthesis.
+ */
+static pcre *CompileAnchored(const char *pattern)
+{
+    const char *p = pattern;
+    while (p[0] == '(' && p[1] == '*' && strchr(p, ')') != NULL)
+    {
+        p = strchr(p, ')') + 1;
+    }
+    const int verbs_len = p - pattern;
+
+    char *anchored;
+    xasprintf(&anchored, "%.*s\\A(?:%s\\E)\\z", verbs_len, pattern, p);
+    pcre *rx = CompileQuiet(anchored);
+    free(anchored);
+
+    if (rx == NULL)
+    {
+        /* Only a comment running to the end can swallow the ')', in which
+         * case extended mode is on and the newline is whitespace. */
+        xasprintf(&anchored, "%.*s\\A(?:%s\n\\E)\\z", verbs_len, pattern, p);
+        rx = CompileQuiet(anchored);
+        free(anchored);
+    }
+    return rx;
+}
+
+static void RegexSetAddSingle(RegexSet *set, size_t index)
+{
+    pcre *rx = set->anchored ? CompileAnchored(set->patterns[index])
+                             : CompileQuiet(set->patterns[index]);
+    assert(rx != NULL); /* already checked in RegexSetNew() */
+    Regex *regex = RegexNew(rx);
+
+    set->singles[set->n_singles].regex = regex;
+    set->singles[set->n_singles].index = index;
+    set->n_singles++;
+}
+
+RegexSet *RegexSetNew(const Seq *patterns, bool anchored)
+{
+    assert(patterns != NULL);
+
+    const size_t count = SeqLength(patterns);
+
+    /* Validate all the patterns first, logging errors like CompileRegex(). */
+    for (size_t i = 0; i < count; i++)
+    {
+        const char *pattern = SeqAt(patterns, i);
+        assert(pattern != NULL);
+        if (!PatternIsLiteral(pattern))
+        {
+            pcre *rx = CompileRegex(pattern);
+            if (rx == NULL)
+            {
+                return NULL;
+            }
+            pcre_free(rx);
+        }
+    }
+
+    RegexSet *set = xcalloc(1, sizeof(RegexSet));
+    set->anchored = anchored;
+    set->count = count;
+    set->patterns = xcalloc(count, sizeof(char *));
+    set->literals = xcalloc(count, sizeof(RegexSetLiteral));
+    set->singles = xcalloc(count, sizeof(RegexSetSingle));
+
+    Seq *combinable = SeqNew(count, NULL);
+    for (size_t i = 0; i < count; i++)
+    {
+        set->patterns[i] = xstrdup(SeqAt(patterns, i));
+
+        if (PatternIsLiteral(set->patterns[i]))
+        {
+            RegexSetLiteral *literal = &set->literals[set->n_literals++];
+            literal->text = set->patterns[i];
+            literal->len = strlen(set->patterns[i]);
+            literal->index = i;
+        }
+        else if (PatternIsCombinable(set->patterns[i]))
+        {
+            SeqAppend(combinable, (void *) i);
+        }
+        else
+        {
+            RegexSetAddSingle(set, i);
+        }
+    }
+
+    if (anchored)
+    {
+        qsort(set->literals, set->n_literals, sizeof(RegexSetLiteral),
+              RegexSetLiteralCompare);
+    }
+
+    if (!RegexSetCompileCombined(set, combinable))
+    {
+        /* E.g. too big for PCRE, match them one by one instead. */
+        Log(LOG_LEVEL_VERBOSE,
+            "Could not combine %zu regular expressions, matching them separately",
+            SeqLength(combinable));
+        RegexSetFreeCombined(set);
+        for (size_t i = 0; i < SeqLength(combinable); i++)
+        {
+            RegexSetAddSingle(set, (size_t) SeqAt(combinable, i));
+        }
+    }
+
+    SeqDestroy(combinable);
+    return set;
+}
+
+void RegexSetDestroy(RegexSet *set)
+{
+    if (set != NULL)
+    {
+        RegexSetFreeCombined(set);
+        for (size_t i = 0; i < set->n_singles; i++)
+        {
+            RegexDestroy(set->singles[i].regex);
+        }
+        free(set->singles);
+        free(set->literals);
+        for (size_t i = 0; i < set->count; i++)
+        {
+            free(set->patterns[i]);
+        }
+        free(set->patterns);
+        free(set);
+    }
+}
+
+size_t RegexSetCount(const RegexSet *set)
+{
+    assert(set != NULL);
+    return set->count;
+}
+
+static inline bool SingleMatches(const RegexSetSingle *single,
+                                 const char *str, size_t len)
+{
+    /* anchored if the set is, see RegexSetAddSingle() */
+    return StringMatchWithPrecompiledRegex(single->regex, str, len, NULL, NULL);
+}
+
+/**
+ * @return Index of the first anchored literal equal to #str, or
+ *         set->n_literals if there is none.
+ */
+static size_t AnchoredLiteralLowerBound(const RegexSet *set, const char *str, size_t len)
+{
+    const RegexSetLiteral key = { .text = str, .len = len, .index = 0 };
+
+    size_t low = 0;
+    size_t high = set->n_literals;
+    while (low < high)
+    {
+        const size_t mid = low + (high - low) / 2;
+        if (RegexSetLiteralCompare(&set->literals[mid], &key) < 0)
+        {
+            low = mid + 1;
+        }
+        else
+        {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+static inline bool LiteralEquals(const RegexSetLiteral *literal, const char *str, size_t len)
+{
+    return (literal->len == len) && (memcmp(literal->text, str, len) == 0);
+}
+
+size_t RegexSetMatch(const RegexSet *set, const char *str, size_t len,
+                     bool *matched)
+{
+    assert(set != NULL);
+    assert(str != NULL);
+
+    if (matched != NULL)
+    {
+        memset(matched, 0, set->count * sizeof(bool));
+    }
+
+    size_t n_matched = 0;
+
+    if (set->anchored)
+    {
+        for (size_t i = AnchoredLiteralLowerBound(set, str, len);
+             i < set->n_literals && LiteralEquals(&set->literals[i], str, len);
+             i++)
+        {
+            if (matched != NULL)
+            {
+                matched[set->literals[i].index] = true;
+            }
+            n_matched++;
+        }
+    }
+    else
+    {
+        for (size_t i = 0; i < set->n_literals; i++)
+        {
+            const RegexSetLiteral *literal = &set->literals[i];
+            if (memmem(str, len, literal->text, literal->len) != NULL)
+            {
+                if (matched != NULL)
+                {
+                    matched[literal->index] = true;
+                }
+                n_matched++;
+            }
+        }
+    }
+
+    if (set->n_combined > 0)
+    {
+        int stack_ovector[REGEX_SET_STACK_OVECCOUNT];
+        int *ovector = stack_ovector;
+        if (set->combined_ovecsize > REGEX_SET_STACK_OVECCOUNT)
+        {
+            ovector = xmalloc(set->combined_ovecsize * sizeof(int));
+        }
+
+        int rc = RegexExecute(set->combined_all, str, len, 0, 0,
+                              ovector, set->combined_ovecsize);
+        assert(rc != 0); /* ovector is always big enough */
+
+        /* rc is one more than the highest group set, groups not set in
+         * between are -1. */
+        for (size_t i = 0; i < set->n_combined; i++)
+        {
+            const int group = set->combined_group[i];
+            if (group < rc && ovector[2 * group] >= 0)
+            {
+                if (matched != NULL)
+                {
+                    matched[set->combined_index[i]] = true;
+                }
+                n_matched++;
+            }
+        }
+
+        if (ovector != stack_ovector)
+        {
+            free(ovector);
+        }
+    }
+
+    for (size_t i = 0; i < set->n_singles; i++)
+    {
+        if (SingleMatches(&set->singles[i], str, len))
+        {
+            if (matched != NULL)
+            {
+                matched[set->singles[i].index] = true;
+            }
+            n_matched++;
+        }
+    }
+
+    return n_matched;
+}
+
+bool RegexSetMatchAny(const RegexSet *set, const char *str, size_t len)
+{
+    assert(set != NULL);
+    assert(str != NULL);
+
+    if (set->anchored)
+    {
+        const size_t i = AnchoredLiteralLowerBound(set, str, len);
+        if (i < set->n_literals && LiteralEquals(&set->literals[i], str, len))
+        {
+            return true;
+        }
+    }
+    else
+    {
+        for (size_t i = 0; i < set->n_literals; i++)
+        {
+            const RegexSetLiteral *literal = &set->literals[i];
+            if (memmem(str, len, literal->text, literal->len) != NULL)
+            {
+                return true;
+            }
+        }
+    }
+
+    if (set->n_combined > 0 &&
+        StringMatchWithPrecompiledRegex(set->combined_any, str, len, NULL, NULL))
+    {
+        return true;
+    }
+
+    for (size_t i = 0; i < set->n_singles; i++)
+    {
+        if (SingleMatches(&set->singles[i], str, len))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
@@ -0,0 +1,87 @@
+/*
+  Copyright 2023 Northern.tech AS
+
+  This file is part of CFEngine 3 - written and maintained by Northern.tech AS.
+
+  This program is free software; you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by the
+  Free Software Foundation; version 3.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA
+
+  To the extent this program is licensed as part of the Enterprise
+  versions of CFEngine, the applicable Commercial Open Source License
+  (COSL) may apply to this file if you as a licensee so wish it. See
+  included file COSL.txt.
+*/
+
+#ifndef CFENGINE_REGEX_SET_H
+#define CFENGINE_REGEX_SET_H
+
+#include <stdbool.h>
+#include <sequence.h>                                           /* Seq */
+
+/**
+  @brief A set of patterns tested against a string in one go.
+
+  Instead of calling StringMatchFull() once per pattern, the patterns are
+  compiled together:
+
+  - Patterns without regex metacharacters are literals. They are compared
+    directly (binary search over the sorted literals for anchored sets,
+    memmem() otherwise) without involving PCRE at all.
+
+  - All other patterns are combined into one PCRE program, so a single
+    pcre_exec() call tells which of them matched. This saves the per-call
+    overhead of matching them one by one, not the work: PCRE still tries
+    the patterns one after the other, each from the start of the string.
+
+  - Patterns which cannot be safely combined (backreferences, named groups,
+    recursion, control verbs) are matched one by one.
+
+  Patterns use the same PCRE options as StringMatch(). A RegexSet is
+  read-only once built and may be shared between threads.
+*/
+typedef struct RegexSet_ RegexSet;
+
+/**
+  @param patterns Seq of pattern strings (char *)
+  @param anchored If true, a pattern only matches when it can match the whole
+                  string, as if written \A(?:pattern)\z, otherwise it may
+                  match anywhere in it (like StringMatch()). Unlike
+                  StringMatchFull(), which checks whether the first match
+                  found spans the string, this tries all alternatives: "a|ab"
+                  matches "ab".
+  @return NULL if any of the patterns fails to compile (the error is logged)
+ */
+RegexSet *RegexSetNew(const Seq *patterns, bool anchored);
+void RegexSetDestroy(RegexSet *set);
+
+/**
+  @return The number of patterns in the set.
+ */
+size_t RegexSetCount(const RegexSet *set);
+
+/**
+  @brief Find all patterns in #set matching #str.
+  @param matched If not NULL, array of RegexSetCount() elements, element i
+                 is set to whether the i-th pattern matched.
+  @return The number of matching patterns.
+ */
+size_t RegexSetMatch(const RegexSet *set, const char *str, size_t len,
+                     bool *matched);
+
+/**
+  @brief Check if any pattern in #set matches #str.
+  @note Faster than RegexSetMatch(), it stops at the first match.
+ */
+bool RegexSetMatchAny(const RegexSet *set, const char *str, size_t len);
+
+#endif  /* CFENGINE_REGEX_SET_H */
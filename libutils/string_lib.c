@@ -24,6 +24,7 @@
 
 #include <platform.h>
 #include <string_lib.h>
+#include <string_simd.h>
 
 #include <alloc.h>
 #include <writer.h>
@@ -93,12 +94,17 @@ unsigned int StringHash(const char *str, unsigned int seed)
     unsigned int h = seed;
 
     // NULL is not allowed, but we will prevent segfault anyway:
-    size_t len = (str != NULL) ? strlen(str) : 0;
+    if (p == NULL)
+    {
+        p = (unsigned const char *) "";
+    }
 
-    /* https://en.wikipedia.org/wiki/Jenkins_hash_function#one-at-a-time */
-    for (size_t i = 0; i < len; i++)
+    /* https://en.wikipedia.org/wiki/Jenkins_hash_function#one-at-a-time
+     * Every step depends on the previous one, so there is nothing to
+     * vectorize; just don't go over the string twice. */
+    for (; *p != '\0'; p++)
     {
-        h += p[i];
+        h += *p;
         h += (h << 10);
         h ^= (h >> 6);
     }
@@ -150,20 +156,14 @@ char ToUpper(char ch)
 
 void ToUpperStrInplace(char *str)
 {
-    for (; *str != '\0'; str++)
-    {
-        *str = ToUpper(*str);
-    }
+    StringSimdToUpper(str, strlen(str));
 }
 
 /*********************************************************************/
 
 void ToLowerStrInplace(char *str)
 {
-    for (; *str != '\0'; str++)
-    {
-        *str = ToLower(*str);
-    }
+    StringSimdToLower(str, strlen(str));
 }
 
 /*********************************************************************/
@@ -433,28 +433,12 @@ char *StringSubstring(const char *source, size_t source_len, int start, int len)
 
 bool StringIsNumeric(const char *s)
 {
-    for (; *s; s++)
-    {
-        if (!isdigit((unsigned char)*s))
-        {
-            return false;
-        }
-    }
-
-    return true;
+    return StringSimdIsNumeric(s, strlen(s));
 }
 
 bool StringIsPrintable(const char *s)
 {
-    for (; *s; s++)
-    {
-        if (!isprint((unsigned char)*s))
-        {
-            return false;
-        }
-    }
-
-    return true;
+    return StringSimdIsPrintable(s, strlen(s));
 }
 
 bool EmptyString(const char *s)
@@ -966,54 +950,26 @@ bool IsStrCaseIn(const char *str, const char *const strs[])
 
 int CountChar(const char *string, char sep)
 {
-    int count = 0;
-
     if (string == NULL)
     {
         return 0;
     }
 
-    if (string && (strlen(string) == 0))
-    {
-        return 0;
-    }
-
-    for (const char *sp = string; *sp != '\0'; sp++)
-    {
-        if ((*sp == '\\') && (*(sp + 1) == sep))
-        {
-            ++sp;
-        }
-        else if (*sp == sep)
-        {
-            count++;
-        }
-    }
-
-    return count;
+    return StringSimdCountChar(string, strlen(string), sep);
 }
 
 void ReplaceChar(const char *in, char *out, int outSz, char from, char to)
 /* Replaces all occurrences of 'from' to 'to' in preallocated
  * string 'out'. */
 {
-    int len;
-    int i;
-
-    memset(out, 0, outSz);
-    len = strlen(in);
-
-    for (i = 0; (i < len) && (i < outSz - 1); i++)
+    if (outSz <= 0)
     {
-        if (in[i] == from)
-        {
-            out[i] = to;
-        }
-        else
-        {
-            out[i] = in[i];
-        }
+        return;
     }
+
+    const size_t len = MIN(strlen(in), (size_t) outSz - 1);
+    StringSimdReplaceChar(in, out, len, from, to);
+    memset(out + len, 0, outSz - len);
 }
 
 /**
@@ -1539,10 +1495,13 @@ bool StringStartsWith(const char *str, const char *prefix)
  */
 void *memcchr(const void *buf, int c, size_t buf_size)
 {
-    const char *cbuf = buf;
-    for (size_t i = 0; i < buf_size; i++)
+    const unsigned char *cbuf = buf;
+    const unsigned char uc = (unsigned char) c;
+    size_t i = StringSimdSpanChar(cbuf, uc, buf_size);
+
+    for (; i < buf_size; i++)
     {
-        if (cbuf[i] != c)
+        if (cbuf[i] != uc)
         {
             return (void *) &cbuf[i];                    /* cast-away const */
         }
@@ -1605,23 +1564,11 @@ bool StringAppend(char *dst, const char *src, size_t n)
  */
 char *StringCanonify(char *dst, const char *src)
 {
-    while (*src != '\0')
-    {
-        if (isalnum((unsigned char) *src))
-        {
-            *dst = *src;
-        }
-        else
-        {
-            *dst = '_';
-        }
-
-        src++;
-        dst++;
-    }
-    *dst = '\0';
+    const size_t len = strlen(src);
+    StringSimdCanonify(dst, src, len);
+    dst[len] = '\0';
 
-    return dst;
+    return dst + len;
 }
 
 /**
@@ -1749,13 +1696,7 @@ void StrCatDelim(char *dst, size_t dst_size, size_t *dst_len,
 
 void CanonifyNameInPlace(char *s)
 {
-    for (; *s != '\0'; s++)
-    {
-        if (!isalnum((unsigned char) *s))
-        {
-            *s = '_';
-        }
-    }
+    StringSimdCanonify(s, s, strlen(s));
 }
 
 bool StringMatchesOption(
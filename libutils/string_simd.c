@@ -0,0 +1,668 @@
+/*
+  Copyright 2023 Northern.tech AS
+
+  This file is part of CFEngine 3 - written and maintained by Northern.tech AS.
+
+  This program is free software; you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by the
+  Free Software Foundation; version 3.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA
+
+  To the extent this program is licensed as part of the Enterprise
+  versions of CFEngine, the applicable Commercial Open Source License
+  (COSL) may apply to this file if you as a licensee so wish it. See
+  included file COSL.txt.
+*/
+
+#include <platform.h>
+#include <string_simd.h>
+#include <string_lib.h>                                /* ToLower(), ToUpper() */
+
+#ifdef __SSE2__
+# include <emmintrin.h>
+#endif
+
+/* AVX2 code is compiled with a target attribute and only run when the CPU
+ * supports it, the rest of the library is built for the baseline. */
+#if defined(HAVE_AVX2_DISPATCH) && defined(__SSE2__)
+# define STRING_SIMD_AVX2_BUILT 1
+# include <immintrin.h>
+# define AVX2_FUNCTION __attribute__((target("avx2")))
+#endif
+
+static pthread_once_t level_once = PTHREAD_ONCE_INIT;            /* GLOBAL_T */
+static StringSimdLevel supported_level = STRING_SIMD_SCALAR;     /* GLOBAL_X */
+static StringSimdLevel current_level = STRING_SIMD_SCALAR;       /* GLOBAL_X */
+
+static void StringSimdInitializeOnce(void)
+{
+#ifdef __SSE2__
+    supported_level = STRING_SIMD_SSE2;
+#endif
+#ifdef STRING_SIMD_AVX2_BUILT
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        supported_level = STRING_SIMD_AVX2;
+    }
+#endif
+    current_level = supported_level;
+}
+
+StringSimdLevel StringSimdGetLevel(void)
+{
+    pthread_once(&level_once, &StringSimdInitializeOnce);
+    return current_level;
+}
+
+StringSimdLevel StringSimdSetLevel(StringSimdLevel level)
+{
+    pthread_once(&level_once, &StringSimdInitializeOnce);
+    current_level = MIN(level, supported_level);
+    return current_level;
+}
+
+const char *StringSimdLevelToString(StringSimdLevel level)
+{
+    switch (level)
+    {
+    case STRING_SIMD_SCALAR:
+        return "scalar";
+    case STRING_SIMD_SSE2:
+        return "SSE2";
+    case STRING_SIMD_AVX2:
+        return "AVX2";
+    }
+    return "unknown";
+}
+
+/*
+ * Scalar code, used for the tails shorter than a vector, for blocks with
+ * non-ASCII bytes and when no vector instructions are available.
+ */
+
+static inline char CanonifyChar(char c)
+{
+    return isalnum((unsigned char) c) ? c : '_';
+}
+
+static inline size_t CountCharStep(const char *str, size_t i, size_t len,
+                                   char sep, size_t *count)
+{
+    if (str[i] == '\\' && i + 1 < len && str[i + 1] == sep)
+    {
+        return i + 2;
+    }
+    if (str[i] == sep)
+    {
+        (*count)++;
+    }
+    return i + 1;
+}
+
+static inline bool IsPrintableRange(const char *str, size_t from, size_t to)
+{
+    for (size_t i = from; i < to; i++)
+    {
+        if (!isprint((unsigned char) str[i]))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * The vector kernels only process whole vectors and return how many bytes
+ * they processed, the callers finish with the code above. Byte ranges are
+ * checked with signed comparisons, which is right for ASCII bytes only.
+ */
+
+#ifdef __SSE2__
+
+static inline __m128i InRange16(__m128i v, char lo, char hi)
+{
+    return _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(lo - 1)),
+                         _mm_cmpgt_epi8(_mm_set1_epi8(hi + 1), v));
+}
+
+static inline __m128i IsAlnum16(__m128i v)
+{
+    const __m128i folded = _mm_or_si128(v, _mm_set1_epi8(0x20));
+    return _mm_or_si128(InRange16(v, '0', '9'), InRange16(folded, 'a', 'z'));
+}
+
+static size_t ToLowerSSE2(char *str, size_t len)
+{
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *) (str + i));
+        if (_mm_movemask_epi8(v) != 0)
+        {
+            for (size_t j = i; j < i + 16; j++)
+            {
+                str[j] = ToLower(str[j]);
+            }
+            continue;
+        }
+        const __m128i upper = InRange16(v, 'A', 'Z');
+        v = _mm_add_epi8(v, _mm_and_si128(upper, _mm_set1_epi8(0x20)));
+        _mm_storeu_si128((__m128i *) (str + i), v);
+    }
+    return i;
+}
+
+static size_t ToUpperSSE2(char *str, size_t len)
+{
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *) (str + i));
+
+        /* ToUpper() is only a plain case conversion for graphic characters */
+        if (_mm_movemask_epi8(InRange16(v, '!', '~')) != 0xFFFF)
+        {
+            for (size_t j = i; j < i + 16; j++)
+            {
+                str[j] = ToUpper(str[j]);
+            }
+            continue;
+        }
+        const __m128i lower = InRange16(v, 'a', 'z');
+        v = _mm_sub_epi8(v, _mm_and_si128(lower, _mm_set1_epi8(0x20)));
+        _mm_storeu_si128((__m128i *) (str + i), v);
+    }
+    return i;
+}
+
+static size_t CanonifySSE2(char *dst, const char *src, size_t len)
+{
+    const __m128i underscore = _mm_set1_epi8('_');
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16)
+    {
+        const __m128i v = _mm_loadu_si128((const __m128i *) (src + i));
+        if (_mm_movemask_epi8(v) != 0)
+        {
+            for (size_t j = i; j < i + 16; j++)
+            {
+                dst[j] = CanonifyChar(src[j]);
+            }
+            continue;
+        }
+        const __m128i alnum = IsAlnum16(v);
+        _mm_storeu_si128((__m128i *) (dst + i),
+                         _mm_or_si128(_mm_and_si128(alnum, v),
+                                      _mm_andnot_si128(alnum, underscore)));
+    }
+    return i;
+}
+
+static size_t IsNumericSSE2(const char *str, size_t len)
+{
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16)
+    {
+        const __m128i v = _mm_loadu_si128((const __m128i *) (str + i));
+        if (_mm_movemask_epi8(InRange16(v, '0', '9')) != 0xFFFF)
+        {
+            break;
+        }
+    }
+    return i;
+}
+
+static size_t IsPrintableSSE2(const char *str, size_t len)
+{
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16)
+    {
+        const __m128i v = _mm_loadu_si128((const __m128i *) (str + i));
+        if (_mm_movemask_epi8(InRange16(v, ' ', '~')) != 0xFFFF &&
+            !IsPrintableRange(str, i, i + 16))
+        {
+            break;
+        }
+    }
+    return i;
+}
+
+static size_t CountCharSSE2(const char *str, size_t len, char sep, size_t *count)
+{
+    const __m128i needle = _mm_set1_epi8(sep);
+    const __m128i backslash = _mm_set1_epi8('\\');
+    size_t i = 0;
+    while (i + 16 <= len)
+    {
+        const __m128i v = _mm_loadu_si128((const __m128i *) (str + i));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(v, backslash)) != 0)
+        {
+            /* escapes may run over the end of the block */
+            const size_t end = i + 16;
+            while (i < end)
+            {
+                i = CountCharStep(str, i, len, sep, count);
+            }
+            continue;
+        }
+        *count += __builtin_popcount(_mm_movemask_epi8(_mm_cmpeq_epi8(v, needle)));
+        i += 16;
+    }
+    return i;
+}
+
+static size_t ReplaceCharSSE2(const char *in, char *out, size_t len, char from, char to)
+{
+    const __m128i needle = _mm_set1_epi8(from);
+    const __m128i replacement = _mm_set1_epi8(to);
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16)
+    {
+        const __m128i v = _mm_loadu_si128((const __m128i *) (in + i));
+        const __m128i found = _mm_cmpeq_epi8(v, needle);
+        _mm_storeu_si128((__m128i *) (out + i),
+                         _mm_or_si128(_mm_andnot_si128(found, v),
+                                      _mm_and_si128(found, replacement)));
+    }
+    return i;
+}
+
+static size_t SpanCharSSE2(const unsigned char *buf, unsigned char c, size_t len)
+{
+    const __m128i needle = _mm_set1_epi8(c);
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16)
+    {
+        const __m128i v = _mm_loadu_si128((const __m128i *) (buf + i));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(v, needle)) != 0xFFFF)
+        {
+            break;
+        }
+    }
+    return i;
+}
+
+#endif /* __SSE2__ */
+
+#ifdef STRING_SIMD_AVX2_BUILT
+
+#define ALL_SET_32 ((int) 0xFFFFFFFF)
+
+AVX2_FUNCTION static inline __m256i InRange32(__m256i v, char lo, char hi)
+{
+    return _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8(lo - 1)),
+                            _mm256_cmpgt_epi8(_mm256_set1_epi8(hi + 1), v));
+}
+
+AVX2_FUNCTION static inline __m256i IsAlnum32(__m256i v)
+{
+    const __m256i folded = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+    return _mm256_or_si256(InRange32(v, '0', '9'), InRange32(folded, 'a', 'z'));
+}
+
+AVX2_FUNCTION static size_t ToLowerAVX2(char *str, size_t len)
+{
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i *) (str + i));
+        if (_mm256_movemask_epi8(v) != 0)
+        {
+            for (size_t j = i; j < i + 32; j++)
+            {
+                str[j] = ToLower(str[j]);
+            }
+            continue;
+        }
+        const __m256i upper = InRange32(v, 'A', 'Z');
+        v = _mm256_add_epi8(v, _mm256_and_si256(upper, _mm256_set1_epi8(0x20)));
+        _mm256_storeu_si256((__m256i *) (str + i), v);
+    }
+    return i;
+}
+
+AVX2_FUNCTION static size_t ToUpperAVX2(char *str, size_t len)
+{
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i *) (str + i));
+        if (_mm256_movemask_epi8(InRange32(v, '!', '~')) != ALL_SET_32)
+        {
+            for (size_t j = i; j < i + 32; j++)
+            {
+                str[j] = ToUpper(str[j]);
+            }
+            continue;
+        }
+        const __m256i lower = InRange32(v, 'a', 'z');
+        v = _mm256_sub_epi8(v, _mm256_and_si256(lower, _mm256_set1_epi8(0x20)));
+        _mm256_storeu_si256((__m256i *) (str + i), v);
+    }
+    return i;
+}
+
+AVX2_FUNCTION static size_t CanonifyAVX2(char *dst, const char *src, size_t len)
+{
+    const __m256i underscore = _mm256_set1_epi8('_');
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32)
+    {
+        const __m256i v = _mm256_loadu_si256((const __m256i *) (src + i));
+        if (_mm256_movemask_epi8(v) != 0)
+        {
+            for (size_t j = i; j < i + 32; j++)
+            {
+                dst[j] = CanonifyChar(src[j]);
+            }
+            continue;
+        }
+        const __m256i alnum = IsAlnum32(v);
+        _mm256_storeu_si256((__m256i *) (dst + i),
+                            _mm256_blendv_epi8(underscore, v, alnum));
+    }
+    return i;
+}
+
+AVX2_FUNCTION static size_t IsNumericAVX2(const char *str, size_t len)
+{
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32)
+    {
+        const __m256i v = _mm256_loadu_si256((const __m256i *) (str + i));
+        if (_mm256_movemask_epi8(InRange32(v, '0', '9')) != ALL_SET_32)
+        {
+            break;
+        }
+    }
+    return i;
+}
+
+AVX2_FUNCTION static size_t IsPrintableAVX2(const char *str, size_t len)
+{
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32)
+    {
+        const __m256i v = _mm256_loadu_si256((const __m256i *) (str + i));
+        if (_mm256_movemask_epi8(InRange32(v, ' ', '~')) != ALL_SET_32 &&
+            !IsPrintableRange(str, i, i + 32))
+        {
+            break;
+        }
+    }
+    return i;
+}
+
+AVX2_FUNCTION static size_t CountCharAVX2(const char *str, size_t len, char sep, size_t *count)
+{
+    const __m256i needle = _mm256_set1_epi8(sep);
+    const __m256i backslash = _mm256_set1_epi8('\\');
+    size_t i = 0;
+    while (i + 32 <= len)
+    {
+        const __m256i v = _mm256_loadu_si256((const __m256i *) (str + i));
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, backslash)) != 0)
+        {
+            const size_t end = i + 32;
+            while (i < end)
+            {
+                i = CountCharStep(str, i, len, sep, count);
+            }
+            continue;
+        }
+        *count += __builtin_popcount(
+            (unsigned int) _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, needle)));
+        i += 32;
+    }
+    return i;
+}
+
+AVX2_FUNCTION static size_t ReplaceCharAVX2(const char *in, char *out, size_t len, char from, char to)
+{
+    const __m256i needle = _mm256_set1_epi8(from);
+    const __m256i replacement = _mm256_set1_epi8(to);
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32)
+    {
+        const __m256i v = _mm256_loadu_si256((const __m256i *) (in + i));
+        const __m256i found = _mm256_cmpeq_epi8(v, needle);
+        _mm256_storeu_si256((__m256i *) (out + i),
+                            _mm256_blendv_epi8(v, replacement, found));
+    }
+    return i;
+}
+
+AVX2_FUNCTION static size_t SpanCharAVX2(const unsigned char *buf, unsigned char c, size_t len)
+{
+    const __m256i needle = _mm256_set1_epi8(c);
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32)
+    {
+        const __m256i v = _mm256_loadu_si256((const __m256i *) (buf + i));
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, needle)) != ALL_SET_32)
+        {
+            break;
+        }
+    }
+    return i;
+}
+
+#endif /* STRING_SIMD_AVX2_BUILT */
+
+/*
+ * Dispatch: the widest vectors first, then the narrower ones for what is
+ * left, the rest byte by byte.
+ */
+
+void StringSimdToLower(char *str, size_t len)
+{
+    size_t i = 0;
+    switch (StringSimdGetLevel())
+    {
+#ifdef STRING_SIMD_AVX2_BUILT
+    case STRING_SIMD_AVX2:
+        i = ToLowerAVX2(str, len);
+        /* fall through */
+#endif
+#ifdef __SSE2__
+    case STRING_SIMD_SSE2:
+        i += ToLowerSSE2(str + i, len - i);
+        break;
+#endif
+    default:
+        break;
+    }
+
+    for (; i < len; i++)
+    {
+        str[i] = ToLower(str[i]);
+    }
+}
+
+void StringSimdToUpper(char *str, size_t len)
+{
+    size_t i = 0;
+    switch (StringSimdGetLevel())
+    {
+#ifdef STRING_SIMD_AVX2_BUILT
+    case STRING_SIMD_AVX2:
+        i = ToUpperAVX2(str, len);
+        /* fall through */
+#endif
+#ifdef __SSE2__
+    case STRING_SIMD_SSE2:
+        i += ToUpperSSE2(str + i, len - i);
+        break;
+#endif
+    default:
+        break;
+    }
+
+    for (; i < len; i++)
+    {
+        str[i] = ToUpper(str[i]);
+    }
+}
+
+void StringSimdCanonify(char *dst, const char *src, size_t len)
+{
+    size_t i = 0;
+    switch (StringSimdGetLevel())
+    {
+#ifdef STRING_SIMD_AVX2_BUILT
+    case STRING_SIMD_AVX2:
+        i = CanonifyAVX2(dst, src, len);
+        /* fall through */
+#endif
+#ifdef __SSE2__
+    case STRING_SIMD_SSE2:
+        i += CanonifySSE2(dst + i, src + i, len - i);
+        break;
+#endif
+    default:
+        break;
+    }
+
+    for (; i < len; i++)
+    {
+        dst[i] = CanonifyChar(src[i]);
+    }
+}
+
+bool StringSimdIsNumeric(const char *str, size_t len)
+{
+    size_t i = 0;
+    switch (StringSimdGetLevel())
+    {
+#ifdef STRING_SIMD_AVX2_BUILT
+    case STRING_SIMD_AVX2:
+        i = IsNumericAVX2(str, len);
+        /* fall through */
+#endif
+#ifdef __SSE2__
+    case STRING_SIMD_SSE2:
+        i += IsNumericSSE2(str + i, len - i);
+        break;
+#endif
+    default:
+        break;
+    }
+
+    for (; i < len; i++)
+    {
+        if (!isdigit((unsigned char) str[i]))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool StringSimdIsPrintable(const char *str, size_t len)
+{
+    size_t i = 0;
+    switch (StringSimdGetLevel())
+    {
+#ifdef STRING_SIMD_AVX2_BUILT
+    case STRING_SIMD_AVX2:
+        i = IsPrintableAVX2(str, len);
+        /* fall through */
+#endif
+#ifdef __SSE2__
+    case STRING_SIMD_SSE2:
+        i += IsPrintableSSE2(str + i, len - i);
+        break;
+#endif
+    default:
+        break;
+    }
+
+    return IsPrintableRange(str, i, len);
+}
+
+size_t StringSimdCountChar(const char *str, size_t len, char sep)
+{
+    size_t count = 0;
+    size_t i = 0;
+    switch (StringSimdGetLevel())
+    {
+#ifdef STRING_SIMD_AVX2_BUILT
+    case STRING_SIMD_AVX2:
+        i = CountCharAVX2(str, len, sep, &count);
+        /* fall through */
+#endif
+#ifdef __SSE2__
+    case STRING_SIMD_SSE2:
+        i += CountCharSSE2(str + i, len - i, sep, &count);
+        break;
+#endif
+    default:
+        break;
+    }
+
+    while (i < len)
+    {
+        i = CountCharStep(str, i, len, sep, &count);
+    }
+    return count;
+}
+
+void StringSimdReplaceChar(const char *in, char *out, size_t len, char from, char to)
+{
+    size_t i = 0;
+    switch (StringSimdGetLevel())
+    {
+#ifdef STRING_SIMD_AVX2_BUILT
+    case STRING_SIMD_AVX2:
+        i = ReplaceCharAVX2(in, out, len, from, to);
+        /* fall through */
+#endif
+#ifdef __SSE2__
+    case STRING_SIMD_SSE2:
+        i += ReplaceCharSSE2(in + i, out + i, len - i, from, to);
+        break;
+#endif
+    default:
+        break;
+    }
+
+    for (; i < len; i++)
+    {
+        out[i] = (in[i] == from) ? to : in[i];
+    }
+}
+
+size_t StringSimdSpanChar(const void *buf, unsigned char c, size_t len)
+{
+    const unsigned char *cbuf = buf;
+    size_t i = 0;
+    switch (StringSimdGetLevel())
+    {
+#ifdef STRING_SIMD_AVX2_BUILT
+    case STRING_SIMD_AVX2:
+        i = SpanCharAVX2(cbuf, c, len);
+        if (i + 32 <= len)
+        {
+            return i;                      /* stopped at a different byte */
+        }
+        /* fall through */
+#endif
+#ifdef __SSE2__
+    case STRING_SIMD_SSE2:
+        i += SpanCharSSE2(cbuf + i, c, len - i);
+        break;
+#endif
+    default:
+        break;
+    }
+    return i;
+}
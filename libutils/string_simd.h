@@ -0,0 +1,88 @@
+/*
+  Copyright 2023 Northern.tech AS
+
+  This file is part of CFEngine 3 - written and maintained by Northern.tech AS.
+
+  This program is free software; you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by the
+  Free Software Foundation; version 3.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA
+
+  To the extent this program is licensed as part of the Enterprise
+  versions of CFEngine, the applicable Commercial Open Source License
+  (COSL) may apply to this file if you as a licensee so wish it. See
+  included file COSL.txt.
+*/
+
+#ifndef CFENGINE_STRING_SIMD_H
+#define CFENGINE_STRING_SIMD_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Vectorized kernels behind the byte-at-a-time helpers of string_lib.h.
+ *
+ * The best implementation the CPU supports is picked at run time, the
+ * scalar one is always available. The results do not depend on the
+ * implementation: blocks the vector code cannot handle exactly (i.e. with
+ * non-ASCII bytes, whose classification depends on the locale) are handled
+ * byte by byte.
+ *
+ * This interface is private to string_lib.c, the tests and the benchmark.
+ */
+
+typedef enum
+{
+    STRING_SIMD_SCALAR = 0,
+    STRING_SIMD_SSE2,
+    STRING_SIMD_AVX2,
+} StringSimdLevel;
+
+/**
+ * @brief The implementation in use, the best one supported unless changed
+ *        with StringSimdSetLevel().
+ */
+StringSimdLevel StringSimdGetLevel(void);
+
+/**
+ * @brief Use the given implementation, or the best supported one below it.
+ * @note Not thread-safe, meant for the tests and benchmarks.
+ * @return The implementation now in use.
+ */
+StringSimdLevel StringSimdSetLevel(StringSimdLevel level);
+
+const char *StringSimdLevelToString(StringSimdLevel level);
+
+/* Same as ToLowerStrInplace()/ToUpperStrInplace() on #len bytes. */
+void StringSimdToLower(char *str, size_t len);
+void StringSimdToUpper(char *str, size_t len);
+
+/* Copy #len bytes replacing non-alphanumeric ones with '_', #dst may be #src */
+void StringSimdCanonify(char *dst, const char *src, size_t len);
+
+bool StringSimdIsNumeric(const char *str, size_t len);
+bool StringSimdIsPrintable(const char *str, size_t len);
+
+/* Occurrences of #sep not escaped by a backslash, see CountChar() */
+size_t StringSimdCountChar(const char *str, size_t len, char sep);
+
+/* Copy #len bytes replacing #from with #to, #out may be #in */
+void StringSimdReplaceChar(const char *in, char *out, size_t len, char from, char to);
+
+/**
+ * @brief Number of leading bytes of #buf checked to be equal to #c.
+ * @note Stops early (at a block boundary) when it finds a different byte,
+ *       the caller has to find it in the rest.
+ */
+size_t StringSimdSpanChar(const void *buf, unsigned char c, size_t len);
+
+#endif
@@ -27,11 +27,28 @@
 
 #include <misc_lib.h>
 #include <alloc.h>
+#include <logging.h>
+
+#ifdef HAVE_SYS_UIO_H
+# include <sys/uio.h>           /* writev() */
+#endif
+
+/* Number of chunks ChunkedWriterFlushToFd() passes to a single writev() */
+#if defined(IOV_MAX) && IOV_MAX < 64
+# define CHUNKED_WRITER_MAX_IOV IOV_MAX
+#else
+# define CHUNKED_WRITER_MAX_IOV 64
+#endif
+
+/* Alignment of the FdWriter buffer and of its writes in direct mode */
+#define FD_WRITER_DIRECT_ALIGN 4096
 
 typedef enum
 {
     WT_STRING,
     WT_FILE,
+    WT_CHUNKED,
+    WT_FD,
 } WriterType;
 
 typedef struct
@@ -41,6 +58,29 @@ typedef struct
     size_t allocated;           /* Includes trailing zero */
 } StringWriterImpl;
 
+typedef struct
+{
+    char **chunks;              /* all full, except for the last one */
+    size_t num_chunks;
+    size_t chunks_allocated;
+    size_t chunk_size;
+    size_t last_used;           /* bytes used in the last chunk */
+    size_t head_offset;         /* bytes of the first chunk already flushed */
+    size_t len;                 /* total not flushed */
+} ChunkedWriterImpl;
+
+typedef struct
+{
+    int fd;
+    char *buffer;
+    size_t size;
+    size_t used;
+    FdWriterSyncPolicy sync;
+    bool direct;                /* only write whole, aligned blocks */
+    bool failed;                /* a write failed, nothing more is written */
+    pthread_mutex_t *lock;      /* NULL unless shared between threads */
+} FdWriterImpl;
+
 struct Writer_
 {
     WriterType type;
@@ -48,6 +88,8 @@ struct Writer_
     {
         StringWriterImpl string;
         FILE *file;
+        ChunkedWriterImpl chunked;
+        FdWriterImpl fd;
     };
 };
 
@@ -77,6 +119,23 @@ Writer *StringWriter(void)
 
 /*********************************************************************/
 
+Writer *StringWriterFromData(char *data, size_t len, size_t allocated)
+{
+    assert(data != NULL);
+    assert(len < allocated);
+    assert(data[len] == '\0');
+
+    Writer *writer = xcalloc(1, sizeof(Writer));
+
+    writer->type = WT_STRING;
+    writer->string.data = data;
+    writer->string.allocated = allocated;
+    writer->string.len = len;
+    return writer;
+}
+
+/*********************************************************************/
+
 static void StringWriterReallocate(Writer *writer, size_t extra_length)
 {
     assert(writer != NULL);
@@ -119,6 +178,585 @@ static size_t StringWriterWriteLen(Writer *writer, const char *str, size_t len_)
 
 /*********************************************************************/
 
+Writer *ChunkedWriter(size_t chunk_size)
+{
+    Writer *writer = xcalloc(1, sizeof(Writer));
+
+    writer->type = WT_CHUNKED;
+    writer->chunked.chunk_size = (chunk_size > 0) ? chunk_size : CHUNKED_WRITER_DEFAULT_CHUNK_SIZE;
+    return writer;
+}
+
+/* Space left in the last chunk, making sure there is a last chunk. */
+static size_t ChunkedWriterSpace(Writer *writer)
+{
+    ChunkedWriterImpl *impl = &writer->chunked;
+
+    if (impl->num_chunks > 0 && impl->last_used < impl->chunk_size)
+    {
+        return impl->chunk_size - impl->last_used;
+    }
+
+    if (impl->num_chunks == impl->chunks_allocated)
+    {
+        impl->chunks_allocated = MAX(8, impl->chunks_allocated * 2);
+        impl->chunks = xrealloc(impl->chunks, impl->chunks_allocated * sizeof(char *));
+    }
+    impl->chunks[impl->num_chunks++] = xmalloc(impl->chunk_size);
+    impl->last_used = 0;
+
+    return impl->chunk_size;
+}
+
+static size_t ChunkedWriterWriteLen(Writer *writer, const char *str, size_t len_)
+{
+    assert(writer != NULL);
+    ChunkedWriterImpl *impl = &writer->chunked;
+    size_t len = strnlen(str, len_);
+
+    size_t left = len;
+    while (left > 0)
+    {
+        const size_t n = MIN(left, ChunkedWriterSpace(writer));
+        memcpy(impl->chunks[impl->num_chunks - 1] + impl->last_used, str, n);
+        impl->last_used += n;
+        str += n;
+        left -= n;
+    }
+    impl->len += len;
+
+    return len;
+}
+
+static size_t ChunkedWriterWriteChar(Writer *writer, char c)
+{
+    assert(writer != NULL);
+    ChunkedWriterImpl *impl = &writer->chunked;
+
+    ChunkedWriterSpace(writer);
+    impl->chunks[impl->num_chunks - 1][impl->last_used++] = c;
+    impl->len++;
+
+    return 1;
+}
+
+static size_t ChunkedWriterWriteVF(Writer *writer, const char *fmt, va_list ap)
+{
+    assert(writer != NULL);
+    ChunkedWriterImpl *impl = &writer->chunked;
+
+    /* Format straight into the last chunk if it fits there (including the
+     * '\0' vsnprintf() insists on writing). */
+    const size_t space = ChunkedWriterSpace(writer);
+    char *dest = impl->chunks[impl->num_chunks - 1] + impl->last_used;
+
+    va_list aq;
+    va_copy(aq, ap);
+    const int printed = vsnprintf(dest, space, fmt, aq);
+    va_end(aq);
+
+    if (printed >= 0 && (size_t) printed < space)
+    {
+        /* cut at an embedded '\0' (from %c) like the other writers do */
+        const size_t len = strnlen(dest, printed);
+        impl->last_used += len;
+        impl->len += len;
+        return len;
+    }
+
+    char *str = NULL;
+    xvasprintf(&str, fmt, ap);
+    size_t size = ChunkedWriterWriteLen(writer, str, INT_MAX);
+    free(str);
+    return size;
+}
+
+static const char *ChunkedWriterChunkData(const ChunkedWriterImpl *impl, size_t index, size_t *length)
+{
+    *length = (index == impl->num_chunks - 1) ? impl->last_used : impl->chunk_size;
+    if (index == 0)
+    {
+        *length -= impl->head_offset;
+        return impl->chunks[0] + impl->head_offset;
+    }
+    return impl->chunks[index];
+}
+
+/* Forget the first #count bytes, which have been written out. */
+static void ChunkedWriterConsume(ChunkedWriterImpl *impl, size_t count)
+{
+    assert(count <= impl->len);
+
+    size_t done = 0;
+    while (count > 0)
+    {
+        size_t length;
+        ChunkedWriterChunkData(impl, done, &length);
+        if (count < length)
+        {
+            impl->head_offset += count;
+            impl->len -= count;
+            break;
+        }
+
+        free(impl->chunks[done]);
+        done++;
+        impl->head_offset = 0;
+        impl->len -= length;
+        count -= length;
+    }
+
+    impl->num_chunks -= done;
+    memmove(impl->chunks, impl->chunks + done, impl->num_chunks * sizeof(char *));
+}
+
+static void ChunkedWriterFreeChunks(ChunkedWriterImpl *impl)
+{
+    for (size_t i = 0; i < impl->num_chunks; i++)
+    {
+        free(impl->chunks[i]);
+    }
+    free(impl->chunks);
+}
+
+size_t ChunkedWriterLength(const Writer *writer)
+{
+    assert(writer != NULL);
+    if (writer->type != WT_CHUNKED)
+    {
+        ProgrammingError("Wrong writer type");
+    }
+
+    return writer->chunked.len;
+}
+
+size_t ChunkedWriterChunkCount(const Writer *writer)
+{
+    assert(writer != NULL);
+    if (writer->type != WT_CHUNKED)
+    {
+        ProgrammingError("Wrong writer type");
+    }
+
+    return writer->chunked.num_chunks;
+}
+
+const char *ChunkedWriterChunk(const Writer *writer, size_t index, size_t *length)
+{
+    assert(writer != NULL);
+    assert(length != NULL);
+    if (writer->type != WT_CHUNKED)
+    {
+        ProgrammingError("Wrong writer type");
+    }
+
+    assert(index < writer->chunked.num_chunks);
+    return ChunkedWriterChunkData(&writer->chunked, index, length);
+}
+
+bool ChunkedWriterFlushToFd(Writer *writer, int fd)
+{
+    assert(writer != NULL);
+    if (writer->type != WT_CHUNKED)
+    {
+        ProgrammingError("Wrong writer type");
+    }
+
+    ChunkedWriterImpl *impl = &writer->chunked;
+    while (impl->len > 0)
+    {
+#ifdef HAVE_SYS_UIO_H
+        struct iovec iov[CHUNKED_WRITER_MAX_IOV];
+        const size_t n = MIN(impl->num_chunks, CHUNKED_WRITER_MAX_IOV);
+        for (size_t i = 0; i < n; i++)
+        {
+            size_t length;
+            iov[i].iov_base = (void *) ChunkedWriterChunkData(impl, i, &length);
+            iov[i].iov_len = length;
+        }
+        const ssize_t written = writev(fd, iov, n);
+#else
+        size_t length;
+        const char *data = ChunkedWriterChunkData(impl, 0, &length);
+        const ssize_t written = write(fd, data, length);
+#endif
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return false;
+        }
+
+        ChunkedWriterConsume(impl, written);
+    }
+
+    /* ChunkedWriterSpace() adds a chunk before anything is known to go into
+     * it, the last one can be left over empty. Keep the array of chunks for
+     * reuse. */
+    for (size_t i = 0; i < impl->num_chunks; i++)
+    {
+        free(impl->chunks[i]);
+    }
+    impl->num_chunks = 0;
+    impl->head_offset = 0;
+    impl->last_used = 0;
+    return true;
+}
+
+char *ChunkedWriterClose(Writer *writer)
+// NOTE: transfer of ownership for allocated return value
+{
+    assert(writer != NULL);
+    if (writer->type != WT_CHUNKED)
+    {
+        ProgrammingError("Wrong writer type");
+    }
+
+    ChunkedWriterImpl *impl = &writer->chunked;
+    char *data;
+    if (impl->num_chunks == 1 && impl->head_offset == 0)
+    {
+        /* no need to copy anything */
+        data = xrealloc(impl->chunks[0], impl->last_used + 1);
+        impl->num_chunks = 0;
+    }
+    else
+    {
+        data = xmalloc(impl->len + 1);
+        size_t offset = 0;
+        for (size_t i = 0; i < impl->num_chunks; i++)
+        {
+            size_t length;
+            const char *chunk = ChunkedWriterChunkData(impl, i, &length);
+            memcpy(data + offset, chunk, length);
+            offset += length;
+        }
+        assert(offset == impl->len);
+    }
+    data[impl->len] = '\0';
+
+    ChunkedWriterFreeChunks(impl);
+    free(writer);
+    return data;
+}
+
+/*********************************************************************/
+
+static char *FdWriterBufferNew(size_t size, bool aligned)
+{
+#ifdef HAVE_POSIX_MEMALIGN
+    if (aligned)
+    {
+        void *buf;
+        if (posix_memalign(&buf, FD_WRITER_DIRECT_ALIGN, size) == 0)
+        {
+            return buf;
+        }
+    }
+#else
+    UNUSED(aligned);
+#endif
+    return xmalloc(size);
+}
+
+Writer *FdWriter(int fd, const FdWriterOptions *options)
+{
+    assert(fd >= 0);
+
+    const FdWriterOptions defaults = FD_WRITER_OPTIONS_DEFAULT;
+    if (options == NULL)
+    {
+        options = &defaults;
+    }
+
+    Writer *writer = xcalloc(1, sizeof(Writer));
+    FdWriterImpl *impl = &writer->fd;
+
+    writer->type = WT_FD;
+    impl->fd = fd;
+    impl->sync = options->sync;
+    impl->size = (options->buffer_size > 0) ? options->buffer_size : FD_WRITER_DEFAULT_BUFFER_SIZE;
+
+#if defined(O_DIRECT) && defined(HAVE_POSIX_MEMALIGN)
+    impl->direct = options->direct;
+#endif
+    if (impl->direct)
+    {
+        impl->size = (impl->size + FD_WRITER_DIRECT_ALIGN - 1) & ~((size_t) FD_WRITER_DIRECT_ALIGN - 1);
+    }
+    impl->buffer = FdWriterBufferNew(impl->size, impl->direct);
+
+    if (options->shared)
+    {
+        impl->lock = xmalloc(sizeof(pthread_mutex_t));
+        pthread_mutex_init(impl->lock, NULL);
+    }
+
+    return writer;
+}
+
+static bool FdWriterWriteAll(FdWriterImpl *impl, const char *data, size_t len)
+{
+    while (len > 0)
+    {
+        const ssize_t written = write(impl->fd, data, len);
+        if (written <= 0)
+        {
+            if (written < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            /* Nothing written is no progress, retrying would never end */
+            if (written == 0)
+            {
+                errno = EIO;
+            }
+            impl->failed = true;
+            return false;
+        }
+        data += written;
+        len -= written;
+    }
+    return true;
+}
+
+/**
+ * Write out the buffer. In direct mode only whole blocks are written unless
+ * #all is true, in which case the file descriptor has to leave direct mode
+ * for the final partial block (and stays so, since the offset is no longer
+ * aligned).
+ */
+static bool FdWriterDrain(FdWriterImpl *impl, bool all)
+{
+    if (impl->failed)
+    {
+        return false;
+    }
+
+    size_t len = impl->used;
+#ifdef O_DIRECT
+    if (impl->direct)
+    {
+        len &= ~((size_t) FD_WRITER_DIRECT_ALIGN - 1);
+    }
+#endif
+
+    if (!FdWriterWriteAll(impl, impl->buffer, len))
+    {
+        return false;
+    }
+    memmove(impl->buffer, impl->buffer + len, impl->used - len);
+    impl->used -= len;
+
+#ifdef O_DIRECT
+    if (all && impl->used > 0)
+    {
+        assert(impl->direct);
+
+        const int flags = fcntl(impl->fd, F_GETFL);
+        if (flags == -1 || fcntl(impl->fd, F_SETFL, flags & ~O_DIRECT) == -1)
+        {
+            impl->failed = true;
+            return false;
+        }
+        impl->direct = false;
+
+        if (!FdWriterWriteAll(impl, impl->buffer, impl->used))
+        {
+            return false;
+        }
+        impl->used = 0;
+    }
+#else
+    UNUSED(all);
+#endif
+
+    return true;
+}
+
+static size_t FdWriterAppend(FdWriterImpl *impl, const char *str, size_t len)
+{
+    if (impl->failed)
+    {
+        return 0;
+    }
+
+    if (len <= impl->size - impl->used)
+    {
+        /* fast path */
+        memcpy(impl->buffer + impl->used, str, len);
+        impl->used += len;
+        return len;
+    }
+
+    size_t left = len;
+    while (left > 0)
+    {
+        if (impl->used == 0 && !impl->direct && left >= impl->size)
+        {
+            /* no point in copying big writes through the buffer */
+            return FdWriterWriteAll(impl, str, left) ? len : 0;
+        }
+
+        const size_t n = MIN(left, impl->size - impl->used);
+        memcpy(impl->buffer + impl->used, str, n);
+        impl->used += n;
+        str += n;
+        left -= n;
+
+        if (impl->used == impl->size && !FdWriterDrain(impl, false))
+        {
+            return 0;
+        }
+    }
+
+    return len;
+}
+
+static size_t FdWriterWriteLen(Writer *writer, const char *str, size_t len_)
+{
+    assert(writer != NULL);
+    FdWriterImpl *impl = &writer->fd;
+    size_t len = strnlen(str, len_);
+
+    if (impl->lock == NULL)
+    {
+        return FdWriterAppend(impl, str, len);
+    }
+
+    pthread_mutex_lock(impl->lock);
+    const size_t ret = FdWriterAppend(impl, str, len);
+    pthread_mutex_unlock(impl->lock);
+    return ret;
+}
+
+static size_t FdWriterWriteChar(Writer *writer, char c)
+{
+    assert(writer != NULL);
+    FdWriterImpl *impl = &writer->fd;
+
+    if (impl->lock == NULL && impl->used < impl->size && !impl->failed)
+    {
+        impl->buffer[impl->used++] = c;
+        return 1;
+    }
+
+    return FdWriterWriteLen(writer, &c, 1);
+}
+
+static size_t FdWriterWriteVF(Writer *writer, const char *fmt, va_list ap)
+{
+    assert(writer != NULL);
+    FdWriterImpl *impl = &writer->fd;
+
+    if (impl->lock == NULL && !impl->failed)
+    {
+        /* Format straight into the buffer if it fits there (including the
+         * '\0' vsnprintf() insists on writing). */
+        char *dest = impl->buffer + impl->used;
+        const size_t space = impl->size - impl->used;
+
+        va_list aq;
+        va_copy(aq, ap);
+        const int printed = vsnprintf(dest, space, fmt, aq);
+        va_end(aq);
+
+        if (printed >= 0 && (size_t) printed < space)
+        {
+            const size_t len = strnlen(dest, printed);
+            impl->used += len;
+            return len;
+        }
+    }
+
+    char *str = NULL;
+    xvasprintf(&str, fmt, ap);
+    size_t size = FdWriterWriteLen(writer, str, INT_MAX);
+    free(str);
+    return size;
+}
+
+bool FdWriterFlush(Writer *writer)
+{
+    assert(writer != NULL);
+    if (writer->type != WT_FD)
+    {
+        ProgrammingError("Wrong writer type");
+    }
+
+    FdWriterImpl *impl = &writer->fd;
+    if (impl->lock != NULL)
+    {
+        pthread_mutex_lock(impl->lock);
+    }
+
+    bool success = FdWriterDrain(impl, true);
+    if (success && impl->sync == FD_WRITER_SYNC_ON_FLUSH && fsync(impl->fd) != 0)
+    {
+        impl->failed = true;
+        success = false;
+    }
+
+    if (impl->lock != NULL)
+    {
+        pthread_mutex_unlock(impl->lock);
+    }
+    return success;
+}
+
+bool FdWriterFailed(const Writer *writer)
+{
+    assert(writer != NULL);
+    if (writer->type != WT_FD)
+    {
+        ProgrammingError("Wrong writer type");
+    }
+
+    return writer->fd.failed;
+}
+
+/* Flush and sync as required before the writer goes away. */
+static bool FdWriterFinish(Writer *writer)
+{
+    FdWriterImpl *impl = &writer->fd;
+
+    bool success = FdWriterDrain(impl, true);
+    if (success && impl->sync != FD_WRITER_SYNC_NONE && fsync(impl->fd) != 0)
+    {
+        success = false;
+    }
+
+    free(impl->buffer);
+    if (impl->lock != NULL)
+    {
+        pthread_mutex_destroy(impl->lock);
+        free(impl->lock);
+    }
+    return success;
+}
+
+int FdWriterDetach(Writer *writer, bool *success)
+{
+    assert(writer != NULL);
+    if (writer->type != WT_FD)
+    {
+        ProgrammingError("Wrong writer type");
+    }
+
+    const int fd = writer->fd.fd;
+    const bool finished = FdWriterFinish(writer);
+    if (success != NULL)
+    {
+        *success = finished;
+    }
+    free(writer);
+    return fd;
+}
+
+/*********************************************************************/
+
 static size_t FileWriterWriteF(Writer *writer, const char *fmt, va_list ap)
 {
     assert(writer != NULL);
@@ -167,6 +805,14 @@ size_t WriterWriteVF(Writer *writer, const char *fmt, va_list ap)
         free(str);
         return size;
     }
+    else if (writer->type == WT_CHUNKED)
+    {
+        return ChunkedWriterWriteVF(writer, fmt, ap);
+    }
+    else if (writer->type == WT_FD)
+    {
+        return FdWriterWriteVF(writer, fmt, ap);
+    }
     else
     {
         return FileWriterWriteF(writer, fmt, ap);
@@ -182,6 +828,14 @@ size_t WriterWriteLen(Writer *writer, const char *str, size_t len)
     {
         return StringWriterWriteLen(writer, str, len);
     }
+    else if (writer->type == WT_CHUNKED)
+    {
+        return ChunkedWriterWriteLen(writer, str, len);
+    }
+    else if (writer->type == WT_FD)
+    {
+        return FdWriterWriteLen(writer, str, len);
+    }
     else
     {
         return FileWriterWriteLen(writer, str, len);
@@ -204,6 +858,14 @@ size_t WriterWriteChar(Writer *writer, char c)
     {
         return StringWriterWriteChar(writer, c);
     }
+    else if (writer->type == WT_CHUNKED)
+    {
+        return ChunkedWriterWriteChar(writer, c);
+    }
+    else if (writer->type == WT_FD)
+    {
+        return FdWriterWriteChar(writer, c);
+    }
     else
     {
         char s[2] = { c, '\0' };
@@ -246,6 +908,19 @@ void WriterClose(Writer *writer)
     {
         free(writer->string.data);
     }
+    else if (writer->type == WT_CHUNKED)
+    {
+        ChunkedWriterFreeChunks(&writer->chunked);
+    }
+    else if (writer->type == WT_FD)
+    {
+        if (!FdWriterFinish(writer))
+        {
+            Log(LOG_LEVEL_ERR, "Failed to write buffered data to file descriptor %d (%s)",
+                writer->fd.fd, GetErrorStr());
+        }
+        close(writer->fd.fd);
+    }
     else
     {
 #ifdef CFENGINE_TEST
@@ -30,7 +30,8 @@
  *
  * Writes passed data either to
  *   passed FILE*, or
- *   memory buffer
+ *   memory buffer, or
+ *   list of fixed-size memory chunks (see ChunkedWriter())
  */
 
 typedef struct Writer_ Writer;
@@ -44,6 +45,10 @@ typedef struct Writer_ Writer;
 Writer *FileWriter(FILE *);
 Writer *StringWriter(void);
 
+/* Takes over #data, a '\0'-terminated string of #len bytes in a heap
+ * allocation of #allocated bytes, as the contents of a new StringWriter. */
+Writer *StringWriterFromData(char *data, size_t len, size_t allocated);
+
 size_t WriterWriteF(Writer *writer, const char *fmt, ...) FUNC_ATTR_PRINTF(2, 3);
 size_t WriterWriteVF(Writer *writer, const char *fmt, va_list ap) FUNC_ATTR_PRINTF(2, 0);
 
@@ -54,6 +59,78 @@ size_t WriterWriteChar(Writer *writer, char c);
 size_t StringWriterLength(const Writer *writer);
 const char *StringWriterData(const Writer *writer);
 
+/*
+ * ChunkedWriter keeps the written data in a list of fixed-size chunks
+ * instead of one string, so that growing it never copies what has been
+ * written so far. Good for very large outputs which are written to a file
+ * descriptor or processed chunk by chunk in the end.
+ */
+#define CHUNKED_WRITER_DEFAULT_CHUNK_SIZE (64 * 1024)
+
+/* #chunk_size 0 means CHUNKED_WRITER_DEFAULT_CHUNK_SIZE */
+Writer *ChunkedWriter(size_t chunk_size);
+
+/* Number of bytes held (written and not flushed yet) */
+size_t ChunkedWriterLength(const Writer *writer);
+
+/* The data held is the concatenation of the chunks 0..count-1, which are
+ * not '\0'-terminated. Chunks are invalidated by further writes. */
+size_t ChunkedWriterChunkCount(const Writer *writer);
+const char *ChunkedWriterChunk(const Writer *writer, size_t index, size_t *length);
+
+/* Write all data held to #fd with writev() and forget it. On error, the
+ * data not written yet is kept and errno is set. */
+bool ChunkedWriterFlushToFd(Writer *writer, int fd);
+
+/* Returns all data held in one modifiable string and destroys itself */
+char *ChunkedWriterClose(Writer *writer) FUNC_WARN_UNUSED_RESULT;
+
+/*
+ * FdWriter writes to a file descriptor through its own buffer, without
+ * stdio and without any locking unless asked for, so that bulk output (JSON,
+ * CSV, XML,...) is mostly memcpy() into the buffer. WriterClose() flushes it,
+ * syncs according to the policy and closes the file descriptor.
+ *
+ * Write errors are sticky: once a write fails, nothing more is written and
+ * FdWriterFailed() returns true.
+ */
+#define FD_WRITER_DEFAULT_BUFFER_SIZE (64 * 1024)
+
+typedef enum
+{
+    FD_WRITER_SYNC_NONE,        /* leave it to the kernel */
+    FD_WRITER_SYNC_ON_CLOSE,    /* fsync() when the writer is closed or detached */
+    FD_WRITER_SYNC_ON_FLUSH,    /* also fsync() on every FdWriterFlush() */
+} FdWriterSyncPolicy;
+
+typedef struct
+{
+    size_t buffer_size;         /* 0 for FD_WRITER_DEFAULT_BUFFER_SIZE */
+    FdWriterSyncPolicy sync;
+
+    /* The file descriptor is opened with O_DIRECT: use an aligned buffer
+     * and only write whole blocks of it. The final partial block is written
+     * with O_DIRECT turned off. Ignored where O_DIRECT is not available. */
+    bool direct;
+
+    /* The writer is used from several threads, lock around every write. */
+    bool shared;
+} FdWriterOptions;
+
+#define FD_WRITER_OPTIONS_DEFAULT \
+    { .buffer_size = 0, .sync = FD_WRITER_SYNC_NONE, .direct = false, .shared = false }
+
+/* #options may be NULL for FD_WRITER_OPTIONS_DEFAULT */
+Writer *FdWriter(int fd, const FdWriterOptions *options);
+
+/* Write out everything buffered (and fsync() with FD_WRITER_SYNC_ON_FLUSH) */
+bool FdWriterFlush(Writer *writer);
+bool FdWriterFailed(const Writer *writer);
+
+/* Flush, sync according to the policy and destroy the writer, returning the
+ * still open file descriptor. #success (may be NULL) tells if all went well. */
+int FdWriterDetach(Writer *writer, bool *success);
+
 void WriterClose(Writer *writer);
 
 /* Returns modifiable string and destroys itself */
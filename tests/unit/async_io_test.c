@@ -0,0 +1,252 @@
+#include <test.h>
+
+#include <async_io.h>
+#include <file_lib.h>
+#include <misc_lib.h>           /* xsnprintf */
+#include <string_lib.h>
+#include <alloc.h>
+
+static char TEMP_DIR[] = "/tmp/async_io_testXXXXXX";
+
+/* More files than io_uring has requests in flight */
+#define N_FILES 300
+
+static void FilePath(char *path, size_t size, size_t i)
+{
+    xsnprintf(path, size, "%s/%zu", TEMP_DIR, i);
+}
+
+/* File i has i * 37 bytes, so that some need several reads */
+static void CreateFiles(void)
+{
+    char path[PATH_MAX];
+    for (size_t i = 0; i < N_FILES; i++)
+    {
+        FilePath(path, sizeof(path), i);
+        FILE *f = fopen(path, "w");
+        assert_true(f != NULL);
+        for (size_t j = 0; j < i * 37; j++)
+        {
+            fputc('a' + (i + j) % 26, f);
+        }
+        fclose(f);
+    }
+
+    xsnprintf(path, sizeof(path), "%s/link", TEMP_DIR);
+    assert_int_equal(symlink("299", path), 0);
+}
+
+static void RemoveFiles(void)
+{
+    char path[PATH_MAX];
+    for (size_t i = 0; i < N_FILES; i++)
+    {
+        FilePath(path, sizeof(path), i);
+        unlink(path);
+    }
+    xsnprintf(path, sizeof(path), "%s/link", TEMP_DIR);
+    unlink(path);
+    rmdir(TEMP_DIR);
+}
+
+static void AssertContents(const char *data, size_t length, size_t i)
+{
+    for (size_t j = 0; j < length; j++)
+    {
+        assert_int_equal(data[j], 'a' + (i + j) % 26);
+    }
+    assert_int_equal(data[length], '\0');
+}
+
+typedef struct
+{
+    AsyncIO *aio;
+    size_t index;
+    size_t max_size;
+    bool called;
+    bool stat_next;
+} Request;
+
+static void ReadDone(AsyncIOResult *result, void *data)
+{
+    Request *request = data;
+    assert_false(request->called);
+    request->called = true;
+
+    const size_t size = request->index * 37;
+    assert_int_equal(result->error, 0);
+    assert_true(result->data != NULL);
+    assert_int_equal(result->length, MIN(size, request->max_size));
+    assert_int_equal(result->truncated, size > request->max_size);
+    assert_true(result->allocated > result->length);
+    AssertContents(result->data, result->length, request->index);
+}
+
+static void StatDone(AsyncIOResult *result, void *data)
+{
+    Request *request = data;
+    assert_false(request->called);
+    request->called = true;
+
+    assert_int_equal(result->error, 0);
+    assert_true(S_ISREG(result->sb.st_mode));
+    assert_int_equal(result->sb.st_size, request->index * 37);
+}
+
+static void ReadThenStat(AsyncIOResult *result, void *data)
+{
+    Request *request = data;
+    ReadDone(result, data);
+
+    /* queue more from a callback */
+    request->called = false;
+    AsyncIOStat(request->aio, result->path, StatDone, request);
+}
+
+static void Failed(AsyncIOResult *result, void *data)
+{
+    bool *called = data;
+    *called = true;
+    assert_int_equal(result->error, ENOENT);
+    assert_true(result->data == NULL);
+}
+
+static void RunBackend(AsyncIOBackend backend)
+{
+    AsyncIO *aio = AsyncIONew(backend);
+    if (aio == NULL)
+    {
+        assert_int_equal(backend, ASYNC_IO_BACKEND_IO_URING);
+        return;
+    }
+    if (backend != ASYNC_IO_BACKEND_DEFAULT)
+    {
+        assert_int_equal(AsyncIOGetBackend(aio), backend);
+    }
+
+    Request requests[N_FILES];
+    char path[PATH_MAX];
+    for (size_t i = 0; i < N_FILES; i++)
+    {
+        requests[i] = (Request) {
+            .aio = aio,
+            .index = i,
+            .max_size = (i % 3 == 0) ? 1000 : SIZE_MAX,
+        };
+        FilePath(path, sizeof(path), i);
+        if (i % 5 == 0)
+        {
+            AsyncIOStat(aio, path, StatDone, &requests[i]);
+        }
+        else if (i % 5 == 1)
+        {
+            AsyncIOReadFile(aio, path, requests[i].max_size, ReadThenStat, &requests[i]);
+        }
+        else
+        {
+            AsyncIOReadFile(aio, path, requests[i].max_size, ReadDone, &requests[i]);
+        }
+    }
+
+    bool missing_called = false;
+    AsyncIOReadFile(aio, "/no/such/file", 100, Failed, &missing_called);
+
+    AsyncIOWait(aio);
+    for (size_t i = 0; i < N_FILES; i++)
+    {
+        assert_true(requests[i].called);
+    }
+    assert_true(missing_called);
+
+    /* a symlink, and reading nothing at all */
+    Request link = { .aio = aio, .index = 299, .max_size = SIZE_MAX };
+    xsnprintf(path, sizeof(path), "%s/link", TEMP_DIR);
+    AsyncIOReadFile(aio, path, SIZE_MAX, ReadDone, &link);
+
+    Request empty = { .aio = aio, .index = 0, .max_size = SIZE_MAX };
+    FilePath(path, sizeof(path), 0);
+    AsyncIOReadFile(aio, path, SIZE_MAX, ReadDone, &empty);
+
+    Request nothing = { .aio = aio, .index = 5, .max_size = 0 };
+    FilePath(path, sizeof(path), 5);
+    AsyncIOReadFile(aio, path, 0, ReadDone, &nothing);
+
+    AsyncIOWait(aio);
+    assert_true(link.called);
+    assert_true(empty.called);
+    assert_true(nothing.called);
+
+    /* nothing to wait for */
+    AsyncIOWait(aio);
+    AsyncIODestroy(aio);
+}
+
+static void test_threads(void)
+{
+    RunBackend(ASYNC_IO_BACKEND_THREADS);
+}
+
+static void test_io_uring(void)
+{
+    RunBackend(ASYNC_IO_BACKEND_IO_URING);
+}
+
+static void test_default(void)
+{
+    RunBackend(ASYNC_IO_BACKEND_DEFAULT);
+}
+
+static void test_file_read_batch(void)
+{
+    const char *filenames[N_FILES + 1];
+    char paths[N_FILES][PATH_MAX];
+    for (size_t i = 0; i < N_FILES; i++)
+    {
+        FilePath(paths[i], sizeof(paths[i]), i);
+        filenames[i] = paths[i];
+    }
+    filenames[N_FILES] = "/no/such/file";
+
+    FileReadResult results[N_FILES + 1];
+    assert_int_equal(FileReadBatch(filenames, N_FILES + 1, 5000, results), N_FILES);
+
+    for (size_t i = 0; i < N_FILES; i++)
+    {
+        assert_true(results[i].contents != NULL);
+        assert_int_equal(results[i].truncated, i * 37 > 5000);
+        assert_int_equal(StringWriterLength(results[i].contents), MIN(i * 37, 5000));
+        AssertContents(StringWriterData(results[i].contents),
+                       StringWriterLength(results[i].contents), i);
+
+        /* the same as reading them one by one */
+        bool truncated;
+        Writer *w = FileRead(filenames[i], 5000, &truncated);
+        assert_int_equal(truncated, results[i].truncated);
+        assert_string_equal(StringWriterData(w), StringWriterData(results[i].contents));
+        WriterClose(w);
+
+        WriterClose(results[i].contents);
+    }
+    assert_true(results[N_FILES].contents == NULL);
+
+    assert_int_equal(FileReadBatch(filenames, 0, 5000, results), 0);
+}
+
+int main()
+{
+    assert_true(mkdtemp(TEMP_DIR) != NULL);
+    CreateFiles();
+
+    PRINT_TEST_BANNER();
+    const UnitTest tests[] =
+    {
+        unit_test(test_threads),
+        unit_test(test_io_uring),
+        unit_test(test_default),
+        unit_test(test_file_read_batch),
+    };
+
+    int ret = run_tests(tests);
+    RemoveFiles();
+    return ret;
+}
@@ -0,0 +1,314 @@
+#include <test.h>
+#include <btree.h>
+
+#include <alloc.h>
+
+#include <stdlib.h>
+
+static void *_IntCopy(const void *_a)
+{
+    return xmemdup(_a, sizeof(int));
+}
+
+static int _IntCompare(const void *_a, const void *_b)
+{
+    const int *a = _a, *b = _b;
+    return (*a > *b) - (*a < *b);
+}
+
+static BTree *IntTreeNew_(void)
+{
+    return BTreeNew(_IntCopy, _IntCompare, free, _IntCopy, _IntCompare, free);
+}
+
+/* Check that iterating #t gives exactly the keys marked in #present, in
+ * order, each with the value #values[key]. */
+static void AssertContents(const BTree *t, const bool *present, const int *values, int range)
+{
+    BTreeIterator it;
+    BTreeIteratorInit(&it, t);
+
+    void *key, *value;
+    size_t count = 0;
+    int previous = -1;
+    while (BTreeIteratorNext(&it, &key, &value))
+    {
+        const int k = *(int *) key;
+        assert_true(k > previous);
+        assert_true(k < range);
+        assert_true(present[k]);
+        assert_int_equal(values[k], *(int *) value);
+        previous = k;
+        count++;
+    }
+
+    size_t expected = 0;
+    for (int i = 0; i < range; i++)
+    {
+        expected += present[i] ? 1 : 0;
+    }
+    assert_int_equal(expected, count);
+    assert_int_equal(expected, BTreeSize(t));
+}
+
+static void test_new_destroy(void)
+{
+    BTree *t = IntTreeNew_();
+    assert_int_equal(0, BTreeSize(t));
+
+    BTreeIterator it;
+    BTreeIteratorInit(&it, t);
+    assert_false(BTreeIteratorNext(&it, NULL, NULL));
+
+    BTreeDestroy(t);
+}
+
+static void test_put_overwrite_remove(void)
+{
+    BTree *t = IntTreeNew_();
+
+    int a = 42, b = 43;
+    assert_false(BTreePut(t, &a, &a));
+    assert_int_equal(a, *(int *) BTreeGet(t, &a));
+
+    assert_true(BTreePut(t, &a, &b));
+    assert_int_equal(b, *(int *) BTreeGet(t, &a));
+    assert_int_equal(1, BTreeSize(t));
+
+    assert_true(BTreeGet(t, &b) == NULL);
+    assert_false(BTreeRemove(t, &b));
+
+    assert_true(BTreeRemove(t, &a));
+    assert_true(BTreeGet(t, &a) == NULL);
+    assert_false(BTreeRemove(t, &a));
+    assert_int_equal(0, BTreeSize(t));
+
+    BTreeDestroy(t);
+}
+
+static void test_random_operations(void)
+{
+    /* enough keys for a tree of three levels, and enough removals to merge
+     * most of it back together */
+    const int range = 20000;
+    bool *present = xcalloc(range, sizeof(bool));
+    int *values = xcalloc(range, sizeof(int));
+
+    BTree *t = IntTreeNew_();
+    srand(1234);
+    for (int round = 0; round < 4; round++)
+    {
+        for (int i = 0; i < 3 * range; i++)
+        {
+            const int k = rand() % range;
+            const int v = rand();
+            if (round % 2 == 0 || rand() % 4 == 0)
+            {
+                assert_int_equal(present[k], BTreePut(t, &k, &v));
+                present[k] = true;
+                values[k] = v;
+            }
+            else
+            {
+                assert_int_equal(present[k], BTreeRemove(t, &k));
+                present[k] = false;
+            }
+        }
+        AssertContents(t, present, values, range);
+
+        for (int k = 0; k < range; k++)
+        {
+            int *v = BTreeGet(t, &k);
+            if (present[k])
+            {
+                assert_true(v != NULL);
+                assert_int_equal(values[k], *v);
+            }
+            else
+            {
+                assert_true(v == NULL);
+            }
+        }
+    }
+
+    /* and remove everything that is left */
+    for (int k = 0; k < range; k++)
+    {
+        assert_int_equal(present[k], BTreeRemove(t, &k));
+        present[k] = false;
+    }
+    AssertContents(t, present, values, range);
+
+    BTreeDestroy(t);
+    free(present);
+    free(values);
+}
+
+static void AssertRange(const BTree *t, bool lower, int bound, int expected_first)
+{
+    BTreeIterator it;
+    if (lower)
+    {
+        BTreeIteratorLowerBound(&it, t, &bound);
+    }
+    else
+    {
+        BTreeIteratorUpperBound(&it, t, &bound);
+    }
+
+    void *key;
+    if (expected_first < 0)
+    {
+        assert_false(BTreeIteratorNext(&it, &key, NULL));
+        return;
+    }
+
+    /* the rest of the tree follows, in order */
+    int expected = expected_first;
+    while (BTreeIteratorNext(&it, &key, NULL))
+    {
+        assert_int_equal(expected, *(int *) key);
+        expected += 10;
+    }
+    assert_int_equal(1000, expected);
+}
+
+static void test_range(void)
+{
+    BTree *t = IntTreeNew_();
+    for (int k = 0; k < 1000; k += 10)
+    {
+        BTreePut(t, &k, &k);
+    }
+
+    AssertRange(t, true, -5, 0);
+    AssertRange(t, true, 0, 0);
+    AssertRange(t, false, 0, 10);
+    AssertRange(t, true, 315, 320);
+    AssertRange(t, false, 315, 320);
+    AssertRange(t, true, 320, 320);
+    AssertRange(t, false, 320, 330);
+    AssertRange(t, true, 990, 990);
+    AssertRange(t, false, 990, -1);
+    AssertRange(t, true, 5000, -1);
+
+    /* every leaf boundary */
+    for (int k = 0; k < 990; k += 10)
+    {
+        AssertRange(t, true, k, k);
+        AssertRange(t, false, k, k + 10);
+    }
+
+    BTreeDestroy(t);
+}
+
+static void test_bulk_load(void)
+{
+    const size_t sizes[] = { 0, 1, 31, 32, 33, 1000, 1025, 50000 };
+
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+    {
+        const size_t count = sizes[s];
+        int *numbers = xcalloc(count + 1, sizeof(int));
+        const void **keys = xcalloc(count + 1, sizeof(void *));
+        for (size_t i = 0; i < count; i++)
+        {
+            numbers[i] = 2 * i;
+            keys[i] = &numbers[i];
+        }
+
+        BTree *t = IntTreeNew_();
+        assert_true(BTreeBulkLoad(t, keys, keys, count));
+        assert_int_equal(count, BTreeSize(t));
+
+        BTree *inserted = IntTreeNew_();
+        for (size_t i = 0; i < count; i++)
+        {
+            BTreePut(inserted, keys[i], keys[i]);
+        }
+        assert_true(BTreeEqual(t, inserted));
+
+        /* a bulk loaded tree is an ordinary one */
+        const int odd = 7, even = 8;
+        assert_true(BTreeGet(t, &odd) == NULL);
+        if (count > 4)
+        {
+            assert_int_equal(even, *(int *) BTreeGet(t, &even));
+            assert_true(BTreeRemove(t, &even));
+            assert_false(BTreeEqual(t, inserted));
+        }
+        for (size_t i = 0; i < count; i++)
+        {
+            BTreeRemove(t, keys[i]);
+        }
+        assert_int_equal(0, BTreeSize(t));
+
+        /* unsorted input, or a tree that is not empty, is refused */
+        if (count > 1)
+        {
+            numbers[count] = numbers[0];
+            keys[count] = &numbers[count];
+            assert_false(BTreeBulkLoad(t, keys, keys, count + 1));
+            assert_int_equal(0, BTreeSize(t));
+
+            assert_false(BTreeBulkLoad(inserted, keys, keys, count));
+            assert_int_equal(count, BTreeSize(inserted));
+        }
+
+        BTreeDestroy(t);
+        BTreeDestroy(inserted);
+        free(keys);
+        free(numbers);
+    }
+}
+
+static void test_clear_equal(void)
+{
+    BTree *a = IntTreeNew_();
+    BTree *b = IntTreeNew_();
+    assert_true(BTreeEqual(a, b));
+
+    for (int k = 0; k < 500; k++)
+    {
+        BTreePut(a, &k, &k);
+    }
+    for (int k = 499; k >= 0; k--)
+    {
+        BTreePut(b, &k, &k);
+    }
+    assert_true(BTreeEqual(a, b));
+
+    int k = 100, v = 101;
+    BTreePut(b, &k, &v);
+    assert_false(BTreeEqual(a, b));
+
+    BTreeClear(a);
+    assert_int_equal(0, BTreeSize(a));
+    assert_true(BTreeGet(a, &k) == NULL);
+    assert_false(BTreeEqual(a, b));
+
+    BTreeClear(b);
+    assert_true(BTreeEqual(a, b));
+
+    BTreePut(a, &k, &v);
+    assert_int_equal(v, *(int *) BTreeGet(a, &k));
+
+    BTreeDestroy(a);
+    BTreeDestroy(b);
+}
+
+int main()
+{
+    PRINT_TEST_BANNER();
+    const UnitTest tests[] =
+    {
+        unit_test(test_new_destroy),
+        unit_test(test_put_overwrite_remove),
+        unit_test(test_random_operations),
+        unit_test(test_range),
+        unit_test(test_bulk_load),
+        unit_test(test_clear_equal),
+    };
+
+    return run_tests(tests);
+}
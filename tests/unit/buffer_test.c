@@ -5,6 +5,7 @@
 #include <string.h>
 #include <cmockery.h>
 #include <buffer.h>
+#include <string_lib.h>
 
 static void test_createBuffer(void)
 {
@@ -599,6 +600,139 @@ static void test_vprintf(void)
     free(char0int0char1double0);
 }
 
+static void test_search_and_replace(void)
+{
+#ifdef WITH_PCRE
+    Buffer *buffer = BufferNewFrom("one two three two", strlen("one two three two"));
+
+    assert_true(BufferSearchAndReplace(buffer, "t(w)o", "[$1]", "g") == NULL);
+    assert_string_equal(BufferData(buffer), "one [w] three [w]");
+
+    assert_true(BufferSearchAndReplace(buffer, "^(\\w+)", "\\1\\1", "") == NULL);
+    assert_string_equal(BufferData(buffer), "oneone [w] three [w]");
+
+    assert_true(BufferSearchAndReplace(buffer, "NOMATCH", "x", "g") == NULL);
+    assert_string_equal(BufferData(buffer), "oneone [w] three [w]");
+
+    BufferDestroy(buffer);
+#endif // WITH_PCRE
+}
+
+static void test_small_buffer(void)
+{
+    Buffer *buffer = BufferNewSmall();
+    assert_int_equal(BufferCapacity(buffer), BUFFER_INLINE_CAPACITY);
+    assert_true(buffer->buffer == buffer->inline_data);
+
+    BufferAppendF(buffer, "%u.%u.%u.%u", 192, 168, 100, 254);
+    assert_string_equal(BufferData(buffer), "192.168.100.254");
+    assert_true(buffer->buffer == buffer->inline_data);
+
+    /* growing moves the data out of the structure */
+    for (int i = 0; i < 10; i++)
+    {
+        BufferAppendString(buffer, "0123456789");
+    }
+    assert_true(buffer->buffer != buffer->inline_data);
+    assert_int_equal(BufferSize(buffer), 15 + 100);
+    assert_true(StringStartsWith(BufferData(buffer), "192.168.100.2540123456789"));
+    BufferDestroy(buffer);
+
+    /* data kept inline is copied when the buffer is closed */
+    buffer = BufferNewSmall();
+    BufferAppendString(buffer, "short");
+    char *data = BufferClose(buffer);
+    assert_string_equal(data, "short");
+    free(data);
+
+    /* small capacities are kept inline */
+    buffer = BufferNewFrom("abc", 3);
+    assert_true(buffer->buffer == buffer->inline_data);
+    Buffer *copy = BufferCopy(buffer);
+    assert_int_equal(BufferCompare(buffer, copy), 0);
+    BufferDestroy(copy);
+    BufferDestroy(buffer);
+
+    /* larger ones do not carry the inline storage */
+    buffer = BufferNew();
+    assert_false(buffer->has_inline);
+    BufferDestroy(buffer);
+}
+
+static void test_reserve(void)
+{
+    Buffer *buffer = BufferNewSmall();
+    BufferAppendString(buffer, "head");
+
+    BufferReserve(buffer, 10000);
+    assert_true(BufferCapacity(buffer) > 10000);
+    assert_string_equal(BufferData(buffer), "head");
+
+    const char *data = BufferData(buffer);
+    for (int i = 0; i < 999; i++)
+    {
+        BufferAppend(buffer, "0123456789", 10);
+    }
+    assert_true(BufferData(buffer) == data);
+    assert_int_equal(BufferSize(buffer), 4 + 9990);
+
+    /* reserving less than the capacity does nothing */
+    const size_t capacity = BufferCapacity(buffer);
+    BufferReserve(buffer, 10);
+    assert_int_equal(BufferCapacity(buffer), capacity);
+
+    BufferDestroy(buffer);
+}
+
+static void test_growth_policy(void)
+{
+    char data[DEFAULT_BUFFER_CAPACITY + 1];
+    memset(data, 'x', DEFAULT_BUFFER_CAPACITY);
+    data[DEFAULT_BUFFER_CAPACITY] = '\0';
+
+    Buffer *buffer = BufferNew();
+    BufferAppendString(buffer, data);
+    assert_int_equal(BufferCapacity(buffer), 2 * DEFAULT_BUFFER_CAPACITY);
+    BufferDestroy(buffer);
+
+    buffer = BufferNew();
+    BufferSetGrowthPolicy(buffer, BUFFER_GROWTH_ONE_AND_HALF);
+    BufferAppendString(buffer, data);
+    assert_int_equal(BufferCapacity(buffer), DEFAULT_BUFFER_CAPACITY + DEFAULT_BUFFER_CAPACITY / 2);
+    assert_string_equal(BufferData(buffer), data);
+    BufferDestroy(buffer);
+
+    buffer = BufferNew();
+    BufferSetGrowthPolicy(buffer, BUFFER_GROWTH_EXACT);
+    BufferAppend(buffer, data, DEFAULT_BUFFER_CAPACITY);
+    assert_int_equal(BufferCapacity(buffer), DEFAULT_BUFFER_CAPACITY + 2);
+    assert_string_equal(BufferData(buffer), data);
+    BufferDestroy(buffer);
+}
+
+static void test_close_to_string_writer(void)
+{
+    Buffer *buffer = BufferNew();
+    BufferAppendString(buffer, "some data");
+    const char *data = BufferData(buffer);
+
+    Writer *writer = BufferCloseToStringWriter(buffer);
+    assert_int_equal(StringWriterLength(writer), 9);
+    assert_true(StringWriterData(writer) == data);
+    WriterWrite(writer, " and more");
+    assert_string_equal(StringWriterData(writer), "some data and more");
+    WriterClose(writer);
+
+    buffer = BufferNewSmall();
+    BufferSetMode(buffer, BUFFER_BEHAVIOR_BYTEARRAY);
+    BufferAppend(buffer, "inline", 6);
+    writer = BufferCloseToStringWriter(buffer);
+    assert_int_equal(StringWriterLength(writer), 6);
+    char *str = StringWriterClose(writer);
+    assert_string_equal(str, "inline");
+    free(str);
+}
+
 int main()
 {
     PRINT_TEST_BANNER();
@@ -613,7 +747,12 @@ int main()
         unit_test(test_appendBuffer),
         unit_test(test_append_boundaries),
         unit_test(test_printf),
-        unit_test(test_vprintf)
+        unit_test(test_vprintf),
+        unit_test(test_search_and_replace),
+        unit_test(test_small_buffer),
+        unit_test(test_reserve),
+        unit_test(test_growth_policy),
+        unit_test(test_close_to_string_writer),
     };
 
     return run_tests(tests);
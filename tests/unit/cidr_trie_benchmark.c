@@ -0,0 +1,138 @@
+/*
+ * Longest prefix matching against 100k-network tables, with the trie and
+ * with a linear scan like the one it replaces:
+ *
+ *   make -C tests/unit cidr_trie_benchmark && tests/unit/cidr_trie_benchmark
+ *
+ * Not run by "make check", the numbers depend too much on the machine.
+ */
+
+#include <platform.h>
+#include <cidr_trie.h>
+#include <sequence.h>
+#include <string_lib.h>
+#include <alloc.h>
+
+#define BENCHMARK_NETWORKS 100000
+#define BENCHMARK_LOOKUPS 1000000
+#define BENCHMARK_SCAN_LOOKUPS 1000
+
+static volatile size_t sink;                                        /* GLOBAL_X */
+
+static double Now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void RandomAddr(IPAddr *addr, IPAddressVersion type, unsigned int *seed)
+{
+    memset(addr, 0, sizeof(*addr));
+    addr->type = type;
+    for (size_t i = 0; i < IP_ADDR_BITS(type) / 8; i++)
+    {
+        addr->bytes[i] = rand_r(seed);
+    }
+}
+
+static bool InNetwork(const IPAddr *addr, const IPAddr *network, unsigned int len)
+{
+    if (addr->type != network->type)
+    {
+        return false;
+    }
+    const unsigned int bytes = len / 8;
+    if (memcmp(addr->bytes, network->bytes, bytes) != 0)
+    {
+        return false;
+    }
+    const uint8_t mask = 0xFF << (8 - (len % 8));
+    return (len % 8 == 0) || ((addr->bytes[bytes] ^ network->bytes[bytes]) & mask) == 0;
+}
+
+static void Benchmark(IPAddressVersion type)
+{
+    const unsigned int bits = IP_ADDR_BITS(type);
+    unsigned int seed = 1;
+
+    /* Networks of realistic lengths, as strings like in the policy */
+    IPAddr *networks = xmalloc(BENCHMARK_NETWORKS * sizeof(IPAddr));
+    unsigned int *lengths = xmalloc(BENCHMARK_NETWORKS * sizeof(unsigned int));
+    Seq *cidrs = SeqNew(BENCHMARK_NETWORKS, free);
+    for (size_t i = 0; i < BENCHMARK_NETWORKS; i++)
+    {
+        char str[IP_ADDR_STRING_SIZE];
+        RandomAddr(&networks[i], type, &seed);
+        lengths[i] = (type == IP_ADDRESS_TYPE_IPV4) ?
+            8 + rand_r(&seed) % 25 : 16 + rand_r(&seed) % 49;
+        IPAddrToString(&networks[i], str, sizeof(str));
+        SeqAppend(cidrs, StringFormat("%s/%u", str, lengths[i]));
+    }
+
+    IPAddr *addrs = xmalloc(BENCHMARK_LOOKUPS * sizeof(IPAddr));
+    for (size_t i = 0; i < BENCHMARK_LOOKUPS; i++)
+    {
+        /* half of them inside some network */
+        RandomAddr(&addrs[i], type, &seed);
+        if (i % 2 == 0)
+        {
+            const size_t n = rand_r(&seed) % BENCHMARK_NETWORKS;
+            memcpy(addrs[i].bytes, networks[n].bytes, lengths[n] / 8);
+        }
+    }
+
+    printf("IPv%d, %d networks:\n", (type == IP_ADDRESS_TYPE_IPV4) ? 4 : 6,
+           BENCHMARK_NETWORKS);
+
+    double start = Now();
+    CidrTrie *trie = CidrTrieNew(NULL);
+    for (size_t i = 0; i < BENCHMARK_NETWORKS; i++)
+    {
+        CidrTrieInsertString(trie, SeqAt(cidrs, i), NULL);
+    }
+    printf("  %-32s %10.1f ms\n", "build, one by one", (Now() - start) * 1e3);
+    CidrTrieDestroy(trie);
+
+    start = Now();
+    trie = CidrTrieNewFromStrings(cidrs, NULL, NULL);
+    printf("  %-32s %10.1f ms\n", "build, CidrTrieNewFromStrings()", (Now() - start) * 1e3);
+
+    start = Now();
+    for (size_t i = 0; i < BENCHMARK_LOOKUPS; i++)
+    {
+        unsigned int len;
+        sink += CidrTrieMatch(trie, &addrs[i], NULL, &len) ? len : 0;
+    }
+    printf("  %-32s %10.1f ns\n", "lookup, trie", (Now() - start) * 1e9 / BENCHMARK_LOOKUPS);
+
+    start = Now();
+    for (size_t i = 0; i < BENCHMARK_SCAN_LOOKUPS; i++)
+    {
+        unsigned int best = 0;
+        for (size_t n = 0; n < BENCHMARK_NETWORKS; n++)
+        {
+            if (lengths[n] > best && lengths[n] <= bits &&
+                InNetwork(&addrs[i], &networks[n], lengths[n]))
+            {
+                best = lengths[n];
+            }
+        }
+        sink += best;
+    }
+    printf("  %-32s %10.1f ns\n", "lookup, linear scan",
+           (Now() - start) * 1e9 / BENCHMARK_SCAN_LOOKUPS);
+
+    CidrTrieDestroy(trie);
+    free(addrs);
+    SeqDestroy(cidrs);
+    free(lengths);
+    free(networks);
+}
+
+int main()
+{
+    Benchmark(IP_ADDRESS_TYPE_IPV4);
+    Benchmark(IP_ADDRESS_TYPE_IPV6);
+    return 0;
+}
@@ -0,0 +1,271 @@
+#include <test.h>
+
+#include <cidr_trie.h>
+#include <sequence.h>
+#include <alloc.h>
+
+static IPAddr Addr(const char *str)
+{
+    IPAddr addr;
+    assert_true(IPAddrParse(str, strlen(str), &addr));
+    return addr;
+}
+
+static int MatchValue(const CidrTrie *trie, const char *str, unsigned int *prefix_len)
+{
+    const IPAddr addr = Addr(str);
+    void *value = NULL;
+    if (!CidrTrieMatch(trie, &addr, &value, prefix_len))
+    {
+        return -1;
+    }
+    return (int) (intptr_t) value;
+}
+
+static void test_parse_cidr(void)
+{
+    IPAddr addr;
+    unsigned int len;
+    char str[IP_ADDR_STRING_SIZE];
+
+    assert_true(IPAddrParseCidr("10.1.2.3/8", 10, &addr, &len));
+    assert_int_equal(len, 8);
+    assert_true(IPAddrToString(&addr, str, sizeof(str)));
+    assert_string_equal(str, "10.0.0.0");
+
+    assert_true(IPAddrParseCidr("192.168.1.77/27", 15, &addr, &len));
+    assert_int_equal(len, 27);
+    assert_true(IPAddrToString(&addr, str, sizeof(str)));
+    assert_string_equal(str, "192.168.1.64");
+
+    assert_true(IPAddrParseCidr("fe80::1/10", 10, &addr, &len));
+    assert_int_equal(len, 10);
+    assert_true(IPAddrToString(&addr, str, sizeof(str)));
+    assert_string_equal(str, "fe80:0:0:0:0:0:0:0");
+
+    assert_true(IPAddrParseCidr("1.2.3.4", 7, &addr, &len));
+    assert_int_equal(len, 32);
+    assert_true(IPAddrParseCidr("::1", 3, &addr, &len));
+    assert_int_equal(len, 128);
+    assert_true(IPAddrParseCidr("0.0.0.0/0", 9, &addr, &len));
+    assert_int_equal(len, 0);
+
+    const char *invalid[] = {
+        "10.0.0.0/33", "10.0.0.0/", "10.0.0.0/8x", "10.0.0.0/-1", "10.0.0.0/0008",
+        "1.2.3.4:80/8", "::/129", "/8", "10.0.0/8", "bogus",
+    };
+    for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++)
+    {
+        assert_false(IPAddrParseCidr(invalid[i], strlen(invalid[i]), &addr, &len));
+    }
+}
+
+static void test_longest_prefix_match(void)
+{
+    CidrTrie *trie = CidrTrieNew(NULL);
+    unsigned int len;
+
+    assert_int_equal(MatchValue(trie, "10.0.0.1", &len), -1);
+
+    assert_true(CidrTrieInsertString(trie, "10.0.0.0/8", (void *) 1));
+    assert_true(CidrTrieInsertString(trie, "10.1.0.0/16", (void *) 2));
+    assert_true(CidrTrieInsertString(trie, "10.1.2.3", (void *) 3));
+    assert_true(CidrTrieInsertString(trie, "10.128.0.0/9", (void *) 4));
+    assert_true(CidrTrieInsertString(trie, "2001:db8::/32", (void *) 5));
+    assert_true(CidrTrieInsertString(trie, "2001:db8:1::/48", (void *) 6));
+    assert_false(CidrTrieInsertString(trie, "10.0.0.0/40", (void *) 7));
+    assert_int_equal(CidrTrieSize(trie), 6);
+
+    assert_int_equal(MatchValue(trie, "10.200.0.1", &len), 4);
+    assert_int_equal(len, 9);
+    assert_int_equal(MatchValue(trie, "10.1.2.3", &len), 3);
+    assert_int_equal(len, 32);
+    assert_int_equal(MatchValue(trie, "10.1.2.4", &len), 2);
+    assert_int_equal(len, 16);
+    assert_int_equal(MatchValue(trie, "10.2.0.0", &len), 1);
+    assert_int_equal(len, 8);
+    assert_int_equal(MatchValue(trie, "11.0.0.0", &len), -1);
+
+    /* the families are separate, ::a00:1 has the bits of 10.0.0.1 */
+    assert_int_equal(MatchValue(trie, "::a00:1", &len), -1);
+    assert_int_equal(MatchValue(trie, "2001:db8:1::5", &len), 6);
+    assert_int_equal(len, 48);
+    assert_int_equal(MatchValue(trie, "2001:db8:2::5", &len), 5);
+    assert_int_equal(MatchValue(trie, "2001:db9::", &len), -1);
+
+    /* default route */
+    assert_true(CidrTrieInsertString(trie, "0.0.0.0/0", (void *) 8));
+    assert_int_equal(MatchValue(trie, "11.0.0.0", &len), 8);
+    assert_int_equal(len, 0);
+    assert_int_equal(MatchValue(trie, "::1", &len), -1);
+
+    /* exact lookups */
+    IPAddr prefix = Addr("10.1.0.0");
+    assert_true(CidrTrieGet(trie, &prefix, 16) == (void *) 2);
+    assert_true(CidrTrieGet(trie, &prefix, 15) == NULL);
+    assert_true(CidrTrieGet(trie, &prefix, 17) == NULL);
+    prefix = Addr("10.1.255.255");
+    assert_true(CidrTrieGet(trie, &prefix, 16) == (void *) 2);
+
+    CidrTrieDestroy(trie);
+}
+
+static int destroyed = 0;
+
+static void CountDestroy(void *value)
+{
+    destroyed++;
+    free(value);
+}
+
+static void test_replace_and_destroy(void)
+{
+    destroyed = 0;
+    CidrTrie *trie = CidrTrieNew(CountDestroy);
+
+    assert_true(CidrTrieInsertString(trie, "192.168.0.0/16", xstrdup("a")));
+    assert_true(CidrTrieInsertString(trie, "192.168.0.0/24", xstrdup("b")));
+    assert_true(CidrTrieInsertString(trie, "192.168.3.0/24", xstrdup("c")));
+    assert_true(CidrTrieInsertString(trie, "192.168.1.1/16", xstrdup("d")));
+    assert_int_equal(destroyed, 1);
+    assert_int_equal(CidrTrieSize(trie), 3);
+
+    const IPAddr addr = Addr("192.168.9.9");
+    void *value;
+    assert_true(CidrTrieMatch(trie, &addr, &value, NULL));
+    assert_string_equal(value, "d");
+
+    CidrTrieDestroy(trie);
+    assert_int_equal(destroyed, 4);
+}
+
+static void test_new_from_strings(void)
+{
+    Seq *cidrs = SeqNew(8, NULL);
+    SeqAppend(cidrs, "172.16.0.0/12");
+    SeqAppend(cidrs, "not a network");
+    SeqAppend(cidrs, "172.16.5.0/24");
+    SeqAppend(cidrs, "fd00::/8");
+    SeqAppend(cidrs, "172.16.0.0/33");
+    SeqAppend(cidrs, "172.16.0.0/12");
+
+    size_t invalid;
+    CidrTrie *trie = CidrTrieNewFromStrings(cidrs, (void *) 1, &invalid);
+    assert_int_equal(invalid, 2);
+    assert_int_equal(CidrTrieSize(trie), 3);
+
+    unsigned int len;
+    assert_int_equal(MatchValue(trie, "172.31.255.255", &len), 1);
+    assert_int_equal(len, 12);
+    assert_int_equal(MatchValue(trie, "172.16.5.200", &len), 1);
+    assert_int_equal(len, 24);
+    assert_int_equal(MatchValue(trie, "fdff::1", &len), 1);
+    assert_int_equal(MatchValue(trie, "172.32.0.0", &len), -1);
+
+    CidrTrieDestroy(trie);
+    SeqDestroy(cidrs);
+}
+
+/* Compare with a linear scan over random, heavily nested networks */
+#define RANDOM_NETWORKS 2000
+#define RANDOM_LOOKUPS 20000
+
+static void RandomAddr(IPAddr *addr, IPAddressVersion type, unsigned int *seed)
+{
+    memset(addr, 0, sizeof(*addr));
+    addr->type = type;
+    const size_t bytes = IP_ADDR_BITS(type) / 8;
+    for (size_t i = 0; i < bytes; i++)
+    {
+        addr->bytes[i] = rand_r(seed);
+    }
+    /* few different top bits, so that networks nest and share prefixes */
+    addr->bytes[0] &= 0x83;
+    addr->bytes[1] &= 0xF1;
+}
+
+static bool InNetwork(const IPAddr *addr, const IPAddr *network, unsigned int len)
+{
+    if (addr->type != network->type)
+    {
+        return false;
+    }
+    for (unsigned int i = 0; i < len; i++)
+    {
+        const uint8_t mask = 0x80 >> (i % 8);
+        if ((addr->bytes[i / 8] & mask) != (network->bytes[i / 8] & mask))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void test_random_against_linear_scan(void)
+{
+    static IPAddr networks[RANDOM_NETWORKS];
+    static unsigned int lengths[RANDOM_NETWORKS];
+    unsigned int seed = 7;
+
+    CidrTrie *trie = CidrTrieNew(NULL);
+    for (intptr_t i = 0; i < RANDOM_NETWORKS; i++)
+    {
+        const IPAddressVersion type = (i % 3 == 0) ? IP_ADDRESS_TYPE_IPV6 : IP_ADDRESS_TYPE_IPV4;
+        RandomAddr(&networks[i], type, &seed);
+        lengths[i] = rand_r(&seed) % (IP_ADDR_BITS(type) + 1);
+        if (type == IP_ADDRESS_TYPE_IPV6)
+        {
+            lengths[i] = MIN(lengths[i], 40);
+        }
+        else
+        {
+            lengths[i] = MIN(lengths[i], 20);
+        }
+        assert_true(CidrTrieInsert(trie, &networks[i], lengths[i], (void *) (i + 1)));
+    }
+
+    for (int n = 0; n < RANDOM_LOOKUPS; n++)
+    {
+        IPAddr addr;
+        RandomAddr(&addr, (n % 2 == 0) ? IP_ADDRESS_TYPE_IPV6 : IP_ADDRESS_TYPE_IPV4, &seed);
+
+        /* the same network inserted again replaces the value */
+        intptr_t expected = 0;
+        int expected_len = -1;
+        for (intptr_t i = 0; i < RANDOM_NETWORKS; i++)
+        {
+            if ((int) lengths[i] >= expected_len && InNetwork(&addr, &networks[i], lengths[i]))
+            {
+                expected = i + 1;
+                expected_len = lengths[i];
+            }
+        }
+
+        void *value = NULL;
+        unsigned int len = 0;
+        const bool found = CidrTrieMatch(trie, &addr, &value, &len);
+        assert_int_equal(found, expected_len >= 0);
+        if (found)
+        {
+            assert_int_equal((intptr_t) value, expected);
+            assert_int_equal(len, expected_len);
+        }
+    }
+
+    CidrTrieDestroy(trie);
+}
+
+int main()
+{
+    PRINT_TEST_BANNER();
+    const UnitTest tests[] =
+    {
+        unit_test(test_parse_cidr),
+        unit_test(test_longest_prefix_match),
+        unit_test(test_replace_and_destroy),
+        unit_test(test_new_from_strings),
+        unit_test(test_random_against_linear_scan),
+    };
+
+    return run_tests(tests);
+}
@@ -304,6 +304,208 @@ static void test_new_csv_reader_carriage_return()
     SeqDestroy(list);
 }
 
+static void test_get_line_length()
+{
+    /* Must split the file into the same records as GetCsvLineNext() */
+    FILE *fp = fopen("./data/csv_file.csv", "r");
+    assert_true(fp);
+    char data[4096];
+    size_t length = fread(data, 1, sizeof(data), fp);
+    assert_true(length > 0 && length < sizeof(data));
+    rewind(fp);
+
+    size_t offset = 0;
+    char *line;
+    while ((line = GetCsvLineNext(fp)) != NULL)
+    {
+        size_t line_length = GetCsvLineLength(data + offset, length - offset);
+        assert_int_equal(line_length, strlen(line));
+        assert_memory_equal(data + offset, line, line_length);
+        offset += line_length;
+        free(line);
+    }
+    assert_int_equal(offset, length);
+    fclose(fp);
+
+    assert_int_equal(GetCsvLineLength("", 0), 0);
+    assert_int_equal(GetCsvLineLength("a,b", 3), 3);
+    assert_int_equal(GetCsvLineLength("a\nb\r\nc", 7), 5);
+    assert_int_equal(GetCsvLineLength("\"a\r\n\",b\r\nc", 11), 9);
+    assert_int_equal(GetCsvLineLength("\"a\r\nb", 6), 6);
+
+    /* Finding a line must not look at the data after it, splitting a big
+     * buffer without quotes is not quadratic */
+    const size_t n_lines = 200000;
+    const char record[] = "field_1,field_2,field_3\n\r\n";
+    const size_t record_length = strlen(record);
+    char *big = xmalloc(n_lines * record_length);
+    for (size_t i = 0; i < n_lines; i++)
+    {
+        memcpy(big + i * record_length, record, record_length);
+    }
+    for (offset = 0; offset < n_lines * record_length; offset += record_length)
+    {
+        assert_int_equal(GetCsvLineLength(big + offset, n_lines * record_length - offset),
+                         record_length);
+    }
+    free(big);
+}
+
+static void assert_fields(CsvReader *reader, size_t n, const char *const *expected)
+{
+    assert_int_equal(CsvReaderFieldCount(reader), n);
+    const CsvField *fields = CsvReaderFields(reader);
+    for (size_t i = 0; i < n; i++)
+    {
+        assert_int_equal(fields[i].length, strlen(expected[i]));
+        assert_memory_equal(fields[i].data, expected[i], fields[i].length);
+    }
+}
+
+static void test_csv_reader()
+{
+    const char data[] =
+        "field_1, field_2\r\n"
+        "field_1, \"value1 \nvalue2\"\r\n"
+        "\"a \"\"quoted\"\" value\" , \"\",\r\n"
+        "\r\n"
+        "bad\"fie\"ld,x\r\n"
+        "last";
+
+    CsvReader *reader = CsvReaderNew(data, strlen(data), ',', CSV_LINE_ENDING_CRLF);
+
+    assert_int_equal(CsvReaderNextRecord(reader), CSV_READER_OK);
+    assert_fields(reader, 2, (const char *[]) { "field_1", " field_2" });
+    assert_int_equal(CsvReaderOffset(reader), 18);
+
+    assert_int_equal(CsvReaderNextRecord(reader), CSV_READER_OK);
+    assert_fields(reader, 2, (const char *[]) { "field_1", "value1 \nvalue2" });
+
+    assert_int_equal(CsvReaderNextRecord(reader), CSV_READER_OK);
+    assert_fields(reader, 3, (const char *[]) { "a \"quoted\" value", "", "" });
+
+    assert_int_equal(CsvReaderNextRecord(reader), CSV_READER_OK);
+    assert_fields(reader, 1, (const char *[]) { "" });
+
+    assert_int_equal(CsvReaderNextRecord(reader), CSV_READER_MALFORMED);
+    assert_int_equal(CsvReaderRecordNumber(reader), 5);
+
+    assert_int_equal(CsvReaderNextRecord(reader), CSV_READER_OK);
+    assert_fields(reader, 1, (const char *[]) { "last" });
+
+    assert_int_equal(CsvReaderNextRecord(reader), CSV_READER_EOF);
+    assert_int_equal(CsvReaderOffset(reader), strlen(data));
+    CsvReaderDestroy(reader);
+
+    /* Same fields as SeqParseCsvString() */
+    const char line[] = ",Null is not empty string,,\"\",\"\"";
+    reader = CsvReaderNew(line, strlen(line), ',', CSV_LINE_ENDING_CRLF);
+    assert_int_equal(CsvReaderNextRecord(reader), CSV_READER_OK);
+    Seq *list = SeqParseCsvString(line);
+    assert_int_equal(CsvReaderFieldCount(reader), SeqLength(list));
+    assert_fields(reader, SeqLength(list), (const char *const *) list->data);
+    SeqDestroy(list);
+    CsvReaderDestroy(reader);
+}
+
+static void test_csv_reader_lf()
+{
+    const char data[] = "a;b\nc;\"d\nd\";e\r\n\n";
+    CsvReader *reader = CsvReaderNew(data, strlen(data), ';', CSV_LINE_ENDING_LF);
+
+    assert_int_equal(CsvReaderNextRecord(reader), CSV_READER_OK);
+    assert_fields(reader, 2, (const char *[]) { "a", "b" });
+    assert_int_equal(CsvReaderNextRecord(reader), CSV_READER_OK);
+    assert_fields(reader, 3, (const char *[]) { "c", "d\nd", "e" });
+    assert_int_equal(CsvReaderNextRecord(reader), CSV_READER_OK);
+    assert_fields(reader, 1, (const char *[]) { "" });
+    assert_int_equal(CsvReaderNextRecord(reader), CSV_READER_EOF);
+    CsvReaderDestroy(reader);
+
+    /* In CRLF mode, the LFs are data */
+    reader = CsvReaderNew(data, strlen(data), ';', CSV_LINE_ENDING_CRLF);
+    assert_int_equal(CsvReaderNextRecord(reader), CSV_READER_OK);
+    assert_fields(reader, 4, (const char *[]) { "a", "b\nc", "d\nd", "e" });
+    assert_int_equal(CsvReaderNextRecord(reader), CSV_READER_OK);
+    assert_fields(reader, 1, (const char *[]) { "\n" });
+    assert_int_equal(CsvReaderNextRecord(reader), CSV_READER_EOF);
+    CsvReaderDestroy(reader);
+}
+
+static void test_csv_reader_fd()
+{
+    /* Enough data for the records to cross read buffer boundaries */
+    const size_t n_records = 50000;
+    char path[] = "/tmp/csv_parser_testXXXXXX";
+    int fd = mkstemp(path);
+    assert_true(fd >= 0);
+    FILE *fp = fdopen(fd, "w");
+    assert_true(fp != NULL);
+    for (size_t i = 0; i < n_records; i++)
+    {
+        fprintf(fp, "%zu,\"quoted \"\"%zu\"\"\"\r\n", i, i);
+    }
+    assert_int_equal(fclose(fp), 0);
+
+    fd = open(path, O_RDONLY);
+    assert_true(fd >= 0);
+    CsvReader *reader = CsvReaderNewFromFd(fd, ',', CSV_LINE_ENDING_CRLF);
+    for (size_t i = 0; i < n_records; i++)
+    {
+        char first[32], second[64];
+        snprintf(first, sizeof(first), "%zu", i);
+        snprintf(second, sizeof(second), "quoted \"%zu\"", i);
+
+        assert_int_equal(CsvReaderNextRecord(reader), CSV_READER_OK);
+        assert_fields(reader, 2, (const char *[]) { first, second });
+    }
+    assert_int_equal(CsvReaderNextRecord(reader), CSV_READER_EOF);
+
+    struct stat sb;
+    assert_int_equal(fstat(fd, &sb), 0);
+    assert_int_equal(CsvReaderOffset(reader), sb.st_size);
+
+    CsvReaderDestroy(reader);
+    close(fd);
+    unlink(path);
+}
+
+static void test_csv_reader_no_quotes()
+{
+    /* Records are found without looking beyond their line, big inputs
+     * without quotes are read in linear time */
+    const size_t n_records = 200000;
+    Writer *w = StringWriter();
+    for (size_t i = 0; i < n_records; i++)
+    {
+        WriterWriteF(w, "%zu,field_2,field_3\n", i);
+    }
+    const size_t length = StringWriterLength(w);
+    char *data = StringWriterClose(w);
+
+    CsvReader *reader = CsvReaderNew(data, length, ',', CSV_LINE_ENDING_LF);
+    for (size_t i = 0; i < n_records; i++)
+    {
+        char first[32];
+        snprintf(first, sizeof(first), "%zu", i);
+
+        assert_int_equal(CsvReaderNextRecord(reader), CSV_READER_OK);
+        assert_fields(reader, 3, (const char *[]) { first, "field_2", "field_3" });
+    }
+    assert_int_equal(CsvReaderNextRecord(reader), CSV_READER_EOF);
+    assert_int_equal(CsvReaderOffset(reader), length);
+    CsvReaderDestroy(reader);
+
+    /* In CRLF mode the whole input is one record, found in one pass */
+    reader = CsvReaderNew(data, length, ',', CSV_LINE_ENDING_CRLF);
+    assert_int_equal(CsvReaderNextRecord(reader), CSV_READER_OK);
+    assert_int_equal(CsvReaderFieldCount(reader), 2 * n_records + 1);
+    assert_int_equal(CsvReaderNextRecord(reader), CSV_READER_EOF);
+    CsvReaderDestroy(reader);
+
+    free(data);
+}
+
 int main()
 {
     PRINT_TEST_BANNER();
@@ -318,6 +520,11 @@ int main()
         unit_test(test_new_csv_reader_lfln_at_end3),
         unit_test(test_get_next_line),
         unit_test(test_get_next_line_edge_cases),
+        unit_test(test_get_line_length),
+        unit_test(test_csv_reader),
+        unit_test(test_csv_reader_lf),
+        unit_test(test_csv_reader_fd),
+        unit_test(test_csv_reader_no_quotes),
         unit_test(test_new_csv_reader_zd3151_ENT3023),
         unit_test(test_new_csv_reader_carriage_return),
     };
@@ -0,0 +1,180 @@
+#include <test.h>
+
+#include <dir_list.h>
+#include <misc_lib.h>           /* xsnprintf */
+#include <string_lib.h>
+#include <set.h>
+#include <alloc.h>
+
+/* More entries than one getdents64() call returns */
+#define MANY_FILES 3000
+
+static char TEMP_DIR[] = "/tmp/dir_list_testXXXXXX";
+
+static void CreateFile(const char *name, size_t size)
+{
+    char path[PATH_MAX];
+    xsnprintf(path, sizeof(path), "%s/%s", TEMP_DIR, name);
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0640);
+    assert_true(fd >= 0);
+    assert_int_equal(ftruncate(fd, size), 0);
+    close(fd);
+}
+
+static void CreateTree(void)
+{
+    char path[PATH_MAX];
+    CreateFile("small", 10);
+    CreateFile("big", 5000);
+    xsnprintf(path, sizeof(path), "%s/sub", TEMP_DIR);
+    assert_int_equal(mkdir(path, 0700), 0);
+    xsnprintf(path, sizeof(path), "%s/link", TEMP_DIR);
+    assert_int_equal(symlink("small", path), 0);
+
+    for (int i = 0; i < MANY_FILES; i++)
+    {
+        char name[64];
+        xsnprintf(name, sizeof(name), "file_with_a_longer_name_%04d", i);
+        CreateFile(name, i);
+    }
+}
+
+static void RemoveTree(void)
+{
+    DirList *list = DirListRead(TEMP_DIR, DIR_LIST_TYPE);
+    assert_true(list != NULL);
+    for (size_t i = 0; i < list->count; i++)
+    {
+        char path[PATH_MAX];
+        xsnprintf(path, sizeof(path), "%s/%s", TEMP_DIR, list->entries[i].name);
+        if (S_ISDIR(list->entries[i].mode))
+        {
+            rmdir(path);
+        }
+        else
+        {
+            unlink(path);
+        }
+    }
+    DirListDestroy(list);
+    rmdir(TEMP_DIR);
+}
+
+static void test_names(void)
+{
+    DirList *list = DirListRead(TEMP_DIR, 0);
+    assert_true(list != NULL);
+    assert_int_equal(list->count, MANY_FILES + 4);
+
+    StringSet *names = StringSetNew();
+    for (size_t i = 0; i < list->count; i++)
+    {
+        const DirListEntry *entry = &list->entries[i];
+        assert_false(StringEqual(entry->name, "."));
+        assert_false(StringEqual(entry->name, ".."));
+        StringSetAdd(names, xstrdup(entry->name));
+
+        /* nothing was asked for, but the type may come for free */
+        assert_true((entry->fields & ~DIR_LIST_TYPE) == 0);
+    }
+    assert_int_equal(StringSetSize(names), MANY_FILES + 4);
+    assert_true(StringSetContains(names, "small"));
+    assert_true(StringSetContains(names, "file_with_a_longer_name_2999"));
+
+    StringSetDestroy(names);
+    DirListDestroy(list);
+}
+
+static void test_fields(void)
+{
+    const unsigned requests[] = {
+        DIR_LIST_TYPE, DIR_LIST_SIZE, DIR_LIST_MTIME | DIR_LIST_OWNER, DIR_LIST_ALL
+    };
+
+    for (size_t r = 0; r < sizeof(requests) / sizeof(requests[0]); r++)
+    {
+        const unsigned fields = requests[r];
+        DirList *list = DirListRead(TEMP_DIR, fields);
+        assert_true(list != NULL);
+        assert_int_equal(list->count, MANY_FILES + 4);
+
+        for (size_t i = 0; i < list->count; i++)
+        {
+            const DirListEntry *entry = &list->entries[i];
+            assert_true((entry->fields & fields) == fields);
+
+            char path[PATH_MAX];
+            xsnprintf(path, sizeof(path), "%s/%s", TEMP_DIR, entry->name);
+            struct stat sb;
+            assert_int_equal(lstat(path, &sb), 0);
+
+            if (fields & DIR_LIST_MODE)
+            {
+                assert_int_equal(entry->mode, sb.st_mode);
+            }
+            else if (entry->fields & DIR_LIST_TYPE)
+            {
+                assert_int_equal(entry->mode, sb.st_mode & S_IFMT);
+            }
+            if (fields & DIR_LIST_SIZE)
+            {
+                assert_int_equal(entry->size, sb.st_size);
+            }
+            if (fields & DIR_LIST_MTIME)
+            {
+                assert_int_equal(entry->mtime, sb.st_mtime);
+            }
+            if (fields & DIR_LIST_OWNER)
+            {
+                assert_int_equal(entry->uid, sb.st_uid);
+                assert_int_equal(entry->gid, sb.st_gid);
+            }
+            if (fields & DIR_LIST_INODE)
+            {
+                assert_int_equal(entry->dev, sb.st_dev);
+                assert_int_equal(entry->ino, sb.st_ino);
+            }
+        }
+
+        DirListDestroy(list);
+    }
+}
+
+static void test_errors(void)
+{
+    char path[PATH_MAX];
+    xsnprintf(path, sizeof(path), "%s/missing", TEMP_DIR);
+    assert_true(DirListRead(path, DIR_LIST_ALL) == NULL);
+    assert_int_equal(errno, ENOENT);
+
+    xsnprintf(path, sizeof(path), "%s/small", TEMP_DIR);
+    assert_true(DirListRead(path, 0) == NULL);
+    assert_int_equal(errno, ENOTDIR);
+
+    /* an empty directory */
+    xsnprintf(path, sizeof(path), "%s/sub/", TEMP_DIR);
+    DirList *list = DirListRead(path, DIR_LIST_ALL);
+    assert_true(list != NULL);
+    assert_int_equal(list->count, 0);
+    DirListDestroy(list);
+
+    DirListDestroy(NULL);
+}
+
+int main()
+{
+    assert_true(mkdtemp(TEMP_DIR) != NULL);
+    CreateTree();
+
+    PRINT_TEST_BANNER();
+    const UnitTest tests[] =
+    {
+        unit_test(test_names),
+        unit_test(test_fields),
+        unit_test(test_errors),
+    };
+
+    int ret = run_tests(tests);
+    RemoveTree();
+    return ret;
+}
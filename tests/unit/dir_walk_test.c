@@ -0,0 +1,288 @@
+#include <test.h>
+
+#include <dir_walk.h>
+#include <file_lib.h>
+#include <misc_lib.h>           /* xsnprintf */
+#include <string_lib.h>
+#include <alloc.h>
+
+static char TEMP_DIR[] = "/tmp/dir_walk_testXXXXXX";
+
+static void CreateFile(const char *dir, const char *name)
+{
+    char path[PATH_MAX];
+    xsnprintf(path, sizeof(path), "%s/%s", dir, name);
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    assert_true(fd >= 0);
+    close(fd);
+}
+
+static void CreateDir(const char *dir, const char *name)
+{
+    char path[PATH_MAX];
+    xsnprintf(path, sizeof(path), "%s/%s", dir, name);
+    assert_int_equal(mkdir(path, 0755), 0);
+}
+
+/*
+ * TEMP_DIR/
+ *   f0
+ *   a/
+ *     f1
+ *     f2.txt
+ *     b/
+ *       f3.txt
+ *       c/
+ *   d/
+ *   link -> a
+ */
+static void CreateTree(void)
+{
+    char path[PATH_MAX];
+    CreateFile(TEMP_DIR, "f0");
+    CreateDir(TEMP_DIR, "a");
+    CreateFile(TEMP_DIR, "a/f1");
+    CreateFile(TEMP_DIR, "a/f2.txt");
+    CreateDir(TEMP_DIR, "a/b");
+    CreateFile(TEMP_DIR, "a/b/f3.txt");
+    CreateDir(TEMP_DIR, "a/b/c");
+    CreateDir(TEMP_DIR, "d");
+    xsnprintf(path, sizeof(path), "%s/link", TEMP_DIR);
+    assert_int_equal(symlink("a", path), 0);
+}
+
+typedef struct
+{
+    pthread_mutex_t lock;
+    Seq *visits;                /* "pre:a/b" and "post:a/b", relative to TEMP_DIR */
+    const char *skip;
+    const char *stop;
+    bool check_stat;
+} Visits;
+
+static DirWalkAction Visit(const DirWalkEntry *entry, Visits *visits, const char *kind)
+{
+    const size_t root_len = strlen(TEMP_DIR) + 1;
+    assert_true(StringStartsWith(entry->path, TEMP_DIR));
+    assert_true(StringEndsWith(entry->path, entry->name));
+
+    const char *relative = entry->path + root_len;
+    size_t depth = 1;
+    for (const char *c = relative; *c != '\0'; c++)
+    {
+        depth += (*c == '/') ? 1 : 0;
+    }
+    assert_int_equal(depth, entry->depth);
+
+    if (visits->check_stat)
+    {
+        assert_true(entry->sb != NULL);
+        switch (entry->type)
+        {
+        case DIR_WALK_TYPE_DIR:
+            assert_true(S_ISDIR(entry->sb->st_mode));
+            break;
+        case DIR_WALK_TYPE_FILE:
+            assert_true(S_ISREG(entry->sb->st_mode));
+            break;
+        case DIR_WALK_TYPE_SYMLINK:
+            assert_true(S_ISLNK(entry->sb->st_mode));
+            break;
+        default:
+            fail();
+        }
+    }
+    else
+    {
+        assert_true(entry->sb == NULL);
+    }
+
+    char *visit = StringFormat("%s:%s", kind, relative);
+    pthread_mutex_lock(&visits->lock);
+    SeqAppend(visits->visits, visit);
+    pthread_mutex_unlock(&visits->lock);
+
+    if (visits->skip != NULL && StringEqual(relative, visits->skip))
+    {
+        return DIR_WALK_SKIP;
+    }
+    if (visits->stop != NULL && StringEqual(relative, visits->stop))
+    {
+        return DIR_WALK_STOP;
+    }
+    return DIR_WALK_CONTINUE;
+}
+
+static DirWalkAction VisitPre(const DirWalkEntry *entry, void *data)
+{
+    return Visit(entry, data, "pre");
+}
+
+static DirWalkAction VisitPost(const DirWalkEntry *entry, void *data)
+{
+    assert_int_equal(entry->type, DIR_WALK_TYPE_DIR);
+    return Visit(entry, data, "post");
+}
+
+static ssize_t VisitIndex(const Visits *visits, const char *visit)
+{
+    return SeqIndexOf(visits->visits, visit, StrCmpWrapper);
+}
+
+static void AssertBefore(const Visits *visits, const char *first, const char *second)
+{
+    const ssize_t a = VisitIndex(visits, first);
+    const ssize_t b = VisitIndex(visits, second);
+    assert_true(a >= 0);
+    assert_true(b >= 0);
+    assert_true(a < b);
+}
+
+static void Walk(Visits *visits, DirWalkOptions *options, bool expected)
+{
+    pthread_mutex_init(&visits->lock, NULL);
+    visits->visits = SeqNew(20, free);
+    options->pre = VisitPre;
+    options->post = VisitPost;
+    options->data = visits;
+    options->stat = visits->check_stat;
+    assert_int_equal(DirWalk(TEMP_DIR, options), expected);
+    pthread_mutex_destroy(&visits->lock);
+}
+
+static void test_walk(void)
+{
+    for (size_t threads = 0; threads <= 4; threads += 4)
+    {
+        for (int check_stat = 0; check_stat < 2; check_stat++)
+        {
+            Visits visits = { .check_stat = check_stat };
+            DirWalkOptions options = { .threads = threads };
+            Walk(&visits, &options, true);
+
+            const char *expected[] = {
+                "pre:f0", "pre:a", "pre:a/f1", "pre:a/f2.txt", "pre:a/b",
+                "pre:a/b/f3.txt", "pre:a/b/c", "pre:d", "pre:link",
+                "post:a", "post:a/b", "post:a/b/c", "post:d",
+            };
+            assert_int_equal(SeqLength(visits.visits), sizeof(expected) / sizeof(expected[0]));
+            for (size_t i = 0; i < sizeof(expected) / sizeof(expected[0]); i++)
+            {
+                assert_true(VisitIndex(&visits, expected[i]) >= 0);
+            }
+
+            /* directories before and after their contents */
+            AssertBefore(&visits, "pre:a", "pre:a/f1");
+            AssertBefore(&visits, "pre:a/b", "pre:a/b/c");
+            AssertBefore(&visits, "post:a/b/c", "post:a/b");
+            AssertBefore(&visits, "pre:a/b/f3.txt", "post:a/b");
+            AssertBefore(&visits, "post:a/b", "post:a");
+            AssertBefore(&visits, "pre:a/f2.txt", "post:a");
+
+            SeqDestroy(visits.visits);
+        }
+    }
+}
+
+static void test_walk_depth_skip_stop(void)
+{
+    Visits visits = { 0 };
+    DirWalkOptions options = { .max_depth = 1 };
+    Walk(&visits, &options, true);
+    assert_int_equal(SeqLength(visits.visits), 4);
+    assert_true(VisitIndex(&visits, "pre:a") >= 0);
+    assert_true(VisitIndex(&visits, "post:a") < 0);
+    SeqDestroy(visits.visits);
+
+    visits = (Visits) { .skip = "a/b" };
+    options = (DirWalkOptions) { 0 };
+    Walk(&visits, &options, true);
+    assert_true(VisitIndex(&visits, "pre:a/b") >= 0);
+    assert_true(VisitIndex(&visits, "pre:a/b/c") < 0);
+    assert_true(VisitIndex(&visits, "post:a/b") < 0);
+    assert_true(VisitIndex(&visits, "post:a") >= 0);
+    SeqDestroy(visits.visits);
+
+    visits = (Visits) { .stop = "a/b" };
+    Walk(&visits, &options, false);
+    assert_true(VisitIndex(&visits, "pre:a/b/c") < 0);
+    assert_true(VisitIndex(&visits, "post:a") < 0);
+    SeqDestroy(visits.visits);
+
+    char missing[PATH_MAX];
+    xsnprintf(missing, sizeof(missing), "%s/missing", TEMP_DIR);
+    assert_false(DirWalk(missing, &options));
+    assert_int_equal(errno, ENOENT);
+}
+
+static void test_list_dir(void)
+{
+    /* "." and ".." are listed, like readdir() does */
+    Seq *list = ListDir(TEMP_DIR, NULL);
+    assert_true(list != NULL);
+    assert_int_equal(SeqLength(list), 6);
+    char path[PATH_MAX];
+    xsnprintf(path, sizeof(path), "%s/..", TEMP_DIR);
+    assert_true(SeqLookup(list, path, StrCmpWrapper) != NULL);
+    SeqDestroy(list);
+
+
+    xsnprintf(path, sizeof(path), "%s/a/", TEMP_DIR);
+    list = ListDir(path, ".txt");
+    assert_true(list != NULL);
+    assert_int_equal(SeqLength(list), 1);
+    xsnprintf(path, sizeof(path), "%s/a/f2.txt", TEMP_DIR);
+    assert_string_equal(SeqAt(list, 0), path);
+    SeqDestroy(list);
+
+    xsnprintf(path, sizeof(path), "%s/missing", TEMP_DIR);
+    assert_true(ListDir(path, NULL) == NULL);
+}
+
+static void test_delete_directory_tree(void)
+{
+    /* enough subtrees for several threads */
+    char path[PATH_MAX];
+    for (int i = 0; i < 20; i++)
+    {
+        xsnprintf(path, sizeof(path), "%s/a/b/c/%d", TEMP_DIR, i);
+        assert_int_equal(mkdir(path, 0755), 0);
+        CreateDir(path, "sub");
+        for (int j = 0; j < 50; j++)
+        {
+            char name[32];
+            xsnprintf(name, sizeof(name), "sub/%d", j);
+            CreateFile(path, name);
+        }
+    }
+
+    assert_true(DeleteDirectoryTree(TEMP_DIR));
+
+    /* only the contents are removed, and not what the symlink points to */
+    Seq *list = ListDir(TEMP_DIR, NULL);
+    assert_true(list != NULL);
+    assert_int_equal(SeqLength(list), 2);
+    SeqDestroy(list);
+
+    xsnprintf(path, sizeof(path), "%s/missing", TEMP_DIR);
+    assert_true(DeleteDirectoryTree(path));
+}
+
+int main()
+{
+    assert_true(mkdtemp(TEMP_DIR) != NULL);
+    CreateTree();
+
+    PRINT_TEST_BANNER();
+    const UnitTest tests[] =
+    {
+        unit_test(test_walk),
+        unit_test(test_walk_depth_skip_stop),
+        unit_test(test_list_dir),
+        unit_test(test_delete_directory_tree),
+    };
+
+    int ret = run_tests(tests);
+    rmdir(TEMP_DIR);
+    return ret;
+}
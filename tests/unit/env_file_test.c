@@ -1,5 +1,6 @@
 #include <test.h>
 #include <misc_lib.h>                       // xsnprintf()
+#include <sys/wait.h>                       // waitpid()
 
 
 #include <json-utils.c>
@@ -180,6 +181,67 @@ static void test_filtered_copy(void)
     filter_expect_null(" \" ");
 }
 
+/* Write #line to the FIFO at #path over and over, until the reader goes away */
+static pid_t FeedFifo(const char *path, const char *line)
+{
+    pid_t pid = fork();
+    assert_true(pid >= 0);
+    if (pid == 0)
+    {
+        const size_t length = strlen(line);
+        int fd = open(path, O_WRONLY);
+        while (fd >= 0 && write(fd, line, length) == (ssize_t) length)
+        {
+        }
+        _exit(0);
+    }
+    return pid;
+}
+
+static void test_size_max(void)
+{
+    char dir[] = "/tmp/env_file_test.XXXXXX";
+    assert_true(mkdtemp(dir) != NULL);
+    char path[PATH_MAX];
+    xsnprintf(path, sizeof(path), "%s/env", dir);
+
+    FILE *fp = fopen(path, "w");
+    assert_true(fp != NULL);
+    fputs("A=1\nB=2\nC=3\n", fp);
+    assert_int_equal(fclose(fp), 0);
+
+    /* Lines cut off by the limit are not parsed */
+    const size_t limits[] = { 8, 9, 11 };
+    for (size_t i = 0; i < sizeof(limits) / sizeof(limits[0]); i++)
+    {
+        JsonElement *json = NULL;
+        assert_true(JsonParseEnvFile(path, limits[i], &json));
+        assert_int_equal(JsonLength(json), 2);
+        assert_string_equal(JsonObjectGetAsString(json, "B"), "2");
+        JsonDestroy(json);
+    }
+
+    JsonElement *json = NULL;
+    assert_true(JsonParseEnvFile(path, 12, &json));
+    assert_int_equal(JsonLength(json), 3);
+    JsonDestroy(json);
+    unlink(path);
+
+    /* No more than the limit is read from a stream which does not end */
+    assert_int_equal(mkfifo(path, 0600), 0);
+    pid_t pid = FeedFifo(path, "KEY=VALUE\n");
+    alarm(60);
+    assert_true(JsonParseEnvFile(path, 1000, &json));
+    alarm(0);
+    assert_int_equal(JsonLength(json), 1);
+    assert_string_equal(JsonObjectGetAsString(json, "KEY"), "VALUE");
+    JsonDestroy(json);
+
+    assert_int_equal(waitpid(pid, NULL, 0), pid);
+    unlink(path);
+    rmdir(dir);
+}
+
 int main()
 {
     PRINT_TEST_BANNER();
@@ -188,6 +250,7 @@ int main()
     {
         unit_test(test_filtered_copy),
         unit_test(test_ParseEnvLine),
+        unit_test(test_size_max),
     };
 
     int ret = run_tests(tests);
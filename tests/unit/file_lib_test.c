@@ -26,6 +26,7 @@
 
 #include <definitions.h>
 #include <file_lib.h>
+#include <alloc.h>
 #include <stdbool.h>
 
 #define TEMP_DIR "/tmp/file_lib_test"
@@ -1571,6 +1572,161 @@ static void test_file_copy(void)
     return_to_test_dir();
 }
 
+static void fill_pattern(char *buf, size_t len, size_t seed)
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        buf[i] = (char) ('a' + (i + seed) % 26);
+    }
+}
+
+static void assert_files_equal(const char *path1, const char *path2)
+{
+    struct stat sb1, sb2;
+    assert_int_equal(stat(path1, &sb1), 0);
+    assert_int_equal(stat(path2, &sb2), 0);
+    assert_int_equal(sb1.st_size, sb2.st_size);
+
+    /* Not FileRead(), the files may contain '\0'. */
+    char *data1 = xmalloc(sb1.st_size + 1);
+    char *data2 = xmalloc(sb2.st_size + 1);
+    int fd1 = safe_open(path1, O_RDONLY);
+    int fd2 = safe_open(path2, O_RDONLY);
+    assert_true(fd1 >= 0 && fd2 >= 0);
+    assert_int_equal(FullRead(fd1, data1, sb1.st_size + 1), sb1.st_size);
+    assert_int_equal(FullRead(fd2, data2, sb2.st_size + 1), sb2.st_size);
+    assert_memory_equal(data1, data2, sb1.st_size);
+    close(fd1);
+    close(fd2);
+    free(data1);
+    free(data2);
+}
+
+static void test_file_copy_large(void)
+{
+    setup_tempfiles();
+
+    /* Bigger than the copy buffer, and not a multiple of it. */
+    const size_t size = 3 * 1024 * 1024 + 123;
+    char *data = xmalloc(size);
+    fill_pattern(data, size, 0);
+
+    int fd = safe_open_create_perms("large_file", O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    assert_true(fd >= 0);
+    assert_int_equal(FullWrite(fd, data, size), size);
+    close(fd);
+
+    assert_true(File_Copy("large_file", "large_file.copy"));
+    assert_files_equal("large_file", "large_file.copy");
+
+    assert_int_equal(unlink("large_file"), 0);
+    assert_int_equal(unlink("large_file.copy"), 0);
+    free(data);
+
+    return_to_test_dir();
+}
+
+static void test_file_copy_pseudo_file(void)
+{
+#ifdef __linux__
+    setup_tempfiles();
+
+    /* procfs reports size 0 and copy_file_range() copies nothing from it,
+     * the data must be copied with read() instead */
+    assert_true(File_Copy("/proc/self/status", "status.copy"));
+
+    int fd = safe_open("status.copy", O_RDONLY);
+    assert_true(fd >= 0);
+    char data[5];
+    assert_int_equal(read(fd, data, sizeof(data)), sizeof(data));
+    assert_memory_equal(data, "Name:", sizeof(data));
+    close(fd);
+
+    assert_int_equal(unlink("status.copy"), 0);
+
+    return_to_test_dir();
+#endif
+}
+
+static void test_file_sparse_copy(void)
+{
+    setup_tempfiles();
+
+    /* data, 1 MiB hole, data, 2 MiB of written zeroes, data, trailing hole */
+    char data[10000];
+    fill_pattern(data, sizeof(data), 7);
+
+    int fd = safe_open_create_perms("sparse_file", O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    assert_true(fd >= 0);
+    assert_int_equal(FullWrite(fd, data, sizeof(data)), sizeof(data));
+    assert_true(lseek(fd, 1024 * 1024, SEEK_CUR) != (off_t) -1);
+    assert_int_equal(FullWrite(fd, data, sizeof(data)), sizeof(data));
+    char *zeroes = xcalloc(1, 2 * 1024 * 1024);
+    assert_int_equal(FullWrite(fd, zeroes, 2 * 1024 * 1024), 2 * 1024 * 1024);
+    free(zeroes);
+    assert_int_equal(FullWrite(fd, data, 100), 100);
+    assert_int_equal(ftruncate(fd, 5 * 1024 * 1024), 0);
+    close(fd);
+
+    int sd = safe_open("sparse_file", O_RDONLY);
+    assert_true(sd >= 0);
+    int dd = safe_open_create_perms("sparse_file.copy", O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    assert_true(dd >= 0);
+
+    size_t total_bytes_written;
+    bool last_write_was_hole;
+    assert_true(FileSparseCopy(sd, "sparse_file", dd, "sparse_file.copy", 4096,
+                               &total_bytes_written, &last_write_was_hole));
+    assert_int_equal(total_bytes_written, 5 * 1024 * 1024);
+    assert_true(last_write_was_hole);
+    assert_true(FileSparseClose(dd, "sparse_file.copy", false,
+                                total_bytes_written, last_write_was_hole));
+    close(sd);
+
+    assert_files_equal("sparse_file", "sparse_file.copy");
+
+    /* Holes are not written. */
+    struct stat sb;
+    assert_int_equal(stat("sparse_file.copy", &sb), 0);
+    assert_true((size_t) sb.st_blocks * 512 < 5 * 1024 * 1024);
+
+    assert_int_equal(unlink("sparse_file"), 0);
+    assert_int_equal(unlink("sparse_file.copy"), 0);
+
+    return_to_test_dir();
+}
+
+static void test_file_sparse_write(void)
+{
+    setup_tempfiles();
+
+    int fd = safe_open_create_perms("sparse_file", O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    assert_true(fd >= 0);
+
+    char buf[4096 + 3] = { 0 };
+    bool wrote_hole = false;
+
+    /* Zeroes at every alignment are holes, a single non-zero byte is not. */
+    for (size_t offset = 0; offset < 3; offset++)
+    {
+        assert_true(FileSparseWrite(fd, buf + offset, 4096, &wrote_hole));
+        assert_true(wrote_hole);
+
+        buf[offset + 4095] = 'x';
+        assert_true(FileSparseWrite(fd, buf + offset, 4096, &wrote_hole));
+        assert_false(wrote_hole);
+        buf[offset + 4095] = '\0';
+    }
+    assert_true(FileSparseClose(fd, "sparse_file", false, 6 * 4096, wrote_hole));
+
+    struct stat sb;
+    assert_int_equal(stat("sparse_file", &sb), 0);
+    assert_int_equal(sb.st_size, 6 * 4096);
+    assert_int_equal(unlink("sparse_file"), 0);
+
+    return_to_test_dir();
+}
+
 static void test_file_copy_to_dir(void)
 {
     setup_tempfiles();
@@ -1614,6 +1770,169 @@ static void test_file_read(void)
     return_to_test_dir();
 }
 
+static void test_file_map(void)
+{
+    setup_tempfiles();
+
+    {
+        bool truncated = true;
+        FileMapping *map = FileMap(TEST_FILE, 1024, &truncated);
+        assert_true(map != NULL);
+        assert_false(truncated);
+        assert_int_equal(FileMappingLength(map), strlen(TEST_STRING));
+        assert_string_equal(FileMappingData(map), TEST_STRING);
+        FileUnmap(map);
+    }
+
+    {
+        bool truncated = false;
+        FileMapping *map = FileMap(TEST_FILE, 4, &truncated);
+        assert_true(map != NULL);
+        assert_true(truncated);
+        assert_int_equal(FileMappingLength(map), 4);
+        assert_string_equal(FileMappingData(map), "BLUE");
+        FileUnmap(map);
+    }
+
+    assert_true(FileMap("no_such_file", 1024, NULL) == NULL);
+
+    /* A file filling whole pages must still be followed by a '\0' */
+    {
+        const size_t length = 4 * 4096;
+        char *buf = xmalloc(length);
+        fill_pattern(buf, length, 0);
+        int fd = safe_open_create_perms("mapped_file", O_WRONLY | O_CREAT | O_TRUNC, 0600);
+        assert_true(fd >= 0);
+        assert_int_equal(FullWrite(fd, buf, length), length);
+        assert_int_equal(close(fd), 0);
+
+        /* Just written files are read rather than mapped */
+        const time_t then = time(NULL) - 60;
+        const struct utimbuf times = { .actime = then, .modtime = then };
+        assert_int_equal(utime("mapped_file", &times), 0);
+
+        FileMapping *map = FileMap("mapped_file", length, NULL);
+        assert_true(map != NULL);
+#ifdef HAVE_MMAP
+        assert_true(FileMappingIsMapped(map));
+#endif
+        assert_int_equal(FileMappingLength(map), length);
+        assert_memory_equal(FileMappingData(map), buf, length);
+        assert_int_equal(FileMappingData(map)[length], '\0');
+        FileUnmap(map);
+
+        free(buf);
+        assert_int_equal(unlink("mapped_file"), 0);
+    }
+
+    /* Files which may be being written are read rather than mapped */
+    {
+        int fd = safe_open_create_perms("busy_file", O_RDWR | O_CREAT | O_TRUNC, 0600);
+        assert_true(fd >= 0);
+        assert_int_equal(FullWrite(fd, TEST_STRING, strlen(TEST_STRING)),
+                         strlen(TEST_STRING));
+
+        FileMapping *map = FileMap("busy_file", 1024, NULL);
+        assert_true(map != NULL);
+        assert_false(FileMappingIsMapped(map));
+        assert_string_equal(FileMappingData(map), TEST_STRING);
+        FileUnmap(map);
+
+        const time_t then = time(NULL) - 60;
+        const struct utimbuf times = { .actime = then, .modtime = then };
+        assert_int_equal(utime("busy_file", &times), 0);
+
+        /* Locks of our own process are not reported, hold one in a child */
+        int ready[2];
+        assert_int_equal(pipe(ready), 0);
+        const pid_t child = fork();
+        assert_true(child >= 0);
+        if (child == 0)
+        {
+            struct flock lock_spec = {
+                .l_type = F_WRLCK,
+                .l_whence = SEEK_SET,
+            };
+            const char c = (fcntl(fd, F_SETLK, &lock_spec) == 0) ? 'y' : 'n';
+            if (write(ready[1], &c, 1) != 1)
+            {
+                _exit(1);
+            }
+            pause();
+            _exit(0);
+        }
+        char c;
+        assert_int_equal(read(ready[0], &c, 1), 1);
+        assert_int_equal(c, 'y');
+
+        map = FileMap("busy_file", 1024, NULL);
+        assert_true(map != NULL);
+        assert_false(FileMappingIsMapped(map));
+        assert_string_equal(FileMappingData(map), TEST_STRING);
+        FileUnmap(map);
+
+        assert_int_equal(kill(child, SIGKILL), 0);
+        assert_int_equal(waitpid(child, NULL, 0), child);
+        close(ready[0]);
+        close(ready[1]);
+
+        map = FileMap("busy_file", 1024, NULL);
+        assert_true(map != NULL);
+#ifdef HAVE_MMAP
+        assert_true(FileMappingIsMapped(map));
+#endif
+        assert_string_equal(FileMappingData(map), TEST_STRING);
+        FileUnmap(map);
+
+        assert_int_equal(close(fd), 0);
+        assert_int_equal(unlink("busy_file"), 0);
+    }
+
+    /* Empty files and pipes are not mapped, but still readable */
+    {
+        int fd = safe_open_create_perms("empty_file", O_WRONLY | O_CREAT | O_TRUNC, 0600);
+        assert_true(fd >= 0);
+        assert_int_equal(close(fd), 0);
+
+        FileMapping *map = FileMap("empty_file", 1024, NULL);
+        assert_true(map != NULL);
+        assert_int_equal(FileMappingLength(map), 0);
+        assert_string_equal(FileMappingData(map), "");
+        FileUnmap(map);
+        assert_int_equal(unlink("empty_file"), 0);
+
+        int fds[2];
+        assert_int_equal(pipe(fds), 0);
+        assert_int_equal(FullWrite(fds[1], TEST_STRING, strlen(TEST_STRING)),
+                         strlen(TEST_STRING));
+        assert_int_equal(close(fds[1]), 0);
+
+        map = FileMapFd(fds[0], 1024, NULL);
+        assert_true(map != NULL);
+        assert_false(FileMappingIsMapped(map));
+        assert_string_equal(FileMappingData(map), TEST_STRING);
+        FileUnmap(map);
+        assert_int_equal(close(fds[0]), 0);
+
+        /* Binary data is read whole, '\0' bytes included */
+        static const char binary[] = "a\0b\0c";
+        assert_int_equal(pipe(fds), 0);
+        assert_int_equal(FullWrite(fds[1], binary, sizeof(binary)), sizeof(binary));
+        assert_int_equal(close(fds[1]), 0);
+
+        bool truncated = false;
+        map = FileMapFd(fds[0], 4, &truncated);
+        assert_true(map != NULL);
+        assert_true(truncated);
+        assert_int_equal(FileMappingLength(map), 4);
+        assert_memory_equal(FileMappingData(map), "a\0b\0", 5);
+        FileUnmap(map);
+        assert_int_equal(close(fds[0]), 0);
+    }
+
+    return_to_test_dir();
+}
+
 static void test_read_file_stream_to_buffer(void)
 {
     setup_tempfiles();
@@ -1967,7 +2286,12 @@ int main(int argc, char **argv)
             unit_test(test_file_can_open),
             unit_test(test_file_copy),
             unit_test(test_file_copy_to_dir),
+            unit_test(test_file_copy_large),
+            unit_test(test_file_copy_pseudo_file),
+            unit_test(test_file_sparse_copy),
+            unit_test(test_file_sparse_write),
             unit_test(test_file_read),
+            unit_test(test_file_map),
             unit_test(test_read_file_stream_to_buffer),
             unit_test(test_full_read_write),
             unit_test(test_is_dir_real),
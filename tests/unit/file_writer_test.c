@@ -93,6 +93,210 @@ void test_multiwrite_file_buffer(void)
     assert_int_equal(global_w_closed, true);
 }
 
+/* Everything written to #fd so far, '\0'-terminated */
+static char *ReadBack(int fd, size_t *length)
+{
+    const off_t size = lseek(fd, 0, SEEK_END);
+    assert_true(size >= 0);
+
+    char *data = xcalloc(size + 1, 1);
+    assert_int_equal(pread(fd, data, size, 0), size);
+    *length = size;
+    return data;
+}
+
+void test_fd_writer(void)
+{
+    FILE *f = tmpfile();
+    assert_true(f != NULL);
+
+    FdWriterOptions options = FD_WRITER_OPTIONS_DEFAULT;
+    options.buffer_size = 100;
+    options.sync = FD_WRITER_SYNC_ON_FLUSH;
+    Writer *w = FdWriter(dup(fileno(f)), &options);
+
+    Writer *expected = StringWriter();
+    for (int i = 0; i < 200; i++)
+    {
+        WriterWriteF(w, "%d:", i);
+        WriterWriteF(expected, "%d:", i);
+        WriterWriteChar(w, 'x');
+        WriterWriteChar(expected, 'x');
+        WriterWrite(w, "text,");
+        WriterWrite(expected, "text,");
+    }
+
+    /* bigger than the buffer */
+    char big[1000];
+    memset(big, 'b', sizeof(big) - 1);
+    big[sizeof(big) - 1] = '\0';
+    WriterWrite(w, big);
+    WriterWrite(expected, big);
+    WriterWrite(w, "tail");
+    WriterWrite(expected, "tail");
+
+    assert_true(FdWriterFlush(w));
+    assert_false(FdWriterFailed(w));
+
+    size_t length;
+    char *data = ReadBack(fileno(f), &length);
+    assert_int_equal(length, StringWriterLength(expected));
+    assert_string_equal(data, StringWriterData(expected));
+    free(data);
+
+    WriterWrite(w, "more");
+    bool success = false;
+    const int fd = FdWriterDetach(w, &success);
+    assert_true(success);
+    close(fd);
+
+    data = ReadBack(fileno(f), &length);
+    assert_int_equal(length, StringWriterLength(expected) + 4);
+    free(data);
+
+    WriterClose(expected);
+    fclose(f);
+}
+
+/* Write 30000 bytes through a direct mode FdWriter, #fd is consumed */
+static void WriteDirect(int fd)
+{
+    FdWriterOptions options = FD_WRITER_OPTIONS_DEFAULT;
+    options.buffer_size = 5000;
+    options.direct = true;
+    Writer *w = FdWriter(fd, &options);
+
+    for (int i = 0; i < 3000; i++)
+    {
+        WriterWrite(w, "0123456789");
+    }
+    bool success = false;
+    close(FdWriterDetach(w, &success));
+    assert_true(success);
+}
+
+static void AssertWrittenDirect(int fd)
+{
+    size_t length;
+    char *data = ReadBack(fd, &length);
+    assert_int_equal(length, 30000);
+    for (size_t i = 0; i < length; i++)
+    {
+        assert_int_equal(data[i], '0' + (i % 10));
+    }
+    free(data);
+}
+
+void test_fd_writer_direct(void)
+{
+    /* a file descriptor without O_DIRECT works the same */
+    FILE *f = tmpfile();
+    assert_true(f != NULL);
+    WriteDirect(dup(fileno(f)));
+    AssertWrittenDirect(fileno(f));
+    fclose(f);
+
+#ifdef O_DIRECT
+    char path[] = "/tmp/fd_writer_directXXXXXX";
+    const int fd = mkstemp(path);
+    assert_true(fd >= 0);
+
+    /* Skipped where the filesystem does not support O_DIRECT, which shows
+     * either when opening or when writing an aligned block. */
+    int direct_fd = open(path, O_WRONLY | O_DIRECT);
+    void *block = NULL;
+    assert_int_equal(posix_memalign(&block, FD_WRITER_DIRECT_ALIGN, FD_WRITER_DIRECT_ALIGN), 0);
+    memset(block, 'x', FD_WRITER_DIRECT_ALIGN);
+    if (direct_fd != -1 &&
+        write(direct_fd, block, FD_WRITER_DIRECT_ALIGN) != FD_WRITER_DIRECT_ALIGN)
+    {
+        assert_int_equal(errno, EINVAL);
+        close(direct_fd);
+        direct_fd = -1;
+        errno = EINVAL;
+    }
+    free(block);
+
+    if (direct_fd == -1)
+    {
+        assert_int_equal(errno, EINVAL);
+    }
+    else
+    {
+        assert_int_equal(ftruncate(direct_fd, 0), 0);
+        assert_int_equal(lseek(direct_fd, 0, SEEK_SET), 0);
+        WriteDirect(direct_fd);
+        AssertWrittenDirect(fd);
+    }
+
+    close(fd);
+    unlink(path);
+#endif
+}
+
+void test_fd_writer_error(void)
+{
+    const int fd = open("/dev/null", O_RDONLY);
+    assert_true(fd >= 0);
+
+    Writer *w = FdWriter(fd, NULL);
+    assert_int_equal(WriterWrite(w, "buffered"), 8);
+    assert_false(FdWriterFlush(w));
+    assert_true(FdWriterFailed(w));
+
+    /* nothing more is accepted */
+    assert_int_equal(WriterWrite(w, "more"), 0);
+
+    bool success = true;
+    close(FdWriterDetach(w, &success));
+    assert_false(success);
+}
+
+#define FD_WRITER_THREADS 4
+#define FD_WRITER_LINES 1000
+
+static void *WriteLines(void *arg)
+{
+    Writer *w = arg;
+    for (int i = 0; i < FD_WRITER_LINES; i++)
+    {
+        WriterWrite(w, "line\n");
+    }
+    return NULL;
+}
+
+void test_fd_writer_shared(void)
+{
+    FILE *f = tmpfile();
+    assert_true(f != NULL);
+
+    FdWriterOptions options = FD_WRITER_OPTIONS_DEFAULT;
+    options.buffer_size = 64;
+    options.shared = true;
+    Writer *w = FdWriter(dup(fileno(f)), &options);
+
+    pthread_t threads[FD_WRITER_THREADS];
+    for (int i = 0; i < FD_WRITER_THREADS; i++)
+    {
+        assert_int_equal(pthread_create(&threads[i], NULL, WriteLines, w), 0);
+    }
+    for (int i = 0; i < FD_WRITER_THREADS; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+    WriterClose(w);
+
+    size_t length;
+    char *data = ReadBack(fileno(f), &length);
+    assert_int_equal(length, FD_WRITER_THREADS * FD_WRITER_LINES * 5);
+    for (size_t i = 0; i < length; i += 5)
+    {
+        assert_int_equal(strncmp(data + i, "line\n", 5), 0);
+    }
+    free(data);
+    fclose(f);
+}
+
 int main()
 {
     PRINT_TEST_BANNER();
@@ -102,6 +306,10 @@ int main()
         unit_test(test_write_empty_file_buffer),
         unit_test(test_write_file_buffer),
         unit_test(test_multiwrite_file_buffer),
+        unit_test(test_fd_writer),
+        unit_test(test_fd_writer_direct),
+        unit_test(test_fd_writer_error),
+        unit_test(test_fd_writer_shared),
     };
 
     return run_tests(tests);
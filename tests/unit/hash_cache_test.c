@@ -0,0 +1,187 @@
+#include <test.h>
+
+#include <hash_cache.h>
+#include <hash.h>
+#include <file_lib.h>
+
+#define TEMP_DIR "/tmp/hash_cache_test"
+#define CACHE_FILE TEMP_DIR "/cache"
+#define DATA_FILE TEMP_DIR "/data"
+
+static char message[] = "This is a message";
+
+static void write_data_file(const char *contents)
+{
+    int fd = safe_open_create_perms(DATA_FILE, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    assert_true(fd >= 0);
+    assert_int_equal(FullWrite(fd, contents, strlen(contents)), strlen(contents));
+    assert_int_equal(close(fd), 0);
+}
+
+static void setup(void)
+{
+    mkdir(TEMP_DIR, 0700);
+    unlink(CACHE_FILE);
+    unlink(CACHE_FILE ".lock");
+    write_data_file(message);
+}
+
+static void teardown(void)
+{
+    unlink(DATA_FILE);
+    unlink(CACHE_FILE);
+    unlink(CACHE_FILE ".lock");
+    rmdir(TEMP_DIR);
+}
+
+static void test_store_lookup(void)
+{
+    setup();
+
+    unsigned char expected[EVP_MAX_MD_SIZE + 1];
+    unsigned char digest[EVP_MAX_MD_SIZE + 1];
+    HashString(message, strlen(message), expected, HASH_METHOD_SHA256);
+
+    struct stat sb;
+    assert_int_equal(stat(DATA_FILE, &sb), 0);
+
+    HashCache *cache = HashCacheOpen(CACHE_FILE);
+    assert_int_equal(HashCacheSize(cache), 0);
+    assert_false(HashCacheLookup(cache, &sb, HASH_METHOD_SHA256, digest));
+
+    HashCacheStore(cache, &sb, HASH_METHOD_SHA256, expected);
+    assert_true(HashCacheLookup(cache, &sb, HASH_METHOD_SHA256, digest));
+    assert_true(HashesMatch(digest, expected, HASH_METHOD_SHA256));
+
+    /* Other methods are separate entries */
+    assert_false(HashCacheLookup(cache, &sb, HASH_METHOD_MD5, digest));
+
+    /* Any change of the metadata makes the entry stale */
+    struct stat changed = sb;
+    changed.st_size++;
+    assert_false(HashCacheLookup(cache, &changed, HASH_METHOD_SHA256, digest));
+    changed = sb;
+    changed.st_mtime--;
+    assert_false(HashCacheLookup(cache, &changed, HASH_METHOD_SHA256, digest));
+    changed = sb;
+    changed.st_ctime++;
+    assert_false(HashCacheLookup(cache, &changed, HASH_METHOD_SHA256, digest));
+
+    assert_true(HashCacheInvalidate(cache, DATA_FILE));
+    assert_false(HashCacheLookup(cache, &sb, HASH_METHOD_SHA256, digest));
+    assert_false(HashCacheInvalidate(cache, DATA_FILE));
+
+    HashCacheClose(cache);
+    teardown();
+}
+
+static void test_save_merge(void)
+{
+    setup();
+
+    unsigned char md5[EVP_MAX_MD_SIZE + 1];
+    unsigned char sha256[EVP_MAX_MD_SIZE + 1];
+    unsigned char digest[EVP_MAX_MD_SIZE + 1];
+    HashString(message, strlen(message), md5, HASH_METHOD_MD5);
+    HashString(message, strlen(message), sha256, HASH_METHOD_SHA256);
+
+    struct stat sb;
+    assert_int_equal(stat(DATA_FILE, &sb), 0);
+
+    /* Two processes updating the same index keep each other's entries */
+    HashCache *cache1 = HashCacheOpen(CACHE_FILE);
+    HashCache *cache2 = HashCacheOpen(CACHE_FILE);
+    HashCacheStore(cache1, &sb, HASH_METHOD_MD5, md5);
+    HashCacheStore(cache2, &sb, HASH_METHOD_SHA256, sha256);
+    assert_true(HashCacheSave(cache1));
+    assert_true(HashCacheSave(cache2));
+    assert_int_equal(HashCacheSize(cache2), 2);
+    HashCacheClose(cache1);
+    HashCacheClose(cache2);
+
+    HashCache *cache = HashCacheOpen(CACHE_FILE);
+    assert_int_equal(HashCacheSize(cache), 2);
+    assert_true(HashCacheLookup(cache, &sb, HASH_METHOD_MD5, digest));
+    assert_true(HashesMatch(digest, md5, HASH_METHOD_MD5));
+    assert_true(HashCacheLookup(cache, &sb, HASH_METHOD_SHA256, digest));
+    assert_true(HashesMatch(digest, sha256, HASH_METHOD_SHA256));
+
+    /* Invalidated entries are not merged back from the index */
+    assert_true(HashCacheInvalidate(cache, DATA_FILE));
+    assert_true(HashCacheSave(cache));
+    assert_int_equal(HashCacheSize(cache), 0);
+    HashCacheClose(cache);
+
+    cache = HashCacheOpen(CACHE_FILE);
+    assert_int_equal(HashCacheSize(cache), 0);
+    HashCacheStore(cache, &sb, HASH_METHOD_MD5, md5);
+    assert_true(HashCacheSave(cache));
+    HashCacheClear(cache);
+    assert_true(HashCacheSave(cache));
+    HashCacheClose(cache);
+
+    cache = HashCacheOpen(CACHE_FILE);
+    assert_int_equal(HashCacheSize(cache), 0);
+    HashCacheClose(cache);
+
+    /* A corrupt index is ignored */
+    int fd = safe_open_create_perms(CACHE_FILE, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    assert_true(fd >= 0);
+    assert_int_equal(FullWrite(fd, "garbage", 7), 7);
+    assert_int_equal(close(fd), 0);
+    cache = HashCacheOpen(CACHE_FILE);
+    assert_int_equal(HashCacheSize(cache), 0);
+    HashCacheClose(cache);
+
+    teardown();
+}
+
+static void test_hash_file(void)
+{
+    setup();
+
+    unsigned char expected[EVP_MAX_MD_SIZE + 1];
+    unsigned char digest[EVP_MAX_MD_SIZE + 1];
+    HashString(message, strlen(message), expected, HASH_METHOD_SHA256);
+
+    HashCache *cache = HashCacheOpen(CACHE_FILE);
+    assert_true(HashCacheHashFile(cache, DATA_FILE, digest, HASH_METHOD_SHA256));
+    assert_true(HashesMatch(digest, expected, HASH_METHOD_SHA256));
+
+    /* The file was just written, so it is too recent to be cached */
+    assert_int_equal(HashCacheSize(cache), 0);
+
+    /* A cached digest is used as long as the file does not change */
+    struct stat sb;
+    assert_int_equal(stat(DATA_FILE, &sb), 0);
+    unsigned char bogus[EVP_MAX_MD_SIZE + 1] = { 0xff };
+    HashCacheStore(cache, &sb, HASH_METHOD_SHA256, bogus);
+    assert_true(HashCacheHashFile(cache, DATA_FILE, digest, HASH_METHOD_SHA256));
+    assert_true(HashesMatch(digest, bogus, HASH_METHOD_SHA256));
+
+    write_data_file("This is another message");
+    assert_true(HashCacheHashFile(cache, DATA_FILE, digest, HASH_METHOD_SHA256));
+    HashString("This is another message", 23, expected, HASH_METHOD_SHA256);
+    assert_true(HashesMatch(digest, expected, HASH_METHOD_SHA256));
+
+    assert_true(HashCacheHashFile(NULL, DATA_FILE, digest, HASH_METHOD_SHA256));
+    assert_true(HashesMatch(digest, expected, HASH_METHOD_SHA256));
+    assert_false(HashCacheHashFile(cache, TEMP_DIR "/no_such_file", digest,
+                                   HASH_METHOD_SHA256));
+
+    HashCacheClose(cache);
+    teardown();
+}
+
+int main()
+{
+    PRINT_TEST_BANNER();
+    const UnitTest tests[] =
+    {
+        unit_test(test_store_lookup),
+        unit_test(test_save_merge),
+        unit_test(test_hash_file),
+    };
+
+    return run_tests(tests);
+}
@@ -4,6 +4,7 @@
 #include <string.h>
 #include <string_lib.h>
 #include <hash.h>
+#include <alloc.h>
 #include <openssl/rsa.h>
 #include <openssl/evp.h>
 #include <openssl/bn.h>
@@ -152,6 +153,127 @@ static void test_HashDescriptor(void)
     assert_true(HashNewFromDescriptor(-1, HASH_METHOD_NONE) == NULL);
 }
 
+static void test_HashFileMulti(void)
+{
+    ASSERT_IF_NOT_INITIALIZED;
+    const HashMethod methods[] = { HASH_METHOD_MD5, HASH_METHOD_SHA256 };
+    unsigned char digests[2][EVP_MAX_MD_SIZE + 1];
+    unsigned char expected[EVP_MAX_MD_SIZE + 1];
+
+    assert_true(HashFileMulti(file, methods, 2, digests));
+    HashString(message, message_length, expected, HASH_METHOD_MD5);
+    assert_true(HashesMatch(digests[0], expected, HASH_METHOD_MD5));
+    HashString(message, message_length, expected, HASH_METHOD_SHA256);
+    assert_true(HashesMatch(digests[1], expected, HASH_METHOD_SHA256));
+
+    /* Same as hashing the file once per method */
+    HashFile(file, expected, HASH_METHOD_SHA256, false);
+    assert_true(HashesMatch(digests[1], expected, HASH_METHOD_SHA256));
+
+    assert_false(HashFileMulti("/no/such/file", methods, 2, digests));
+}
+
+static void test_HashFiles(void)
+{
+    ASSERT_IF_NOT_INITIALIZED;
+    /* Enough files for several threads, every 7th one missing */
+    const size_t n_files = 100;
+    const char *filenames[n_files];
+    for (size_t i = 0; i < n_files; i++)
+    {
+        filenames[i] = (i % 7 == 0) ? "/no/such/file" : file;
+    }
+
+    const HashMethod methods[] = { HASH_METHOD_SHA256, HASH_METHOD_MD5 };
+    unsigned char md5[EVP_MAX_MD_SIZE + 1];
+    unsigned char sha256[EVP_MAX_MD_SIZE + 1];
+    HashString(message, message_length, md5, HASH_METHOD_MD5);
+    HashString(message, message_length, sha256, HASH_METHOD_SHA256);
+
+    HashFileResult results[n_files];
+    assert_int_equal(HashFiles(filenames, n_files, methods, 2, results, 4),
+                     n_files - (n_files + 6) / 7);
+    for (size_t i = 0; i < n_files; i++)
+    {
+        if (i % 7 == 0)
+        {
+            assert_false(results[i].success);
+        }
+        else
+        {
+            assert_true(results[i].success);
+            assert_true(HashesMatch(results[i].digests[0], sha256, HASH_METHOD_SHA256));
+            assert_true(HashesMatch(results[i].digests[1], md5, HASH_METHOD_MD5));
+        }
+    }
+
+    assert_int_equal(HashFiles(filenames, 0, methods, 2, results, 0), 0);
+}
+
+static void test_HashFilesAsync(void)
+{
+    ASSERT_IF_NOT_INITIALIZED;
+
+    /* A file too large to be read whole, the rest of it is hashed later */
+    char large[] = "/tmp/hash_largeXXXXXX";
+    const int large_fd = mkstemp(large);
+    assert_true(large_fd >= 0);
+    const size_t large_size = 3 * 1024 * 1024;
+    char *large_data = xcalloc(large_size, 1);
+    for (size_t i = 0; i < large_size; i++)
+    {
+        large_data[i] = i % 251;
+    }
+    assert_int_equal(write(large_fd, large_data, large_size), large_size);
+    close(large_fd);
+
+    const size_t n_files = 200;
+    const char *filenames[n_files];
+    for (size_t i = 0; i < n_files; i++)
+    {
+        filenames[i] = (i % 7 == 0) ? "/no/such/file" : file;
+    }
+    filenames[100] = large;
+
+    const HashMethod methods[] = { HASH_METHOD_SHA256, HASH_METHOD_MD5 };
+    unsigned char md5[EVP_MAX_MD_SIZE + 1];
+    unsigned char sha256[EVP_MAX_MD_SIZE + 1];
+    unsigned char large_md5[EVP_MAX_MD_SIZE + 1];
+    unsigned char large_sha256[EVP_MAX_MD_SIZE + 1];
+    HashString(message, message_length, md5, HASH_METHOD_MD5);
+    HashString(message, message_length, sha256, HASH_METHOD_SHA256);
+    HashString(large_data, large_size, large_md5, HASH_METHOD_MD5);
+    HashString(large_data, large_size, large_sha256, HASH_METHOD_SHA256);
+
+    HashFileResult results[n_files];
+    assert_int_equal(HashFilesAsync(filenames, n_files, methods, 2, results),
+                     n_files - (n_files + 6) / 7);
+    for (size_t i = 0; i < n_files; i++)
+    {
+        if (i % 7 == 0)
+        {
+            assert_false(results[i].success);
+        }
+        else if (i == 100)
+        {
+            assert_true(results[i].success);
+            assert_true(HashesMatch(results[i].digests[0], large_sha256, HASH_METHOD_SHA256));
+            assert_true(HashesMatch(results[i].digests[1], large_md5, HASH_METHOD_MD5));
+        }
+        else
+        {
+            assert_true(results[i].success);
+            assert_true(HashesMatch(results[i].digests[0], sha256, HASH_METHOD_SHA256));
+            assert_true(HashesMatch(results[i].digests[1], md5, HASH_METHOD_MD5));
+        }
+    }
+
+    assert_int_equal(HashFilesAsync(filenames, 0, methods, 2, results), 0);
+
+    unlink(large);
+    free(large_data);
+}
+
 static void test_HashKey(void)
 {
     ASSERT_IF_NOT_INITIALIZED;
@@ -273,6 +395,9 @@ int main()
     {
         unit_test(test_HashString),
         unit_test(test_HashDescriptor),
+        unit_test(test_HashFileMulti),
+        unit_test(test_HashFiles),
+        unit_test(test_HashFilesAsync),
         unit_test(test_HashKey),
         unit_test(test_HashCopy),
         unit_test(test_HashesMatch),
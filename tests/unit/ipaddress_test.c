@@ -5,6 +5,7 @@
 #include <buffer.h>
 #include <ip_address.c>
 #include <ip_address.h>
+#include <map.h>
 
 static void test_ipv4(void)
 {
@@ -753,6 +754,117 @@ static void test_string_is_local_host_ip(void)
 #endif
 }
 
+static void test_addr_value(void)
+{
+    /*
+     * Parsing works on slices of bigger strings, without allocations.
+     */
+    const char *list = "10.0.0.1:80,[a::b]:443,bogus,a::b";
+    IPAddr first, second, third;
+    char str[IP_ADDR_STRING_SIZE];
+
+    assert_true(IPAddrParse(list, 11, &first));
+    assert_int_equal(IP_ADDRESS_TYPE_IPV4, first.type);
+    assert_int_equal(80, first.port);
+    assert_true(IPAddrToString(&first, str, sizeof(str)));
+    assert_string_equal("10.0.0.1", str);
+
+    assert_true(IPAddrParse(list + 12, 10, &second));
+    assert_int_equal(IP_ADDRESS_TYPE_IPV6, second.type);
+    assert_int_equal(443, second.port);
+    assert_true(IPAddrToString(&second, str, sizeof(str)));
+    assert_string_equal("a:0:0:0:0:0:0:b", str);
+
+    assert_false(IPAddrParse(list + 23, 5, NULL));
+    assert_false(IPAddrParse(list, 12, NULL)); /* with the "," */
+    assert_false(IPAddrParse(list, 0, NULL));
+    assert_true(IPAddrParse(list + 29, 4, &third));
+
+    /*
+     * The port is not part of the identity, everything else is in the bytes.
+     */
+    assert_true(IPAddrEqual(&second, &third));
+    assert_int_equal(0, memcmp(second.bytes, third.bytes, sizeof(second.bytes)));
+    assert_int_equal(IPAddrHash(&second, 0), IPAddrHash(&third, 0));
+    assert_false(IPAddrEqual(&first, &second));
+
+    /* IPv4 before IPv6, then by address */
+    assert_true(IPAddrCompare(&first, &second) < 0);
+    assert_true(IPAddrCompare(&second, &first) > 0);
+    IPAddr low, high;
+    assert_true(IPAddrParse("9.255.255.255", strlen("9.255.255.255"), &low));
+    assert_true(IPAddrParse("10.0.0.0", strlen("10.0.0.0"), &high));
+    assert_true(IPAddrCompare(&low, &high) < 0);
+    assert_true(IPAddrParse("1:ffff::", strlen("1:ffff::"), &low));
+    assert_true(IPAddrParse("2::", strlen("2::"), &high));
+    assert_true(IPAddrCompare(&low, &high) < 0);
+
+    /* zero compression is resolved the same way with brackets and ports */
+    const char *compressed[][2] = {
+        { "[1::2:3]", "1:0:0:0:0:0:2:3" },
+        { "[::1]:22", "0:0:0:0:0:0:0:1" },
+        { "1::2:3:4:5:6:7", "1:0:2:3:4:5:6:7" },
+        { "[1::2:3:4:5:6:7]:5", "1:0:2:3:4:5:6:7" },
+    };
+    for (size_t i = 0; i < sizeof(compressed) / sizeof(compressed[0]); i++)
+    {
+        assert_true(IPAddrParse(compressed[i][0], strlen(compressed[i][0]), &third));
+        assert_true(IPAddrToString(&third, str, sizeof(str)));
+        assert_string_equal(compressed[i][1], str);
+    }
+
+    /* too small buffer */
+    assert_false(IPAddrToString(&second, str, 8));
+
+    /* hex, as in procfs */
+    assert_true(IPAddrParseHex("0100007F:1F90", 13, &third));
+    assert_true(IPAddrToString(&third, str, sizeof(str)));
+    assert_string_equal("127.0.0.1", str);
+    assert_int_equal(8080, third.port);
+    assert_false(IPAddrParseHex("0100007F00000000000000000000000000000000", 40, NULL));
+
+    /*
+     * The wrapper object holds the same value.
+     */
+    Buffer *buffer = BufferNewFrom("[a::b]:443", strlen("[a::b]:443"));
+    IPAddress *address = IPAddressNew(buffer);
+    assert_true(address != NULL);
+    assert_true(IPAddrEqual(IPAddressGetAddr(address), &second));
+    assert_int_equal(443, IPAddressGetAddr(address)->port);
+    IPAddressDestroy(&address);
+    BufferDestroy(buffer);
+
+    address = IPAddressNewFromAddr(&first);
+    assert_int_equal(IP_ADDRESS_TYPE_IPV4, IPAddressType(address));
+    assert_int_equal(80, IPAddressGetPort(address));
+    IPAddressDestroy(&address);
+}
+
+static void test_addr_map_key(void)
+{
+    Map *map = MapNew(IPAddrHash_untyped, IPAddrEqual_untyped, free, NULL);
+    const char *addresses[] = { "10.0.0.1", "10.0.0.2", "::1", "[::1]:22", "10.0.0.1:8080" };
+
+    for (size_t i = 0; i < sizeof(addresses) / sizeof(addresses[0]); i++)
+    {
+        IPAddr addr;
+        assert_true(IPAddrParse(addresses[i], strlen(addresses[i]), &addr));
+        if (!MapHasKey(map, &addr))
+        {
+            MapInsert(map, xmemdup(&addr, sizeof(addr)), (void *) addresses[i]);
+        }
+    }
+    assert_int_equal(3, MapSize(map));
+
+    IPAddr addr;
+    assert_true(IPAddrParse("0:0:0:0:0:0:0:1", strlen("0:0:0:0:0:0:0:1"), &addr));
+    assert_string_equal("::1", MapGet(map, &addr));
+    assert_true(IPAddrParse("10.0.0.3", strlen("10.0.0.3"), &addr));
+    assert_false(MapHasKey(map, &addr));
+
+    MapDestroy(map);
+}
+
 int main()
 {
     PRINT_TEST_BANNER();
@@ -766,6 +878,8 @@ int main()
         , unit_test(test_ipv6_address_comparison)
         , unit_test(test_isipaddress)
         , unit_test(test_string_is_local_host_ip)
+        , unit_test(test_addr_value)
+        , unit_test(test_addr_map_key)
     };
 
     return run_tests(tests);
@@ -0,0 +1,357 @@
+#include <test.h>
+
+#include <json-binary.h>
+#include <json.h>
+#include <alloc.h>
+#include <buffer.h>
+#include <misc_lib.h> /* xsnprintf */
+#include <writer.h>
+
+static const char *const CORPUS[] = {
+    "benchmark.json",
+    "sample.json",
+    "mustache_comments.json",
+    "mustache_delimiters.json",
+    "mustache_extra.json",
+    "mustache_interpolation.json",
+    "mustache_inverted.json",
+    "mustache_sections.json",
+};
+
+static JsonElement *ParseJson(const char *data)
+{
+    JsonElement *json = NULL;
+    assert_int_equal(JSON_PARSE_OK, JsonParse(&data, &json));
+    return json;
+}
+
+static char *JsonToCompactString(const JsonElement *json)
+{
+    Writer *w = StringWriter();
+    JsonWriteCompact(w, json);
+    return StringWriterClose(w);
+}
+
+static Buffer *WriteBinary(const JsonElement *json)
+{
+    Buffer *buffer = BufferNew();
+    assert_true(JsonWriteBinary(buffer, json));
+    return buffer;
+}
+
+/* Same values, and numbers written out the same way too. */
+static void AssertRoundTrip(const JsonElement *json)
+{
+    Buffer *binary = WriteBinary(json);
+
+    JsonElement *parsed = NULL;
+    assert_int_equal(JSON_PARSE_OK,
+                     JsonParseBinary(BufferData(binary), BufferSize(binary), &parsed));
+    assert_true(JsonEqual(json, parsed));
+
+    char *expected = JsonToCompactString(json);
+    char *actual = JsonToCompactString(parsed);
+    assert_string_equal(expected, actual);
+    free(actual);
+
+    JsonBinary *doc = JsonBinaryOpen(BufferData(binary), BufferSize(binary));
+    assert_true(doc != NULL);
+    JsonElement *built = JsonBinaryToJson(JsonBinaryRoot(doc));
+    actual = JsonToCompactString(built);
+    assert_string_equal(expected, actual);
+    free(actual);
+    JsonDestroy(built);
+    JsonBinaryClose(doc);
+
+    free(expected);
+    JsonDestroy(parsed);
+    BufferDestroy(binary);
+}
+
+static void test_round_trip_corpus(void)
+{
+    for (size_t i = 0; i < sizeof(CORPUS) / sizeof(CORPUS[0]); i++)
+    {
+        char path[PATH_MAX];
+        xsnprintf(path, sizeof(path), "%s/%s", TESTDATADIR, CORPUS[i]);
+
+        JsonElement *json = NULL;
+        assert_int_equal(JSON_PARSE_OK, JsonParseFile(path, SIZE_MAX, &json));
+        AssertRoundTrip(json);
+
+        /* copies sharing their data with the original are written the same */
+        JsonElement *copy = JsonCopy(json);
+        AssertRoundTrip(copy);
+        JsonDestroy(copy);
+
+        JsonDestroy(json);
+    }
+}
+
+static void test_round_trip_values(void)
+{
+    const char *const documents[] = {
+        "null",
+        "true",
+        "\"\"",
+        "[]",
+        "{}",
+        "[1, -5, 0, 9223372036854775807, -9223372036854775808, 123456789012345678901234567890]",
+        "[1.5, 0.1234567, -0.0, 1e5, 2E-3, 3.0000, 12345678901234567890.5]",
+        "{\"a\": {\"a\": [{\"a\": null, \"b\": false}, {\"b\": \"a\"}]}, \"\": \"empty key\"}",
+        "[\"unicode \\u00e9\\u4e2d\", \"escapes \\\" \\\\ \\n \\t\"]",
+    };
+
+    for (size_t i = 0; i < sizeof(documents) / sizeof(documents[0]); i++)
+    {
+        JsonElement *json = ParseJson(documents[i]);
+        AssertRoundTrip(json);
+        JsonDestroy(json);
+    }
+
+    JsonElement *numbers = JsonArrayCreate(4);
+    JsonArrayAppendElement(numbers, JsonIntegerCreate64(INT64_MIN));
+    JsonArrayAppendElement(numbers, JsonRealCreate(2.5));
+    JsonArrayAppendElement(numbers, JsonRealCreate(-1234567.0625));
+    JsonArrayAppendElement(numbers, JsonRealCreate(1e300));
+    AssertRoundTrip(numbers);
+    JsonDestroy(numbers);
+}
+
+static void test_keys_stored_once(void)
+{
+    JsonElement *rows = JsonArrayCreate(1000);
+    for (int i = 0; i < 1000; i++)
+    {
+        JsonElement *row = JsonObjectCreate(2);
+        JsonObjectAppendInteger(row, "a_rather_long_property_name", i);
+        JsonObjectAppendBool(row, "another_rather_long_property_name", i % 2);
+        JsonArrayAppendObject(rows, row);
+    }
+
+    /* tag, key index and value, with the keys in the table only */
+    Buffer *binary = WriteBinary(rows);
+    assert_true(BufferSize(binary) < 1000 * (13 + 4 + 9 + 4 + 1) + 200);
+    AssertRoundTrip(rows);
+
+    BufferDestroy(binary);
+    JsonDestroy(rows);
+}
+
+static void test_read_in_place(void)
+{
+    JsonElement *json = ParseJson(
+        "{\"name\": \"state\", \"count\": 3, \"ratio\": 0.5, \"big\": 123456789012345678901,"
+        " \"on\": true, \"none\": null, \"items\": [10, \"x\", {\"k\": [1]}]}");
+    Buffer *binary = WriteBinary(json);
+
+    JsonBinary *doc = JsonBinaryOpen(BufferData(binary), BufferSize(binary));
+    assert_true(doc != NULL);
+    JsonBinaryValue root = JsonBinaryRoot(doc);
+    assert_int_equal(JSON_TYPE_OBJECT, JsonBinaryGetType(root));
+    assert_int_equal(7, JsonBinaryLength(root));
+
+    JsonBinaryValue value;
+    assert_true(JsonBinaryObjectGet(root, "name", &value));
+    assert_string_equal("state", JsonBinaryGetString(value));
+    assert_int_equal(0, JsonBinaryLength(value));
+
+    int64_t integer;
+    double real;
+    bool b;
+    assert_true(JsonBinaryObjectGet(root, "count", &value));
+    assert_int_equal(JSON_TYPE_INTEGER, JsonBinaryGetType(value));
+    assert_true(JsonBinaryGetInteger(value, &integer));
+    assert_int_equal(3, integer);
+    assert_true(JsonBinaryGetReal(value, &real));
+    assert_true(real == 3.0);
+    assert_true(JsonBinaryGetString(value) == NULL);
+
+    assert_true(JsonBinaryObjectGet(root, "ratio", &value));
+    assert_int_equal(JSON_TYPE_REAL, JsonBinaryGetType(value));
+    assert_true(JsonBinaryGetReal(value, &real));
+    assert_true(real == 0.5);
+    assert_false(JsonBinaryGetInteger(value, &integer));
+
+    /* too big for 64 bits, stored as text */
+    assert_true(JsonBinaryObjectGet(root, "big", &value));
+    assert_int_equal(JSON_TYPE_INTEGER, JsonBinaryGetType(value));
+    assert_false(JsonBinaryGetInteger(value, &integer));
+    assert_true(JsonBinaryGetReal(value, &real));
+    assert_true(real > 1.2e20 && real < 1.3e20);
+
+    assert_true(JsonBinaryObjectGet(root, "on", &value));
+    assert_true(JsonBinaryGetBool(value, &b));
+    assert_true(b);
+    assert_true(JsonBinaryObjectGet(root, "none", &value));
+    assert_int_equal(JSON_TYPE_NULL, JsonBinaryGetType(value));
+    assert_false(JsonBinaryGetBool(value, &b));
+
+    assert_false(JsonBinaryObjectGet(root, "missing", &value));
+    assert_false(JsonBinaryObjectGet(root, "nam", &value));
+
+    JsonBinaryValue items;
+    assert_true(JsonBinaryObjectGet(root, "items", &items));
+    assert_int_equal(JSON_TYPE_ARRAY, JsonBinaryGetType(items));
+    assert_int_equal(3, JsonBinaryLength(items));
+    assert_false(JsonBinaryObjectGet(items, "name", &value));
+    assert_false(JsonBinaryArrayGet(root, 0, &value));
+    assert_false(JsonBinaryArrayGet(items, 3, &value));
+    assert_true(JsonBinaryArrayGet(items, 1, &value));
+    assert_string_equal("x", JsonBinaryGetString(value));
+    assert_true(JsonBinaryArrayGet(items, 2, &value));
+    assert_true(JsonBinaryObjectGet(value, "k", &value));
+    assert_true(JsonBinaryArrayGet(value, 0, &value));
+    assert_true(JsonBinaryGetInteger(value, &integer));
+    assert_int_equal(1, integer);
+
+    /* iteration gives keys in the original order */
+    const char *const keys[] = { "name", "count", "ratio", "big", "on", "none", "items" };
+    JsonBinaryIterator iter = JsonBinaryIteratorInit(root);
+    const char *key;
+    size_t i = 0;
+    while (JsonBinaryIteratorNext(&iter, &key, &value))
+    {
+        assert_true(i < 7);
+        assert_string_equal(keys[i], key);
+        i++;
+    }
+    assert_int_equal(7, i);
+
+    iter = JsonBinaryIteratorInit(items);
+    assert_true(JsonBinaryIteratorNext(&iter, &key, &value));
+    assert_true(key == NULL);
+    assert_true(JsonBinaryGetInteger(value, &integer));
+    assert_int_equal(10, integer);
+
+    /* subtrees can be turned into JSON elements */
+    JsonElement *subtree = JsonBinaryToJson(items);
+    assert_true(JsonEqual(JsonObjectGet(json, "items"), subtree));
+    JsonDestroy(subtree);
+
+    JsonBinaryClose(doc);
+    BufferDestroy(binary);
+    JsonDestroy(json);
+}
+
+static void test_invalid(void)
+{
+    JsonElement *json = ParseJson(
+        "{\"a\": [1, 2.5, \"s\", 123456789012345678901, {\"b\": null}], \"c\": {\"d\": true}}");
+    Buffer *binary = WriteBinary(json);
+    const size_t size = BufferSize(binary);
+    char *data = xmemdup(BufferData(binary), size);
+
+    JsonElement *parsed = NULL;
+    for (size_t length = 0; length < size; length++)
+    {
+        /* exactly as much memory as data, for reads past it to be caught */
+        char *truncated = xmemdup(data, MAX(length, 1));
+        assert_int_equal(JSON_PARSE_ERROR_BINARY_FORMAT,
+                         JsonParseBinary(truncated, length, &parsed));
+        assert_true(JsonBinaryOpen(truncated, length) == NULL);
+        free(truncated);
+    }
+
+    /* trailing data */
+    char *longer = xcalloc(size + 1, 1);
+    memcpy(longer, data, size);
+    assert_int_equal(JSON_PARSE_ERROR_BINARY_FORMAT, JsonParseBinary(longer, size + 1, &parsed));
+    free(longer);
+
+    /* broken bytes are either rejected or give some valid document */
+    for (size_t i = 0; i < size; i++)
+    {
+        const char orig = data[i];
+        for (int bit = 0; bit < 8; bit++)
+        {
+            data[i] = orig ^ (1 << bit);
+            parsed = NULL;
+            if (JsonParseBinary(data, size, &parsed) == JSON_PARSE_OK)
+            {
+                JsonDestroy(JsonCopy(parsed));
+                free(JsonToCompactString(parsed));
+                JsonDestroy(parsed);
+            }
+        }
+        data[i] = orig;
+    }
+
+    /* a key used twice in the same object */
+    JsonElement *dup = ParseJson("{\"a\": 1, \"b\": 2}");
+    Buffer *dup_binary = WriteBinary(dup);
+    char *dup_data = xmemdup(BufferData(dup_binary), BufferSize(dup_binary));
+    assert_int_equal(JSON_PARSE_OK,
+                     JsonParseBinary(dup_data, BufferSize(dup_binary), &parsed));
+    JsonDestroy(parsed);
+    /* header, two keys, object header, key index 0, integer, key index 1 */
+    const size_t second_key = 12 + 6 + 6 + 13 + 4 + 9;
+    assert_int_equal(1, dup_data[second_key]);
+    dup_data[second_key] = 0;
+    assert_int_equal(JSON_PARSE_ERROR_BINARY_FORMAT,
+                     JsonParseBinary(dup_data, BufferSize(dup_binary), &parsed));
+    free(dup_data);
+    BufferDestroy(dup_binary);
+    JsonDestroy(dup);
+
+    const char *text = "{\"a\": 1}";
+    assert_int_equal(JSON_PARSE_ERROR_BINARY_FORMAT,
+                     JsonParseBinary(text, strlen(text), &parsed));
+
+    free(data);
+    BufferDestroy(binary);
+    JsonDestroy(json);
+}
+
+static void test_file(void)
+{
+    char path[] = "/tmp/json_binary_test.XXXXXX";
+    int fd = mkstemp(path);
+    assert_true(fd >= 0);
+
+    char sample[PATH_MAX];
+    xsnprintf(sample, sizeof(sample), "%s/benchmark.json", TESTDATADIR);
+    JsonElement *json = NULL;
+    assert_int_equal(JSON_PARSE_OK, JsonParseFile(sample, SIZE_MAX, &json));
+
+    assert_true(JsonWriteBinaryFd(fd, json));
+    assert_int_equal(0, close(fd));
+
+    JsonElement *parsed = NULL;
+    assert_int_equal(JSON_PARSE_OK, JsonParseBinaryFile(path, SIZE_MAX, &parsed));
+    assert_true(JsonEqual(json, parsed));
+    JsonDestroy(parsed);
+
+    assert_int_equal(JSON_PARSE_ERROR_TRUNCATED, JsonParseBinaryFile(path, 100, &parsed));
+    assert_true(JsonBinaryOpenFile(path, 100) == NULL);
+
+    JsonBinary *doc = JsonBinaryOpenFile(path, SIZE_MAX);
+    assert_true(doc != NULL);
+    assert_int_equal(JsonLength(json), JsonBinaryLength(JsonBinaryRoot(doc)));
+    parsed = JsonBinaryToJson(JsonBinaryRoot(doc));
+    assert_true(JsonEqual(json, parsed));
+    JsonDestroy(parsed);
+    JsonBinaryClose(doc);
+
+    assert_int_equal(0, unlink(path));
+    assert_int_equal(JSON_PARSE_ERROR_NO_SUCH_FILE, JsonParseBinaryFile(path, SIZE_MAX, &parsed));
+    assert_true(JsonBinaryOpenFile(path, SIZE_MAX) == NULL);
+
+    JsonDestroy(json);
+}
+
+int main()
+{
+    PRINT_TEST_BANNER();
+    const UnitTest tests[] =
+    {
+        unit_test(test_round_trip_corpus),
+        unit_test(test_round_trip_values),
+        unit_test(test_keys_stored_once),
+        unit_test(test_read_in_place),
+        unit_test(test_invalid),
+        unit_test(test_file),
+    };
+
+    return run_tests(tests);
+}
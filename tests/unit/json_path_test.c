@@ -0,0 +1,233 @@
+#include <test.h>
+
+#include <json-path.h>
+#include <json.h>
+#include <alloc.h>
+#include <writer.h>
+
+static const char *const STORE =
+    "{\"store\": {"
+    "  \"book\": ["
+    "    {\"category\": \"reference\", \"author\": \"Rees\", \"title\": \"Sayings\", \"price\": 8.95},"
+    "    {\"category\": \"fiction\", \"author\": \"Waugh\", \"title\": \"Sword\", \"price\": 12.99},"
+    "    {\"category\": \"fiction\", \"author\": \"Melville\", \"title\": \"Moby Dick\", \"isbn\": \"0-553\", \"price\": 8},"
+    "    {\"category\": \"fiction\", \"author\": \"Tolkien\", \"title\": \"The Lord\", \"isbn\": \"0-395\", \"price\": 22.99, \"used\": true}"
+    "  ],"
+    "  \"bicycle\": {\"color\": \"red\", \"price\": 19.95}"
+    "}, \"a.b\": [0, 1, 2, 3, 4, 5]}";
+
+static JsonElement *ParseJson(const char *data)
+{
+    JsonElement *json = NULL;
+    assert_int_equal(JSON_PARSE_OK, JsonParse(&data, &json));
+    return json;
+}
+
+/* All matches of #expression written compactly, separated by spaces. */
+static void AssertMatches(const char *expression, JsonElement *json,
+                          const char *expected)
+{
+    JsonPath *path = JsonPathCompile(expression);
+    assert_true(path != NULL);
+
+    Seq *matches = JsonPathSelect(path, json);
+    Writer *w = StringWriter();
+    for (size_t i = 0; i < SeqLength(matches); i++)
+    {
+        if (i > 0)
+        {
+            WriterWriteChar(w, ' ');
+        }
+        JsonWriteCompact(w, SeqAt(matches, i));
+    }
+    char *actual = StringWriterClose(w);
+    assert_string_equal(expected, actual);
+    free(actual);
+
+    JsonElement *first = JsonPathSelectFirst(path, json);
+    assert_true(first == ((SeqLength(matches) > 0) ? SeqAt(matches, 0) : NULL));
+
+    SeqDestroy(matches);
+    JsonPathDestroy(path);
+}
+
+static void test_keys_and_indices(void)
+{
+    JsonElement *json = ParseJson(STORE);
+
+    JsonPath *root = JsonPathCompile("$");
+    assert_true(JsonPathSelectFirst(root, json) == json);
+    JsonPathDestroy(root);
+
+    AssertMatches("$.store.bicycle.color", json, "\"red\"");
+    AssertMatches("store.bicycle['color']", json, "\"red\"");
+    AssertMatches("$[\"a.b\"][2]", json, "2");
+    AssertMatches("$['a.b'][-1]", json, "5");
+    AssertMatches("$.store.book[1].author", json, "\"Waugh\"");
+    AssertMatches("$.store.book[-4].author", json, "\"Rees\"");
+    AssertMatches("$.store.book[4].author", json, "");
+    AssertMatches("$.store.book[-5]", json, "");
+    AssertMatches("$.store.nothing.here", json, "");
+    AssertMatches("$.store.bicycle[0]", json, "");
+    AssertMatches("$.store.book.author", json, "");
+
+    JsonDestroy(json);
+}
+
+static void test_wildcards_slices_unions(void)
+{
+    JsonElement *json = ParseJson(STORE);
+
+    AssertMatches("$.store.book[*].author", json,
+                  "\"Rees\" \"Waugh\" \"Melville\" \"Tolkien\"");
+    AssertMatches("$.store.bicycle.*", json, "\"red\" 19.95");
+    AssertMatches("$.store.book[0,2].price", json, "8.95 8");
+    AssertMatches("$.store.bicycle['price','color','none']", json, "19.95 \"red\"");
+
+    AssertMatches("$['a.b'][1:3]", json, "1 2");
+    AssertMatches("$['a.b'][:2]", json, "0 1");
+    AssertMatches("$['a.b'][4:]", json, "4 5");
+    AssertMatches("$['a.b'][-2:]", json, "4 5");
+    AssertMatches("$['a.b'][::2]", json, "0 2 4");
+    AssertMatches("$['a.b'][::-2]", json, "5 3 1");
+    AssertMatches("$['a.b'][4:1:-1]", json, "4 3 2");
+    AssertMatches("$['a.b'][ 1 : 100 : 3 ]", json, "1 4");
+    AssertMatches("$['a.b'][3:1]", json, "");
+    AssertMatches("$['a.b'][-100:1, 5]", json, "0 5");
+
+    JsonDestroy(json);
+}
+
+static void test_descendants(void)
+{
+    JsonElement *json = ParseJson(STORE);
+
+    AssertMatches("$..author", json,
+                  "\"Rees\" \"Waugh\" \"Melville\" \"Tolkien\"");
+    AssertMatches("$.store..price", json, "8.95 12.99 8 22.99 19.95");
+    AssertMatches("$..book[-1].title", json, "\"The Lord\"");
+    AssertMatches("$..['isbn']", json, "\"0-553\" \"0-395\"");
+    AssertMatches("$.store.bicycle..*", json, "\"red\" 19.95");
+
+    JsonDestroy(json);
+}
+
+static void test_filters(void)
+{
+    JsonElement *json = ParseJson(STORE);
+
+    AssertMatches("$.store.book[?(@.isbn)].title", json,
+                  "\"Moby Dick\" \"The Lord\"");
+    AssertMatches("$.store.book[?(@.price < 10)].title", json,
+                  "\"Sayings\" \"Moby Dick\"");
+    AssertMatches("$.store.book[?(@.price >= 12.99)].author", json,
+                  "\"Waugh\" \"Tolkien\"");
+    AssertMatches("$.store.book[?(@.price == 8)].author", json, "\"Melville\"");
+    AssertMatches("$.store.book[?(@.category != 'fiction')].author", json,
+                  "\"Rees\"");
+    AssertMatches("$.store.book[?(@.author > \"S\")].author", json,
+                  "\"Waugh\" \"Tolkien\"");
+    AssertMatches("$.store.book[?(@.used == true)].author", json, "\"Tolkien\"");
+    AssertMatches("$.store.book[?(@.used != true)].author", json,
+                  "\"Rees\" \"Waugh\" \"Melville\"");
+    AssertMatches("$.store.book[?(@.used < true)].author", json, "");
+    AssertMatches("$.store.book[?(@.title == 8)].author", json, "");
+    AssertMatches("$['a.b'][?(@ > 3)]", json, "4 5");
+    AssertMatches("$..[?(@.color)].price", json, "19.95");
+
+    JsonDestroy(json);
+}
+
+static void test_invalid(void)
+{
+    const char *const invalid[] = {
+        "$.",
+        "$..",
+        "$[",
+        "$[1",
+        "$['a]",
+        "$[a]",
+        "$[1:2:0]",
+        "$[?(@.a <)]",
+        "$[?(@.a == 1]",
+        "$[?(@.a < 1e400)]",
+        "$[?(@.a > -1e400)]",
+        "$[?(@.a == nan)]",
+        "$[?(.a)]",
+        "$[?@.a]",
+        "$.a]",
+        "$x",
+        "a[0]b",
+    };
+
+    for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++)
+    {
+        assert_true(JsonPathCompile(invalid[i]) == NULL);
+    }
+
+    // large numbers are fine as long as they fit a double
+    JsonPath *path = JsonPathCompile("$[?(@.a < 1e300)]");
+    assert_true(path != NULL);
+    JsonPathDestroy(path);
+    path = JsonPathCompile("$[?(@.a < 99999999999999999999)]");
+    assert_true(path != NULL);
+    JsonPathDestroy(path);
+}
+
+static bool StopAfterTwo(ARG_UNUSED JsonElement *element, void *data)
+{
+    return ++(*(int *) data) < 2;
+}
+
+static void test_reuse_and_stop(void)
+{
+    JsonPath *path = JsonPathCompile("$..price");
+    assert_true(path != NULL);
+
+    JsonElement *json = ParseJson(STORE);
+    int visited = 0;
+    assert_false(JsonPathEvaluate(path, json, StopAfterTwo, &visited));
+    assert_int_equal(2, visited);
+
+    /* the same compiled path on other documents, including a shared copy
+     * which is changed through a match */
+    JsonElement *copy = JsonCopyShared(json);
+    JsonElement *bicycle = JsonPathSelectFirst(path, copy);
+    assert_true(bicycle != NULL);
+
+    JsonPath *bicycle_path = JsonPathCompile("store.bicycle");
+    JsonObjectAppendInteger(JsonPathSelectFirst(bicycle_path, copy), "price", 1);
+    AssertMatches("$.store.bicycle.price", copy, "1");
+    AssertMatches("$.store.bicycle.price", json, "19.95");
+    JsonPathDestroy(bicycle_path);
+
+    JsonElement *other = ParseJson("[{\"price\": 1}, {\"x\": {\"price\": 2}}]");
+    Seq *matches = JsonPathSelect(path, other);
+    assert_int_equal(2, SeqLength(matches));
+    SeqDestroy(matches);
+
+    JsonElement *primitive = JsonStringCreate("price");
+    assert_true(JsonPathSelectFirst(path, primitive) == NULL);
+
+    JsonDestroy(primitive);
+    JsonDestroy(other);
+    JsonDestroy(copy);
+    JsonDestroy(json);
+    JsonPathDestroy(path);
+}
+
+int main()
+{
+    PRINT_TEST_BANNER();
+    const UnitTest tests[] =
+    {
+        unit_test(test_keys_and_indices),
+        unit_test(test_wildcards_slices_unions),
+        unit_test(test_descendants),
+        unit_test(test_filters),
+        unit_test(test_invalid),
+        unit_test(test_reuse_and_stop),
+    };
+
+    return run_tests(tests);
+}
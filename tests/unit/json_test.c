@@ -1,12 +1,14 @@
 #include <test.h>
 
 #include <json.h>
+#include <json-utils.h>
 #include <string_lib.h>
 #include <file_lib.h>
 #include <misc_lib.h> /* xsnprintf */
 #include <alloc.h>    // xasprintf()
 
 #include <float.h>
+#include <sys/wait.h> // waitpid()
 
 
 static const char *OBJECT_ARRAY =
@@ -569,6 +571,241 @@ static void test_copy_compare(void)
     JsonDestroy(copy);
 }
 
+static char *JsonToCompactString(const JsonElement *json)
+{
+    Writer *w = StringWriter();
+    JsonWriteCompact(w, json);
+    return StringWriterClose(w);
+}
+
+static void assert_json_equal(const char *expected, const JsonElement *json)
+{
+    char *actual = JsonToCompactString(json);
+    assert_string_equal(expected, actual);
+    free(actual);
+}
+
+static JsonElement *ParseJson(const char *data)
+{
+    JsonElement *json = NULL;
+    assert_int_equal(JSON_PARSE_OK, JsonParse(&data, &json));
+    return json;
+}
+
+static void test_copy_on_write(void)
+{
+    const char *const original =
+        "{\"a\":{\"b\":[1,2,{\"c\":\"d\"}]},\"e\":\"f\"}";
+    JsonElement *json = ParseJson(original);
+
+    /* changing a copy through its children leaves the original alone */
+    JsonElement *copy = JsonCopyShared(json);
+    JsonElement *b = JsonObjectGetAsArray(JsonObjectGetAsObject(copy, "a"), "b");
+    JsonObjectAppendString(JsonArrayGetAsObject(b, 2), "c", "x");
+    JsonArrayAppendInteger(b, 3);
+    assert_json_equal(original, json);
+    assert_json_equal("{\"a\":{\"b\":[1,2,{\"c\":\"x\"},3]},\"e\":\"f\"}", copy);
+    assert_int_not_equal(0, JsonCompare(json, copy));
+    JsonDestroy(copy);
+
+    /* changing the original through children got before copying it leaves
+     * the copy alone */
+    JsonElement *inner = JsonObjectGetAsObject(json, "a");
+    JsonElement *c = JsonArrayGetAsObject(JsonObjectGetAsArray(inner, "b"), 2);
+    copy = JsonCopyShared(json);
+    JsonElement *copy_of_copy = JsonCopyShared(copy);
+    JsonObjectAppendString(c, "c", "y");
+    JsonObjectRemoveKey(inner, "b");
+    assert_json_equal("{\"a\":{},\"e\":\"f\"}", json);
+    assert_json_equal(original, copy);
+    assert_json_equal(original, copy_of_copy);
+    assert_int_equal(0, JsonCompare(copy, copy_of_copy));
+
+    /* strings got from a copy stay valid when the original goes away */
+    const char *e = JsonObjectGetAsString(copy, "e");
+    JsonDestroy(json);
+    assert_string_equal("f", e);
+    assert_json_equal(original, copy);
+    JsonDestroy(copy);
+    assert_json_equal(original, copy_of_copy);
+
+    /* iterating a copy and changing what the iterator gives */
+    JsonElement *copy_of_copy_2 = JsonCopyShared(copy_of_copy);
+    JsonIterator iter = JsonIteratorInit(copy_of_copy_2);
+    JsonElement *child;
+    while ((child = JsonIteratorNextValueByType(
+                &iter, JSON_ELEMENT_TYPE_CONTAINER, true)) != NULL)
+    {
+        JsonObjectAppendBool(child, "g", true);
+    }
+    assert_json_equal(original, copy_of_copy);
+    assert_json_equal(
+        "{\"a\":{\"b\":[1,2,{\"c\":\"d\"}],\"g\":true},\"e\":\"f\"}",
+        copy_of_copy_2);
+
+    /* detaching from a copy */
+    JsonElement *detached = JsonObjectDetachKey(copy_of_copy_2, "a");
+    JsonElement *b_copy = JsonCopyShared(
+        JsonObjectGetAsArray(JsonObjectGetAsObject(copy_of_copy, "a"), "b"));
+    JsonArrayExtend(JsonObjectGetAsArray(detached, "b"), b_copy);
+    assert_json_equal(
+        "{\"b\":[1,2,{\"c\":\"d\"},1,2,{\"c\":\"d\"}],\"g\":true}", detached);
+    assert_json_equal("{\"e\":\"f\"}", copy_of_copy_2);
+    assert_json_equal(original, copy_of_copy);
+
+    JsonDestroy(detached);
+    JsonDestroy(copy_of_copy_2);
+    JsonDestroy(copy_of_copy);
+}
+
+static void test_merge_shares_children(void)
+{
+    JsonElement *defaults = ParseJson(
+        "{\"x\":{\"y\":[1,{\"z\":2}]},\"w\":\"v\"}");
+    JsonElement *overrides = ParseJson("{\"w\":\"u\",\"t\":[true]}");
+
+    JsonElement *merged = JsonMergeShared(defaults, overrides);
+    assert_json_equal("{\"t\":[true],\"w\":\"u\",\"x\":{\"y\":[1,{\"z\":2}]}}",
+                      merged);
+
+    /* the merged object can be changed without changing its inputs, and
+     * outlives them */
+    JsonElement *y = JsonObjectGetAsArray(JsonObjectGetAsObject(merged, "x"), "y");
+    JsonObjectAppendInteger(JsonArrayGetAsObject(y, 1), "z", 3);
+    JsonArrayAppendNull(JsonObjectGetAsArray(merged, "t"));
+    assert_json_equal("{\"w\":\"v\",\"x\":{\"y\":[1,{\"z\":2}]}}", defaults);
+    assert_json_equal("{\"t\":[true],\"w\":\"u\"}", overrides);
+
+    JsonDestroy(defaults);
+    JsonDestroy(overrides);
+    assert_json_equal(
+        "{\"t\":[true,null],\"w\":\"u\",\"x\":{\"y\":[1,{\"z\":3}]}}", merged);
+
+    JsonDestroy(merged);
+}
+
+static void test_write_copy_while_iterating(void)
+{
+    JsonElement *json = ParseJson("{\"b\":1,\"a\":2,\"c\":3}");
+    JsonElement *copies[] = { JsonCopy(json), JsonCopyShared(json) };
+
+    /* writing a copy, which sorts the keys for the output, leaves the order
+     * of the original alone */
+    for (size_t i = 0; i < sizeof(copies) / sizeof(copies[0]); i++)
+    {
+        Writer *keys = StringWriter();
+        JsonIterator iter = JsonIteratorInit(json);
+        const char *key;
+        while ((key = JsonIteratorNextKey(&iter)) != NULL)
+        {
+            WriterWrite(keys, key);
+            assert_json_equal("{\"a\":2,\"b\":1,\"c\":3}", copies[i]);
+        }
+        char *result = StringWriterClose(keys);
+        assert_string_equal("bac", result);
+        free(result);
+        JsonDestroy(copies[i]);
+    }
+
+    JsonDestroy(json);
+}
+
+static void test_compare_ignores_key_order(void)
+{
+    JsonElement *a = ParseJson("{\"x\":1,\"y\":[true,{\"p\":\"q\",\"r\":null}]}");
+    JsonElement *b = ParseJson("{\"y\":[true,{\"r\":null,\"p\":\"q\"}],\"x\":1}");
+    JsonElement *c = ParseJson("{\"y\":[true,{\"r\":null,\"p\":\"Q\"}],\"x\":1}");
+    JsonElement *d = ParseJson("{\"y\":[{\"r\":null,\"p\":\"q\"},true],\"x\":1}");
+
+    assert_int_equal(0, JsonCompare(a, b));
+    assert_true(JsonCompare(a, c) > 0);
+    assert_true(JsonCompare(c, a) < 0);
+    assert_int_not_equal(0, JsonCompare(a, d));
+
+    assert_true(JsonEqual(a, b));
+    assert_false(JsonEqual(a, c));
+    assert_false(JsonEqual(a, d));
+    assert_int_equal(JsonHash(a), JsonHash(b));
+    assert_int_not_equal(JsonHash(a), JsonHash(c));
+    assert_int_not_equal(JsonHash(a), JsonHash(d));
+
+    JsonDestroy(a);
+    JsonDestroy(b);
+    JsonDestroy(c);
+    JsonDestroy(d);
+}
+
+static void test_hash_follows_changes(void)
+{
+    JsonElement *a = ParseJson("{\"x\":{\"y\":{\"z\":[1,2]}},\"w\":\"v\"}");
+    JsonElement *b = JsonCopy(a);
+
+    const uint64_t hash = JsonHash(a);
+    assert_int_equal(hash, JsonHash(b));
+    assert_true(JsonEqual(a, b));
+
+    /* a change deep down changes the hash of everything above it */
+    JsonElement *z = JsonObjectGetAsArray(
+        JsonObjectGetAsObject(JsonObjectGetAsObject(b, "x"), "y"), "z");
+    JsonArrayAppendInteger(z, 3);
+    assert_int_not_equal(hash, JsonHash(b));
+    assert_int_equal(hash, JsonHash(a));
+    assert_false(JsonEqual(a, b));
+
+    JsonArrayRemoveRange(z, 2, 2);
+    assert_int_equal(hash, JsonHash(b));
+    assert_true(JsonEqual(a, b));
+    assert_int_equal(0, JsonCompare(a, b));
+
+    /* primitives compare (and hash) by their values */
+    JsonElement *s = JsonStringCreate("1");
+    JsonElement *i = JsonIntegerCreate(1);
+    assert_int_equal(0, JsonCompare(s, i));
+    assert_true(JsonEqual(s, i));
+    JsonDestroy(s);
+    JsonDestroy(i);
+
+    JsonDestroy(a);
+    JsonDestroy(b);
+}
+
+static void test_merge_large_objects(void)
+{
+    JsonElement *a = JsonObjectCreate(20000);
+    JsonElement *b = JsonObjectCreate(20000);
+    char key[32];
+    for (int i = 0; i < 20000; i++)
+    {
+        xsnprintf(key, sizeof(key), "key%d", i);
+        JsonObjectAppendInteger(a, key, i);
+        xsnprintf(key, sizeof(key), "key%d", i + 10000);
+        JsonObjectAppendInteger(b, key, -i);
+    }
+
+    JsonElement *merged = JsonMerge(a, b);
+    assert_int_equal(30000, JsonLength(merged));
+
+    /* a's members not in b keep their order, followed by b's */
+    JsonIterator iter = JsonIteratorInit(merged);
+    for (int i = 0; i < 30000; i++)
+    {
+        xsnprintf(key, sizeof(key), "key%d", i);
+        assert_string_equal(key, JsonIteratorNextKey(&iter));
+        assert_int_equal((long) ((i < 10000) ? i : -(i - 10000)),
+                         JsonPrimitiveGetAsInteger(JsonIteratorCurrentValue(&iter)));
+    }
+
+    JsonElement *again = JsonMerge(a, b);
+    assert_true(JsonEqual(merged, again));
+    JsonObjectRemoveKey(again, "key0");
+    assert_false(JsonEqual(merged, again));
+
+    JsonDestroy(again);
+    JsonDestroy(merged);
+    JsonDestroy(a);
+    JsonDestroy(b);
+}
+
 static void test_select(void)
 {
     const char *data = OBJECT_ARRAY;
@@ -1823,6 +2060,153 @@ static void test_json_null_not_null(void)
     JsonDestroy(json);
 }
 
+static void assert_csv_json(const char *csv, size_t size_max,
+                            const JsonCsvOptions *options, const char *expected)
+{
+    JsonElement *json = NULL;
+    assert_true(JsonParseCsvData(csv, strlen(csv), size_max, options, NULL, &json));
+    char *out = JsonToString(json);
+    assert_string_equal(out, expected);
+    free(out);
+
+    /* Copies must not share anything with the original */
+    JsonElement *copy = JsonCopy(json);
+    JsonDestroy(json);
+    out = JsonToString(copy);
+    assert_string_equal(out, expected);
+    free(out);
+    JsonDestroy(copy);
+}
+
+static void test_parse_csv_data(void)
+{
+    const char csv[] = "a,b\r\n1,\"x \"\"y\"\"\"\r\n2,\r\n";
+
+    assert_csv_json(csv, SIZE_MAX, NULL,
+                    "[[\"a\",\"b\"],[\"1\",\"x \\\"y\\\"\"],[\"2\",\"\"]]");
+
+    /* Records ending past size_max are dropped */
+    assert_csv_json(csv, 5, NULL, "[[\"a\",\"b\"]]");
+    assert_csv_json(csv, 4, NULL, "[]");
+    assert_csv_json(csv, strlen(csv) - 1, NULL,
+                    "[[\"a\",\"b\"],[\"1\",\"x \\\"y\\\"\"]]");
+
+    JsonCsvOptions options = JSON_CSV_OPTIONS_DEFAULT;
+    options.header = true;
+    assert_csv_json(csv, SIZE_MAX, &options,
+                    "[{\"a\":\"1\",\"b\":\"x \\\"y\\\"\"},{\"a\":\"2\",\"b\":\"\"}]");
+
+    /* Short records lack keys, extra fields and duplicate columns are dropped */
+    options.separator = ';';
+    options.line_ending = CSV_LINE_ENDING_LF;
+    assert_csv_json("k;v;k\n1;2;3\n4\n5;6;7;8\n", SIZE_MAX, &options,
+                    "[{\"k\":\"3\",\"v\":\"2\"},{},{\"k\":\"7\",\"v\":\"6\"}]");
+    assert_csv_json("k;v\n", SIZE_MAX, &options, "[]");
+}
+
+static void test_parse_csv_file(void)
+{
+    JsonElement *json = NULL;
+    assert_true(JsonParseCsvFile("./data/csv_file.csv", SIZE_MAX, &json));
+    char *out = JsonToString(json);
+    assert_string_equal(out,
+                        "[[\"field_1\",\" field_2\"],"
+                        "[\"field_1\",\"value1 \\nvalue2 \\nvalue3\"],"
+                        "[\"field_1\",\"field,2\"]]");
+    free(out);
+    JsonDestroy(json);
+
+    assert_false(JsonParseCsvFile("./data/no_such_file.csv", SIZE_MAX, &json));
+}
+
+static void test_parse_large_csv_file(void)
+{
+    /* A big import without quotes, the case the records are found in
+     * linear time for (about 9 MB) */
+    const size_t n_records = 200000;
+    char path[] = "/tmp/json_test_csv.XXXXXX";
+    int fd = mkstemp(path);
+    assert_true(fd >= 0);
+    FILE *fp = fdopen(fd, "w");
+    assert_true(fp != NULL);
+    fprintf(fp, "id,name,value\r\n");
+    for (size_t i = 0; i < n_records; i++)
+    {
+        fprintf(fp, "%zu,name of record %zu,%zu\r\n", i, i, i * 7);
+    }
+    assert_int_equal(fclose(fp), 0);
+
+    JsonElement *json = NULL;
+    assert_true(JsonParseCsvFile(path, SIZE_MAX, &json));
+    assert_int_equal(JsonLength(json), n_records + 1);
+    JsonElement *last = JsonAt(json, n_records);
+    assert_string_equal(JsonArrayGetAsString(last, 1), "name of record 199999");
+    JsonDestroy(json);
+
+    JsonCsvOptions options = JSON_CSV_OPTIONS_DEFAULT;
+    options.header = true;
+    assert_true(JsonParseCsvFileWithOptions(path, SIZE_MAX, &options, &json));
+    assert_int_equal(JsonLength(json), n_records);
+    last = JsonArrayGetAsObject(json, n_records - 1);
+    assert_string_equal(JsonObjectGetAsString(last, "value"), "1399993");
+    JsonDestroy(json);
+
+    unlink(path);
+}
+
+/* Write #line to the FIFO at #path over and over, until the reader goes away */
+static pid_t FeedFifo(const char *path, const char *line)
+{
+    pid_t pid = fork();
+    assert_true(pid >= 0);
+    if (pid == 0)
+    {
+        const size_t length = strlen(line);
+        int fd = open(path, O_WRONLY);
+        while (fd >= 0 && write(fd, line, length) == (ssize_t) length)
+        {
+        }
+        _exit(0);
+    }
+    return pid;
+}
+
+static void test_parse_csv_file_size_max(void)
+{
+    char dir[] = "/tmp/json_test_csv.XXXXXX";
+    assert_true(mkdtemp(dir) != NULL);
+    char path[PATH_MAX];
+    xsnprintf(path, sizeof(path), "%s/csv", dir);
+
+    FILE *fp = fopen(path, "w");
+    assert_true(fp != NULL);
+    fputs("a,b\r\nc,d\r\ne,f\r\n", fp);
+    assert_int_equal(fclose(fp), 0);
+
+    /* Records ending past the limit are dropped */
+    JsonElement *json = NULL;
+    assert_true(JsonParseCsvFile(path, 9, &json));
+    assert_int_equal(JsonLength(json), 1);
+    JsonDestroy(json);
+    assert_true(JsonParseCsvFile(path, 10, &json));
+    assert_int_equal(JsonLength(json), 2);
+    JsonDestroy(json);
+    unlink(path);
+
+    /* No more than the limit is read from a stream which does not end */
+    assert_int_equal(mkfifo(path, 0600), 0);
+    pid_t pid = FeedFifo(path, "field_1,field_2\r\n");
+    alarm(60);
+    assert_true(JsonParseCsvFile(path, 1000, &json));
+    alarm(0);
+    assert_int_equal(JsonLength(json), 1000 / strlen("field_1,field_2\r\n"));
+    JsonDestroy(json);
+
+    assert_int_equal(waitpid(pid, NULL, 0), pid);
+    unlink(path);
+    rmdir(dir);
+}
+
 int main()
 {
     PRINT_TEST_BANNER();
@@ -1832,6 +2216,12 @@ int main()
         unit_test(test_array_remove_range),
         unit_test(test_array_extend),
         unit_test(test_copy_compare),
+        unit_test(test_copy_on_write),
+        unit_test(test_compare_ignores_key_order),
+        unit_test(test_hash_follows_changes),
+        unit_test(test_merge_large_objects),
+        unit_test(test_merge_shares_children),
+        unit_test(test_write_copy_while_iterating),
         unit_test(test_detach_key_from_object),
         unit_test(test_iterator_current),
         unit_test(test_merge_array),
@@ -1891,6 +2281,10 @@ int main()
         unit_test(test_string_escape),
         unit_test(test_string_escape_json5),
         unit_test(test_json_null_not_null),
+        unit_test(test_parse_csv_data),
+        unit_test(test_parse_csv_file),
+        unit_test(test_parse_large_csv_file),
+        unit_test(test_parse_csv_file_size_max),
     };
 
     return run_tests(tests);
@@ -0,0 +1,101 @@
+#include <test.h>
+
+#include <lru_cache.h>
+#include <string_lib.h>
+#include <alloc.h>
+
+static LRUCache *NewStringCache(size_t capacity)
+{
+    return LRUCacheNew(capacity, StringHash_untyped, StringEqual_untyped, free);
+}
+
+static void test_hits_and_misses(void)
+{
+    LRUCache *cache = NewStringCache(4);
+
+    assert_true(LRUCacheAcquire(cache, "a") == NULL);
+
+    LRUCacheEntry *entry = LRUCacheInsert(cache, xstrdup("a"));
+    assert_string_equal(LRUCacheEntryGet(entry), "a");
+    LRUCacheRelease(cache, entry);
+
+    for (int i = 0; i < 3; i++)
+    {
+        entry = LRUCacheAcquire(cache, "a");
+        assert_true(entry != NULL);
+        assert_string_equal(LRUCacheEntryGet(entry), "a");
+        LRUCacheRelease(cache, entry);
+    }
+
+    /* Inserting an equal item keeps the cached one. */
+    LRUCacheEntry *first = LRUCacheAcquire(cache, "a");
+    entry = LRUCacheInsert(cache, xstrdup("a"));
+    assert_true(entry == first);
+    LRUCacheRelease(cache, entry);
+    LRUCacheRelease(cache, first);
+
+    LRUCacheStats stats;
+    LRUCacheGetStats(cache, &stats);
+    assert_int_equal(stats.hits, 4);
+    assert_int_equal(stats.misses, 1);
+    assert_int_equal(stats.evictions, 0);
+    assert_int_equal(stats.entries, 1);
+
+    LRUCacheClear(cache);
+    LRUCacheGetStats(cache, &stats);
+    assert_int_equal(stats.hits, 0);
+    assert_int_equal(stats.entries, 0);
+    assert_true(LRUCacheAcquire(cache, "a") == NULL);
+
+    LRUCacheDestroy(cache);
+}
+
+static void test_eviction(void)
+{
+    static const size_t CAPACITY = 3;
+    LRUCache *cache = NewStringCache(CAPACITY);
+
+    LRUCacheRelease(cache, LRUCacheInsert(cache, xstrdup("a")));
+    LRUCacheRelease(cache, LRUCacheInsert(cache, xstrdup("b")));
+    LRUCacheRelease(cache, LRUCacheInsert(cache, xstrdup("c")));
+
+    /* Use "a" so that "b" becomes the least recently used item. */
+    LRUCacheRelease(cache, LRUCacheAcquire(cache, "a"));
+
+    /* Keep "c" in use while it gets evicted. */
+    LRUCacheEntry *c = LRUCacheAcquire(cache, "c");
+
+    LRUCacheRelease(cache, LRUCacheInsert(cache, xstrdup("d")));
+    assert_true(LRUCacheAcquire(cache, "b") == NULL);
+
+    LRUCacheRelease(cache, LRUCacheInsert(cache, xstrdup("e")));
+    LRUCacheRelease(cache, LRUCacheInsert(cache, xstrdup("f")));
+
+    LRUCacheStats stats;
+    LRUCacheGetStats(cache, &stats);
+    assert_int_equal(stats.entries, CAPACITY);
+    assert_int_equal(stats.evictions, 3);
+
+    /* The evicted item stays valid until it is released. */
+    assert_string_equal(LRUCacheEntryGet(c), "c");
+    assert_true(LRUCacheAcquire(cache, "c") == NULL);
+    LRUCacheRelease(cache, c);
+
+    LRUCacheEntry *f = LRUCacheAcquire(cache, "f");
+    assert_true(f != NULL);
+    LRUCacheRelease(cache, f);
+
+    LRUCacheDestroy(cache);
+}
+
+int main()
+{
+    PRINT_TEST_BANNER();
+    const UnitTest tests[] =
+    {
+        unit_test(test_hits_and_misses),
+        unit_test(test_eviction)
+    };
+
+    return run_tests(tests);
+}
@@ -0,0 +1,278 @@
+#include <test.h>
+
+#include <mustache.h>
+#include <json.h>
+#include <misc_lib.h> /* xsnprintf */
+#include <alloc.h>
+
+static JsonElement *LoadSpec(const char *filename)
+{
+    char path[PATH_MAX];
+    xsnprintf(path, sizeof(path), "%s/%s", TESTDATADIR, filename);
+
+    JsonElement *spec = NULL;
+    assert_int_equal(JsonParseFile(path, SIZE_MAX, &spec), JSON_PARSE_OK);
+    return spec;
+}
+
+/* Render every test of a spec file by template text, precompiled and into a Writer. */
+static void RunSpec(const char *filename)
+{
+    JsonElement *spec = LoadSpec(filename);
+    JsonElement *tests = JsonObjectGetAsArray(spec, "tests");
+    assert_true(tests != NULL);
+
+    for (size_t i = 0; i < JsonLength(tests); i++)
+    {
+        JsonElement *test = JsonAt(tests, i);
+        const char *template = JsonObjectGetAsString(test, "template");
+        const char *expected = JsonObjectGetAsString(test, "expected");
+        const JsonElement *data = JsonObjectGet(test, "data");
+
+        Buffer *out = BufferNew();
+        assert_true(MustacheRender(out, template, data));
+        assert_string_equal(expected, BufferData(out));
+
+        MustacheTemplate *compiled = MustacheCompile(template);
+        assert_true(compiled != NULL);
+
+        /* twice, to make sure rendering does not change the template */
+        for (int j = 0; j < 2; j++)
+        {
+            BufferClear(out);
+            assert_true(MustacheRenderTemplate(out, compiled, data));
+            assert_string_equal(expected, BufferData(out));
+        }
+
+        Writer *w = StringWriter();
+        assert_true(MustacheRenderTemplateToWriter(w, compiled, data));
+        assert_string_equal(expected, StringWriterData(w));
+        WriterClose(w);
+
+        MustacheTemplateDestroy(compiled);
+        BufferDestroy(out);
+    }
+
+    JsonDestroy(spec);
+}
+
+static void test_spec_comments(void)
+{
+    RunSpec("mustache_comments.json");
+}
+
+static void test_spec_delimiters(void)
+{
+    RunSpec("mustache_delimiters.json");
+}
+
+static void test_spec_extra(void)
+{
+    RunSpec("mustache_extra.json");
+}
+
+static void test_spec_interpolation(void)
+{
+    RunSpec("mustache_interpolation.json");
+}
+
+static void test_spec_inverted(void)
+{
+    RunSpec("mustache_inverted.json");
+}
+
+static void test_spec_sections(void)
+{
+    RunSpec("mustache_sections.json");
+}
+
+static void AssertRender(const char *template, const char *data, const char *expected)
+{
+    JsonElement *json = NULL;
+    assert_int_equal(JsonParse(&data, &json), JSON_PARSE_OK);
+
+    Buffer *out = BufferNew();
+    assert_true(MustacheRender(out, template, json));
+    assert_string_equal(expected, BufferData(out));
+
+    BufferDestroy(out);
+    JsonDestroy(json);
+}
+
+static void test_key_iteration(void)
+{
+    AssertRender("{{#o}}{{@}}={{.}},{{/o}}", "{\"o\": {\"a\": 1, \"b\": \"x<\"}}",
+                 "a=1,b=x&lt;,");
+    AssertRender("{{#o}}{{{@}}}{{/o}}", "{\"o\": {\"a\": 1, \"b\": 2}}", "ab");
+    AssertRender("{{#l}}{{@}}:{{.}} {{/l}}", "{\"l\": [\"p\", \"q\"]}", "0:p 1:q ");
+
+    /* without {{@}} an object section is rendered once, in its context */
+    AssertRender("{{#o}}{{a}}{{b}}{{/o}}", "{\"o\": {\"a\": 1, \"b\": 2}}", "12");
+}
+
+static void test_section_scope(void)
+{
+    /* the context of a section ends with it, also after iterating a list */
+    AssertRender("{{#s}}{{#l}}{{.}}{{/l}}{{name}}{{/s}}{{name}}",
+                 "{\"name\": \"outer\", \"s\": {\"name\": \"inner\", \"l\": [1]}}",
+                 "1innerouter");
+
+    /* nothing in a skipped section is rendered */
+    AssertRender("{{#f}}{{^e}}X{{/e}}{{/f}}", "{\"f\": false, \"e\": []}", "");
+}
+
+static void test_top_and_serialization(void)
+{
+    AssertRender("{{#o}}{{x}}{{-top-.x}}{{/o}}", "{\"x\": \"T\", \"o\": {\"x\": \"I\"}}", "IT");
+    AssertRender("{{$o}} {{$o.b}}", "{\"o\": {\"b\": [1, 2], \"a\": true}}",
+                 "{\"a\":true,\"b\":[1,2]} [1,2]");
+}
+
+static void test_broken_templates(void)
+{
+    const char *broken[] = {
+        "{{#s}}unclosed",
+        "unopened{{/s}}",
+        "{{{unbalanced}}",
+        "{{no end",
+        "{{=<% bad delimiters=}}",
+    };
+
+    for (size_t i = 0; i < sizeof(broken) / sizeof(broken[0]); i++)
+    {
+        assert_true(MustacheCompile(broken[i]) == NULL);
+
+        Buffer *out = BufferNew();
+        assert_false(MustacheRender(out, broken[i], NULL));
+        BufferDestroy(out);
+    }
+
+    /* sections must be booleans or containers */
+    JsonElement *data = JsonObjectCreate(1);
+    JsonObjectAppendString(data, "s", "string");
+    Buffer *out = BufferNew();
+    assert_false(MustacheRender(out, "{{#s}}x{{/s}}", data));
+    BufferDestroy(out);
+    JsonDestroy(data);
+}
+
+static void test_render_to_writer(void)
+{
+    /* enough output to go through the local buffer several times, with
+     * spans both smaller and larger than it */
+    JsonElement *data = JsonObjectCreate(2);
+    JsonElement *items = JsonArrayCreate(1000);
+    for (int i = 0; i < 1000; i++)
+    {
+        JsonArrayAppendString(items, "a<b>&\"c\"");
+    }
+    JsonObjectAppendArray(data, "items", items);
+
+    char *big = xcalloc(20001, 1);
+    memset(big, '&', 10000);
+    memset(big + 10000, 'x', 10000);
+    JsonObjectAppendString(data, "big", big);
+    free(big);
+
+    const char *template = "{{#items}}{{@}}: {{.}} {{{.}}}\n{{/items}}{{big}}{{&big}}{{%items}}";
+
+    Buffer *expected = BufferNew();
+    assert_true(MustacheRender(expected, template, data));
+    assert_true(BufferSize(expected) > 100000);
+
+    Writer *w = StringWriter();
+    assert_true(MustacheRenderToWriter(w, template, data));
+    assert_int_equal(StringWriterLength(w), BufferSize(expected));
+    assert_string_equal(StringWriterData(w), BufferData(expected));
+    WriterClose(w);
+
+    FILE *f = tmpfile();
+    assert_true(f != NULL);
+    w = FileWriter(f);
+    assert_true(MustacheRenderToWriter(w, template, data));
+    assert_true(fflush(f) == 0);
+
+    rewind(f);
+    char *written = xcalloc(BufferSize(expected) + 1, 1);
+    assert_int_equal(fread(written, 1, BufferSize(expected) + 1, f), BufferSize(expected));
+    assert_string_equal(written, BufferData(expected));
+    free(written);
+    WriterClose(w);
+
+    /* broken templates fail, and so does rendering */
+    w = StringWriter();
+    assert_false(MustacheRenderToWriter(w, "{{#items}}", data));
+    assert_false(MustacheRenderToWriter(w, "{{@}}", data));
+    WriterClose(w);
+
+    BufferDestroy(expected);
+    JsonDestroy(data);
+}
+
+static void test_cache(void)
+{
+    MustacheCacheClear();
+
+    JsonElement *data = JsonObjectCreate(1);
+    JsonObjectAppendString(data, "x", "y");
+
+    Buffer *out = BufferNew();
+    for (int i = 0; i < 3; i++)
+    {
+        BufferClear(out);
+        assert_true(MustacheRender(out, "x={{x}}", data));
+        assert_string_equal("x=y", BufferData(out));
+    }
+
+    MustacheCacheStats stats;
+    MustacheCacheGetStats(&stats);
+    assert_int_equal(stats.misses, 1);
+    assert_int_equal(stats.hits, 2);
+    assert_int_equal(stats.entries, 1);
+
+    /* fill the cache with other templates until the first one is evicted */
+    char template[64];
+    for (int i = 0; i < 100; i++)
+    {
+        xsnprintf(template, sizeof(template), "%d={{x}}", i);
+        BufferClear(out);
+        assert_true(MustacheRender(out, template, data));
+    }
+
+    MustacheCacheGetStats(&stats);
+    assert_true(stats.evictions > 0);
+    assert_true(stats.entries < 100);
+
+    BufferClear(out);
+    assert_true(MustacheRender(out, "x={{x}}", data));
+    assert_string_equal("x=y", BufferData(out));
+
+    MustacheCacheClear();
+    MustacheCacheGetStats(&stats);
+    assert_int_equal(stats.entries, 0);
+
+    BufferDestroy(out);
+    JsonDestroy(data);
+}
+
+int main()
+{
+    PRINT_TEST_BANNER();
+    const UnitTest tests[] =
+    {
+        unit_test(test_spec_comments),
+        unit_test(test_spec_delimiters),
+        unit_test(test_spec_extra),
+        unit_test(test_spec_interpolation),
+        unit_test(test_spec_inverted),
+        unit_test(test_spec_sections),
+        unit_test(test_key_iteration),
+        unit_test(test_section_scope),
+        unit_test(test_top_and_serialization),
+        unit_test(test_broken_templates),
+        unit_test(test_render_to_writer),
+        unit_test(test_cache),
+    };
+
+    return run_tests(tests);
+}
@@ -0,0 +1,170 @@
+/*
+ * Matching host names against sets of patterns, with a RegexSet and with
+ * precompiled patterns tried one by one like the code it replaces:
+ *
+ *   make -C tests/unit regex_set_benchmark && tests/unit/regex_set_benchmark
+ *
+ * Not run by "make check", the numbers depend too much on the machine.
+ */
+
+#include <platform.h>
+#include <regex_set.h>
+#include <regex.h>
+#include <sequence.h>
+#include <string_lib.h>
+#include <alloc.h>
+
+#define BENCHMARK_SUBJECTS 1000
+#define BENCHMARK_MATCHES 1000000       /* patterns times subjects, per run */
+
+static volatile size_t sink;                                        /* GLOBAL_X */
+
+static double Now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Host name classes as found in policies: literals and simple patterns */
+static char *Pattern(size_t i)
+{
+    switch (i % 4)
+    {
+    case 0:
+        return StringFormat("host%zu.example.com", i);
+    case 1:
+        return StringFormat("host%zu\\.example\\.(com|org)", i);
+    case 2:
+        return StringFormat("web[0-9]+-%zu\\.example\\.com", i);
+    default:
+        return StringFormat("db%zu-(primary|replica)\\..*", i);
+    }
+}
+
+static char *Subject(size_t i, size_t n_patterns)
+{
+    /* half of them matching one of the patterns */
+    const size_t n = (i / 2) % n_patterns;
+    if (i % 2 != 0)
+    {
+        return StringFormat("client%zu.example.net", i);
+    }
+    switch (n % 4)
+    {
+    case 0:
+        return StringFormat("host%zu.example.com", n);
+    case 1:
+        return StringFormat("host%zu.example.org", n);
+    case 2:
+        return StringFormat("web42-%zu.example.com", n);
+    default:
+        return StringFormat("db%zu-replica.example.com", n);
+    }
+}
+
+static void Benchmark(size_t n_patterns)
+{
+    Seq *patterns = SeqNew(n_patterns, free);
+    Regex **regexes = xmalloc(n_patterns * sizeof(Regex *));
+    for (size_t i = 0; i < n_patterns; i++)
+    {
+        SeqAppend(patterns, Pattern(i));
+        regexes[i] = RegexCompile(SeqAt(patterns, i), PCRE_MULTILINE | PCRE_DOTALL);
+    }
+
+    char *subjects[BENCHMARK_SUBJECTS];
+    for (size_t i = 0; i < BENCHMARK_SUBJECTS; i++)
+    {
+        subjects[i] = Subject(i, n_patterns);
+    }
+
+    const size_t rounds = MAX(BENCHMARK_MATCHES / (n_patterns * BENCHMARK_SUBJECTS), 1);
+    const size_t calls = rounds * BENCHMARK_SUBJECTS;
+    bool *matched = xmalloc(n_patterns * sizeof(bool));
+
+    printf("%zu patterns:\n", n_patterns);
+
+    double start = Now();
+    RegexSet *set = RegexSetNew(patterns, true);
+    printf("  %-36s %10.1f ms\n", "build, RegexSetNew()", (Now() - start) * 1e3);
+
+    start = Now();
+    for (size_t r = 0; r < rounds; r++)
+    {
+        for (size_t i = 0; i < BENCHMARK_SUBJECTS; i++)
+        {
+            const size_t len = strlen(subjects[i]);
+            for (size_t p = 0; p < n_patterns; p++)
+            {
+                sink += StringMatchFullWithPrecompiledRegex(regexes[p], subjects[i], len);
+            }
+        }
+    }
+    printf("  %-36s %10.1f ns\n", "all, one by one",
+           (Now() - start) * 1e9 / calls);
+
+    start = Now();
+    for (size_t r = 0; r < rounds; r++)
+    {
+        for (size_t i = 0; i < BENCHMARK_SUBJECTS; i++)
+        {
+            sink += RegexSetMatch(set, subjects[i], strlen(subjects[i]), matched);
+        }
+    }
+    printf("  %-36s %10.1f ns\n", "all, RegexSetMatch()",
+           (Now() - start) * 1e9 / calls);
+
+    start = Now();
+    for (size_t r = 0; r < rounds; r++)
+    {
+        for (size_t i = 0; i < BENCHMARK_SUBJECTS; i++)
+        {
+            const size_t len = strlen(subjects[i]);
+            for (size_t p = 0; p < n_patterns; p++)
+            {
+                if (StringMatchFullWithPrecompiledRegex(regexes[p], subjects[i], len))
+                {
+                    sink++;
+                    break;
+                }
+            }
+        }
+    }
+    printf("  %-36s %10.1f ns\n", "any, one by one",
+           (Now() - start) * 1e9 / calls);
+
+    start = Now();
+    for (size_t r = 0; r < rounds; r++)
+    {
+        for (size_t i = 0; i < BENCHMARK_SUBJECTS; i++)
+        {
+            sink += RegexSetMatchAny(set, subjects[i], strlen(subjects[i]));
+        }
+    }
+    printf("  %-36s %10.1f ns\n", "any, RegexSetMatchAny()",
+           (Now() - start) * 1e9 / calls);
+
+    RegexSetDestroy(set);
+    free(matched);
+    for (size_t i = 0; i < BENCHMARK_SUBJECTS; i++)
+    {
+        free(subjects[i]);
+    }
+    for (size_t i = 0; i < n_patterns; i++)
+    {
+        RegexDestroy(regexes[i]);
+    }
+    free(regexes);
+    SeqDestroy(patterns);
+}
+
+int main()
+{
+    static const size_t counts[] = { 10, 100, 1000 };
+    for (size_t i = 0; i < sizeof(counts) / sizeof(counts[0]); i++)
+    {
+        Benchmark(counts[i]);
+    }
+    return 0;
+}
@@ -0,0 +1,180 @@
+#include <test.h>
+
+#include <regex_set.h>
+#include <regex.h>
+#include <sequence.h>
+#include <alloc.h>
+
+static const char *const PATTERNS[] =
+{
+    "foo",                      /* literal */
+    "fo+",                      /* combined */
+    "b(a)(r)",                  /* combined, with captures */
+    "(b)\\1",                   /* backreference, matched on its own */
+    "(?i)BAZ",                  /* scoped inline option, combined */
+    "foo",                      /* duplicate literal */
+    "a|ab",                     /* alternation inside a pattern */
+    "[()]x",                    /* parentheses in a class */
+    "x|(x)\\1",                 /* alternation matched on its own */
+    "\\Qa.b",                   /* unterminated quote, matched on its own */
+    "(?x) c d # comment",       /* extended mode, matched on its own */
+};
+#define N_PATTERNS (sizeof(PATTERNS) / sizeof(PATTERNS[0]))
+
+static RegexSet *NewSet(bool anchored)
+{
+    Seq *patterns = SeqNew(N_PATTERNS, NULL);
+    for (size_t i = 0; i < N_PATTERNS; i++)
+    {
+        SeqAppend(patterns, (void *) PATTERNS[i]);
+    }
+    RegexSet *set = RegexSetNew(patterns, anchored);
+    SeqDestroy(patterns);
+    return set;
+}
+
+/* Reference result computed pattern by pattern. */
+static void assert_same_as_separate(const RegexSet *set, bool anchored, const char *str)
+{
+    bool matched[N_PATTERNS];
+    size_t n = RegexSetMatch(set, str, strlen(str), matched);
+
+    size_t expected_n = 0;
+    for (size_t i = 0; i < N_PATTERNS; i++)
+    {
+        Regex *regex = RegexCompile(PATTERNS[i], PCRE_MULTILINE | PCRE_DOTALL);
+        size_t start, end;
+        bool expected = StringMatchWithPrecompiledRegex(regex, str, strlen(str), &start, &end);
+        if (anchored && expected)
+        {
+            /* anchored sets backtrack into alternatives, so use an anchored
+             * pattern rather than StringMatchFull() as the reference, with
+             * \Q and comments ended before the closing parenthesis */
+            char *full;
+            xasprintf(&full, "\\A(?:%s%s\\E)\\z", PATTERNS[i],
+                      (strstr(PATTERNS[i], "(?x)") != NULL) ? "\n" : "");
+            Regex *full_regex = RegexCompile(full, PCRE_MULTILINE | PCRE_DOTALL);
+            expected = StringMatchWithPrecompiledRegex(full_regex, str, strlen(str), NULL, NULL);
+            RegexDestroy(full_regex);
+            free(full);
+        }
+        RegexDestroy(regex);
+
+        assert_int_equal(matched[i], expected);
+        expected_n += expected;
+    }
+    assert_int_equal(n, expected_n);
+    assert_int_equal(RegexSetMatchAny(set, str, strlen(str)), expected_n > 0);
+}
+
+static const char *const SUBJECTS[] =
+{
+    "", "foo", "fooo", "bar", "bb", "baz", "xBaZx", "a", "ab", "(x", ")x",
+    "foobar", "nothing here", "xbbx", "\nfoo\n", "xx", "a.b", "axb", "cd",
+};
+#define N_SUBJECTS (sizeof(SUBJECTS) / sizeof(SUBJECTS[0]))
+
+static void test_anchored(void)
+{
+    RegexSet *set = NewSet(true);
+    assert_true(set != NULL);
+    assert_int_equal(RegexSetCount(set), N_PATTERNS);
+
+    bool matched[N_PATTERNS];
+    assert_int_equal(RegexSetMatch(set, "foo", 3, matched), 3);
+    assert_true(matched[0]);
+    assert_true(matched[1]);
+    assert_true(matched[5]);
+    assert_int_equal(RegexSetMatch(set, "ab", 2, matched), 1);
+    assert_true(matched[6]);
+    assert_int_equal(RegexSetMatch(set, "bb", 2, NULL), 1);
+    assert_false(RegexSetMatchAny(set, "foobar", 6));
+    assert_int_equal(RegexSetMatch(set, "xx", 2, matched), 1);
+    assert_true(matched[8]);
+    assert_int_equal(RegexSetMatch(set, "a.b", 3, matched), 1);
+    assert_true(matched[9]);
+    assert_int_equal(RegexSetMatch(set, "cd", 2, matched), 1);
+    assert_true(matched[10]);
+
+    for (size_t i = 0; i < N_SUBJECTS; i++)
+    {
+        assert_same_as_separate(set, true, SUBJECTS[i]);
+    }
+
+    RegexSetDestroy(set);
+}
+
+static void test_unanchored(void)
+{
+    RegexSet *set = NewSet(false);
+    assert_true(set != NULL);
+
+    bool matched[N_PATTERNS];
+    assert_int_equal(RegexSetMatch(set, "foobar", 6, matched), 5);
+    assert_true(matched[2]);
+    assert_true(matched[6]);
+    assert_true(RegexSetMatchAny(set, "xbbx", 4));
+    assert_false(RegexSetMatchAny(set, "nothing", 7));
+
+    for (size_t i = 0; i < N_SUBJECTS; i++)
+    {
+        assert_same_as_separate(set, false, SUBJECTS[i]);
+    }
+
+    RegexSetDestroy(set);
+}
+
+static void test_empty_and_invalid(void)
+{
+    Seq *patterns = SeqNew(1, NULL);
+
+    RegexSet *set = RegexSetNew(patterns, true);
+    assert_int_equal(RegexSetCount(set), 0);
+    assert_int_equal(RegexSetMatch(set, "x", 1, NULL), 0);
+    assert_false(RegexSetMatchAny(set, "x", 1));
+    RegexSetDestroy(set);
+
+    SeqAppend(patterns, "ok");
+    SeqAppend(patterns, "(");
+    assert_true(RegexSetNew(patterns, true) == NULL);
+
+    SeqDestroy(patterns);
+}
+
+static void test_many_patterns(void)
+{
+    Seq *patterns = SeqNew(500, free);
+    for (int i = 0; i < 500; i++)
+    {
+        char *pattern;
+        xasprintf(&pattern, (i % 2) ? "host%d" : "host%d\\.example\\.(com|org)", i);
+        SeqAppend(patterns, pattern);
+    }
+
+    RegexSet *set = RegexSetNew(patterns, true);
+    assert_true(set != NULL);
+
+    bool matched[500];
+    assert_int_equal(RegexSetMatch(set, "host42.example.org", 18, matched), 1);
+    assert_true(matched[42]);
+    assert_int_equal(RegexSetMatch(set, "host43", 6, matched), 1);
+    assert_true(matched[43]);
+    assert_false(RegexSetMatchAny(set, "host43.example.org", 18));
+
+    RegexSetDestroy(set);
+    SeqDestroy(patterns);
+}
+
+int main()
+{
+    PRINT_TEST_BANNER();
+    const UnitTest tests[] =
+    {
+        unit_test(test_anchored),
+        unit_test(test_unanchored),
+        unit_test(test_empty_and_invalid),
+        unit_test(test_many_patterns),
+    };
+
+    return run_tests(tests);
+}
@@ -0,0 +1,162 @@
+/*
+ * Compares the implementations of the vectorized string functions:
+ *
+ *   make -C tests/unit string_lib_benchmark && tests/unit/string_lib_benchmark
+ *
+ * Not run by "make check", the numbers depend too much on the machine.
+ */
+
+#include <platform.h>
+#include <string_lib.h>
+#include <string_simd.h>
+#include <alloc.h>
+
+#define BENCHMARK_BYTES (64 * 1024 * 1024)
+
+typedef void (*BenchmarkFunction)(char *str, char *out, size_t size);
+
+static volatile size_t sink;                                        /* GLOBAL_X */
+
+static void BenchToLower(char *str, ARG_UNUSED char *out, ARG_UNUSED size_t size)
+{
+    ToLowerStrInplace(str);
+}
+
+static void BenchToUpper(char *str, ARG_UNUSED char *out, ARG_UNUSED size_t size)
+{
+    ToUpperStrInplace(str);
+}
+
+static void BenchCanonify(char *str, char *out, ARG_UNUSED size_t size)
+{
+    StringCanonify(out, str);
+}
+
+static void BenchCanonifyInPlace(char *str, ARG_UNUSED char *out, ARG_UNUSED size_t size)
+{
+    CanonifyNameInPlace(str);
+}
+
+static void BenchIsNumeric(char *str, ARG_UNUSED char *out, ARG_UNUSED size_t size)
+{
+    sink += StringIsNumeric(str);
+}
+
+static void BenchIsPrintable(char *str, ARG_UNUSED char *out, ARG_UNUSED size_t size)
+{
+    sink += StringIsPrintable(str);
+}
+
+static void BenchCountChar(char *str, ARG_UNUSED char *out, ARG_UNUSED size_t size)
+{
+    sink += CountChar(str, '.');
+}
+
+static void BenchReplaceChar(char *str, char *out, size_t size)
+{
+    ReplaceChar(str, out, size, '.', '_');
+}
+
+static void BenchMemcchr(ARG_UNUSED char *str, char *out, size_t size)
+{
+    sink += (memcchr(out, 'x', size - 1) != NULL);
+}
+
+static void BenchStringHash(char *str, ARG_UNUSED char *out, ARG_UNUSED size_t size)
+{
+    sink += StringHash(str, 0);
+}
+
+static const struct
+{
+    const char *name;
+    BenchmarkFunction function;
+    bool numeric;                /* needs a string of digits to do its job */
+} BENCHMARKS[] = {
+    { "ToLowerStrInplace", BenchToLower, false },
+    { "ToUpperStrInplace", BenchToUpper, false },
+    { "StringCanonify", BenchCanonify, false },
+    { "CanonifyNameInPlace", BenchCanonifyInPlace, false },
+    { "StringIsNumeric", BenchIsNumeric, true },
+    { "StringIsPrintable", BenchIsPrintable, false },
+    { "CountChar", BenchCountChar, false },
+    { "ReplaceChar", BenchReplaceChar, false },
+    { "memcchr", BenchMemcchr, false },
+    { "StringHash", BenchStringHash, false },
+};
+
+static double Now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* A class or variable name like the ones canonified all the time */
+static void FillName(char *str, size_t len, bool numeric)
+{
+    static const char name_chars[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789.-:_";
+    for (size_t i = 0; i < len; i++)
+    {
+        str[i] = numeric ? '0' + (i % 10) : name_chars[(i * 7) % (sizeof(name_chars) - 1)];
+    }
+    str[len] = '\0';
+}
+
+int main(int argc, char **argv)
+{
+    static const size_t lengths[] = { 16, 32, 64, 256, 4096 };
+    const StringSimdLevel best = StringSimdGetLevel();
+
+    printf("%-20s %6s", "function", "bytes");
+    for (StringSimdLevel level = STRING_SIMD_SCALAR; level <= best; level++)
+    {
+        printf(" %10s", StringSimdLevelToString(level));
+    }
+    printf("   (ns per call)\n");
+
+    for (size_t b = 0; b < sizeof(BENCHMARKS) / sizeof(BENCHMARKS[0]); b++)
+    {
+        /* only run the benchmarks named on the command line, if any */
+        bool selected = (argc < 2);
+        for (int i = 1; i < argc; i++)
+        {
+            selected = selected || (strcmp(argv[i], BENCHMARKS[b].name) == 0);
+        }
+        if (!selected)
+        {
+            continue;
+        }
+
+        for (size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++)
+        {
+            const size_t len = lengths[l];
+            const size_t iterations = BENCHMARK_BYTES / len;
+            char *str = xmalloc(len + 1);
+            char *out = xcalloc(len + 1, 1);
+
+            printf("%-20s %6zu", BENCHMARKS[b].name, len);
+            for (StringSimdLevel level = STRING_SIMD_SCALAR; level <= best; level++)
+            {
+                StringSimdSetLevel(level);
+                FillName(str, len, BENCHMARKS[b].numeric);
+                memset(out, 'x', len);
+
+                const double start = Now();
+                for (size_t i = 0; i < iterations; i++)
+                {
+                    BENCHMARKS[b].function(str, out, len + 1);
+                }
+                printf(" %10.1f", (Now() - start) * 1e9 / iterations);
+                fflush(stdout);
+            }
+            printf("\n");
+
+            free(str);
+            free(out);
+        }
+    }
+
+    StringSimdSetLevel(best);
+    return 0;
+}
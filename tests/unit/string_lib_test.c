@@ -1,9 +1,15 @@
 #include <platform.h>
 #include <definitions.h>
 #include <string_lib.h>
+#include <string_simd.h>
+#include <misc_lib.h> /* xsnprintf */
 #include <alloc.h>
 #include <regex.h>
 #include <encode.h>
+#include <buffer.h>
+#include <sequence.h>
+#include <logging.h>
+#include <logging_priv.h>
 
 #include <test.h>
 
@@ -868,6 +874,121 @@ static void test_safe_equal_n(void)
     assert_true(StringEqualN_IgnoreCase("123abc", "123ABC", 1000));
 }
 
+static void test_memcchr(void)
+{
+    char buf[100];
+    memset(buf, 'a', sizeof(buf));
+
+    for (size_t start = 0; start < 9; start++)
+    {
+        for (size_t len = 0; start + len <= sizeof(buf); len++)
+        {
+            assert_true(memcchr(buf + start, 'a', len) == NULL);
+
+            for (size_t i = 0; i < len; i++)
+            {
+                buf[start + i] = 'b';
+                assert_true(memcchr(buf + start, 'a', len) == buf + start + i);
+                buf[start + i] = 'a';
+            }
+        }
+    }
+
+    assert_true(memcchr("\0\0\0\0\0\0\0\0\0\xff", '\0', 10) != NULL);
+    assert_true(memcchr("\xff\xff", 0xff, 2) == NULL);
+}
+
+/* Results of the vectorized string functions on #str, with the given implementation */
+static char *SimdResults(StringSimdLevel level, const char *str)
+{
+    assert_int_equal(StringSimdSetLevel(level), level);
+    const size_t len = strlen(str);
+
+    char *lower = xstrdup(str);
+    ToLowerStrInplace(lower);
+    char *upper = xstrdup(str);
+    ToUpperStrInplace(upper);
+    char *canon = xcalloc(len + 1, 1);
+    assert_true(StringCanonify(canon, str) == canon + len);
+    char *canon_inplace = xstrdup(str);
+    CanonifyNameInPlace(canon_inplace);
+    char *replaced = xcalloc(len + 8, 1);
+    ReplaceChar(str, replaced, len + 8, 'a', '#');
+    char *truncated = xcalloc(len / 2 + 1, 1);
+    ReplaceChar(str, truncated, len / 2 + 1, 'a', '#');
+    const void *nondigit = memcchr(str, '1', len);
+
+    /* ToUpper() turns some control characters into '\0', keep all of it */
+    char *result = xcalloc(len * 6 + 64, 1);
+    char *p = result;
+    memcpy(p, lower, len);
+    p += len;
+    memcpy(p, upper, len);
+    p += len;
+    memcpy(p, canon, len);
+    p += len;
+    memcpy(p, canon_inplace, len);
+    p += len;
+    memcpy(p, replaced, len);
+    p += len;
+    memcpy(p, truncated, len / 2);
+    p += len / 2;
+    xsnprintf(p, 64, "%d%d%d%d%td", StringIsNumeric(str), StringIsPrintable(str),
+              CountChar(str, '.'), CountChar(str, '\\'),
+              (nondigit == NULL) ? -1 : ((const char *) nondigit - str));
+
+    free(lower);
+    free(upper);
+    free(canon);
+    free(canon_inplace);
+    free(replaced);
+    free(truncated);
+    return result;
+}
+
+static void test_simd_levels(void)
+{
+    const StringSimdLevel supported = StringSimdSetLevel(STRING_SIMD_AVX2);
+
+    /* character sets exercising the special cases of every function */
+    const char *alphabets[] = {
+        "1",
+        "0123456789",
+        "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789",
+        "aZ09 !~.@[`{/:",
+        "a.\\.b\\\\",
+        "ab.\x7f\x01\t\x80\xe9\xff",
+    };
+
+    char str[300];
+    unsigned int seed = 42;
+    for (size_t a = 0; a < sizeof(alphabets) / sizeof(alphabets[0]); a++)
+    {
+        const char *alphabet = alphabets[a];
+        const size_t alphabet_len = strlen(alphabet);
+
+        for (size_t len = 0; len < sizeof(str); len += (len < 80) ? 1 : 37)
+        {
+            for (size_t i = 0; i < len; i++)
+            {
+                str[i] = alphabet[rand_r(&seed) % alphabet_len];
+            }
+            str[len] = '\0';
+
+            char *expected = SimdResults(STRING_SIMD_SCALAR, str);
+            for (StringSimdLevel level = STRING_SIMD_SSE2; level <= supported; level++)
+            {
+                char *actual = SimdResults(level, str);
+                assert_memory_equal(expected, actual, len * 6 + 64);
+                free(actual);
+            }
+            free(expected);
+        }
+    }
+
+    StringSimdSetLevel(supported);
+}
+
 static void test_match(void)
 {
 #ifdef WITH_PCRE
@@ -889,6 +1010,117 @@ static void test_match_full(void)
 #endif // WITH_PCRE
 }
 
+static void test_match_precompiled(void)
+{
+#ifdef WITH_PCRE
+    Regex *regex = RegexCompile("^a(b+)(?<tail>c?)$", PCRE_MULTILINE | PCRE_DOTALL);
+    assert_true(regex != NULL);
+    assert_int_equal(RegexGetCaptureCount(regex), 2);
+
+    size_t start, end;
+    assert_true(StringMatchWithPrecompiledRegex(regex, "abbc", 4, &start, &end));
+    assert_int_equal(start, 0);
+    assert_int_equal(end, 4);
+    assert_true(StringMatchFullWithPrecompiledRegex(regex, "abbcXXX", 3));
+    assert_false(StringMatchFullWithPrecompiledRegex(regex, "abbcXXX", 7));
+    assert_false(StringMatchWithPrecompiledRegex(regex, "ac", 2, &start, &end));
+    assert_int_equal(end, 0);
+
+    Seq *captures = StringMatchCapturesWithPrecompiledRegex(regex, "abbb", 4, true);
+    assert_true(captures != NULL);
+    assert_int_equal(SeqLength(captures), 6);
+    assert_string_equal(BufferData(SeqAt(captures, 3)), "bbb");
+    assert_string_equal(BufferData(SeqAt(captures, 4)), "tail");
+    assert_string_equal(BufferData(SeqAt(captures, 5)), "");
+    SeqDestroy(captures);
+
+    assert_true(StringMatchFullWithPrecompiledRegex(regex, "abc", 3));
+    assert_false(StringMatchFullWithPrecompiledRegex(regex, "abcd", 4));
+
+    RegexDestroy(regex);
+
+    assert_true(RegexCompile("(", 0) == NULL);
+#endif // WITH_PCRE
+}
+
+static int logged_regex_errors = 0;
+
+static char *CountRegexErrors(ARG_UNUSED LoggingPrivContext *context,
+                              LogLevel level, const char *message)
+{
+    if (level == LOG_LEVEL_ERR && StringStartsWith(message, "Regular expression error"))
+    {
+        logged_regex_errors++;
+    }
+    return (char *) message;
+}
+
+static void test_match_cache(void)
+{
+#ifdef WITH_PCRE
+    RegexCacheClear();
+
+    RegexCacheStats stats;
+    RegexCacheGetStats(&stats);
+    assert_int_equal(stats.hits, 0);
+    assert_int_equal(stats.misses, 0);
+    assert_int_equal(stats.entries, 0);
+
+    for (int i = 0; i < 10; i++)
+    {
+        assert_true(StringMatchFull("^a.*$", "abc"));
+        assert_false(StringMatchFull("^a.*$", "bac"));
+    }
+    assert_true(CompareStringOrRegex("abc", "^a.*$", true));
+
+    RegexCacheGetStats(&stats);
+    assert_int_equal(stats.misses, 1);
+    assert_int_equal(stats.hits, 20);
+    assert_int_equal(stats.entries, 1);
+
+    /* Invalid patterns are cached too, they are only compiled once, but
+     * their error is logged for every caller asking for it. */
+    LoggingPrivContext log_context = {
+        .log_hook = CountRegexErrors,
+        .force_hook_level = LOG_LEVEL_ERR,
+    };
+    LoggingPrivSetContext(&log_context);
+    logged_regex_errors = 0;
+    for (int i = 0; i < 5; i++)
+    {
+        assert_false(StringMatchFull("(", "("));
+        assert_false(StringMatch("(", "(", NULL, NULL));
+    }
+    assert_true(StringMatchCaptures("(", "(", false) == NULL);
+    LoggingPrivSetContext(NULL);
+    assert_int_equal(logged_regex_errors, 10);
+    RegexCacheGetStats(&stats);
+    assert_int_equal(stats.misses, 2);
+    assert_int_equal(stats.hits, 30);
+    assert_int_equal(stats.entries, 2);
+
+    /* Overflow the cache, the oldest entries get evicted. */
+    char pattern[32];
+    char subject[32];
+    for (int i = 0; i < 1000; i++)
+    {
+        snprintf(pattern, sizeof(pattern), "^a%d$", i);
+        snprintf(subject, sizeof(subject), "a%d", i);
+        assert_true(StringMatch(pattern, subject, NULL, NULL));
+    }
+    RegexCacheGetStats(&stats);
+    assert_true(stats.evictions > 0);
+    assert_true(stats.entries < 1000);
+    assert_true(StringMatchFull("^a999$", "a999"));
+    RegexCacheGetStats(&stats);
+    assert_int_equal(stats.misses, 1002);
+
+    RegexCacheClear();
+    RegexCacheGetStats(&stats);
+    assert_int_equal(stats.entries, 0);
+#endif // WITH_PCRE
+}
+
 static void test_encode_base64(void)
 {
 #ifdef WITH_OPENSSL
@@ -1533,8 +1765,12 @@ int main()
         unit_test(test_safe_equal_ignore_case),
         unit_test(test_safe_equal_n),
 
+        unit_test(test_memcchr),
+        unit_test(test_simd_levels),
         unit_test(test_match),
         unit_test(test_match_full),
+        unit_test(test_match_precompiled),
+        unit_test(test_match_cache),
 
         unit_test(test_encode_base64),
 
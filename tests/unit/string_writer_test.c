@@ -2,6 +2,7 @@
 
 #include <platform.h>
 #include <writer.h>
+#include <alloc.h>
 
 void test_empty_string_buffer(void)
 {
@@ -76,6 +77,116 @@ void test_release_string(void)
     free(ret);
 }
 
+/* Concatenation of all the chunks of a ChunkedWriter */
+static char *ChunkedWriterJoin(const Writer *w)
+{
+    char *ret = xcalloc(ChunkedWriterLength(w) + 1, 1);
+    size_t offset = 0;
+    for (size_t i = 0; i < ChunkedWriterChunkCount(w); i++)
+    {
+        size_t length;
+        const char *chunk = ChunkedWriterChunk(w, i, &length);
+        memcpy(ret + offset, chunk, length);
+        offset += length;
+    }
+    assert_int_equal(offset, ChunkedWriterLength(w));
+    return ret;
+}
+
+void test_chunked_writer(void)
+{
+    Writer *w = ChunkedWriter(4);
+    assert_int_equal(ChunkedWriterLength(w), 0);
+    assert_int_equal(ChunkedWriterChunkCount(w), 0);
+
+    WriterWrite(w, "123");
+    WriterWriteChar(w, '4');
+    WriterWriteChar(w, '5');
+    WriterWriteLen(w, "6789abc", 4);
+    WriterWriteF(w, "%d", 0);
+    WriterWriteF(w, "%s-%d", "long", 42);
+
+    assert_int_equal(ChunkedWriterLength(w), 17);
+    assert_int_equal(ChunkedWriterChunkCount(w), 5);
+
+    char *joined = ChunkedWriterJoin(w);
+    assert_string_equal(joined, "1234567890long-42");
+    free(joined);
+
+    char *ret = ChunkedWriterClose(w);
+    assert_string_equal(ret, "1234567890long-42");
+    free(ret);
+
+    /* a single chunk is handed over as is */
+    w = ChunkedWriter(0);
+    WriterWrite(w, "abc");
+    ret = ChunkedWriterClose(w);
+    assert_string_equal(ret, "abc");
+    free(ret);
+
+    w = ChunkedWriter(0);
+    ret = ChunkedWriterClose(w);
+    assert_string_equal(ret, "");
+    free(ret);
+}
+
+void test_chunked_writer_flush(void)
+{
+    FILE *f = tmpfile();
+    assert_true(f != NULL);
+    const int fd = fileno(f);
+
+    Writer *w = ChunkedWriter(7);
+    for (int i = 0; i < 1000; i++)
+    {
+        WriterWriteF(w, "%d,", i);
+    }
+    const size_t length = ChunkedWriterLength(w);
+    char *expected = ChunkedWriterJoin(w);
+
+    assert_true(ChunkedWriterFlushToFd(w, fd));
+    assert_int_equal(ChunkedWriterLength(w), 0);
+    assert_int_equal(ChunkedWriterChunkCount(w), 0);
+
+    /* still usable after flushing */
+    WriterWrite(w, "end");
+    assert_true(ChunkedWriterFlushToFd(w, fd));
+    WriterClose(w);
+
+    char *written = xcalloc(length + 4, 1);
+    assert_int_equal(pread(fd, written, length + 4, 0), length + 3);
+    assert_int_equal(memcmp(written, expected, length), 0);
+    assert_string_equal(written + length, "end");
+
+    free(written);
+    free(expected);
+    fclose(f);
+
+    /* chunks added for writes of nothing are dropped too */
+    f = tmpfile();
+    assert_true(f != NULL);
+    w = ChunkedWriter(16);
+    WriterWriteF(w, "%s", "");
+    assert_int_equal(ChunkedWriterChunkCount(w), 1);
+    assert_true(ChunkedWriterFlushToFd(w, fileno(f)));
+    assert_int_equal(ChunkedWriterChunkCount(w), 0);
+    WriterWrite(w, "0123456789abcdef");
+    WriterWriteF(w, "%s", "");
+    assert_int_equal(ChunkedWriterChunkCount(w), 2);
+    assert_true(ChunkedWriterFlushToFd(w, fileno(f)));
+    assert_int_equal(ChunkedWriterChunkCount(w), 0);
+    WriterClose(w);
+    assert_int_equal(ftell(f), 16);
+    fclose(f);
+
+    /* failed writes keep the data */
+    w = ChunkedWriter(0);
+    WriterWrite(w, "data");
+    assert_false(ChunkedWriterFlushToFd(w, -1));
+    assert_int_equal(ChunkedWriterLength(w), 4);
+    WriterClose(w);
+}
+
 int main()
 {
     PRINT_TEST_BANNER();
@@ -87,6 +198,8 @@ int main()
         unit_test(test_multiwrite_string_buffer),
         unit_test(test_write_char_string_buffer),
         unit_test(test_release_string),
+        unit_test(test_chunked_writer),
+        unit_test(test_chunked_writer_flush),
     };
 
     return run_tests(tests);